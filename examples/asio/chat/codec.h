@@ -8,6 +8,7 @@
 
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
 
 class LengthHeaderCodec : boost::noncopyable
 {
@@ -70,6 +71,17 @@ class LengthHeaderCodec : boost::noncopyable
     conn->send(&buf);
   }
 
+  // with its header, to be sent to many connections
+  static boost::shared_ptr<const muduo::string> encode(const muduo::StringPiece& message)
+  {
+    int32_t be32 = muduo::net::sockets::hostToNetwork32(static_cast<int32_t>(message.size()));
+    boost::shared_ptr<muduo::string> encoded(new muduo::string);
+    encoded->reserve(sizeof be32 + message.size());
+    encoded->append(reinterpret_cast<const char*>(&be32), sizeof be32);
+    encoded->append(message.data(), message.size());
+    return encoded;
+  }
+
  private:
   StringMessageCallback messageCallback_;
   const static size_t kHeaderLen = sizeof(int32_t);
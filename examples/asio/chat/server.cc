@@ -2,12 +2,12 @@
 
 #include <muduo/base/Logging.h>
 #include <muduo/base/Mutex.h>
+#include <muduo/net/BroadcastGroup.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/TcpServer.h>
 
 #include <boost/bind.hpp>
 
-#include <set>
 #include <stdio.h>
 
 using namespace muduo;
@@ -29,7 +29,9 @@ class ChatServer : boost::noncopyable
  public:
   ChatServer(EventLoop* loop,
              const InetAddress& listenAddr)
-  : server_(loop, listenAddr, "ChatServer"),
+  : // a client who stops reading loses its oldest messages
+    connections_(BroadcastGroup::kDropOldest, 64*1024, 1024*1024),
+    server_(loop, listenAddr, "ChatServer"),
     // 这里将onStringMessage注册给LengthHeaderCodec使用
     codec_(boost::bind(&ChatServer::onStringMessage, this, _1, _2, _3))
   {
@@ -54,11 +56,11 @@ class ChatServer : boost::noncopyable
 
     if (conn->connected())
     {
-      connections_.insert(conn);
+      connections_.add(conn);
     }
     else
     {
-      connections_.erase(conn);
+      connections_.remove(conn);
     }
   }
 
@@ -70,18 +72,12 @@ class ChatServer : boost::noncopyable
                        Timestamp)
   {
     // 依次发给每个客户
-    for (ConnectionList::iterator it = connections_.begin();
-        it != connections_.end();
-        ++it)
-    {
-      codec_.send(get_pointer(*it), message);
-    }
+    connections_.send(LengthHeaderCodec::encode(message));
   }
 
-  typedef std::set<TcpConnectionPtr> ConnectionList;
+  BroadcastGroup connections_;  // outlives connections of server_
   TcpServer server_;
   LengthHeaderCodec codec_;
-  ConnectionList connections_;
 };
 
 int main(int argc, char* argv[])
@@ -41,11 +41,20 @@ class ChatServer : boost::noncopyable
   }
 
  private:
+  static const size_t kMaxOutput = 1024*1024;
+
   void onConnection(const TcpConnectionPtr& conn)
   {
     LOG_INFO << conn->localAddress().toIpPort() << " -> "
         << conn->peerAddress().toIpPort() << " is "
         << (conn->connected() ? "UP" : "DOWN");
+    if (conn->connected())
+    {
+      // Messages are sent from all IO threads, BroadcastGroup can't be
+      // used, so a client who stops reading is disconnected.
+      conn->setHighWaterMarkCallback(
+          boost::bind(&ChatServer::onHighWaterMark, this, _1, _2), kMaxOutput);
+    }
 
     // 必须对容器加锁
     MutexLockGuard lock(mutex_);
@@ -59,6 +68,12 @@ class ChatServer : boost::noncopyable
     }
   }
 
+  void onHighWaterMark(const TcpConnectionPtr& conn, size_t len)
+  {
+    LOG_WARN << conn->name() << " is disconnected, " << len << " bytes unsent";
+    conn->forceClose();
+  }
+
   void onStringMessage(const TcpConnectionPtr&,
                        const string& message,
                        Timestamp)
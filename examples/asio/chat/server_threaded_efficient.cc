@@ -43,11 +43,20 @@ class ChatServer : boost::noncopyable
   }
 
  private:
+  static const size_t kMaxOutput = 1024*1024;
+
   void onConnection(const TcpConnectionPtr& conn)
   {
     LOG_INFO << conn->localAddress().toIpPort() << " -> "
         << conn->peerAddress().toIpPort() << " is "
         << (conn->connected() ? "UP" : "DOWN");
+    if (conn->connected())
+    {
+      // onStringMessage() runs in any IO thread, so no BroadcastGroup,
+      // just closes a client who lets kMaxOutput pile up
+      conn->setHighWaterMarkCallback(
+          boost::bind(&ChatServer::onHighWaterMark, this, _1, _2), kMaxOutput);
+    }
 
     MutexLockGuard lock(mutex_);
     // 当connections_的引用计数大于1时
@@ -72,6 +81,12 @@ class ChatServer : boost::noncopyable
   typedef std::set<TcpConnectionPtr> ConnectionList; // 客户连接的集合
   typedef boost::shared_ptr<ConnectionList> ConnectionListPtr; // 客户连接集合的指针
 
+  void onHighWaterMark(const TcpConnectionPtr& conn, size_t len)
+  {
+    LOG_WARN << conn->name() << " is disconnected, " << len << " bytes unsent";
+    conn->forceClose();
+  }
+
   void onStringMessage(const TcpConnectionPtr&,
                        const string& message,
                        Timestamp)
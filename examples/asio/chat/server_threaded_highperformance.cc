@@ -3,6 +3,7 @@
 #include <muduo/base/Logging.h>
 #include <muduo/base/Mutex.h>
 #include <muduo/base/ThreadLocalSingleton.h>
+#include <muduo/net/BroadcastGroup.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/TcpServer.h>
 
@@ -15,6 +16,17 @@
 using namespace muduo;
 using namespace muduo::net;
 
+// connections of a loop, a client who stops reading loses its oldest messages,
+// deleted when the loop thread exits, after TcpServer destroyed its connections
+struct LocalGroup
+{
+  LocalGroup()
+    : connections(BroadcastGroup::kDropOldest, 64*1024, 1024*1024)
+  {
+  }
+
+  BroadcastGroup connections;
+};
 
 /*
   这是Chat的一个高性能版本，它的高性能体现在：
@@ -60,11 +72,11 @@ class ChatServer : boost::noncopyable
 
     if (conn->connected())
     {
-      LocalConnections::instance().insert(conn);
+      LocalConnections::instance().connections.add(conn);
     }
     else
     {
-      LocalConnections::instance().erase(conn);
+      LocalConnections::instance().connections.remove(conn);
     }
   }
 
@@ -73,7 +85,8 @@ class ChatServer : boost::noncopyable
                        Timestamp)
   {
     // 分发消息的任务
-    EventLoop::Functor f = boost::bind(&ChatServer::distributeMessage, this, message);
+    EventLoop::Functor f = boost::bind(&ChatServer::distributeMessage, this,
+                                       LengthHeaderCodec::encode(message));
     LOG_DEBUG;
 
     MutexLockGuard lock(mutex_);
@@ -87,26 +100,19 @@ class ChatServer : boost::noncopyable
     LOG_DEBUG;
   }
 
-  typedef std::set<TcpConnectionPtr> ConnectionList;
-
   // 分发消息，这个函数由每个loop去执行
-  void distributeMessage(const string& message)
+  void distributeMessage(const boost::shared_ptr<const string>& message)
   {
     LOG_DEBUG << "begin";
     // 因为LocalConnections是线程局部的，所以每个loop调用LocalConnections::instance()
     // 获得的connections也是不同的
-    for (ConnectionList::iterator it = LocalConnections::instance().begin();
-        it != LocalConnections::instance().end();
-        ++it)
-    {
-      codec_.send(get_pointer(*it), message);
-    }
+    LocalConnections::instance().connections.send(message);
     LOG_DEBUG << "end";
   }
 
   void threadInit(EventLoop* loop)
   {
-    // 每个loop线程在初始化时，都先实例化一个ConnectionList，这个是线程局部的
+    // 每个loop线程在初始化时，都先实例化一个LocalGroup，这个是线程局部的
     // 然后将loop加入loops_中
     assert(LocalConnections::pointer() == NULL);
     // 底层调用了pthread_setspecific，设置了一个线程私有变量
@@ -118,8 +124,8 @@ class ChatServer : boost::noncopyable
 
   TcpServer server_;
   LengthHeaderCodec codec_;
-  // 线程局部的ConnectionList，而且是单例
-  typedef ThreadLocalSingleton<ConnectionList> LocalConnections;
+  // 线程局部的LocalGroup，而且是单例
+  typedef ThreadLocalSingleton<LocalGroup> LocalConnections;
 
   MutexLock mutex_;
   std::set<EventLoop*> loops_; // 线程池中loop的集合
@@ -0,0 +1,186 @@
+#include "MessageLog.h"
+
+#include <muduo/base/Logging.h>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace pubsub;
+
+namespace
+{
+const char kMagic[] = "MUDUOHB1";
+const size_t kMagicSize = sizeof kMagic - 1;
+}
+
+const size_t MessageLog::kInitialSize;
+
+bool MessageLog::read(const string& path, const RecordCallback& cb)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    if (errno != ENOENT)
+    {
+      LOG_SYSERR << "MessageLog::read " << path;
+    }
+    return false;
+  }
+  bool ok = false;
+  struct stat st;
+  if (::fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* p = ::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
+    {
+      ::madvise(p, size, MADV_SEQUENTIAL);
+      const char* start = static_cast<const char*>(p);
+      ok = size >= kMagicSize && memcmp(start, kMagic, kMagicSize) == 0;
+      size_t offset = kMagicSize;
+      while (ok && size - offset >= sizeof(RecordHeader))
+      {
+        RecordHeader header;
+        memcpy(&header, start + offset, sizeof header);
+        const size_t len = static_cast<size_t>(header.topicLen) + header.contentLen;
+        if (header.seq == 0 || len > size - offset - sizeof header)
+        {
+          // the end, or a record being appended when the hub died
+          break;
+        }
+        const char* topic = start + offset + sizeof header;
+        cb(header.seq,
+           StringPiece(topic, static_cast<int>(header.topicLen)),
+           StringPiece(topic + header.topicLen, static_cast<int>(header.contentLen)));
+        offset += sizeof header + len;
+      }
+      ::munmap(p, size);
+    }
+    else
+    {
+      LOG_SYSERR << "MessageLog::read mmap " << path;
+    }
+  }
+  ::close(fd);
+  if (!ok)
+  {
+    LOG_ERROR << "MessageLog::read " << path << " is damaged";
+  }
+  return ok;
+}
+
+MessageLog::MessageLog(const string& path)
+  : path_(path),
+    fd_(::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)),
+    start_(NULL),
+    mapped_(0),
+    written_(0)
+{
+  if (fd_ < 0)
+  {
+    LOG_SYSERR << "MessageLog::MessageLog " << path_;
+    return;
+  }
+  if (::ftruncate(fd_, kInitialSize) == 0)
+  {
+    void* p = ::mmap(NULL, kInitialSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p != MAP_FAILED)
+    {
+      start_ = static_cast<char*>(p);
+      mapped_ = kInitialSize;
+      memcpy(start_, kMagic, kMagicSize);
+      written_ = kMagicSize;
+      return;
+    }
+  }
+  LOG_SYSERR << "MessageLog::MessageLog " << path_;
+  close();
+}
+
+MessageLog::~MessageLog()
+{
+  close();
+}
+
+void MessageLog::append(int64_t seq, const StringPiece& topic, const StringPiece& content)
+{
+  assert(seq > 0);
+  RecordHeader header;
+  header.seq = seq;
+  header.topicLen = static_cast<uint32_t>(topic.size());
+  header.contentLen = static_cast<uint32_t>(content.size());
+  const size_t len = sizeof header + topic.size() + content.size();
+  if (!reserve(len))
+  {
+    return;
+  }
+  char* record = start_ + written_;
+  memcpy(record + sizeof header, topic.data(), topic.size());
+  memcpy(record + sizeof header + topic.size(), content.data(), content.size());
+  memcpy(record + sizeof header.seq, &header.topicLen,
+         sizeof header - sizeof header.seq);
+  memcpy(record, &header.seq, sizeof header.seq);
+  written_ += len;
+}
+
+void MessageLog::flush()
+{
+  if (start_ && ::msync(start_, written_, MS_ASYNC) != 0)
+  {
+    LOG_SYSERR << "MessageLog::flush " << path_;
+  }
+}
+
+bool MessageLog::reserve(size_t len)
+{
+  if (start_ == NULL)
+  {
+    return false;
+  }
+  if (mapped_ - written_ >= len)
+  {
+    return true;
+  }
+  const size_t size = std::max(mapped_ * 2, written_ + len);
+  void* p = MAP_FAILED;
+  if (::ftruncate(fd_, static_cast<off_t>(size)) == 0)
+  {
+    p = ::mremap(start_, mapped_, size, MREMAP_MAYMOVE);
+  }
+  if (p == MAP_FAILED)
+  {
+    // stops logging, rather than losing records in the middle
+    LOG_SYSERR << "MessageLog::reserve " << path_ << " stops logging";
+    close();
+    return false;
+  }
+  start_ = static_cast<char*>(p);
+  mapped_ = size;
+  return true;
+}
+
+void MessageLog::close()
+{
+  if (start_)
+  {
+    ::munmap(start_, mapped_);
+    start_ = NULL;
+    // drops the zeros
+    if (::ftruncate(fd_, static_cast<off_t>(written_)) != 0)
+    {
+      LOG_SYSERR << "MessageLog::close " << path_;
+    }
+  }
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef MUDUO_EXAMPLES_HUB_MESSAGELOG_H
+#define MUDUO_EXAMPLES_HUB_MESSAGELOG_H
+
+// internal header file
+
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Types.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <stdint.h>
+
+namespace pubsub
+{
+using muduo::string;
+using muduo::StringPiece;
+
+// Append only file of published messages, in host byte order:
+//
+//   "MUDUOHB1"
+//   records, each a RecordHeader then the topic and the content
+//   zeros, up to the size of the file
+//
+// It is written through a shared mapping, so what a crashed hub has
+// appended is kept by the kernel.  A record is complete once its seq
+// is not zero, seq is written last.
+class MessageLog : boost::noncopyable
+{
+ public:
+  typedef boost::function<void (int64_t seq,
+                                const StringPiece& topic,
+                                const StringPiece& content)> RecordCallback;
+
+  // Passes records of path to cb in order, false if it can't be read.
+  static bool read(const string& path, const RecordCallback& cb);
+
+  // creates or truncates path
+  explicit MessageLog(const string& path);
+  ~MessageLog();
+
+  bool valid() const { return start_ != NULL; }
+  size_t bytes() const { return written_; }
+
+  // not thread safe
+  void append(int64_t seq, const StringPiece& topic, const StringPiece& content);
+  // starts writing back dirty pages
+  void flush();
+
+ private:
+  struct RecordHeader
+  {
+    int64_t seq;
+    uint32_t topicLen;
+    uint32_t contentLen;
+  };
+
+  static const size_t kInitialSize = 16*1024*1024;
+
+  bool reserve(size_t len);
+  void close();
+
+  const string path_;
+  int fd_;
+  char* start_;
+  size_t mapped_;
+  size_t written_;
+};
+
+}
+
+#endif  // MUDUO_EXAMPLES_HUB_MESSAGELOG_H
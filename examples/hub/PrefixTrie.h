@@ -0,0 +1,93 @@
+#ifndef MUDUO_EXAMPLES_HUB_PREFIXTRIE_H
+#define MUDUO_EXAMPLES_HUB_PREFIXTRIE_H
+
+// internal header file
+
+#include <muduo/base/StringPiece.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+namespace pubsub
+{
+
+// Maps prefixes to values, finds all prefixes of a key in one walk.
+// Nodes live in one vector and are never removed.
+template<typename T>
+class PrefixTrie : boost::noncopyable
+{
+ public:
+  PrefixTrie()
+    : nodes_(1)
+  {
+  }
+
+  // Creates the value if absent, the reference is valid until next call.
+  T& operator[](muduo::StringPiece prefix)
+  {
+    uint32_t node = 0;
+    for (int i = 0; i < prefix.size(); ++i)
+    {
+      uint32_t next = child(node, prefix[i]);
+      if (next == 0)
+      {
+        next = static_cast<uint32_t>(nodes_.size());
+        nodes_[node].children.push_back(std::make_pair(prefix[i], next));
+        nodes_.push_back(Node());
+      }
+      node = next;
+    }
+    nodes_[node].used = true;
+    return nodes_[node].value;
+  }
+
+  // Appends values of all prefixes of key, shortest first.
+  void prefixesOf(muduo::StringPiece key, std::vector<T*>* values)
+  {
+    uint32_t node = 0;
+    for (int i = 0; ; ++i)
+    {
+      if (nodes_[node].used)
+      {
+        values->push_back(&nodes_[node].value);
+      }
+      if (i == key.size() || (node = child(node, key[i])) == 0)
+      {
+        break;
+      }
+    }
+  }
+
+ private:
+  struct Node
+  {
+    Node() : used(false) {}
+    T value;
+    bool used;  // operator[] was called for it
+    std::vector<std::pair<char, uint32_t> > children;  // few, so unsorted
+  };
+
+  // 0 if none, as the root is no one's child
+  uint32_t child(uint32_t node, char c) const
+  {
+    const std::vector<std::pair<char, uint32_t> >& children = nodes_[node].children;
+    for (size_t i = 0; i < children.size(); ++i)
+    {
+      if (children[i].first == c)
+      {
+        return children[i].second;
+      }
+    }
+    return 0;
+  }
+
+  std::vector<Node> nodes_;
+};
+
+}
+
+#endif  // MUDUO_EXAMPLES_HUB_PREFIXTRIE_H
@@ -1,14 +1,32 @@
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+
 #include "codec.h"
+#include "MessageLog.h"
+#include "PrefixTrie.h"
 
 #include <muduo/base/Logging.h>
+#include <muduo/base/Mutex.h>
+#include <muduo/base/ThreadLocalSingleton.h>
+#include <muduo/net/BroadcastGroup.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/TcpServer.h>
 
+#include <examples/wordcount/hash.h>
+
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <deque>
+#include <vector>
 
-#include <map>
-#include <set>
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 using namespace muduo;
 using namespace muduo::net;
@@ -16,63 +34,173 @@ using namespace muduo::net;
 namespace pubsub
 {
 
-typedef std::set<string> ConnectionSubscription;
+// subscriptions of a connection, to its position in Audiences
+typedef boost::unordered_map<string, size_t> ConnectionSubscription;
 
-class Topic : public muduo::copyable
+// Not in Audiences yet, see PubSubServer::join().
+const size_t kJoining = static_cast<size_t>(-1);
+
+// The log is compacted when it doubles since the last time, from this size.
+const size_t kCompactLogBytes = 64*1024*1024;
+
+// Sent to subscribers as "seq 42\r\npub topic\r\ncontent\r\n",
+// seq counts messages of a topic from 1.
+struct Message
 {
- public:
-  Topic(const string& topic)
-    : topic_(topic)
+  Message(int64_t s, const string& topic, const string& content)
+    : seq(s)
   {
+    char buf[32];
+    snprintf(buf, sizeof buf, "seq %" PRId64 "\r\n", seq);
+    data.reserve(strlen(buf) + topic.size() + content.size() + 8);
+    data += buf;
+    data += "pub ";
+    topicOffset = data.size();
+    data += topic;
+    data += "\r\n";
+    contentOffset = data.size();
+    data += content;
+    data += "\r\n";
   }
 
-  void add(const TcpConnectionPtr& conn)
+  StringPiece topic() const
   {
-    audiences_.insert(conn);
-    if (lastPubTime_.valid())
-    {
-      conn->send(makeMessage());
-    }
+    return StringPiece(data.data() + topicOffset,
+                       static_cast<int>(contentOffset - topicOffset) - 2);
   }
 
-  void remove(const TcpConnectionPtr& conn)
+  StringPiece content() const
   {
-    audiences_.erase(conn);
+    return StringPiece(data.data() + contentOffset,
+                       static_cast<int>(data.size() - contentOffset) - 2);
   }
 
-  void publish(const string& content, Timestamp time)
+  int64_t seq;
+  size_t topicOffset;
+  size_t contentOffset;
+  string data;
+};
+
+typedef boost::shared_ptr<const Message> MessagePtr;
+
+// Dense for fan out, removal moves the last one into the hole.
+// Connections unsubscribe everything before they leave the group.
+typedef std::vector<BroadcastGroup::Member*> Audiences;
+
+// Published by the hub, clients may only subscribe it.
+const char kUtcTime[] = "utc_time";
+
+bool isInternal(const string& topic)
+{
+  return topic == kUtcTime;
+}
+
+// "sub prefix*" subscribes all topics starting with prefix.
+bool isPattern(const string& topic)
+{
+  return !topic.empty() && topic[topic.size()-1] == '*';
+}
+
+StringPiece prefixOf(const string& pattern)
+{
+  return StringPiece(pattern.data(), static_cast<int>(pattern.size()) - 1);
+}
+
+ConnectionSubscription& subscriptionOf(TcpConnection* conn)
+{
+  return *boost::any_cast<ConnectionSubscription>(conn->getMutableContext());
+}
+
+ConnectionSubscription& subscriptionOf(BroadcastGroup::Member* member)
+{
+  return subscriptionOf(get_pointer(member->connection()));
+}
+
+void addAudience(Audiences* audiences, BroadcastGroup::Member* member, const string& topic)
+{
+  subscriptionOf(member)[topic] = audiences->size();
+  audiences->push_back(member);
+}
+
+void removeAudience(Audiences* audiences, BroadcastGroup::Member* member, const string& topic)
+{
+  const size_t i = subscriptionOf(member)[topic];
+  assert((*audiences)[i] == member);
+  BroadcastGroup::Member* last = audiences->back();
+  (*audiences)[i] = last;
+  subscriptionOf(last)[topic] = i;
+  audiences->pop_back();
+}
+
+// Subscribers in one IO loop, touched in that loop only.
+struct LocalTopics
+{
+  LocalTopics()
+    : index(-1)
   {
-    content_ = content;
-    lastPubTime_ = time;
-    string message = makeMessage();
-    for (std::set<TcpConnectionPtr>::iterator it = audiences_.begin();
-         it != audiences_.end();
-         ++it)
-    {
-      (*it)->send(message);
-    }
   }
 
- private:
+  int index;  // of this loop in PubSubServer::loops_
+  boost::scoped_ptr<BroadcastGroup> connections;
+  boost::unordered_map<string, Audiences> topics;
+  PrefixTrie<Audiences> patterns;
+  std::vector<Audiences*> matched;  // for distribute()
+};
 
-  string makeMessage()
+// A topic across all IO loops, guarded by the mutex of its TopicShard.
+struct Topic
+{
+  Topic()
+    : seq(0),
+      internal(false)
   {
-    return "pub " + topic_ + "\r\n" + content_ + "\r\n";
   }
 
-  string topic_;
-  string content_;
-  Timestamp lastPubTime_;
-  std::set<TcpConnectionPtr> audiences_;
+  std::deque<MessagePtr> retained;  // the last ones, in order of seq
+  int64_t seq;                      // of the last message, 0 if none
+  bool internal;                    // published by the hub, not logged
+  std::vector<int> audiences;       // per loop
 };
 
+// Publishers of topics in different shards do not contend.
+// Pattern audiences are kept in every shard, as patterns match topics
+// of any shard.
+struct TopicShard : boost::noncopyable
+{
+  MutexLock mutex;
+  // guarded by mutex
+  boost::unordered_map<string, Topic> topics;
+  PrefixTrie<std::vector<int> > patterns;  // audiences per loop
+  std::vector<std::vector<int>*> matchedPatterns;  // for doPublish()
+  std::vector<MessagePtr> unlogged;  // for writeLog()
+};
+
+// Subscribers are spread over IO loops, each loop keeps its own
+// subscribers of every topic and pattern.  A message is built once and
+// handed to each loop which has subscribers of its topic, or of a
+// pattern matching it, the loop then sends it to them.
+//
+// The last messages of a topic are retained, and optionally logged to
+// a file to survive restarts.  "subfrom 42 topic" subscribes topic and
+// replays retained messages after seq 42, so that a subscriber
+// reconnecting catches up without asking publishers.
 class PubSubServer : boost::noncopyable
 {
  public:
+  static const size_t kDefaultRetained = 16;
+  static const size_t kDefaultHighWaterMark = 64*1024;
+  static const size_t kDefaultMaxPendingBytes = 4*1024*1024;
+
   PubSubServer(muduo::net::EventLoop* loop,
                const muduo::net::InetAddress& listenAddr)
     : loop_(loop),
-      server_(loop, listenAddr, "PubSubServer")
+      server_(loop, listenAddr, "PubSubServer"),
+      retained_(kDefaultRetained),
+      policy_(BroadcastGroup::kConflate),
+      highWaterMark_(kDefaultHighWaterMark),
+      maxPendingBytes_(kDefaultMaxPendingBytes),
+      logging_(false),
+      compactedBytes_(0)
   {
     server_.setConnectionCallback(
         boost::bind(&PubSubServer::onConnection, this, _1));
@@ -81,28 +209,100 @@ class PubSubServer : boost::noncopyable
     loop_->runEvery(1.0, boost::bind(&PubSubServer::timePublish, this));
   }
 
+  void setThreadNum(int numThreads)
+  {
+    server_.setThreadNum(numThreads);
+  }
+
+  // at least 1, the last message is always retained
+  void setRetained(size_t retained)
+  {
+    retained_ = std::max(retained, static_cast<size_t>(1));
+  }
+
+  // For a subscriber who reads slower than messages are published,
+  // by default it gets the latest message of each topic.
+  void setOutputLimit(BroadcastGroup::Policy policy,
+                      size_t highWaterMark,
+                      size_t maxPendingBytes)
+  {
+    policy_ = policy;
+    highWaterMark_ = highWaterMark;
+    maxPendingBytes_ = maxPendingBytes;
+  }
+
+  // Restores retained messages from path, then logs new ones to it,
+  // except internal ones.  Before start().
+  bool openLog(const string& path)
+  {
+    MessageLog::read(path, boost::bind(&PubSubServer::restore, this, _1, _2, _3));
+    logPath_ = path;
+    if (!compactLog())
+    {
+      return false;
+    }
+    logging_ = true;
+    size_t topics = 0;
+    for (int i = 0; i < kShards; ++i)
+    {
+      MutexLockGuard lock(shards_[i].mutex);
+      topics += shards_[i].topics.size();
+    }
+    LOG_INFO << "PubSubServer::openLog " << path << " restored "
+             << topics << " topics";
+    loop_->runEvery(1.0, boost::bind(&PubSubServer::flushLog, this));
+    return true;
+  }
+
   void start()
   {
+    server_.setThreadInitCallback(boost::bind(&PubSubServer::threadInit, this, _1));
     server_.start();
   }
 
  private:
+  typedef ThreadLocalSingleton<LocalTopics> Local;
+
+  static const int kShards = 16;
+
+  TopicShard& shardOf(const string& topic)
+  {
+    return shards_[hashWord(topic.data(), topic.size()) % kShards];
+  }
+
+  void threadInit(EventLoop* loop)
+  {
+    assert(Local::pointer() == NULL);
+    Local::instance().connections.reset(
+        new BroadcastGroup(policy_, highWaterMark_, maxPendingBytes_));
+    MutexLockGuard lock(mutex_);
+    Local::instance().index = static_cast<int>(loops_.size());
+    loops_.push_back(loop);
+  }
+
   void onConnection(const TcpConnectionPtr& conn)
   {
     if (conn->connected())
     {
       conn->setContext(ConnectionSubscription());
+      Local::instance().connections->add(conn);
     }
     else
     {
+      std::vector<string> topics;
       const ConnectionSubscription& connSub
         = boost::any_cast<const ConnectionSubscription&>(conn->getContext());
-      // subtle: doUnsubscribe will erase *it, so increase before calling.
       for (ConnectionSubscription::const_iterator it = connSub.begin();
-           it != connSub.end();)
+           it != connSub.end(); ++it)
+      {
+        topics.push_back(it->first);
+      }
+      // doUnsubscribe erases from connSub
+      for (size_t i = 0; i < topics.size(); ++i)
       {
-        doUnsubscribe(conn, *it++);
+        doUnsubscribe(conn, topics[i]);
       }
+      Local::instance().connections->remove(conn);
     }
   }
 
@@ -119,14 +319,26 @@ class PubSubServer : boost::noncopyable
       result = parseMessage(buf, &cmd, &topic, &content);
       if (result == kSuccess)
       {
-        if (cmd == "pub")
+        size_t space = string::npos;
+        if (cmd == "pub" && !isPattern(topic) && !isInternal(topic))
+        {
+          doPublish(topic, content, receiveTime);
+        }
+        else if (cmd == "pub" && isInternal(topic))
         {
-          doPublish(conn->name(), topic, content, receiveTime);
+          LOG_WARN << conn->name() << " publishes internal topic " << topic;
         }
         else if (cmd == "sub")
         {
           LOG_INFO << conn->name() << " subscribes " << topic;
-          doSubscribe(conn, topic);
+          doSubscribe(conn, topic, kLatest);
+        }
+        else if (cmd == "subfrom" && (space = topic.find(' ')) != string::npos)
+        {
+          const int64_t since = strtoll(topic.c_str(), NULL, 10);
+          topic.erase(0, space + 1);
+          LOG_INFO << conn->name() << " subscribes " << topic << " from " << since;
+          doSubscribe(conn, topic, since);
         }
         else if (cmd == "unsub")
         {
@@ -148,51 +360,321 @@ class PubSubServer : boost::noncopyable
   void timePublish()
   {
     Timestamp now = Timestamp::now();
-    doPublish("internal", "utc_time", now.toFormattedString(), now);
+    doPublish(kUtcTime, now.toFormattedString(), now);
+  }
+
+  // The log is written in loop_ only, outside shard locks, as it may
+  // grow the file.  Publishers only queue their messages.
+  void writeLog(TopicShard* shard)
+  {
+    std::vector<MessagePtr> messages;
+    {
+      MutexLockGuard lock(shard->mutex);
+      messages.swap(shard->unlogged);
+    }
+    appendLog(get_pointer(log_), messages);
   }
 
+  static void appendLog(MessageLog* log, const std::vector<MessagePtr>& messages)
+  {
+    for (size_t i = 0; i < messages.size(); ++i)
+    {
+      log->append(messages[i]->seq, messages[i]->topic(), messages[i]->content());
+    }
+  }
+
+  void flushLog()
+  {
+    log_->flush();
+    if (log_->bytes() > std::max(2 * compactedBytes_, kCompactLogBytes))
+    {
+      compactLog();
+    }
+  }
+
+  // Rewrites the log with retained messages only, in loop_.
+  // Messages published meanwhile go to the new log.
+  bool compactLog()
+  {
+    std::vector<MessagePtr> retained;
+    std::vector<MessagePtr> unlogged;
+    for (int i = 0; i < kShards; ++i)
+    {
+      TopicShard& shard = shards_[i];
+      MutexLockGuard lock(shard.mutex);
+      for (boost::unordered_map<string, Topic>::const_iterator it = shard.topics.begin();
+           it != shard.topics.end(); ++it)
+      {
+        if (!it->second.internal)
+        {
+          retained.insert(retained.end(), it->second.retained.begin(), it->second.retained.end());
+        }
+      }
+      // the retained ones among them are in retained
+      unlogged.insert(unlogged.end(), shard.unlogged.begin(), shard.unlogged.end());
+      shard.unlogged.clear();
+    }
+
+    const string tmpPath = logPath_ + ".tmp";
+    boost::scoped_ptr<MessageLog> log(new MessageLog(tmpPath));
+    appendLog(get_pointer(log), retained);
+    bool ok = log->valid();
+    if (ok && ::rename(tmpPath.c_str(), logPath_.c_str()) != 0)
+    {
+      LOG_SYSERR << "PubSubServer::compactLog rename to " << logPath_;
+      ok = false;
+    }
+    if (ok)
+    {
+      LOG_INFO << "PubSubServer::compactLog " << logPath_ << " from "
+               << (log_ ? log_->bytes() : 0) << " to " << log->bytes() << " bytes";
+      log_.swap(log);
+    }
+    else
+    {
+      ::unlink(tmpPath.c_str());
+      if (log_)
+      {
+        appendLog(get_pointer(log_), unlogged);
+      }
+    }
+    compactedBytes_ = log_ ? log_->bytes() : 0;
+    return ok;
+  }
+
+  // replays the last message only
+  static const int64_t kLatest = -1;
+
+  // in the loop of conn
   void doSubscribe(const TcpConnectionPtr& conn,
-                   const string& topic)
+                   const string& topic,
+                   int64_t since)
   {
-    ConnectionSubscription* connSub
-      = boost::any_cast<ConnectionSubscription>(conn->getMutableContext());
+    ConnectionSubscription& connSub = subscriptionOf(get_pointer(conn));
+    if (connSub.count(topic) > 0)
+    {
+      return;
+    }
+
+    LocalTopics& local = Local::instance();
+    if (isPattern(topic))
+    {
+      // new messages only, no retained ones
+      addAudience(&local.patterns[prefixOf(topic)], local.connections->find(conn), topic);
+      for (int i = 0; i < kShards; ++i)
+      {
+        MutexLockGuard lock(shards_[i].mutex);
+        std::vector<int>& audiences = shards_[i].patterns[prefixOf(topic)];
+        audiences.resize(loops_.size());
+        ++audiences[local.index];
+      }
+      return;
+    }
 
-    connSub->insert(topic);
-    getTopic(topic).add(conn);
+    connSub[topic] = kJoining;
+    std::vector<MessagePtr> replay;
+    TopicShard& shard = shardOf(topic);
+    MutexLockGuard lock(shard.mutex);
+    Topic& t = getTopic(&shard, topic);
+    ++t.audiences[local.index];
+    if (since > t.seq)
+    {
+      // from before a restart without log
+      since = 0;
+    }
+    for (std::deque<MessagePtr>::reverse_iterator it = t.retained.rbegin();
+         it != t.retained.rend() && (*it)->seq > since; ++it)
+    {
+      replay.push_back(*it);
+      if (since == kLatest)
+      {
+        break;
+      }
+    }
+    // Messages published so far are queued to this loop before join(),
+    // later ones after it, so conn gets each of them once.
+    loops_[local.index]->queueInLoop(
+        boost::bind(&PubSubServer::join, this, conn, topic, replay));
   }
 
+  // in the loop of conn
+  void join(const TcpConnectionPtr& conn,
+            const string& topic,
+            const std::vector<MessagePtr>& replay)
+  {
+    ConnectionSubscription& connSub = subscriptionOf(get_pointer(conn));
+    ConnectionSubscription::iterator it = connSub.find(topic);
+    if (it == connSub.end() || it->second != kJoining)
+    {
+      // unsubscribed meanwhile, or joined by an earlier subscription
+      return;
+    }
+    LocalTopics& local = Local::instance();
+    BroadcastGroup::Member* member = local.connections->find(conn);
+    addAudience(&local.topics[topic], member, topic);
+    // newest first in replay
+    for (size_t i = replay.size(); i > 0; --i)
+    {
+      member->send(replay[i-1]->data, replay[i-1], topic);
+    }
+  }
+
+  // in the loop of conn
   void doUnsubscribe(const TcpConnectionPtr& conn,
                      const string& topic)
   {
     LOG_INFO << conn->name() << " unsubscribes " << topic;
-    getTopic(topic).remove(conn);
-    // topic could be the one to be destroyed, so don't use it after erasing.
-    ConnectionSubscription* connSub
-      = boost::any_cast<ConnectionSubscription>(conn->getMutableContext());
-    connSub->erase(topic);
+    ConnectionSubscription& connSub = subscriptionOf(get_pointer(conn));
+    ConnectionSubscription::iterator it = connSub.find(topic);
+    if (it == connSub.end())
+    {
+      return;
+    }
+
+    LocalTopics& local = Local::instance();
+    if (isPattern(topic))
+    {
+      removeAudience(&local.patterns[prefixOf(topic)], local.connections->find(conn), topic);
+      for (int i = 0; i < kShards; ++i)
+      {
+        MutexLockGuard lock(shards_[i].mutex);
+        --shards_[i].patterns[prefixOf(topic)][local.index];
+      }
+    }
+    else
+    {
+      if (it->second != kJoining)
+      {
+        boost::unordered_map<string, Audiences>::iterator audiences
+          = local.topics.find(topic);
+        removeAudience(&audiences->second, local.connections->find(conn), topic);
+        if (audiences->second.empty())
+        {
+          local.topics.erase(audiences);
+        }
+      }
+      TopicShard& shard = shardOf(topic);
+      MutexLockGuard lock(shard.mutex);
+      --getTopic(&shard, topic).audiences[local.index];
+    }
+    connSub.erase(topic);
   }
 
-  void doPublish(const string& source,
-                 const string& topic,
+  // in any loop
+  void doPublish(const string& topic,
                  const string& content,
                  Timestamp time)
   {
-    getTopic(topic).publish(content, time);
+    TopicShard& shard = shardOf(topic);
+    MutexLockGuard lock(shard.mutex);
+    Topic& t = getTopic(&shard, topic);
+    MessagePtr message(new Message(++t.seq, topic, content));
+    t.retained.push_back(message);
+    if (t.retained.size() > retained_)
+    {
+      t.retained.pop_front();
+    }
+    // the clock is not worth keeping
+    t.internal = isInternal(topic);
+    if (logging_ && !t.internal)
+    {
+      shard.unlogged.push_back(message);
+      if (shard.unlogged.size() == 1)
+      {
+        loop_->queueInLoop(boost::bind(&PubSubServer::writeLog, this, &shard));
+      }
+    }
+
+    std::vector<std::vector<int>*>& matched = shard.matchedPatterns;
+    matched.clear();
+    shard.patterns.prefixesOf(topic, &matched);
+    for (size_t i = 0; i < loops_.size(); ++i)
+    {
+      const bool toAudiences = t.audiences[i] > 0;
+      bool toPatterns = false;
+      for (size_t j = 0; j < matched.size() && !toPatterns; ++j)
+      {
+        toPatterns = i < matched[j]->size() && (*matched[j])[i] > 0;
+      }
+      if (toAudiences || toPatterns)
+      {
+        loops_[i]->queueInLoop(
+            boost::bind(&PubSubServer::distribute, this, topic, message));
+      }
+    }
   }
 
-  Topic& getTopic(const string& topic)
+  // in each loop which has audiences of topic or of patterns matching it
+  void distribute(const string& topic, const MessagePtr& message)
   {
-    std::map<string, Topic>::iterator it = topics_.find(topic);
-    if (it == topics_.end())
+    LocalTopics& local = Local::instance();
+    boost::unordered_map<string, Audiences>::const_iterator it = local.topics.find(topic);
+    if (it != local.topics.end())
     {
-      it = topics_.insert(make_pair(topic, Topic(topic))).first;
+      send(it->second, topic, message);
+    }
+    // once for each matching pattern a connection subscribes
+    local.matched.clear();
+    local.patterns.prefixesOf(topic, &local.matched);
+    for (size_t i = 0; i < local.matched.size(); ++i)
+    {
+      send(*local.matched[i], topic, message);
     }
-    return it->second;
+  }
+
+  // conflated by topic, if so
+  static void send(const Audiences& audiences, const string& topic, const MessagePtr& message)
+  {
+    for (size_t i = 0; i < audiences.size(); ++i)
+    {
+      audiences[i]->send(message->data, message, topic);
+    }
+  }
+
+  // from the log, before start()
+  void restore(int64_t seq, const StringPiece& topic, const StringPiece& content)
+  {
+    TopicShard& shard = shardOf(topic.as_string());
+    MutexLockGuard lock(shard.mutex);
+    Topic& t = getTopic(&shard, topic.as_string());
+    if (seq <= t.seq)
+    {
+      return;
+    }
+    t.seq = seq;
+    t.retained.push_back(MessagePtr(new Message(seq, topic.as_string(), content.as_string())));
+    if (t.retained.size() > retained_)
+    {
+      t.retained.pop_front();
+    }
+  }
+
+  Topic& getTopic(TopicShard* shard, const string& topic)
+  {
+    shard->mutex.assertLocked();
+    Topic& t = shard->topics[topic];
+    if (t.audiences.size() < loops_.size())
+    {
+      t.audiences.resize(loops_.size());
+    }
+    return t;
   }
 
   EventLoop* loop_;
   TcpServer server_;
-  std::map<string, Topic> topics_;
+  size_t retained_;
+  BroadcastGroup::Policy policy_;
+  size_t highWaterMark_;
+  size_t maxPendingBytes_;
+  MutexLock mutex_;  // for threadInit()
+  std::vector<EventLoop*> loops_;  // index by LocalTopics::index, set in start()
+  TopicShard shards_[kShards];
+
+  bool logging_;  // set before start()
+  // in loop_
+  string logPath_;
+  boost::scoped_ptr<MessageLog> log_;
+  size_t compactedBytes_;
 };
 
 }
@@ -208,12 +690,23 @@ int main(int argc, char* argv[])
       //int inspectPort = atoi(argv[2]);
     }
     pubsub::PubSubServer server(&loop, InetAddress(port));
+    if (argc > 3)
+    {
+      server.setThreadNum(atoi(argv[3]));
+    }
+    if (argc > 4)
+    {
+      server.setRetained(static_cast<size_t>(atoi(argv[4])));
+    }
+    if (argc > 5 && !server.openLog(argv[5]))
+    {
+      return 1;
+    }
     server.start();
     loop.loop();
   }
   else
   {
-    printf("Usage: %s pubsub_port [inspect_port]\n", argv[0]);
+    printf("Usage: %s pubsub_port [inspect_port] [io_threads] [retained] [log_file]\n", argv[0]);
   }
 }
-
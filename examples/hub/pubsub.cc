@@ -1,8 +1,14 @@
+#define __STDC_FORMAT_MACROS
+
 #include "pubsub.h"
 #include "codec.h"
 
 #include <boost/bind.hpp>
 
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
 using namespace muduo;
 using namespace muduo::net;
 using namespace pubsub;
@@ -10,7 +16,8 @@ using namespace pubsub;
 PubSubClient::PubSubClient(EventLoop* loop,
                            const InetAddress& hubAddr,
                            const string& name)
-  : client_(loop, hubAddr, name)
+  : client_(loop, hubAddr, name),
+    seq_(0)
 {
   // FIXME: dtor is not thread safe
   client_.setConnectionCallback(
@@ -38,12 +45,14 @@ bool PubSubClient::subscribe(const string& topic, const SubscribeCallback& cb)
 {
   string message = "sub " + topic + "\r\n";
   subscribeCallback_ = cb;
+  subscriptions_.insert(std::make_pair(topic, 0));
   return send(message);
 }
 
 void PubSubClient::unsubscribe(const string& topic)
 {
   string message = "unsub " + topic + "\r\n";
+  subscriptions_.erase(topic);
   send(message);
 }
 
@@ -59,7 +68,20 @@ void PubSubClient::onConnection(const TcpConnectionPtr& conn)
   if (conn->connected())
   {
     conn_ = conn;
-    // FIXME: re-sub
+    for (std::map<string, int64_t>::iterator it = subscriptions_.begin();
+         it != subscriptions_.end(); ++it)
+    {
+      if (it->second > 0)
+      {
+        char buf[32];
+        snprintf(buf, sizeof buf, "subfrom %" PRId64 " ", it->second);
+        send(buf + it->first + "\r\n");
+      }
+      else
+      {
+        send("sub " + it->first + "\r\n");
+      }
+    }
   }
   else
   {
@@ -84,9 +106,22 @@ void PubSubClient::onMessage(const TcpConnectionPtr& conn,
     result = parseMessage(buf, &cmd, &topic, &content);
     if (result == kSuccess)
     {
-      if (cmd == "pub" && subscribeCallback_)
+      if (cmd == "seq")
+      {
+        seq_ = strtoll(topic.c_str(), NULL, 10);
+      }
+      else if (cmd == "pub")
       {
-        subscribeCallback_(topic, content, receiveTime);
+        std::map<string, int64_t>::iterator it = subscriptions_.find(topic);
+        if (it != subscriptions_.end() && seq_ > 0)
+        {
+          it->second = seq_;
+        }
+        seq_ = 0;
+        if (subscribeCallback_)
+        {
+          subscribeCallback_(topic, content, receiveTime);
+        }
       }
     }
     else if (result == kError)
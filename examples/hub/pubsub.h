@@ -3,6 +3,8 @@
 
 #include <muduo/net/TcpClient.h>
 
+#include <map>
+
 namespace pubsub
 {
 using muduo::string;
@@ -27,6 +29,8 @@ class PubSubClient : boost::noncopyable
   void setConnectionCallback(const ConnectionCallback& cb)
   { connectionCallback_ = cb; }
 
+  // Subscriptions are made again after reconnecting, catching up
+  // from the last message received.
   bool subscribe(const string& topic, const SubscribeCallback& cb);
   void unsubscribe(const string& topic);
   bool publish(const string& topic, const string& content);
@@ -42,6 +46,8 @@ class PubSubClient : boost::noncopyable
   muduo::net::TcpConnectionPtr conn_;
   ConnectionCallback connectionCallback_;
   SubscribeCallback subscribeCallback_;
+  std::map<string, int64_t> subscriptions_;  // topic to seq of the last message
+  int64_t seq_;  // of the message being received
 };
 }
 
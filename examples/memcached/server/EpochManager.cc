@@ -0,0 +1,145 @@
+#include "EpochManager.h"
+
+#include <algorithm>
+
+#include <assert.h>
+
+using namespace muduo;
+
+namespace
+{
+// retire()s between two reclaim()s
+const int kReclaimInterval = 32;
+}
+
+EpochManager::Registration::~Registration()
+{
+  // thread exits
+  if (participant)
+  {
+    participant->owner->unregister(participant);
+  }
+}
+
+EpochManager::EpochManager()
+  : epoch_(2)  // so that epoch_ - 2 never wraps
+{
+}
+
+EpochManager::~EpochManager()
+{
+  MutexLockGuard lock(mutex_);
+  for (size_t i = 0; i < participants_.size(); ++i)
+  {
+    // no reader by now, it doesn't matter which thread runs deleters
+    assert(participants_[i]->state == 0);
+    runDeleters(&participants_[i]->limbo, epoch_);
+    delete participants_[i];
+  }
+  runDeleters(&orphans_, epoch_);
+}
+
+EpochManager::Participant* EpochManager::participant()
+{
+  Registration& registration = registration_.value();
+  if (registration.participant == NULL)
+  {
+    registration.participant = new Participant(this);
+    MutexLockGuard lock(mutex_);
+    participants_.push_back(registration.participant);
+  }
+  return registration.participant;
+}
+
+EpochManager::Participant* EpochManager::enter()
+{
+  Participant* self = participant();
+  if (self->nesting++ == 0)
+  {
+    uint64_t epoch = __atomic_load_n(&epoch_, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&self->state, epoch << 1 | 1, __ATOMIC_RELAXED);
+    // tryAdvanceLocked() must see us before we read anything shared
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  }
+  return self;
+}
+
+void EpochManager::exit(Participant* self)
+{
+  assert(self->nesting > 0);
+  if (--self->nesting == 0)
+  {
+    __atomic_store_n(&self->state, 0, __ATOMIC_RELEASE);
+  }
+}
+
+void EpochManager::retire(void* p, Deleter deleter)
+{
+  Participant* self = participant();
+  assert(self->nesting == 0);
+  // p was unlinked before the epoch is read
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  Retired retired = { p, deleter, __atomic_load_n(&epoch_, __ATOMIC_ACQUIRE) };
+  self->limbo.push_back(retired);
+  if (++self->retiredSinceReclaim >= kReclaimInterval)
+  {
+    reclaim();
+  }
+}
+
+void EpochManager::reclaim()
+{
+  Participant* self = participant();
+  assert(self->nesting == 0);
+  self->retiredSinceReclaim = 0;
+  uint64_t epoch = 0;
+  {
+  MutexLockGuard lock(mutex_);
+  // twice, what was retired just now can go if no one is reading
+  if (tryAdvanceLocked())
+  {
+    tryAdvanceLocked();
+  }
+  epoch = epoch_;
+  runDeleters(&orphans_, epoch - 2);
+  }
+  runDeleters(&self->limbo, epoch - 2);
+}
+
+bool EpochManager::tryAdvanceLocked()
+{
+  mutex_.assertLocked();
+  const uint64_t current = epoch_ << 1 | 1;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (size_t i = 0; i < participants_.size(); ++i)
+  {
+    uint64_t state = __atomic_load_n(&participants_[i]->state, __ATOMIC_ACQUIRE);
+    if (state != 0 && state != current)
+    {
+      return false;
+    }
+  }
+  __atomic_store_n(&epoch_, epoch_ + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+void EpochManager::unregister(Participant* participant)
+{
+  assert(participant->nesting == 0);
+  MutexLockGuard lock(mutex_);
+  participants_.erase(std::remove(participants_.begin(), participants_.end(), participant),
+                      participants_.end());
+  orphans_.insert(orphans_.end(), participant->limbo.begin(), participant->limbo.end());
+  delete participant;
+}
+
+void EpochManager::runDeleters(std::deque<Retired>* retired, uint64_t safeEpoch)
+{
+  // in retiring order, so epochs don't decrease
+  while (!retired->empty() && retired->front().epoch <= safeEpoch)
+  {
+    Retired r = retired->front();
+    retired->pop_front();
+    r.deleter(r.p);
+  }
+}
@@ -0,0 +1,100 @@
+#ifndef MUDUO_EXAMPLES_MEMCACHED_SERVER_EPOCHMANAGER_H
+#define MUDUO_EXAMPLES_MEMCACHED_SERVER_EPOCHMANAGER_H
+
+#include <muduo/base/Mutex.h>
+#include <muduo/base/ThreadLocal.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <deque>
+#include <vector>
+
+// Epoch based reclamation, for readers that take no lock.
+//
+// Readers stay inside a Guard while they use shared objects.  A writer
+// unlinks an object then retire()s it, the deleter runs once every reader
+// that might have seen it has left its Guard, ie. after the global epoch
+// moved twice.  Each thread keeps what it retired, and frees it in
+// retire() or reclaim().
+class EpochManager : boost::noncopyable
+{
+ private:
+  struct Participant;
+
+ public:
+  typedef void (*Deleter)(void* p);
+
+  class Guard : boost::noncopyable
+  {
+   public:
+    explicit Guard(EpochManager* epochs)
+      : participant_(epochs->enter())
+    {
+    }
+
+    ~Guard()
+    {
+      EpochManager::exit(participant_);
+    }
+
+   private:
+    Participant* participant_;
+  };
+
+  EpochManager();
+  ~EpochManager();  // runs all deleters
+
+  // Calls deleter(p) later, when no reader can see p.
+  // Must not be called inside a Guard of this thread.
+  void retire(void* p, Deleter deleter);
+
+  // Tries to move the epoch on, and frees what this thread retired before.
+  // Must not be called inside a Guard of this thread.
+  void reclaim();
+
+ private:
+  struct Retired
+  {
+    void* p;
+    Deleter deleter;
+    uint64_t epoch;
+  };
+
+  struct Participant : boost::noncopyable
+  {
+    explicit Participant(EpochManager* o)
+      : owner(o), state(0), nesting(0), retiredSinceReclaim(0)
+    {
+    }
+
+    EpochManager* owner;
+    uint64_t state;  // epoch << 1 | 1 inside a Guard, 0 outside, read by others
+    int nesting;
+    int retiredSinceReclaim;
+    std::deque<Retired> limbo;  // owner thread only
+  };
+
+  // deletes its Participant at thread exit
+  struct Registration
+  {
+    Registration() : participant(NULL) {}
+    ~Registration();
+    Participant* participant;
+  };
+
+  Participant* participant();
+  Participant* enter();
+  static void exit(Participant* participant);
+  // with mutex_ held, false if some reader is behind
+  bool tryAdvanceLocked();
+  void unregister(Participant* participant);
+  static void runDeleters(std::deque<Retired>* retired, uint64_t safeEpoch);
+
+  uint64_t epoch_;  // written with mutex_ held
+  muduo::ThreadLocal<Registration> registration_;
+  muduo::MutexLock mutex_;
+  std::vector<Participant*> participants_;  // guarded by mutex_
+  std::deque<Retired> orphans_;  // of exited threads, guarded by mutex_
+};
+
+#endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_EPOCHMANAGER_H
@@ -1,47 +1,119 @@
 #include "Item.h"
+#include "SlabAllocator.h"
 
 #include <muduo/base/LogStream.h>
-#include <muduo/net/Buffer.h>
+#include <muduo/net/ChainBuffer.h>
 
 #include <boost/unordered_map.hpp>
 
+#include <new>
+
 #include <string.h> // memcpy
 #include <stdio.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
+namespace
+{
+// an iovec and a reference cost more than copying a small value
+const size_t kMinReferencedValue = 1024;
+
+void releaseItem(const Item* item)
+{
+  intrusive_ptr_release(item);
+}
+}
+
+ItemPtr Item::makeItem(StringPiece keyArg,
+                       uint32_t flagsArg,
+                       int exptimeArg,
+                       int valuelen,
+                       uint64_t casArg)
+{
+  void* p = ::malloc(sizeFor(keyArg.size(), valuelen));
+  if (p == NULL)
+  {
+    throw std::bad_alloc();
+  }
+  return ItemPtr(new (p) Item(keyArg, flagsArg, exptimeArg, valuelen, casArg, NULL, kNoSlab));
+}
+
+ItemPtr Item::makeItem(SlabAllocator* slabs,
+                       StringPiece keyArg,
+                       uint32_t flagsArg,
+                       int exptimeArg,
+                       int valuelen,
+                       uint64_t casArg)
+{
+  const size_t size = sizeFor(keyArg.size(), valuelen);
+  int cls = slabs->classOf(size);
+  void* p = cls >= 0 ? slabs->allocate(cls, size) : NULL;
+  if (p == NULL)
+  {
+    return ItemPtr();
+  }
+  assert(cls < kNoSlab);
+  return ItemPtr(new (p) Item(keyArg, flagsArg, exptimeArg, valuelen, casArg, slabs, cls));
+}
+
 Item::Item(StringPiece keyArg,
            uint32_t flagsArg,
            int exptimeArg,
            int valuelen,
-           uint64_t casArg)
-  : keylen_(keyArg.size()),
+           uint64_t casArg,
+           SlabAllocator* slabs,
+           int slabClass)
+  : keylen_(static_cast<uint8_t>(keyArg.size())),
+    slabClass_(static_cast<uint8_t>(slabClass)),
+    referenced_(false),
+    queued_(false),
     flags_(flagsArg),
     rel_exptime_(exptimeArg),
     valuelen_(valuelen),
     receivedBytes_(0),
     cas_(casArg),
     hash_(boost::hash_range(keyArg.begin(), keyArg.end())),
-    data_(static_cast<char*>(::malloc(totalLen())))
+    prev_(NULL),
+    next_(NULL),
+    slabs_(slabs)
 {
+  assert(keyArg.size() <= 250);
   assert(valuelen_ >= 2);
   assert(receivedBytes_ < totalLen());
   append(keyArg.data(), keylen_);
 }
 
+void Item::destroy() const
+{
+  assert(!queued_);
+  SlabAllocator* slabs = slabs_;
+  const int cls = slabClass_;
+  const size_t size = sizeFor(keylen_, valuelen_);
+  void* p = const_cast<Item*>(this);
+  this->~Item();
+  if (slabs)
+  {
+    slabs->deallocate(p, cls, size);
+  }
+  else
+  {
+    ::free(p);
+  }
+}
+
 void Item::append(const char* data, size_t len)
 {
   assert(len <= neededBytes());
-  memcpy(data_ + receivedBytes_, data, len);
+  memcpy(this->data() + receivedBytes_, data, len);
   receivedBytes_ += static_cast<int>(len);
   assert(receivedBytes_ <= totalLen());
 }
 
-void Item::output(Buffer* out, bool needCas) const
+void Item::output(ChainBuffer* out, bool needCas) const
 {
   out->append("VALUE ");
-  out->append(data_, keylen_);
+  out->append(data(), keylen_);
   LogStream buf;
   buf << ' ' << flags_ << ' ' << valuelen_-2;
   if (needCas)
@@ -50,13 +122,32 @@ void Item::output(Buffer* out, bool needCas) const
   }
   buf << "\r\n";
   out->append(buf.buffer().data(), buf.buffer().length());
-  out->append(value(), valuelen_);
+  appendValue(out, valuelen_);
+}
+
+void Item::outputValue(ChainBuffer* out) const
+{
+  appendValue(out, valuelen_-2);
+}
+
+void Item::appendValue(ChainBuffer* out, size_t len) const
+{
+  if (len < kMinReferencedValue)
+  {
+    out->append(value(), len);
+  }
+  else
+  {
+    // the reference is dropped once the socket took the value
+    intrusive_ptr_add_ref(this);
+    out->appendRef(value(), len, boost::shared_ptr<const void>(this, releaseItem));
+  }
 }
 
 void Item::resetKey(StringPiece k)
 {
   assert(k.size() <= 250);
-  keylen_ = k.size();
+  keylen_ = static_cast<uint8_t>(k.size());
   receivedBytes_ = 0;
   append(k.data(), k.size());
   hash_ = boost::hash_range(k.begin(), k.end());
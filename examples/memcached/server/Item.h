@@ -5,9 +5,8 @@
 #include <muduo/base/StringPiece.h>
 #include <muduo/base/Types.h>
 
-#include <boost/make_shared.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <boost/noncopyable.hpp>
-#include <boost/shared_ptr.hpp>
 
 using muduo::string;
 using muduo::StringPiece;
@@ -16,15 +15,23 @@ namespace muduo
 {
 namespace net
 {
-class Buffer;
+class ChainBuffer;
 }
 }
 
 class Item;
-typedef boost::shared_ptr<Item> ItemPtr;  // TODO: use unique_ptr
-typedef boost::shared_ptr<const Item> ConstItemPtr;  // TODO: use unique_ptr
+class MemcacheServer;
+class SlabAllocator;
+typedef boost::intrusive_ptr<Item> ItemPtr;
+typedef boost::intrusive_ptr<const Item> ConstItemPtr;
+
+void intrusive_ptr_add_ref(const Item* item);
+void intrusive_ptr_release(const Item* item);
 
 // Item is immutable once added into hash table
+//
+// The header, key and value share one block, taken from a SlabAllocator
+// for stored items or from malloc otherwise.  Reference counted in place.
 class Item : boost::noncopyable
 {
  public:
@@ -43,26 +50,25 @@ class Item : boost::noncopyable
                           uint32_t flagsArg,
                           int exptimeArg,
                           int valuelen,
-                          uint64_t casArg)
-  {
-    return boost::make_shared<Item>(keyArg, flagsArg, exptimeArg, valuelen, casArg);
-    //return ItemPtr(new Item(keyArg, flagsArg, exptimeArg, valuelen, casArg));
-  }
+                          uint64_t casArg);
 
-  Item(StringPiece keyArg,
-       uint32_t flagsArg,
-       int exptimeArg,
-       int valuelen,
-       uint64_t casArg);
+  // NULL if slabs is out of memory
+  static ItemPtr makeItem(SlabAllocator* slabs,
+                          StringPiece keyArg,
+                          uint32_t flagsArg,
+                          int exptimeArg,
+                          int valuelen,
+                          uint64_t casArg);
 
-  ~Item()
+  // bytes taken by an item, including the header
+  static size_t sizeFor(size_t keylen, size_t valuelen)
   {
-    ::free(data_);
+    return sizeof(Item) + keylen + valuelen;
   }
 
   muduo::StringPiece key() const
   {
-    return muduo::StringPiece(data_, keylen_);
+    return muduo::StringPiece(data(), keylen_);
   }
 
   uint32_t flags() const
@@ -77,7 +83,7 @@ class Item : boost::noncopyable
 
   const char* value() const
   {
-    return data_+keylen_;
+    return data()+keylen_;
   }
 
   size_t valueLength() const
@@ -100,6 +106,31 @@ class Item : boost::noncopyable
     cas_ = casArg;
   }
 
+  int slabClass() const
+  {
+    return slabClass_ == kNoSlab ? -1 : slabClass_;
+  }
+
+  // marks it recently used for eviction, no lock needed
+  void touch() const
+  {
+    // relaxed, a lost mark only costs a second chance
+    if (!referenced())
+    {
+      __atomic_store_n(&referenced_, true, __ATOMIC_RELAXED);
+    }
+  }
+
+  bool referenced() const
+  {
+    return __atomic_load_n(&referenced_, __ATOMIC_RELAXED);
+  }
+
+  bool unique() const
+  {
+    return refs_.get() == 1;
+  }
+
   size_t neededBytes() const
   {
     return totalLen() - receivedBytes_;
@@ -110,25 +141,66 @@ class Item : boost::noncopyable
   bool endsWithCRLF() const
   {
     return receivedBytes_ == totalLen()
-        && data_[totalLen()-2] == '\r'
-        && data_[totalLen()-1] == '\n';
+        && data()[totalLen()-2] == '\r'
+        && data()[totalLen()-1] == '\n';
   }
 
-  void output(muduo::net::Buffer* out, bool needCas = false) const;
+  // large values are referenced, not copied, until written
+  void output(muduo::net::ChainBuffer* out, bool needCas = false) const;
+  // without "\r\n", for the binary protocol
+  void outputValue(muduo::net::ChainBuffer* out) const;
 
   void resetKey(StringPiece k);
 
  private:
-  int totalLen() const { return keylen_ + valuelen_; }
+  friend class MemcacheServer;  // for the eviction queue
+  friend void intrusive_ptr_add_ref(const Item* item);
+  friend void intrusive_ptr_release(const Item* item);
+
+  static const uint8_t kNoSlab = 0xff;
+
+  Item(StringPiece keyArg,
+       uint32_t flagsArg,
+       int exptimeArg,
+       int valuelen,
+       uint64_t casArg,
+       SlabAllocator* slabs,
+       int slabClass);
 
-  int            keylen_;
+  int totalLen() const { return keylen_ + valuelen_; }
+  // key and value follow the header
+  char* data() const { return reinterpret_cast<char*>(const_cast<Item*>(this + 1)); }
+  void destroy() const;
+  void appendValue(muduo::net::ChainBuffer* out, size_t len) const;
+
+  uint8_t        keylen_;
+  const uint8_t  slabClass_;
+  mutable bool   referenced_;     // atomic, set by readers
+  bool           queued_;         // guarded by eviction queue lock
+  mutable muduo::AtomicInt32 refs_;  // not first, it has an empty base too
   const uint32_t flags_;
   const int      rel_exptime_;
   const int      valuelen_;
   int            receivedBytes_;  // FIXME: remove this member
   uint64_t       cas_;
   size_t         hash_;
-  char*          data_;
+  // eviction queue of slabClass_
+  Item*          prev_;
+  Item*          next_;
+  SlabAllocator* const slabs_;
 };
 
+inline void intrusive_ptr_add_ref(const Item* item)
+{
+  item->refs_.increment();
+}
+
+inline void intrusive_ptr_release(const Item* item)
+{
+  if (item->refs_.decrementAndGet() == 0)
+  {
+    item->destroy();
+  }
+}
+
 #endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEM_H
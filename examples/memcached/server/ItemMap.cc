@@ -0,0 +1,220 @@
+#include "ItemMap.h"
+#include "EpochManager.h"
+
+#include <new>
+
+#include <assert.h>
+#include <stdlib.h>
+
+namespace
+{
+const size_t kInitialCapacity = 8;
+
+char tombstone;
+const Item* const kTombstone = reinterpret_cast<const Item*>(&tombstone);
+
+void releaseItem(void* item)
+{
+  intrusive_ptr_release(static_cast<const Item*>(item));
+}
+}
+
+ItemMap::ItemMap(EpochManager* epochs)
+  : epochs_(epochs),
+    seq_(0),
+    table_(newTable(kInitialCapacity)),
+    size_(0),
+    used_(0)
+{
+}
+
+ItemMap::~ItemMap()
+{
+  for (size_t i = 0; i <= table_->mask; ++i)
+  {
+    const Item* item = table_->slots[i].item;
+    if (item != NULL && item != kTombstone)
+    {
+      intrusive_ptr_release(item);
+    }
+  }
+  freeTable(table_);
+}
+
+ItemMap::Table* ItemMap::newTable(size_t capacity)
+{
+  assert((capacity & (capacity - 1)) == 0);
+  void* p = ::calloc(1, sizeof(Table) + (capacity - 1) * sizeof(Slot));
+  if (p == NULL)
+  {
+    throw std::bad_alloc();
+  }
+  Table* table = static_cast<Table*>(p);
+  table->mask = capacity - 1;
+  return table;
+}
+
+void ItemMap::freeTable(void* table)
+{
+  ::free(table);
+}
+
+const Item* ItemMap::lookup(const Table* table, const Item* key)
+{
+  const size_t hash = key->hash();
+  size_t i = hash & table->mask;
+  // bounded, a torn read must not loop forever
+  for (size_t n = 0; n <= table->mask; ++n)
+  {
+    const Slot& slot = table->slots[i];
+    const Item* item = __atomic_load_n(&slot.item, __ATOMIC_ACQUIRE);
+    if (item == NULL)
+    {
+      break;
+    }
+    if (item != kTombstone
+        && __atomic_load_n(&slot.hash, __ATOMIC_RELAXED) == hash
+        && item->key() == key->key())
+    {
+      return item;
+    }
+    i = (i + 1) & table->mask;
+  }
+  return NULL;
+}
+
+const Item* ItemMap::find(const Item* key) const
+{
+  while (true)
+  {
+    const uint32_t seq = __atomic_load_n(&seq_, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+    {
+      continue;  // a writer is busy
+    }
+    const Item* item = lookup(__atomic_load_n(&table_, __ATOMIC_ACQUIRE), key);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&seq_, __ATOMIC_RELAXED) == seq)
+    {
+      return item;
+    }
+  }
+}
+
+const Item* ItemMap::findLocked(const Item* key) const
+{
+  return lookup(table_, key);
+}
+
+void ItemMap::insertLocked(const ConstItemPtr& item)
+{
+  assert(findLocked(get_pointer(item)) == NULL);
+  if ((used_ + 1) * 4 > (table_->mask + 1) * 3)
+  {
+    // at most half full afterwards, tombstones are dropped
+    size_t capacity = kInitialCapacity;
+    while (capacity < (size_ + 1) * 2)
+    {
+      capacity *= 2;
+    }
+    rehashLocked(capacity);
+  }
+
+  const size_t hash = item->hash();
+  size_t i = hash & table_->mask;
+  while (table_->slots[i].item != NULL && table_->slots[i].item != kTombstone)
+  {
+    i = (i + 1) & table_->mask;
+  }
+  Slot& slot = table_->slots[i];
+  if (slot.item == NULL)
+  {
+    ++used_;
+  }
+  intrusive_ptr_add_ref(get_pointer(item));
+  beginWrite();
+  __atomic_store_n(&slot.hash, hash, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot.item, get_pointer(item), __ATOMIC_RELEASE);
+  endWrite();
+  ++size_;
+}
+
+void ItemMap::replaceLocked(const Item* oldItem, const ConstItemPtr& newItem)
+{
+  assert(oldItem->hash() == newItem->hash());
+  Slot* slot = slotOfLocked(oldItem);
+  intrusive_ptr_add_ref(get_pointer(newItem));
+  beginWrite();
+  __atomic_store_n(&slot->item, get_pointer(newItem), __ATOMIC_RELEASE);
+  endWrite();
+  epochs_->retire(const_cast<Item*>(oldItem), releaseItem);
+}
+
+void ItemMap::eraseLocked(const Item* item)
+{
+  Slot* slot = slotOfLocked(item);
+  beginWrite();
+  __atomic_store_n(&slot->item, kTombstone, __ATOMIC_RELEASE);
+  endWrite();
+  --size_;
+  epochs_->retire(const_cast<Item*>(item), releaseItem);
+}
+
+void ItemMap::collectLocked(std::vector<ConstItemPtr>* items) const
+{
+  for (size_t i = 0; i <= table_->mask; ++i)
+  {
+    const Item* item = table_->slots[i].item;
+    if (item != NULL && item != kTombstone)
+    {
+      items->push_back(ConstItemPtr(item));
+    }
+  }
+}
+
+ItemMap::Slot* ItemMap::slotOfLocked(const Item* item) const
+{
+  size_t i = item->hash() & table_->mask;
+  while (table_->slots[i].item != item)
+  {
+    assert(table_->slots[i].item != NULL);
+    i = (i + 1) & table_->mask;
+  }
+  return &table_->slots[i];
+}
+
+void ItemMap::beginWrite()
+{
+  __atomic_store_n(&seq_, seq_ + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void ItemMap::endWrite()
+{
+  __atomic_store_n(&seq_, seq_ + 1, __ATOMIC_RELEASE);
+}
+
+void ItemMap::rehashLocked(size_t capacity)
+{
+  Table* oldTable = table_;
+  Table* table = newTable(capacity);
+  for (size_t i = 0; i <= oldTable->mask; ++i)
+  {
+    const Slot& slot = oldTable->slots[i];
+    if (slot.item != NULL && slot.item != kTombstone)
+    {
+      size_t j = slot.hash & table->mask;
+      while (table->slots[j].item != NULL)
+      {
+        j = (j + 1) & table->mask;
+      }
+      table->slots[j] = slot;
+    }
+  }
+  // readers may still be on the old one
+  beginWrite();
+  __atomic_store_n(&table_, table, __ATOMIC_RELEASE);
+  endWrite();
+  used_ = size_;
+  epochs_->retire(oldTable, freeTable);
+}
@@ -0,0 +1,67 @@
+#ifndef MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEMMAP_H
+#define MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEMMAP_H
+
+#include "Item.h"
+
+#include <boost/noncopyable.hpp>
+
+#include <vector>
+
+class EpochManager;
+
+// Open addressing hash set of items, keyed by Item::key().
+//
+// Writers must be serialized by the caller.  Readers take no lock: a
+// sequence number tells them to retry if a writer was busy meanwhile, and
+// removed items and old tables are retired to an EpochManager, so they
+// stay valid inside a Guard.  Holds a reference to each item.
+class ItemMap : boost::noncopyable
+{
+ public:
+  explicit ItemMap(EpochManager* epochs);
+  ~ItemMap();
+
+  // Lock free, must be called inside an EpochManager::Guard,
+  // the item is valid until the guard goes out of scope.
+  const Item* find(const Item* key) const;
+
+  // The following are for the writer.
+  const Item* findLocked(const Item* key) const;
+  // key must be absent
+  void insertLocked(const ConstItemPtr& item);
+  // same key
+  void replaceLocked(const Item* oldItem, const ConstItemPtr& newItem);
+  void eraseLocked(const Item* item);
+  // appends all items
+  void collectLocked(std::vector<ConstItemPtr>* items) const;
+  size_t size() const { return size_; }
+
+ private:
+  struct Slot
+  {
+    size_t hash;
+    const Item* item;  // NULL if empty, kTombstone if erased
+  };
+
+  struct Table
+  {
+    size_t mask;
+    Slot slots[1];
+  };
+
+  static Table* newTable(size_t capacity);
+  static void freeTable(void* table);
+  static const Item* lookup(const Table* table, const Item* key);
+  Slot* slotOfLocked(const Item* item) const;
+  void beginWrite();
+  void endWrite();
+  void rehashLocked(size_t capacity);
+
+  EpochManager* epochs_;
+  uint32_t seq_;   // odd while writing
+  Table* table_;
+  size_t size_;
+  size_t used_;    // size_ plus tombstones
+};
+
+#endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEMMAP_H
@@ -1,42 +1,104 @@
 #include "MemcacheServer.h"
+#include "Snapshot.h"
 
 #include <muduo/base/Atomic.h>
 #include <muduo/base/Logging.h>
+#include <muduo/base/Thread.h>
+#include <muduo/base/Timestamp.h>
 #include <muduo/net/EventLoop.h>
 
 #include <boost/bind.hpp>
 
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+
 using namespace muduo;
 using namespace muduo::net;
 
 muduo::AtomicInt64 g_cas;
 
+namespace
+{
+// longest key and value
+const size_t kMaxItemSize = Item::sizeFor(250, 1024*1024 + 2);
+// victims can be in use, their chunks come back later
+const int kEvictionTries = 10;
+
+void appendStat(Buffer* out, const char* name, int64_t value)
+{
+  char buf[256];
+  int n = snprintf(buf, sizeof buf, "STAT %s %" PRId64 "\r\n", name, value);
+  out->append(buf, n);
+}
+}
+
 MemcacheServer::Options::Options()
+  : tcpport(0),
+    udpport(0),
+    gperfport(0),
+    threads(0),
+    memoryLimit(0),
+    snapshotInterval(0)
 {
-  bzero(this, sizeof(*this));
 }
 
 struct MemcacheServer::Stats
 {
+  AtomicInt64 currItems;
+  AtomicInt64 totalItems;
+  AtomicInt64 evictions;
+  AtomicInt64 outOfMemory;
 };
 
 MemcacheServer::MemcacheServer(muduo::net::EventLoop* loop, const Options& options)
   : loop_(loop),
     options_(options),
     startTime_(::time(NULL)-1),
+    slabs_(new SlabAllocator(options.memoryLimit, kMaxItemSize)),
+    epochs_(new EpochManager),
+    queues_(new EvictionQueue[slabs_->numClasses()]),
     server_(loop, InetAddress(options.tcpport), "muduo-memcached"),
     stats_(new Stats)
 {
+  for (int i = 0; i < kShards; ++i)
+  {
+    shards_.push_back(new MapWithLock(get_pointer(epochs_)));
+  }
   server_.setConnectionCallback(
       boost::bind(&MemcacheServer::onConnection, this, _1));
 }
 
 MemcacheServer::~MemcacheServer()
 {
+  // items are freed with shards_ and epochs_
+  for (int i = 0; i < slabs_->numClasses(); ++i)
+  {
+    for (Item* item = queues_[i].head; item; item = item->next_)
+    {
+      item->queued_ = false;
+    }
+  }
 }
 
 void MemcacheServer::start()
 {
+  if (!options_.snapshotFile.empty())
+  {
+    // warm before the first request
+    loadSnapshot();
+    if (options_.snapshotInterval > 0)
+    {
+      snapshotPool_.reset(new ThreadPool("snapshot"));
+      snapshotPool_->start(1);
+      loop_->runEvery(options_.snapshotInterval,
+                      boost::bind(&MemcacheServer::requestSnapshot, this));
+    }
+  }
   server_.start();
 }
 
@@ -45,22 +107,57 @@ void MemcacheServer::stop()
   loop_->runAfter(3.0, boost::bind(&EventLoop::quit, loop_));
 }
 
+ItemPtr MemcacheServer::makeItem(StringPiece key,
+                                 uint32_t flags,
+                                 int exptime,
+                                 int valuelen,
+                                 uint64_t cas)
+{
+  ItemPtr item(Item::makeItem(get_pointer(slabs_), key, flags, exptime, valuelen, cas));
+  const int cls = slabs_->classOf(Item::sizeFor(key.size(), valuelen));
+  for (int i = 0; !item && cls >= 0 && i < kEvictionTries; ++i)
+  {
+    if (i > 0)
+    {
+      // let readers leave their guards
+      sched_yield();
+    }
+    evict(cls);
+    // chunks come back once no reader can see them
+    epochs_->reclaim();
+    item = Item::makeItem(get_pointer(slabs_), key, flags, exptime, valuelen, cas);
+  }
+  if (!item)
+  {
+    stats_->outOfMemory.increment();
+  }
+  return item;
+}
+
 bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy policy, bool* exists)
 {
   assert(item->neededBytes() == 0);
+  if (policy == Item::kAppend || policy == Item::kPrepend)
+  {
+    return appendItem(item, policy, exists);
+  }
+
   MutexLock& mutex = shards_[item->hash() % kShards].mutex;
   ItemMap& items = shards_[item->hash() % kShards].items;
   MutexLockGuard lock(mutex);
-  ItemMap::const_iterator it = items.find(item);
-  *exists = it != items.end();
+  const Item* oldItem = items.findLocked(get_pointer(item));
+  *exists = oldItem != NULL;
   if (policy == Item::kSet)
   {
     item->setCas(g_cas.incrementAndGet());
     if (*exists)
     {
-      items.erase(it);
+      replaceLocked(items, oldItem, item);
+    }
+    else
+    {
+      insertLocked(items, item);
     }
-    items.insert(item);
   }
   else
   {
@@ -73,7 +170,7 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
       else
       {
         item->setCas(g_cas.incrementAndGet());
-        items.insert(item);
+        insertLocked(items, item);
       }
     }
     else if (policy == Item::kReplace)
@@ -81,39 +178,7 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
       if (*exists)
       {
         item->setCas(g_cas.incrementAndGet());
-        items.erase(it);
-        items.insert(item);
-      }
-      else
-      {
-        return false;
-      }
-    }
-    else if (policy == Item::kAppend || policy == Item::kPrepend)
-    {
-      if (*exists)
-      {
-        const ConstItemPtr& oldItem = *it;
-        int newLen = static_cast<int>(item->valueLength() + oldItem->valueLength() - 2);
-        ItemPtr newItem(Item::makeItem(item->key(),
-                                       oldItem->flags(),
-                                       oldItem->rel_exptime(),
-                                       newLen,
-                                       g_cas.incrementAndGet()));
-        if (policy == Item::kAppend)
-        {
-          newItem->append(oldItem->value(), oldItem->valueLength() - 2);
-          newItem->append(item->value(), item->valueLength());
-        }
-        else
-        {
-          newItem->append(item->value(), item->valueLength() - 2);
-          newItem->append(oldItem->value(), oldItem->valueLength());
-        }
-        assert(newItem->neededBytes() == 0);
-        assert(newItem->endsWithCRLF());
-        items.erase(it);
-        items.insert(newItem);
+        replaceLocked(items, oldItem, item);
       }
       else
       {
@@ -122,11 +187,10 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
     }
     else if (policy == Item::kCas)
     {
-      if (*exists && (*it)->cas() == item->cas())
+      if (*exists && oldItem->cas() == item->cas())
       {
         item->setCas(g_cas.incrementAndGet());
-        items.erase(it);
-        items.insert(item);
+        replaceLocked(items, oldItem, item);
       }
       else
       {
@@ -141,13 +205,69 @@ bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy pol
   return true;
 }
 
+bool MemcacheServer::appendItem(const ItemPtr& item, const Item::UpdatePolicy policy, bool* exists)
+{
+  // allocates without holding a shard lock, as evict() takes one,
+  // retries if the old item was changed meanwhile.
+  while (true)
+  {
+    ConstItemPtr oldItem = getItem(item);
+    if (!oldItem)
+    {
+      *exists = false;
+      return false;
+    }
+    *exists = true;
+    int newLen = static_cast<int>(item->valueLength() + oldItem->valueLength() - 2);
+    ItemPtr newItem(makeItem(item->key(),
+                             oldItem->flags(),
+                             oldItem->rel_exptime(),
+                             newLen,
+                             0));
+    if (!newItem)
+    {
+      return false;
+    }
+    if (policy == Item::kAppend)
+    {
+      newItem->append(oldItem->value(), oldItem->valueLength() - 2);
+      newItem->append(item->value(), item->valueLength());
+    }
+    else
+    {
+      newItem->append(item->value(), item->valueLength() - 2);
+      newItem->append(oldItem->value(), oldItem->valueLength());
+    }
+    assert(newItem->neededBytes() == 0);
+    assert(newItem->endsWithCRLF());
+
+    MutexLock& mutex = shards_[item->hash() % kShards].mutex;
+    ItemMap& items = shards_[item->hash() % kShards].items;
+    MutexLockGuard lock(mutex);
+    if (items.findLocked(get_pointer(item)) == get_pointer(oldItem))
+    {
+      newItem->setCas(g_cas.incrementAndGet());
+      replaceLocked(items, get_pointer(oldItem), newItem);
+      return true;
+    }
+  }
+}
+
+const Item* MemcacheServer::findItem(const Item* key, const ReadGuard&) const
+{
+  const Item* item = shards_[key->hash() % kShards].items.find(key);
+  if (item)
+  {
+    item->touch();
+  }
+  return item;
+}
+
 ConstItemPtr MemcacheServer::getItem(const ConstItemPtr& key) const
 {
-  MutexLock& mutex = shards_[key->hash() % kShards].mutex;
-  const ItemMap& items = shards_[key->hash() % kShards].items;
-  MutexLockGuard lock(mutex);
-  ItemMap::const_iterator it = items.find(key);
-  return it != items.end() ? *it : ConstItemPtr();
+  ReadGuard guard(this);
+  // still referenced by the table or by retired ones
+  return ConstItemPtr(findItem(get_pointer(key), guard));
 }
 
 bool MemcacheServer::deleteItem(const ConstItemPtr& key)
@@ -155,7 +275,309 @@ bool MemcacheServer::deleteItem(const ConstItemPtr& key)
   MutexLock& mutex = shards_[key->hash() % kShards].mutex;
   ItemMap& items = shards_[key->hash() % kShards].items;
   MutexLockGuard lock(mutex);
-  return items.erase(key) == 1;
+  const Item* item = items.findLocked(get_pointer(key));
+  if (item)
+  {
+    eraseLocked(items, item);
+    return true;
+  }
+  return false;
+}
+
+void MemcacheServer::insertLocked(ItemMap& items, const ConstItemPtr& item)
+{
+  items.insertLocked(item);
+  enqueue(get_pointer(item));
+  stats_->currItems.increment();
+  stats_->totalItems.increment();
+}
+
+void MemcacheServer::replaceLocked(ItemMap& items, const Item* oldItem, const ConstItemPtr& item)
+{
+  // dequeue before the table drops its reference
+  dequeue(oldItem);
+  items.replaceLocked(oldItem, item);
+  enqueue(get_pointer(item));
+  stats_->totalItems.increment();
+}
+
+void MemcacheServer::eraseLocked(ItemMap& items, const Item* item)
+{
+  dequeue(item);
+  items.eraseLocked(item);
+  stats_->currItems.decrement();
+}
+
+void MemcacheServer::enqueue(const Item* constItem)
+{
+  const int cls = constItem->slabClass();
+  if (cls >= 0)
+  {
+    Item* item = const_cast<Item*>(constItem);
+    EvictionQueue& queue = queues_[cls];
+    MutexLockGuard lock(queue.mutex);
+    assert(!item->queued_);
+    item->queued_ = true;
+    item->prev_ = queue.tail;
+    item->next_ = NULL;
+    if (queue.tail)
+    {
+      queue.tail->next_ = item;
+    }
+    else
+    {
+      queue.head = item;
+    }
+    queue.tail = item;
+    ++queue.size;
+  }
+}
+
+void MemcacheServer::dequeue(const Item* item)
+{
+  const int cls = item->slabClass();
+  if (cls >= 0)
+  {
+    EvictionQueue& queue = queues_[cls];
+    MutexLockGuard lock(queue.mutex);
+    if (item->queued_)
+    {
+      dequeueLocked(queue, const_cast<Item*>(item));
+    }
+  }
+}
+
+void MemcacheServer::dequeueLocked(EvictionQueue& queue, Item* item)
+{
+  queue.mutex.assertLocked();
+  assert(item->queued_);
+  if (item->prev_)
+    item->prev_->next_ = item->next_;
+  else
+    queue.head = item->next_;
+  if (item->next_)
+    item->next_->prev_ = item->prev_;
+  else
+    queue.tail = item->prev_;
+  item->prev_ = NULL;
+  item->next_ = NULL;
+  item->queued_ = false;
+  --queue.size;
+}
+
+bool MemcacheServer::evict(int slabClass)
+{
+  ConstItemPtr victim;
+  {
+  EvictionQueue& queue = queues_[slabClass];
+  MutexLockGuard lock(queue.mutex);
+  // every item gets a second chance, but not forever
+  for (size_t n = queue.size; n > 0 && queue.head->referenced(); --n)
+  {
+    Item* item = queue.head;
+    __atomic_store_n(&item->referenced_, false, __ATOMIC_RELAXED);
+    if (item != queue.tail)
+    {
+      queue.head = item->next_;
+      queue.head->prev_ = NULL;
+      item->prev_ = queue.tail;
+      item->next_ = NULL;
+      queue.tail->next_ = item;
+      queue.tail = item;
+    }
+  }
+  if (queue.head == NULL)
+  {
+    return false;
+  }
+  // still referenced by the table, as dequeuing comes first
+  victim = queue.head;
+  dequeueLocked(queue, queue.head);
+  }
+
+  {
+  MutexLock& mutex = shards_[victim->hash() % kShards].mutex;
+  ItemMap& items = shards_[victim->hash() % kShards].items;
+  MutexLockGuard lock(mutex);
+  if (items.findLocked(get_pointer(victim)) == get_pointer(victim))
+  {
+    eraseLocked(items, get_pointer(victim));
+    stats_->evictions.increment();
+  }
+  }
+  return true;
+}
+
+bool MemcacheServer::stats(StringPiece group, Buffer* out) const
+{
+  if (group.empty())
+  {
+    const time_t now = ::time(NULL);
+    size_t connections = 0;
+    {
+    MutexLockGuard lock(mutex_);
+    connections = sessions_.size();
+    }
+    size_t bytes = 0;
+    for (int i = 0; i < slabs_->numClasses(); ++i)
+    {
+      bytes += slabs_->classStats(i).requestedBytes;
+    }
+    appendStat(out, "pid", ::getpid());
+    appendStat(out, "uptime", now - startTime_);
+    appendStat(out, "time", now);
+    appendStat(out, "curr_connections", connections);
+    appendStat(out, "threads", options_.threads);
+    appendStat(out, "curr_items", stats_->currItems.get());
+    appendStat(out, "total_items", stats_->totalItems.get());
+    appendStat(out, "bytes", bytes);
+    appendStat(out, "limit_maxbytes", slabs_->memoryLimit());
+    appendStat(out, "total_malloced", slabs_->totalMalloced());
+    appendStat(out, "evictions", stats_->evictions.get());
+    appendStat(out, "outofmemory", stats_->outOfMemory.get());
+  }
+  else if (group == "slabs")
+  {
+    int active = 0;
+    for (int i = 0; i < slabs_->numClasses(); ++i)
+    {
+      SlabAllocator::ClassStats cs = slabs_->classStats(i);
+      if (cs.totalPages == 0)
+      {
+        continue;
+      }
+      ++active;
+      char name[64];
+      snprintf(name, sizeof name, "%d:chunk_size", i);
+      appendStat(out, name, cs.chunkSize);
+      snprintf(name, sizeof name, "%d:chunks_per_page", i);
+      appendStat(out, name, cs.chunksPerPage);
+      snprintf(name, sizeof name, "%d:total_pages", i);
+      appendStat(out, name, cs.totalPages);
+      snprintf(name, sizeof name, "%d:total_chunks", i);
+      appendStat(out, name, cs.totalChunks);
+      snprintf(name, sizeof name, "%d:used_chunks", i);
+      appendStat(out, name, cs.usedChunks);
+      snprintf(name, sizeof name, "%d:free_chunks", i);
+      appendStat(out, name, cs.totalChunks - cs.usedChunks);
+      snprintf(name, sizeof name, "%d:mem_requested", i);
+      appendStat(out, name, cs.requestedBytes);
+    }
+    appendStat(out, "active_slabs", active);
+    appendStat(out, "total_malloced", slabs_->totalMalloced());
+  }
+  else
+  {
+    return false;
+  }
+  out->append("END\r\n");
+  return true;
+}
+
+bool MemcacheServer::saveSnapshot()
+{
+  MutexLockGuard lock(snapshotMutex_);
+  const Timestamp start(Timestamp::now());
+  snapshot::Writer writer(options_.snapshotFile);
+  std::vector<ConstItemPtr> items;
+  for (int i = 0; i < kShards; ++i)
+  {
+    // writers of this shard wait for pointers to be copied only
+    {
+    MutexLockGuard shardLock(shards_[i].mutex);
+    shards_[i].items.collectLocked(&items);
+    }
+    for (size_t j = 0; j < items.size(); ++j)
+    {
+      writer.append(get_pointer(items[j]));
+    }
+    items.clear();
+  }
+  const bool ok = writer.commit();
+  if (ok)
+  {
+    LOG_INFO << "snapshot of " << writer.records() << " items, " << writer.bytes()
+             << " bytes in " << timeDifference(Timestamp::now(), start) << " seconds";
+  }
+  return ok;
+}
+
+void MemcacheServer::requestSnapshot()
+{
+  if (snapshotting_.getAndSet(1) == 0)
+  {
+    snapshotPool_->run(boost::bind(&MemcacheServer::snapshotInPool, this));
+  }
+  else
+  {
+    LOG_WARN << "last snapshot is still running, skip this one";
+  }
+}
+
+void MemcacheServer::snapshotInPool()
+{
+  saveSnapshot();
+  snapshotting_.getAndSet(0);
+}
+
+size_t MemcacheServer::loadSnapshot()
+{
+  const Timestamp start(Timestamp::now());
+  snapshot::Reader reader(options_.snapshotFile);
+  if (!reader.valid())
+  {
+    return 0;
+  }
+  AtomicInt32 nextBlock;
+  AtomicInt64 loaded;
+  const int threads = static_cast<int>(std::max(::sysconf(_SC_NPROCESSORS_ONLN), 1L));
+  boost::ptr_vector<Thread> loaders;
+  for (int i = 0; i < threads; ++i)
+  {
+    loaders.push_back(new Thread(
+        boost::bind(&MemcacheServer::loadBlocks, this, &reader, &nextBlock, &loaded),
+        "snapshot-loader"));
+    loaders.back().start();
+  }
+  for (int i = 0; i < threads; ++i)
+  {
+    loaders[i].join();
+  }
+  LOG_INFO << "loaded " << loaded.get() << " items of " << reader.fileSize()
+           << " bytes in " << timeDifference(Timestamp::now(), start) << " seconds by "
+           << threads << " threads";
+  return static_cast<size_t>(loaded.get());
+}
+
+void MemcacheServer::loadBlocks(const snapshot::Reader* reader,
+                                AtomicInt32* nextBlock,
+                                AtomicInt64* loaded)
+{
+  const snapshot::Reader::RecordCallback cb(
+      boost::bind(&MemcacheServer::restoreRecord, this, _1, loaded));
+  int block = 0;
+  while ((block = nextBlock->getAndAdd(1)) < reader->numBlocks())
+  {
+    if (!reader->readBlock(block, cb))
+    {
+      LOG_ERROR << "snapshot block " << block << " is damaged, stop loading";
+      // loaders finish blocks they have taken
+      nextBlock->getAndSet(reader->numBlocks());
+    }
+  }
+}
+
+void MemcacheServer::restoreRecord(const snapshot::Record& record, AtomicInt64* loaded)
+{
+  // a new cas, like any set
+  ItemPtr item(makeItem(record.key, record.flags, record.exptime, record.value.size(), 0));
+  if (item)
+  {
+    item->append(record.value.data(), record.value.size());
+    bool exists = false;
+    storeItem(item, Item::kSet, &exists);
+    loaded->increment();
+  }
 }
 
 void MemcacheServer::onConnection(const TcpConnectionPtr& conn)
@@ -1,17 +1,28 @@
 #ifndef MUDUO_EXAMPLES_MEMCACHED_SERVER_MEMCACHESERVER_H
 #define MUDUO_EXAMPLES_MEMCACHED_SERVER_MEMCACHESERVER_H
 
+#include "EpochManager.h"
 #include "Item.h"
+#include "ItemMap.h"
 #include "Session.h"
+#include "SlabAllocator.h"
 
+#include <muduo/base/Atomic.h>
 #include <muduo/base/Mutex.h>
+#include <muduo/base/ThreadPool.h>
 #include <muduo/net/TcpServer.h>
 #include <examples/wordcount/hash.h>
 
-#include <boost/array.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_array.hpp>
 #include <boost/unordered_map.hpp>
-#include <boost/unordered_set.hpp>
+
+namespace snapshot
+{
+class Reader;
+struct Record;
+}
 
 class MemcacheServer : boost::noncopyable
 {
@@ -23,6 +34,9 @@ class MemcacheServer : boost::noncopyable
     uint16_t udpport;
     uint16_t gperfport;
     int threads;
+    size_t memoryLimit;  // bytes for items, 0 means no limit
+    string snapshotFile;  // empty for none
+    int snapshotInterval;  // seconds between snapshots, 0 for none
   };
 
   MemcacheServer(muduo::net::EventLoop* loop, const Options&);
@@ -34,55 +48,112 @@ class MemcacheServer : boost::noncopyable
 
   time_t startTime() const { return startTime_; }
 
+  // Writes all items to options.snapshotFile, requests are served meanwhile.
+  // start() loads it back.
+  bool saveSnapshot();
+
+  // Allocates from slabs, evicts least recently used items of the same
+  // size when memory limit is reached.  NULL if still out of memory.
+  ItemPtr makeItem(StringPiece key,
+                   uint32_t flags,
+                   int exptime,
+                   int valuelen,
+                   uint64_t cas);
+
+  // Items found stay valid while it is in scope, without a reference.
+  class ReadGuard : boost::noncopyable
+  {
+   public:
+    explicit ReadGuard(const MemcacheServer* server)
+      : guard_(get_pointer(server->epochs_))
+    {
+    }
+
+   private:
+    EpochManager::Guard guard_;
+  };
+
   bool storeItem(const ItemPtr& item, Item::UpdatePolicy policy, bool* exists);
+  // lock free, NULL if not found
+  const Item* findItem(const Item* key, const ReadGuard&) const;
   ConstItemPtr getItem(const ConstItemPtr& key) const;
   bool deleteItem(const ConstItemPtr& key);
 
+  // "STAT name value" lines of group "" or "slabs", false if unknown group
+  bool stats(StringPiece group, muduo::net::Buffer* out) const;
+
  private:
   void onConnection(const muduo::net::TcpConnectionPtr& conn);
+  // on all CPUs, returns number of items loaded
+  size_t loadSnapshot();
+  // in loop thread, skipped if the last one is still running
+  void requestSnapshot();
+  void snapshotInPool();
+  void loadBlocks(const snapshot::Reader* reader,
+                  muduo::AtomicInt32* nextBlock,
+                  muduo::AtomicInt64* loaded);
+  void restoreRecord(const snapshot::Record& record, muduo::AtomicInt64* loaded);
 
   struct Stats;
 
   muduo::net::EventLoop* loop_;  // not own
   Options options_;
   const time_t startTime_;
+  // before items and sessions, they hold chunks
+  boost::scoped_ptr<SlabAllocator> slabs_;
+  boost::scoped_ptr<EpochManager> epochs_;
 
   mutable muduo::MutexLock mutex_;
   boost::unordered_map<string, SessionPtr> sessions_;
 
-  // a complicated solution to save memory
-  struct Hash
+  // readers don't lock
+  struct MapWithLock : boost::noncopyable
   {
-    size_t operator()(const ConstItemPtr& x) const
+    explicit MapWithLock(EpochManager* epochs)
+      : items(epochs)
     {
-      return x->hash();
     }
-  };
 
-  struct Equal
-  {
-    bool operator()(const ConstItemPtr& x, const ConstItemPtr& y) const
-    {
-      return x->key() == y->key();
-    }
+    ItemMap items;
+    mutable muduo::MutexLock mutex;  // for writers
   };
 
-  typedef boost::unordered_set<ConstItemPtr, Hash, Equal> ItemMap;
-
-  struct MapWithLock
+  // Stored items of one slab class, oldest first.  CLOCK: an item touched
+  // since it was last looked at goes to the tail instead of being evicted.
+  struct EvictionQueue
   {
-    ItemMap items;
-    mutable muduo::MutexLock mutex;
+    EvictionQueue() : head(NULL), tail(NULL), size(0) {}
+    Item* head;
+    Item* tail;
+    size_t size;
+    muduo::MutexLock mutex;
   };
 
+  bool appendItem(const ItemPtr& item, Item::UpdatePolicy policy, bool* exists);
+  // with shard mutex held
+  void insertLocked(ItemMap& items, const ConstItemPtr& item);
+  void replaceLocked(ItemMap& items, const Item* oldItem, const ConstItemPtr& item);
+  void eraseLocked(ItemMap& items, const Item* item);
+  void enqueue(const Item* item);
+  void dequeue(const Item* item);
+  // with queue.mutex held
+  static void dequeueLocked(EvictionQueue& queue, Item* item);
+  // false if nothing to evict
+  bool evict(int slabClass);
+
   const static int kShards = 4096;
 
-  boost::array<MapWithLock, kShards> shards_;
+  boost::ptr_vector<MapWithLock> shards_;
+  boost::scoped_array<EvictionQueue> queues_;
 
   // NOT guarded by mutex_, but here because server_ has to destructs before
   // sessions_
   muduo::net::TcpServer server_;
   boost::scoped_ptr<Stats> stats_;
+  muduo::AtomicInt32 snapshotting_;
+  muduo::MutexLock snapshotMutex_;  // one writer of snapshotFile at a time
+  // last, a running snapshot finishes before items go
+  boost::scoped_ptr<muduo::ThreadPool> snapshotPool_;
 };
 
 #endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_MEMCACHESERVER_H
@@ -1,6 +1,10 @@
 #include "Session.h"
 #include "MemcacheServer.h"
 
+#include <muduo/net/Endian.h>
+
+#include <boost/static_assert.hpp>
+
 #ifdef HAVE_TCMALLOC
 #include <google/malloc_extension.h>
 #endif
@@ -14,61 +18,132 @@ static bool isBinaryProtocol(uint8_t firstByte)
 }
 
 const int kLongestKeySize = 250;
+const int kLongestValueSize = 1024*1024;
 string Session::kLongestKey(kLongestKeySize, 'x');
 
-template <typename InputIterator, typename Token>
-bool Session::SpaceSeparator::operator()(InputIterator& next, InputIterator end, Token& tok)
+namespace
 {
-  while (next != end && *next == ' ')
-    ++next;
-  if (next == end)
-  {
-    tok.clear();
-    return false;
-  }
-  InputIterator start(next);
-  const char* sp = static_cast<const char*>(memchr(start, ' ', end - start));
-  if (sp)
+const uint8_t kRequestMagic = 0x80;
+const uint8_t kResponseMagic = 0x81;
+
+enum BinaryOpcode
+{
+  kGet = 0x00,
+  kSet = 0x01,
+  kAdd = 0x02,
+  kReplace = 0x03,
+  kDelete = 0x04,
+  kQuit = 0x07,
+  kGetQ = 0x09,
+  kNoop = 0x0a,
+  kVersion = 0x0b,
+  kGetK = 0x0c,
+  kGetKQ = 0x0d,
+  kAppend = 0x0e,
+  kPrepend = 0x0f,
+  kStat = 0x10,
+  kSetQ = 0x11,
+  kAddQ = 0x12,
+  kReplaceQ = 0x13,
+  kDeleteQ = 0x14,
+  kQuitQ = 0x17,
+  kAppendQ = 0x19,
+  kPrependQ = 0x1a,
+};
+
+enum BinaryStatus
+{
+  kNoError = 0x00,
+  kKeyNotFound = 0x01,
+  kKeyExists = 0x02,
+  kValueTooLarge = 0x03,
+  kInvalidArguments = 0x04,
+  kItemNotStored = 0x05,
+  kUnknownCommand = 0x81,
+  kOutOfMemory = 0x82,
+};
+
+// quiet commands reply on failure only, quiet gets on hit only
+bool isQuiet(uint8_t opcode)
+{
+  switch (opcode)
   {
-    tok.set(start, static_cast<int>(sp - start));
-    next = sp;
+    case kGetQ: case kGetKQ: case kSetQ: case kAddQ: case kReplaceQ:
+    case kDeleteQ: case kQuitQ: case kAppendQ: case kPrependQ:
+      return true;
+    default:
+      return false;
   }
+}
+
+Item::UpdatePolicy updatePolicy(StringPiece command)
+{
+  if (command == "set")
+    return Item::kSet;
+  else if (command == "add")
+    return Item::kAdd;
+  else if (command == "replace")
+    return Item::kReplace;
+  else if (command == "append")
+    return Item::kAppend;
+  else if (command == "prepend")
+    return Item::kPrepend;
+  else if (command == "cas")
+    return Item::kCas;
   else
-  {
-    tok.set(start, static_cast<int>(end - next));
-    next = end;
-  }
-  return true;
+    return Item::kInvalid;
+}
+
+uint32_t readUint32(const char* p)
+{
+  uint32_t x = 0;
+  memcpy(&x, p, sizeof x);
+  return sockets::networkToHost32(x);
+}
 }
 
-struct Session::Reader
+bool Session::Tokenizer::next(StringPiece* token)
 {
-  Reader(Tokenizer::iterator& beg, Tokenizer::iterator end)
-      : first_(beg),
-        last_(end)
+  const char* p = rest_.begin();
+  while (p != rest_.end() && *p == ' ')
+    ++p;
+  if (p == rest_.end())
   {
+    rest_.clear();
+    return false;
   }
+  const char* sp = static_cast<const char*>(memchr(p, ' ', rest_.end() - p));
+  const char* end = sp ? sp : rest_.end();
+  token->set(p, static_cast<int>(end - p));
+  rest_.set(end, static_cast<int>(rest_.end() - end));
+  return true;
+}
 
-  template<typename T>
-  bool read(T* val)
+template<typename T>
+bool Session::Tokenizer::nextNumber(T* value)
+{
+  StringPiece token;
+  if (!next(&token))
+    return false;
+  const char* p = token.begin();
+  const bool negative = p != token.end() && *p == '-';
+  if (negative)
+    ++p;
+  if (p == token.end())
+    return false;
+  uint64_t x = 0;
+  for (; p != token.end(); ++p)
   {
-    if (first_ == last_)
+    if (*p < '0' || *p > '9')
       return false;
-    char* end = NULL;
-    uint64_t x = strtoull((*first_).data(), &end, 10);
-    if (end == (*first_).end())
-    {
-      *val = static_cast<T>(x);
-      ++first_;
-      return true;
-    }
-    return false;
+    uint64_t next = x * 10 + static_cast<uint64_t>(*p - '0');
+    if (next / 10 != x)
+      return false;  // overflow
+    x = next;
   }
-
- private:
-  Tokenizer::iterator first_;
-  Tokenizer::iterator last_;;
-};
+  *value = static_cast<T>(negative ? -x : x);
+  return true;
+}
 
 void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
                         muduo::net::Buffer* buf,
@@ -90,7 +165,10 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
       assert(protocol_ == kAscii || protocol_ == kBinary);
       if (protocol_ == kBinary)
       {
-        // FIXME
+        if (!processBinaryRequest(buf))
+        {
+          break;
+        }
       }
       else  // ASCII protocol
       {
@@ -110,7 +188,7 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
           if (buf->readableBytes() > 1024)
           {
             // FIXME: check for 'get' and 'gets'
-            conn_->shutdown();
+            shutdown();
             // buf->retrieveAll() ???
           }
           break;
@@ -131,16 +209,17 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
     }
   }
   bytesRead_ += initialReadable - buf->readableBytes();
+  // pipelined requests get their replies in one write
+  sendReplies();
 }
 
 void Session::receiveValue(muduo::net::Buffer* buf)
 {
   assert(currItem_.get());
   assert(state_ == kReceiveValue);
-  // if (protocol_ == kBinary)
 
   const size_t avail = std::min(buf->readableBytes(), currItem_->neededBytes());
-  assert(currItem_.unique());
+  assert(currItem_->unique());
   currItem_->append(buf->peek(), avail);
   buf->retrieve(avail);
   if (currItem_->neededBytes() == 0)
@@ -200,7 +279,6 @@ void Session::discardValue(muduo::net::Buffer* buf)
 
 bool Session::processRequest(StringPiece request)
 {
-  assert(command_.empty());
   assert(!noreply_);
   assert(policy_ == Item::kInvalid);
   assert(!currItem_);
@@ -218,30 +296,28 @@ bool Session::processRequest(StringPiece request)
     }
   }
 
-  SpaceSeparator sep;
-  Tokenizer tok(request.begin(), request.end(), sep);
-  Tokenizer::iterator beg = tok.begin();
-  if (beg == tok.end())
+  Tokenizer tok(request);
+  StringPiece command;
+  if (!tok.next(&command))
   {
     reply("ERROR\r\n");
     return true;
   }
-  (*beg).CopyToString(&command_);
-  ++beg;
-  if (command_ == "set" || command_ == "add" || command_ == "replace"
-      || command_ == "append" || command_ == "prepend" || command_ == "cas")
+  policy_ = updatePolicy(command);
+  if (policy_ != Item::kInvalid)
   {
     // this normally returns false
-    return doUpdate(beg, tok.end());
+    return doUpdate(tok);
   }
-  else if (command_ == "get" || command_ == "gets")
+  else if (command == "get" || command == "gets")
   {
-    bool cas = command_ == "gets";
+    bool cas = command == "gets";
 
     // FIXME: send multiple chunks with write complete callback.
-    while (beg != tok.end())
+    MemcacheServer::ReadGuard guard(owner_);
+    StringPiece key;
+    while (tok.next(&key))
     {
-      StringPiece key = *beg;
       bool good = key.size() <= kLongestKeySize;
       if (!good)
       {
@@ -250,28 +326,33 @@ bool Session::processRequest(StringPiece request)
       }
 
       needle_->resetKey(key);
-      ConstItemPtr item = owner_->getItem(needle_);
-      ++beg;
+      const Item* item = owner_->findItem(get_pointer(needle_), guard);
       if (item)
       {
         item->output(&outputBuf_, cas);
       }
     }
     outputBuf_.append("END\r\n");
-
-    if (conn_->outputBuffer()->writableBytes() > 65536 + outputBuf_.readableBytes())
-    {
-      LOG_DEBUG << "shrink output buffer from " << conn_->outputBuffer()->internalCapacity();
-      conn_->outputBuffer()->shrink(65536 + outputBuf_.readableBytes());
-    }
-
-    conn_->send(&outputBuf_);
   }
-  else if (command_ == "delete")
+  else if (command == "delete")
+  {
+    doDelete(tok);
+  }
+  else if (command == "stats")
   {
-    doDelete(beg, tok.end());
+    StringPiece group;
+    tok.next(&group);
+    Buffer stats;
+    if (owner_->stats(group, &stats))
+    {
+      outputBuf_.append(stats.peek(), stats.readableBytes());
+    }
+    else
+    {
+      reply("ERROR\r\n");
+    }
   }
-  else if (command_ == "version")
+  else if (command == "version")
   {
 #ifdef HAVE_TCMALLOC
     reply("VERSION 0.01 muduo with tcmalloc\r\n");
@@ -280,34 +361,33 @@ bool Session::processRequest(StringPiece request)
 #endif
   }
 #ifdef HAVE_TCMALLOC
-  else if (command_ == "memstat")
+  else if (command == "memstat")
   {
     char buf[1024*64];
     MallocExtension::instance()->GetStats(buf, sizeof buf);
     reply(buf);
   }
 #endif
-  else if (command_ == "quit")
+  else if (command == "quit")
   {
-    conn_->shutdown();
+    shutdown();
   }
-  else if (command_ == "shutdown")
+  else if (command == "shutdown")
   {
     // "ERROR: shutdown not enabled"
-    conn_->shutdown();
+    shutdown();
     owner_->stop();
   }
   else
   {
     reply("ERROR\r\n");
-    LOG_INFO << "Unknown command: " << command_;
+    LOG_INFO << "Unknown command: " << command;
   }
   return true;
 }
 
 void Session::resetRequest()
 {
-  command_.clear();
   noreply_ = false;
   policy_ = Item::kInvalid;
   currItem_.reset();
@@ -318,65 +398,56 @@ void Session::reply(muduo::StringPiece msg)
 {
   if (!noreply_)
   {
-    conn_->send(msg.data(), msg.size());
+    outputBuf_.append(msg.data(), msg.size());
   }
 }
 
-bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::iterator end)
+void Session::sendReplies()
 {
-  if (command_ == "set")
-    policy_ = Item::kSet;
-  else if (command_ == "add")
-    policy_ = Item::kAdd;
-  else if (command_ == "replace")
-    policy_ = Item::kReplace;
-  else if (command_ == "append")
-    policy_ = Item::kAppend;
-  else if (command_ == "prepend")
-    policy_ = Item::kPrepend;
-  else if (command_ == "cas")
-    policy_ = Item::kCas;
-  else
-    assert(false);
+  if (outputBuf_.readableBytes() > 0)
+  {
+    if (conn_->outputBuffer()->writableBytes() > 65536 + outputBuf_.readableBytes())
+    {
+      LOG_DEBUG << "shrink output buffer from " << conn_->outputBuffer()->internalCapacity();
+      conn_->outputBuffer()->shrink(65536 + outputBuf_.readableBytes());
+    }
+    conn_->send(&outputBuf_);
+  }
+}
+
+void Session::shutdown()
+{
+  sendReplies();
+  conn_->shutdown();
+}
+
+bool Session::doUpdate(Tokenizer& tok)
+{
+  assert(policy_ != Item::kInvalid);
 
-  // FIXME: check (beg != end)
-  StringPiece key = (*beg);
-  ++beg;
-  bool good = key.size() <= kLongestKeySize;
+  StringPiece key;
+  bool good = tok.next(&key) && key.size() <= kLongestKeySize;
 
   uint32_t flags = 0;
   time_t exptime = 1;
   int bytes = -1;
   uint64_t cas = 0;
 
-  Reader r(beg, end);
-  good = good && r.read(&flags) && r.read(&exptime) && r.read(&bytes);
+  good = good && tok.nextNumber(&flags) && tok.nextNumber(&exptime) && tok.nextNumber(&bytes);
 
-  int rel_exptime = static_cast<int>(exptime);
-  if (exptime > 60*60*24*30)
-  {
-    rel_exptime = static_cast<int>(exptime - owner_->startTime());
-    if (rel_exptime < 1)
-    {
-      rel_exptime = 1;
-    }
-  }
-  else
-  {
-    // rel_exptime = exptime + currentTime;
-  }
+  int rel_exptime = relativeExptime(exptime);
 
   if (good && policy_ == Item::kCas)
   {
-    good = r.read(&cas);
+    good = tok.nextNumber(&cas);
   }
 
-  if (!good)
+  if (!good || bytes < 0)
   {
     reply("CLIENT_ERROR bad command line format\r\n");
     return true;
   }
-  if (bytes > 1024*1024)
+  if (bytes > kLongestValueSize)
   {
     reply("SERVER_ERROR object too large for cache\r\n");
     needle_->resetKey(key);
@@ -387,24 +458,31 @@ bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
   }
   else
   {
-    currItem_ = Item::makeItem(key, flags, rel_exptime, bytes + 2, cas);
+    currItem_ = owner_->makeItem(key, flags, rel_exptime, bytes + 2, cas);
+    if (!currItem_)
+    {
+      reply("SERVER_ERROR out of memory storing object\r\n");
+      needle_->resetKey(key);
+      owner_->deleteItem(needle_);
+      bytesToDiscard_ = bytes + 2;
+      state_ = kDiscardValue;
+      return false;
+    }
     state_ = kReceiveValue;
     return false;
   }
 }
 
-void Session::doDelete(Session::Tokenizer::iterator& beg, Session::Tokenizer::iterator end)
+void Session::doDelete(Tokenizer& tok)
 {
-  assert(command_ == "delete");
-  // FIXME: check (beg != end)
-  StringPiece key = *beg;
-  bool good = key.size() <= kLongestKeySize;
-  ++beg;
+  StringPiece key;
+  bool good = tok.next(&key) && key.size() <= kLongestKeySize;
+  StringPiece extra;
   if (!good)
   {
     reply("CLIENT_ERROR bad command line format\r\n");
   }
-  else if (beg != end && *beg != "0") // issue 108, old protocol
+  else if (tok.next(&extra) && extra != "0") // issue 108, old protocol
   {
     reply("CLIENT_ERROR bad command line format.  Usage: delete <key> [noreply]\r\n");
   }
@@ -421,3 +499,272 @@ void Session::doDelete(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
     }
   }
 }
+
+int Session::relativeExptime(time_t exptime) const
+{
+  int rel_exptime = static_cast<int>(exptime);
+  if (exptime > 60*60*24*30)
+  {
+    rel_exptime = static_cast<int>(exptime - owner_->startTime());
+    if (rel_exptime < 1)
+    {
+      rel_exptime = 1;
+    }
+  }
+  else
+  {
+    // rel_exptime = exptime + currentTime;
+  }
+  return rel_exptime;
+}
+
+bool Session::processBinaryRequest(Buffer* buf)
+{
+  BOOST_STATIC_ASSERT(sizeof(BinaryHeader) == 24);
+  if (buf->readableBytes() < sizeof(BinaryHeader))
+  {
+    return false;
+  }
+  BinaryHeader request;
+  memcpy(&request, buf->peek(), sizeof request);
+  request.keylen = sockets::networkToHost16(request.keylen);
+  request.status = sockets::networkToHost16(request.status);
+  request.bodylen = sockets::networkToHost32(request.bodylen);
+  request.opaque = sockets::networkToHost32(request.opaque);
+  request.cas = sockets::networkToHost64(request.cas);
+
+  if (request.magic != kRequestMagic)
+  {
+    LOG_INFO << "Bad magic " << request.magic;
+    shutdown();
+    buf->retrieveAll();
+    return false;
+  }
+  if (request.bodylen > kLongestValueSize + 8 + kLongestKeySize)
+  {
+    ++requestsProcessed_;
+    binaryReply(request, kValueTooLarge, StringPiece(), StringPiece(), StringPiece(), 0);
+    buf->retrieve(sizeof request);
+    bytesToDiscard_ = request.bodylen;
+    state_ = kDiscardValue;
+    return true;
+  }
+  // whole request at once, no more than one value is buffered
+  if (buf->readableBytes() < sizeof request + request.bodylen)
+  {
+    return false;
+  }
+  ++requestsProcessed_;
+  doBinaryRequest(request, buf->peek() + sizeof request);
+  buf->retrieve(sizeof request + request.bodylen);
+  return true;
+}
+
+void Session::doBinaryRequest(const BinaryHeader& request, const char* body)
+{
+  if (request.extlen + request.keylen > request.bodylen
+      || request.keylen > kLongestKeySize)
+  {
+    binaryReply(request, kInvalidArguments, StringPiece(), StringPiece(), StringPiece(), 0);
+    return;
+  }
+  StringPiece extras(body, request.extlen);
+  StringPiece key(body + request.extlen, request.keylen);
+  StringPiece value(key.end(), static_cast<int>(request.bodylen - request.extlen - request.keylen));
+
+  switch (request.opcode)
+  {
+    case kGet: case kGetQ: case kGetK: case kGetKQ:
+      doBinaryGet(request, key);
+      break;
+    case kSet: case kSetQ: case kAdd: case kAddQ: case kReplace: case kReplaceQ:
+    case kAppend: case kAppendQ: case kPrepend: case kPrependQ:
+      doBinaryUpdate(request, extras, key, value);
+      break;
+    case kDelete: case kDeleteQ:
+      {
+      needle_->resetKey(key);
+      if (owner_->deleteItem(needle_))
+      {
+        binaryReply(request, kNoError, StringPiece(), StringPiece(), StringPiece(), 0);
+      }
+      else
+      {
+        binaryReply(request, kKeyNotFound, StringPiece(), StringPiece(), StringPiece(), 0);
+      }
+      }
+      break;
+    case kNoop:
+      binaryReply(request, kNoError, StringPiece(), StringPiece(), StringPiece(), 0);
+      break;
+    case kVersion:
+      binaryReply(request, kNoError, StringPiece(), StringPiece(), "0.01 muduo", 0);
+      break;
+    case kStat:
+      doBinaryStats(request, key);
+      break;
+    case kQuit: case kQuitQ:
+      binaryReply(request, kNoError, StringPiece(), StringPiece(), StringPiece(), 0);
+      shutdown();
+      break;
+    default:
+      LOG_INFO << "Unknown binary command: " << request.opcode;
+      binaryReply(request, kUnknownCommand, StringPiece(), StringPiece(), StringPiece(), 0);
+      break;
+  }
+}
+
+void Session::doBinaryGet(const BinaryHeader& request, StringPiece key)
+{
+  const bool withKey = request.opcode == kGetK || request.opcode == kGetKQ;
+  MemcacheServer::ReadGuard guard(owner_);
+  needle_->resetKey(key);
+  const Item* item = owner_->findItem(get_pointer(needle_), guard);
+  if (item)
+  {
+    binaryReply(request, item, withKey ? key : StringPiece());
+  }
+  else
+  {
+    binaryReply(request, kKeyNotFound, StringPiece(),
+                withKey ? key : StringPiece(), StringPiece(), 0);
+  }
+}
+
+void Session::doBinaryUpdate(const BinaryHeader& request,
+                             StringPiece extras,
+                             StringPiece key,
+                             StringPiece value)
+{
+  Item::UpdatePolicy policy = Item::kInvalid;
+  switch (request.opcode)
+  {
+    case kSet: case kSetQ:
+      policy = request.cas ? Item::kCas : Item::kSet;
+      break;
+    case kAdd: case kAddQ:
+      policy = Item::kAdd;
+      break;
+    case kReplace: case kReplaceQ:
+      policy = request.cas ? Item::kCas : Item::kReplace;
+      break;
+    case kAppend: case kAppendQ:
+      policy = Item::kAppend;
+      break;
+    case kPrepend: case kPrependQ:
+      policy = Item::kPrepend;
+      break;
+  }
+  const bool appending = policy == Item::kAppend || policy == Item::kPrepend;
+  if (extras.size() != (appending ? 0 : 8) || key.empty())
+  {
+    binaryReply(request, kInvalidArguments, StringPiece(), StringPiece(), StringPiece(), 0);
+    return;
+  }
+  uint32_t flags = appending ? 0 : readUint32(extras.data());
+  uint32_t exptime = appending ? 0 : readUint32(extras.data() + 4);
+
+  ItemPtr item(owner_->makeItem(key, flags, relativeExptime(exptime), value.size() + 2, request.cas));
+  if (!item)
+  {
+    binaryReply(request, kOutOfMemory, StringPiece(), StringPiece(), StringPiece(), 0);
+    return;
+  }
+  item->append(value.data(), value.size());
+  item->append("\r\n", 2);
+
+  bool exists = false;
+  if (owner_->storeItem(item, policy, &exists))
+  {
+    binaryReply(request, kNoError, StringPiece(), StringPiece(), StringPiece(), item->cas());
+  }
+  else if (policy == Item::kAdd || (policy == Item::kCas && exists))
+  {
+    binaryReply(request, kKeyExists, StringPiece(), StringPiece(), StringPiece(), 0);
+  }
+  else if (policy == Item::kReplace || policy == Item::kCas)
+  {
+    binaryReply(request, kKeyNotFound, StringPiece(), StringPiece(), StringPiece(), 0);
+  }
+  else
+  {
+    binaryReply(request, kItemNotStored, StringPiece(), StringPiece(), StringPiece(), 0);
+  }
+}
+
+void Session::doBinaryStats(const BinaryHeader& request, StringPiece group)
+{
+  Buffer stats;
+  if (!owner_->stats(group, &stats))
+  {
+    binaryReply(request, kKeyNotFound, StringPiece(), StringPiece(), StringPiece(), 0);
+    return;
+  }
+  // one reply per "STAT name value" line, and an empty one
+  const char* crlf = NULL;
+  while ((crlf = stats.findCRLF()) != NULL)
+  {
+    Tokenizer tok(StringPiece(stats.peek(), static_cast<int>(crlf - stats.peek())));
+    StringPiece stat, name, value;
+    if (tok.next(&stat) && stat == "STAT" && tok.next(&name) && tok.next(&value))
+    {
+      binaryReply(request, kNoError, StringPiece(), name, value, 0);
+    }
+    stats.retrieveUntil(crlf + 2);
+  }
+  binaryReply(request, kNoError, StringPiece(), StringPiece(), StringPiece(), 0);
+}
+
+void Session::binaryReply(const BinaryHeader& request,
+                          uint16_t status,
+                          StringPiece extras,
+                          StringPiece key,
+                          StringPiece value,
+                          uint64_t cas)
+{
+  if (isQuiet(request.opcode))
+  {
+    const bool get = request.opcode == kGetQ || request.opcode == kGetKQ;
+    if (get == (status != kNoError))
+    {
+      return;
+    }
+  }
+
+  appendBinaryHeader(request, status, extras.size(), key.size(), value.size(), cas);
+  outputBuf_.append(extras.data(), extras.size());
+  outputBuf_.append(key.data(), key.size());
+  outputBuf_.append(value.data(), value.size());
+}
+
+void Session::binaryReply(const BinaryHeader& request,
+                          const Item* item,
+                          StringPiece key)
+{
+  uint32_t flags = sockets::hostToNetwork32(item->flags());
+  appendBinaryHeader(request, kNoError, sizeof flags, key.size(),
+                     item->valueLength() - 2, item->cas());
+  outputBuf_.append(&flags, sizeof flags);
+  outputBuf_.append(key.data(), key.size());
+  item->outputValue(&outputBuf_);
+}
+
+void Session::appendBinaryHeader(const BinaryHeader& request,
+                                 uint16_t status,
+                                 size_t extlen,
+                                 size_t keylen,
+                                 size_t valuelen,
+                                 uint64_t cas)
+{
+  BinaryHeader response;
+  response.magic = kResponseMagic;
+  response.opcode = request.opcode;
+  response.keylen = sockets::hostToNetwork16(static_cast<uint16_t>(keylen));
+  response.extlen = static_cast<uint8_t>(extlen);
+  response.datatype = 0;
+  response.status = sockets::hostToNetwork16(status);
+  response.bodylen = sockets::hostToNetwork32(static_cast<uint32_t>(extlen + keylen + valuelen));
+  response.opaque = sockets::hostToNetwork32(request.opaque);
+  response.cas = sockets::hostToNetwork64(cas);
+  outputBuf_.append(&response, sizeof response);
+}
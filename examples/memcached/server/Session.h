@@ -5,12 +5,12 @@
 
 #include <muduo/base/Logging.h>
 
+#include <muduo/net/ChainBuffer.h>
 #include <muduo/net/TcpConnection.h>
 
 #include <boost/bind.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/noncopyable.hpp>
-#include <boost/tokenizer.hpp>
 
 using muduo::string;
 
@@ -24,7 +24,7 @@ class Session : boost::noncopyable,
     : owner_(owner),
       conn_(conn),
       state_(kNewCommand),
-      protocol_(kAscii), // FIXME
+      protocol_(kAuto),
       noreply_(false),
       policy_(Item::kInvalid),
       bytesToDiscard_(0),
@@ -58,33 +58,84 @@ class Session : boost::noncopyable,
     kAuto,
   };
 
+  // Splits a request line on spaces, without allocation.
+  class Tokenizer
+  {
+   public:
+    explicit Tokenizer(muduo::StringPiece line)
+      : rest_(line)
+    {
+    }
+
+    // false if no more tokens
+    bool next(muduo::StringPiece* token);
+
+    // decimal, a leading '-' wraps around like strtoull()
+    template<typename T>
+    bool nextNumber(T* value);
+
+   private:
+    muduo::StringPiece rest_;
+  };
+
+  // 24 bytes, in network byte order on the wire
+  struct BinaryHeader
+  {
+    uint8_t magic;
+    uint8_t opcode;
+    uint16_t keylen;
+    uint8_t extlen;
+    uint8_t datatype;
+    uint16_t status;  // vbucket id in requests
+    uint32_t bodylen;
+    uint32_t opaque;
+    uint64_t cas;
+  };
+
   void onMessage(const muduo::net::TcpConnectionPtr& conn,
                  muduo::net::Buffer* buf,
                  muduo::Timestamp);
-  void onWriteComplete(const muduo::net::TcpConnectionPtr& conn);
   void receiveValue(muduo::net::Buffer* buf);
   void discardValue(muduo::net::Buffer* buf);
   // TODO: highWaterMark
-  // TODO: onWriteComplete
 
   // returns true if finished a request
   bool processRequest(muduo::StringPiece request);
   void resetRequest();
+  // replies are sent together at the end of onMessage()
   void reply(muduo::StringPiece msg);
-
-  struct SpaceSeparator
-  {
-    void reset() {}
-    template <typename InputIterator, typename Token>
-    bool operator()(InputIterator& next, InputIterator end, Token& tok);
-  };
-
-  typedef boost::tokenizer<SpaceSeparator,
-      const char*,
-      muduo::StringPiece> Tokenizer;
-  struct Reader;
-  bool doUpdate(Tokenizer::iterator& beg, Tokenizer::iterator end);
-  void doDelete(Tokenizer::iterator& beg, Tokenizer::iterator end);
+  void sendReplies();
+  void shutdown();
+
+  bool doUpdate(Tokenizer& tok);
+  void doDelete(Tokenizer& tok);
+  int relativeExptime(time_t exptime) const;
+
+  // returns false if more input is needed
+  bool processBinaryRequest(muduo::net::Buffer* buf);
+  void doBinaryRequest(const BinaryHeader& request, const char* body);
+  void doBinaryGet(const BinaryHeader& request, muduo::StringPiece key);
+  void doBinaryUpdate(const BinaryHeader& request,
+                      muduo::StringPiece extras,
+                      muduo::StringPiece key,
+                      muduo::StringPiece value);
+  void doBinaryStats(const BinaryHeader& request, muduo::StringPiece group);
+  void binaryReply(const BinaryHeader& request,
+                   uint16_t status,
+                   muduo::StringPiece extras,
+                   muduo::StringPiece key,
+                   muduo::StringPiece value,
+                   uint64_t cas);
+  // a hit, the value is not copied if large
+  void binaryReply(const BinaryHeader& request,
+                   const Item* item,
+                   muduo::StringPiece key);
+  void appendBinaryHeader(const BinaryHeader& request,
+                          uint16_t status,
+                          size_t extlen,
+                          size_t keylen,
+                          size_t valuelen,
+                          uint64_t cas);
 
   MemcacheServer* owner_;
   muduo::net::TcpConnectionPtr conn_;
@@ -92,14 +143,13 @@ class Session : boost::noncopyable,
   Protocol protocol_;
 
   // current request
-  string command_;
   bool noreply_;
   Item::UpdatePolicy policy_;
   ItemPtr currItem_;
   size_t bytesToDiscard_;
   // cached
   ItemPtr needle_;
-  muduo::net::Buffer outputBuf_;
+  muduo::net::ChainBuffer outputBuf_;  // replies of this onMessage()
 
   // per session stats
   size_t bytesRead_;
@@ -0,0 +1,152 @@
+#include "SlabAllocator.h"
+
+#include <algorithm>
+
+#include <assert.h>
+#include <stdlib.h>
+
+using namespace muduo;
+
+namespace
+{
+size_t alignUp(size_t size)
+{
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+}
+
+const size_t SlabAllocator::kPageSize;
+const size_t SlabAllocator::kMinChunkSize;
+
+SlabAllocator::SlabClass::SlabClass(size_t size, size_t perPage)
+  : chunkSize(size),
+    chunksPerPage(perPage),
+    freeList(NULL),
+    unused(NULL),
+    usedChunks(0),
+    requestedBytes(0)
+{
+}
+
+SlabAllocator::SlabAllocator(size_t memoryLimit, size_t maxChunkSize, double growthFactor)
+  : memoryLimit_(memoryLimit)
+{
+  assert(growthFactor > 1.0);
+  maxChunkSize = alignUp(maxChunkSize);
+  size_t size = kMinChunkSize;
+  while (size < maxChunkSize)
+  {
+    classes_.push_back(new SlabClass(size, std::max(kPageSize / size, static_cast<size_t>(1))));
+    size_t next = alignUp(static_cast<size_t>(static_cast<double>(size) * growthFactor));
+    size = std::max(next, size + 8);
+  }
+  classes_.push_back(new SlabClass(maxChunkSize, std::max(kPageSize / maxChunkSize, static_cast<size_t>(1))));
+}
+
+SlabAllocator::~SlabAllocator()
+{
+  for (size_t i = 0; i < classes_.size(); ++i)
+  {
+    const std::vector<char*>& pages = classes_[i].pages;
+    for (size_t j = 0; j < pages.size(); ++j)
+    {
+      ::free(pages[j]);
+    }
+  }
+}
+
+int SlabAllocator::classOf(size_t size) const
+{
+  // binary search, classes_ is sorted by chunkSize
+  int lo = 0;
+  int hi = numClasses();
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (classes_[mid].chunkSize < size)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < numClasses() ? lo : -1;
+}
+
+void* SlabAllocator::allocate(int cls, size_t size)
+{
+  SlabClass& slab = classes_[cls];
+  assert(size <= slab.chunkSize);
+  MutexLockGuard lock(slab.mutex);
+  void* chunk = NULL;
+  if (slab.freeList)
+  {
+    chunk = slab.freeList;
+    slab.freeList = slab.freeList->next;
+  }
+  else
+  {
+    if (slab.unused == NULL && !newPage(&slab))
+    {
+      return NULL;
+    }
+    chunk = slab.unused;
+    slab.unused += slab.chunkSize;
+    if (slab.unused == slab.pages.back() + slab.chunkSize * slab.chunksPerPage)
+    {
+      slab.unused = NULL;
+    }
+  }
+  ++slab.usedChunks;
+  slab.requestedBytes += size;
+  return chunk;
+}
+
+void SlabAllocator::deallocate(void* chunk, int cls, size_t size)
+{
+  SlabClass& slab = classes_[cls];
+  FreeChunk* node = static_cast<FreeChunk*>(chunk);
+  MutexLockGuard lock(slab.mutex);
+  node->next = slab.freeList;
+  slab.freeList = node;
+  --slab.usedChunks;
+  slab.requestedBytes -= size;
+}
+
+bool SlabAllocator::newPage(SlabClass* slab)
+{
+  slab->mutex.assertLocked();
+  const int64_t bytes = static_cast<int64_t>(slab->chunkSize * slab->chunksPerPage);
+  if (memoryLimit_ > 0
+      && totalMalloced_.addAndGet(bytes) > static_cast<int64_t>(memoryLimit_))
+  {
+    totalMalloced_.add(-bytes);
+    return false;
+  }
+  else if (memoryLimit_ == 0)
+  {
+    totalMalloced_.add(bytes);
+  }
+
+  char* page = static_cast<char*>(::malloc(bytes));
+  if (page == NULL)
+  {
+    totalMalloced_.add(-bytes);
+    return false;
+  }
+  slab->pages.push_back(page);
+  slab->unused = page;
+  return true;
+}
+
+SlabAllocator::ClassStats SlabAllocator::classStats(int cls) const
+{
+  const SlabClass& slab = classes_[cls];
+  MutexLockGuard lock(slab.mutex);
+  ClassStats stats;
+  stats.chunkSize = slab.chunkSize;
+  stats.chunksPerPage = slab.chunksPerPage;
+  stats.totalPages = slab.pages.size();
+  stats.totalChunks = slab.pages.size() * slab.chunksPerPage;
+  stats.usedChunks = slab.usedChunks;
+  stats.requestedBytes = slab.requestedBytes;
+  return stats;
+}
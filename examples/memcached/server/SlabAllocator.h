@@ -0,0 +1,80 @@
+#ifndef MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
+#define MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/Mutex.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <vector>
+
+// Fixed size chunks carved from pages, like memcached's slabs.
+//
+// Chunk sizes grow by a factor from kMinChunkSize up to maxChunkSize, a
+// request gets a chunk of the smallest class that fits.  Pages are taken
+// from malloc on demand until memoryLimit is reached and are never given
+// back, freed chunks are reused by the same class only.
+// Thread safe, each class has its own lock.
+class SlabAllocator : boost::noncopyable
+{
+ public:
+  static const size_t kPageSize = 1024*1024;
+  static const size_t kMinChunkSize = 64;
+
+  struct ClassStats
+  {
+    size_t chunkSize;
+    size_t chunksPerPage;
+    size_t totalPages;
+    size_t totalChunks;
+    size_t usedChunks;
+    size_t requestedBytes;  // sum of sizes passed to allocate()
+  };
+
+  // memoryLimit 0 means no limit
+  SlabAllocator(size_t memoryLimit, size_t maxChunkSize, double growthFactor = 1.25);
+  ~SlabAllocator();
+
+  // -1 if size is larger than maxChunkSize
+  int classOf(size_t size) const;
+  int numClasses() const { return static_cast<int>(classes_.size()); }
+  size_t chunkSize(int cls) const { return classes_[cls].chunkSize; }
+
+  // Returns NULL if class cls has no free chunk and memoryLimit is reached.
+  void* allocate(int cls, size_t size);
+  void deallocate(void* chunk, int cls, size_t size);
+
+  size_t memoryLimit() const { return memoryLimit_; }
+  size_t totalMalloced() { return static_cast<size_t>(totalMalloced_.get()); }
+  ClassStats classStats(int cls) const;
+
+ private:
+  struct FreeChunk
+  {
+    FreeChunk* next;
+  };
+
+  struct SlabClass : boost::noncopyable
+  {
+    SlabClass(size_t size, size_t perPage);
+
+    const size_t chunkSize;
+    const size_t chunksPerPage;
+    mutable muduo::MutexLock mutex;
+    // guarded by mutex
+    std::vector<char*> pages;
+    FreeChunk* freeList;
+    char* unused;     // never allocated chunks at the end of the last page
+    size_t usedChunks;
+    size_t requestedBytes;
+  };
+
+  bool newPage(SlabClass* slab);
+
+  const size_t memoryLimit_;
+  muduo::AtomicInt64 totalMalloced_;
+  boost::ptr_vector<SlabClass> classes_;
+};
+
+#endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
@@ -0,0 +1,230 @@
+#include "Snapshot.h"
+
+#include <muduo/base/Logging.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace snapshot;
+
+namespace
+{
+const char kMagic[] = "MUDUOMC1";
+const size_t kMagicSize = sizeof kMagic - 1;
+}
+
+const size_t Writer::kBlockSize;
+
+Writer::Writer(const string& path)
+  : path_(path),
+    tmpPath_(path + ".tmp"),
+    fp_(::fopen(tmpPath_.c_str(), "we")),
+    ok_(fp_ != NULL),
+    blockRecords_(0),
+    records_(0),
+    bytes_(0)
+{
+  if (fp_)
+  {
+    write(kMagic, kMagicSize);
+  }
+  else
+  {
+    LOG_SYSERR << "Writer::Writer " << tmpPath_;
+  }
+}
+
+Writer::~Writer()
+{
+  if (fp_)
+  {
+    ::fclose(fp_);
+    ::unlink(tmpPath_.c_str());
+  }
+}
+
+void Writer::append(const Item* item)
+{
+  RecordHeader header;
+  header.cas = item->cas();
+  header.flags = item->flags();
+  header.exptime = item->rel_exptime();
+  header.valuelen = static_cast<uint32_t>(item->valueLength());
+  header.keylen = static_cast<uint32_t>(item->key().size());
+  block_.append(&header, sizeof header);
+  block_.append(item->key().data(), item->key().size());
+  block_.append(item->value(), item->valueLength());
+  ++blockRecords_;
+  ++records_;
+  if (block_.readableBytes() >= kBlockSize)
+  {
+    writeBlock();
+  }
+}
+
+bool Writer::commit()
+{
+  if (block_.readableBytes() > 0)
+  {
+    writeBlock();
+  }
+  writeBlock();  // the empty one
+  if (ok_ && (::fflush(fp_) != 0 || ::fsync(::fileno(fp_)) != 0))
+  {
+    LOG_SYSERR << "Writer::commit " << tmpPath_;
+    ok_ = false;
+  }
+  if (!ok_)
+  {
+    return false;
+  }
+  ::fclose(fp_);
+  fp_ = NULL;
+  if (::rename(tmpPath_.c_str(), path_.c_str()) != 0)
+  {
+    LOG_SYSERR << "Writer::commit rename to " << path_;
+    ::unlink(tmpPath_.c_str());
+    return false;
+  }
+  return true;
+}
+
+void Writer::writeBlock()
+{
+  BlockHeader header;
+  header.records = blockRecords_;
+  header.reserved = 0;
+  header.bytes = block_.readableBytes();
+  write(&header, sizeof header);
+  write(block_.peek(), block_.readableBytes());
+  block_.retrieveAll();
+  blockRecords_ = 0;
+}
+
+void Writer::write(const void* data, size_t len)
+{
+  if (ok_)
+  {
+    size_t n = ::fwrite(data, 1, len, fp_);
+    bytes_ += n;
+    if (n != len)
+    {
+      LOG_SYSERR << "Writer::write " << tmpPath_;
+      ok_ = false;
+    }
+  }
+}
+
+Reader::Reader(const string& path)
+  : start_(NULL),
+    size_(0),
+    valid_(false)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    if (errno != ENOENT)
+    {
+      LOG_SYSERR << "Reader::Reader " << path;
+    }
+    return;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    size_ = static_cast<size_t>(st.st_size);
+    void* p = ::mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
+    {
+      // read ahead while block headers are being walked
+      ::madvise(p, size_, MADV_WILLNEED);
+      start_ = static_cast<const char*>(p);
+      parse();
+    }
+    else
+    {
+      LOG_SYSERR << "Reader::Reader mmap " << path;
+    }
+  }
+  ::close(fd);
+  if (start_ && !valid_)
+  {
+    LOG_ERROR << "Reader::Reader " << path << " is damaged";
+  }
+}
+
+Reader::~Reader()
+{
+  if (start_)
+  {
+    ::munmap(const_cast<char*>(start_), size_);
+  }
+}
+
+void Reader::parse()
+{
+  if (size_ < kMagicSize || memcmp(start_, kMagic, kMagicSize) != 0)
+  {
+    return;
+  }
+  // block headers only, records are checked while being read
+  size_t offset = kMagicSize;
+  while (size_ - offset >= sizeof(BlockHeader))
+  {
+    BlockHeader header;
+    memcpy(&header, start_ + offset, sizeof header);
+    if (header.bytes > size_ - offset - sizeof header)
+    {
+      return;
+    }
+    if (header.records == 0)
+    {
+      valid_ = header.bytes == 0 && offset + sizeof header == size_;
+      return;
+    }
+    blocks_.push_back(start_ + offset);
+    offset += sizeof header + header.bytes;
+  }
+}
+
+bool Reader::readBlock(int block, const RecordCallback& cb) const
+{
+  BlockHeader header;
+  memcpy(&header, blocks_[block], sizeof header);
+  const char* p = blocks_[block] + sizeof header;
+  const char* end = p + header.bytes;
+  for (uint32_t i = 0; i < header.records; ++i)
+  {
+    RecordHeader rh;
+    if (static_cast<size_t>(end - p) < sizeof rh)
+    {
+      return false;
+    }
+    memcpy(&rh, p, sizeof rh);
+    p += sizeof rh;
+    if (rh.keylen > 250 || rh.valuelen < 2
+        || static_cast<size_t>(end - p) < static_cast<size_t>(rh.keylen) + rh.valuelen)
+    {
+      return false;
+    }
+    const char* crlf = p + rh.keylen + rh.valuelen - 2;
+    if (crlf[0] != '\r' || crlf[1] != '\n')
+    {
+      return false;
+    }
+    Record record;
+    record.key = StringPiece(p, static_cast<int>(rh.keylen));
+    record.value = StringPiece(p + rh.keylen, static_cast<int>(rh.valuelen));
+    record.flags = rh.flags;
+    record.exptime = rh.exptime;
+    record.cas = rh.cas;
+    p += rh.keylen + rh.valuelen;
+    cb(record);
+  }
+  return p == end;
+}
@@ -0,0 +1,109 @@
+#ifndef MUDUO_EXAMPLES_MEMCACHED_SERVER_SNAPSHOT_H
+#define MUDUO_EXAMPLES_MEMCACHED_SERVER_SNAPSHOT_H
+
+#include "Item.h"
+
+#include <muduo/net/Buffer.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <vector>
+
+#include <stdio.h>
+
+// On disk format of a cache snapshot, in host byte order:
+//
+//   "MUDUOMC1"
+//   blocks, each a BlockHeader then its records
+//   an empty block, to tell a complete file
+//
+// A record is a RecordHeader then the key and the value with "\r\n".
+// Blocks are about kBlockSize, so that they can be loaded in parallel.
+namespace snapshot
+{
+
+struct BlockHeader
+{
+  uint32_t records;
+  uint32_t reserved;
+  uint64_t bytes;  // of records
+};
+
+struct RecordHeader
+{
+  uint64_t cas;
+  uint32_t flags;
+  int32_t exptime;
+  uint32_t valuelen;
+  uint32_t keylen;
+};
+
+struct Record
+{
+  StringPiece key;
+  StringPiece value;  // with "\r\n"
+  uint32_t flags;
+  int exptime;
+  uint64_t cas;
+};
+
+// Writes to path.tmp, then renames it to path in commit().
+class Writer : boost::noncopyable
+{
+ public:
+  static const size_t kBlockSize = 1024*1024;
+
+  explicit Writer(const string& path);
+  ~Writer();  // removes the temporary file unless committed
+
+  // buffered until the block is full
+  void append(const Item* item);
+  bool commit();
+
+  size_t records() const { return records_; }
+  size_t bytes() const { return bytes_; }
+
+ private:
+  void writeBlock();
+  void write(const void* data, size_t len);
+
+  const string path_;
+  const string tmpPath_;
+  FILE* fp_;
+  bool ok_;
+  muduo::net::Buffer block_;
+  uint32_t blockRecords_;
+  size_t records_;
+  size_t bytes_;
+};
+
+// Maps a snapshot file into memory, blocks may be read by many threads.
+class Reader : boost::noncopyable
+{
+ public:
+  typedef boost::function<void (const Record&)> RecordCallback;
+
+  explicit Reader(const string& path);
+  ~Reader();
+
+  // false if missing or damaged
+  bool valid() const { return valid_; }
+  int numBlocks() const { return static_cast<int>(blocks_.size()); }
+  size_t fileSize() const { return size_; }
+
+  // false if a record is damaged, records before it are passed to cb
+  bool readBlock(int block, const RecordCallback& cb) const;
+
+ private:
+  void parse();
+
+  const char* start_;
+  size_t size_;
+  bool valid_;
+  std::vector<const char*> blocks_;  // headers
+};
+
+}
+
+#endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_SNAPSHOT_H
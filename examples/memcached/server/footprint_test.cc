@@ -1,15 +1,26 @@
 #include "MemcacheServer.h"
+#include <muduo/base/ProcessInfo.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/inspect/ProcessInspector.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #ifdef HAVE_TCMALLOC
 #include <google/heap-profiler.h>
 #include <google/malloc_extension.h>
 #endif
 
+using namespace muduo;
 using namespace muduo::net;
 
+// in kB
+long residentSize()
+{
+  string status = ProcessInfo::procStatus();
+  size_t pos = status.find("VmRSS:");
+  return pos != string::npos ? atol(status.c_str() + pos + 6) : 0;
+}
+
 int main(int argc, char* argv[])
 {
 #ifdef HAVE_TCMALLOC
@@ -18,19 +29,23 @@ int main(int argc, char* argv[])
   int items = argc > 1 ? atoi(argv[1]) : 10000;
   int keylen = argc > 2 ? atoi(argv[2]) : 10;
   int valuelen = argc > 3 ? atoi(argv[3]) : 100;
+  int memoryMb = argc > 4 ? atoi(argv[4]) : 0;
   EventLoop loop;
   MemcacheServer::Options options;
+  options.memoryLimit = static_cast<size_t>(memoryMb) * 1024 * 1024;
   MemcacheServer server(&loop, options);
 
-  printf("sizeof(Item) = %zd\npid = %d\nitems = %d\nkeylen = %d\nvaluelen = %d\n",
-         sizeof(Item), getpid(), items, keylen, valuelen);
+  printf("sizeof(Item) = %zd\npid = %d\nitems = %d\nkeylen = %d\nvaluelen = %d\nmemory = %dMB\n",
+         sizeof(Item), getpid(), items, keylen, valuelen, memoryMb);
+  const long rssBefore = residentSize();
   char key[256] = { 0 };
   string value;
   for (int i = 0; i < items; ++i)
   {
     snprintf(key, sizeof key, "%0*d", keylen, i);
     value.assign(valuelen, "0123456789"[i % 10]);
-    ItemPtr item(Item::makeItem(key, 0, 0, valuelen+2, 1));
+    ItemPtr item(server.makeItem(key, 0, 0, valuelen+2, 1));
+    assert(item);
     item->append(value.data(), value.size());
     item->append("\r\n", 2);
     assert(item->endsWithCRLF());
@@ -39,10 +54,21 @@ int main(int argc, char* argv[])
     assert(stored); (void) stored;
     assert(!exists);
   }
+  const long rssAfter = residentSize();
   Inspector::ArgList arg;
   printf("==========\n%s\n",
          ProcessInspector::overview(HttpRequest::kGet, arg).c_str());
-  // TODO: print bytes per item, overhead percent
+
+  Buffer stats;
+  server.stats("", &stats);
+  server.stats("slabs", &stats);
+  printf("==========\n%s", stats.retrieveAllAsString().c_str());
+
+  // payload is key and value with its CRLF, as stored
+  const double payload = keylen + valuelen + 2;
+  const double bytesPerItem = static_cast<double>(rssAfter - rssBefore) * 1024 / items;
+  printf("==========\nbytes per item = %.1f\noverhead = %.1f%%\n",
+         bytesPerItem, (bytesPerItem - payload) * 100 / payload);
   fflush(stdout);
 #ifdef HAVE_TCMALLOC
   char buf[8192];
@@ -14,6 +14,7 @@ bool parseCommandLine(int argc, char* argv[], MemcacheServer::Options* options)
   options->tcpport = 11211;
   options->gperfport = 11212;
   options->threads = 4;
+  size_t memoryMb = 64;
 
   po::options_description desc("Allowed options");
   desc.add_options()
@@ -22,11 +23,17 @@ bool parseCommandLine(int argc, char* argv[], MemcacheServer::Options* options)
       ("udpport,U", po::value<uint16_t>(&options->udpport), "UDP port")
       ("gperf,g", po::value<uint16_t>(&options->gperfport), "port for gperftools")
       ("threads,t", po::value<int>(&options->threads), "Number of worker threads")
+      ("memory,m", po::value<size_t>(&memoryMb), "Item memory in megabytes, 0 for no limit")
+      ("snapshot,s", po::value<string>(&options->snapshotFile),
+       "Snapshot file, loaded at start and written at exit")
+      ("snapshot-interval", po::value<int>(&options->snapshotInterval),
+       "Seconds between background snapshots, 0 for none")
       ;
 
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
   po::notify(vm);
+  options->memoryLimit = memoryMb * 1024 * 1024;
 
   if (vm.count("help"))
   {
@@ -50,6 +57,10 @@ int main(int argc, char* argv[])
     server.setThreadNum(options.threads);
     server.start();
     loop.loop();
+    if (!options.snapshotFile.empty())
+    {
+      server.saveSnapshot();
+    }
   }
 }
 
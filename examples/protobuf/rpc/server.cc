@@ -1,6 +1,7 @@
 #include <examples/protobuf/rpc/sudoku.pb.h>
 
 #include <muduo/base/Logging.h>
+#include <muduo/base/ThreadPool.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/protorpc/RpcServer.h>
 
@@ -29,14 +30,26 @@ class SudokuServiceImpl : public SudokuService
 
 }
 
-int main()
+int main(int argc, char* argv[])
 {
   LOG_INFO << "pid = " << getpid();
+  // solving is CPU bound, keep it out of the IO thread
+  int numThreads = argc > 1 ? atoi(argv[1]) : 0;
   EventLoop loop;
   InetAddress listenAddr(9981);
   sudoku::SudokuServiceImpl impl;
+  ThreadPool pool;
   RpcServer server(&loop, listenAddr);
-  server.registerService(&impl);
+  if (numThreads > 0)
+  {
+    pool.start(numThreads);
+    server.registerService(&impl, &pool);
+    server.setMethodConcurrency("sudoku.SudokuService.Solve", numThreads * 16, true);
+  }
+  else
+  {
+    server.registerService(&impl);
+  }
   server.start();
   loop.loop();
   google::protobuf::ShutdownProtobufLibrary();
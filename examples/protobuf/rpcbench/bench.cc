@@ -0,0 +1,472 @@
+// RPC load generator, reports throughput and latency percentiles.
+//
+// Without a server address, a RpcServer with EchoService is started
+// on loopback, with -T IO threads and -w worker threads.
+//
+// Each connection keeps -d calls of -s bytes in flight (closed loop),
+// a reply is followed by a new call at once.
+
+#include <examples/protobuf/rpcbench/echo.pb.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/LatencyHistogram.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/ThreadPool.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/EventLoopThreadPool.h>
+#include <muduo/net/InetAddress.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/protorpc/RpcChannel.h>
+#include <muduo/net/protorpc/RpcController.h>
+#include <muduo/net/protorpc/RpcServer.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+struct Options
+{
+  Options()
+    : threads(1),
+      connections(1),
+      seconds(10),
+      depth(1),
+      payloadSize(64),
+      checksum(ProtobufCodecLite::kAdler32),
+      serverThreads(1),
+      workerThreads(0),
+      port(18888)
+  {
+  }
+
+  int threads;
+  int connections;
+  int seconds;
+  int depth;          // calls in flight per connection
+  int payloadSize;
+  ProtobufCodecLite::ChecksumType checksum;
+  int serverThreads;  // IO threads of embedded server
+  int workerThreads;  // method threads of embedded server, 0 runs in IO thread
+  uint16_t port;
+  string ip;          // empty for embedded server
+};
+
+int64_t nowMicroSeconds()
+{
+  return Timestamp::now().microSecondsSinceEpoch();
+}
+
+class Session : boost::noncopyable
+{
+ public:
+  Session(EventLoop* loop,
+          const InetAddress& serverAddr,
+          const string& name,
+          const Options& options,
+          const echo::EchoRequest& request)
+    : client_(loop, serverAddr, name),
+      channel_(new RpcChannel),
+      stub_(get_pointer(channel_)),
+      options_(options),
+      request_(request),
+      running_(true),
+      responses_(0),
+      errors_(0)
+  {
+    client_.setConnectionCallback(
+        boost::bind(&Session::onConnection, this, _1));
+    client_.setMessageCallback(
+        boost::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
+    channel_->setChecksumType(options.checksum);
+    channel_->setDefaultTimeout(0);
+  }
+
+  ~Session()
+  {
+    if (conn_)
+    {
+      conn_->setConnectionCallback(defaultConnectionCallback);
+      conn_->setMessageCallback(defaultMessageCallback);
+    }
+  }
+
+  void start()
+  {
+    client_.connect();
+  }
+
+  void stop()
+  {
+    running_ = false;
+    client_.stop();
+    client_.disconnect();
+  }
+
+  const LatencyHistogram& latency() const { return latency_; }
+  int64_t responses() const { return responses_; }
+  int64_t errors() const { return errors_; }
+
+ private:
+  struct Call
+  {
+    RpcController controller;
+    int64_t start;
+  };
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      if (!running_)
+      {
+        conn->shutdown();
+        return;
+      }
+      conn->setTcpNoDelay(true);
+      conn_ = conn;
+      channel_->setConnection(conn);
+      for (int i = 0; i < options_.depth; ++i)
+      {
+        sendRequest();
+      }
+    }
+    else
+    {
+      conn_.reset();
+      channel_->failOutstandingCalls();
+    }
+  }
+
+  void sendRequest()
+  {
+    Call* call = new Call;
+    call->start = nowMicroSeconds();
+    // deleted by channel after replied()
+    echo::EchoResponse* response = new echo::EchoResponse;
+    stub_.Echo(&call->controller, &request_, response,
+               NewCallback(this, &Session::replied, call, response));
+  }
+
+  void replied(Call* call, echo::EchoResponse* response)
+  {
+    boost::scoped_ptr<Call> guard(call);
+    if (!running_)
+    {
+      return;
+    }
+    if (call->controller.Failed()
+        || response->payload().size() != request_.payload().size())
+    {
+      ++errors_;
+    }
+    else
+    {
+      latency_.record(nowMicroSeconds() - call->start);
+      ++responses_;
+    }
+    if (conn_)
+    {
+      sendRequest();
+    }
+  }
+
+  TcpClient client_;
+  RpcChannelPtr channel_;
+  echo::EchoService::Stub stub_;
+  const Options& options_;
+  const echo::EchoRequest& request_;
+  bool running_;
+  TcpConnectionPtr conn_;
+  LatencyHistogram latency_;
+  int64_t responses_;
+  int64_t errors_;
+};
+
+typedef boost::shared_ptr<Session> SessionPtr;
+
+// sessions of one IO loop
+class Worker : boost::noncopyable
+{
+ public:
+  explicit Worker(EventLoop* loop)
+    : loop_(loop)
+  {
+  }
+
+  EventLoop* getLoop() const { return loop_; }
+
+  void add(const SessionPtr& session)
+  { sessions_.push_back(session); }
+
+  void start()
+  {
+    for (size_t i = 0; i < sessions_.size(); ++i)
+    {
+      sessions_[i]->start();
+    }
+  }
+
+  void stop(CountDownLatch* latch)
+  {
+    for (size_t i = 0; i < sessions_.size(); ++i)
+    {
+      sessions_[i]->stop();
+    }
+    latch->countDown();
+  }
+
+  void destroy(CountDownLatch* latch)
+  {
+    sessions_.clear();
+    latch->countDown();
+  }
+
+  const std::vector<SessionPtr>& sessions() const
+  { return sessions_; }
+
+ private:
+  EventLoop* loop_;
+  std::vector<SessionPtr> sessions_;
+};
+
+typedef boost::shared_ptr<Worker> WorkerPtr;
+
+class Benchmark : boost::noncopyable
+{
+ public:
+  Benchmark(EventLoop* loop, const InetAddress& serverAddr, const Options& options)
+    : loop_(loop),
+      threadPool_(loop),
+      options_(options)
+  {
+    request_.set_payload(std::string(options.payloadSize, 'x'));
+
+    threadPool_.setThreadNum(options.threads);
+    threadPool_.start();
+    std::vector<EventLoop*> loops = threadPool_.getAllLoops();
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+      workers_.push_back(WorkerPtr(new Worker(loops[i])));
+    }
+    for (int i = 0; i < options.connections; ++i)
+    {
+      char name[32];
+      snprintf(name, sizeof name, "C%05d", i);
+      Worker* worker = get_pointer(workers_[static_cast<size_t>(i) % workers_.size()]);
+      worker->add(SessionPtr(new Session(worker->getLoop(), serverAddr, name, options_, request_)));
+    }
+  }
+
+  void start()
+  {
+    start_ = Timestamp::now();
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+      workers_[i]->getLoop()->runInLoop(boost::bind(&Worker::start, get_pointer(workers_[i])));
+    }
+    loop_->runAfter(options_.seconds, boost::bind(&Benchmark::stop, this));
+  }
+
+ private:
+  void stop()
+  {
+    CountDownLatch latch(static_cast<int>(workers_.size()));
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+      workers_[i]->getLoop()->runInLoop(boost::bind(&Worker::stop, get_pointer(workers_[i]), &latch));
+    }
+    latch.wait();
+    report(timeDifference(Timestamp::now(), start_));
+    // let connections close
+    loop_->runAfter(0.5, boost::bind(&Benchmark::quit, this));
+  }
+
+  void quit()
+  {
+    CountDownLatch latch(static_cast<int>(workers_.size()));
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+      workers_[i]->getLoop()->runInLoop(boost::bind(&Worker::destroy, get_pointer(workers_[i]), &latch));
+    }
+    latch.wait();
+    loop_->runAfter(0.1, boost::bind(&EventLoop::quit, loop_));
+  }
+
+  void report(double seconds)
+  {
+    LatencyHistogram latency;
+    int64_t responses = 0;
+    int64_t errors = 0;
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+      const std::vector<SessionPtr>& sessions = workers_[i]->sessions();
+      for (size_t j = 0; j < sessions.size(); ++j)
+      {
+        latency.merge(sessions[j]->latency());
+        responses += sessions[j]->responses();
+        errors += sessions[j]->errors();
+      }
+    }
+
+    printf("%d threads, %d connections, depth %d, payload %d bytes, checksum %d\n",
+           options_.threads, options_.connections, options_.depth,
+           options_.payloadSize, options_.checksum);
+    printf("%" PRId64 " calls, %" PRId64 " errors in %.2f seconds\n", responses, errors, seconds);
+    printf("%.1f calls/s, %.2f MiB/s payload each way\n",
+           static_cast<double>(responses) / seconds,
+           static_cast<double>(responses) * options_.payloadSize / seconds / 1024 / 1024);
+    printf("latency us: mean %.1f p50 %" PRId64 " p90 %" PRId64 " p99 %" PRId64
+           " p99.9 %" PRId64 " max %" PRId64 "\n",
+           latency.mean(), latency.percentile(50), latency.percentile(90),
+           latency.percentile(99), latency.percentile(99.9), latency.max());
+    fflush(stdout);
+  }
+
+  EventLoop* loop_;
+  EventLoopThreadPool threadPool_;
+  const Options& options_;
+  echo::EchoRequest request_;
+  Timestamp start_;
+  std::vector<WorkerPtr> workers_;
+};
+
+namespace echo
+{
+
+class EchoServiceImpl : public EchoService
+{
+ public:
+  virtual void Echo(::google::protobuf::RpcController* controller,
+                    const ::echo::EchoRequest* request,
+                    ::echo::EchoResponse* response,
+                    ::google::protobuf::Closure* done)
+  {
+    response->set_payload(request->payload());
+    done->Run();
+  }
+};
+
+}
+
+// RpcServer on loopback, in its own thread
+class EmbeddedServer : boost::noncopyable
+{
+ public:
+  explicit EmbeddedServer(const Options& options)
+    : loop_(thread_.startLoop()),
+      workers_("EchoWorker")
+  {
+    if (options.workerThreads > 0)
+    {
+      workers_.start(options.workerThreads);
+    }
+    CountDownLatch latch(1);
+    loop_->runInLoop(boost::bind(&EmbeddedServer::startInLoop, this, options, &latch));
+    latch.wait();
+  }
+
+  ~EmbeddedServer()
+  {
+    CountDownLatch latch(1);
+    loop_->runInLoop(boost::bind(&EmbeddedServer::stopInLoop, this, &latch));
+    latch.wait();
+  }
+
+ private:
+  void startInLoop(const Options& options, CountDownLatch* latch)
+  {
+    server_.reset(new RpcServer(loop_, InetAddress(options.port, true)));
+    server_->setThreadNum(options.serverThreads);
+    if (options.workerThreads > 0)
+    {
+      server_->registerService(&impl_, &workers_);
+    }
+    else
+    {
+      server_->registerService(&impl_);
+    }
+    server_->start();
+    latch->countDown();
+  }
+
+  void stopInLoop(CountDownLatch* latch)
+  {
+    server_.reset();
+    latch->countDown();
+  }
+
+  EventLoopThread thread_;
+  EventLoop* loop_;
+  echo::EchoServiceImpl impl_;
+  ThreadPool workers_;
+  boost::scoped_ptr<RpcServer> server_;
+};
+
+void usage(const char* prog)
+{
+  printf("Usage: %s [-t threads] [-c connections] [-n seconds] [-d depth] [-s payload_size]\n"
+         "          [-x checksum] [-T server_threads] [-w worker_threads] [-p port] [ip]\n"
+         "checksum is 0 for adler32, 1 for crc32c, 2 for none.\n"
+         "Starts a RpcServer on 127.0.0.1:port if ip is not given.\n", prog);
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:c:n:d:s:x:T:w:p:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 't': options.threads = atoi(optarg); break;
+      case 'c': options.connections = atoi(optarg); break;
+      case 'n': options.seconds = atoi(optarg); break;
+      case 'd': options.depth = atoi(optarg); break;
+      case 's': options.payloadSize = atoi(optarg); break;
+      case 'x': options.checksum = static_cast<ProtobufCodecLite::ChecksumType>(atoi(optarg)); break;
+      case 'T': options.serverThreads = atoi(optarg); break;
+      case 'w': options.workerThreads = atoi(optarg); break;
+      case 'p': options.port = static_cast<uint16_t>(atoi(optarg)); break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (optind < argc)
+  {
+    options.ip = argv[optind];
+  }
+  if (options.connections <= 0 || options.depth <= 0 || options.seconds <= 0
+      || options.payloadSize < 0
+      || options.checksum < ProtobufCodecLite::kAdler32
+      || options.checksum > ProtobufCodecLite::kNoChecksum)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Logger::setLogLevel(Logger::WARN);
+  boost::scoped_ptr<EmbeddedServer> server;
+  if (options.ip.empty())
+  {
+    options.ip = "127.0.0.1";
+    server.reset(new EmbeddedServer(options));
+    printf("RpcServer on loopback, %d IO threads, %d worker threads\n",
+           options.serverThreads, options.workerThreads);
+  }
+
+  EventLoop loop;
+  Benchmark bench(&loop, InetAddress(options.ip, options.port), options);
+  bench.start();
+  loop.loop();
+}
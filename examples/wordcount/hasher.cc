@@ -1,5 +1,11 @@
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+
+#include <muduo/base/Atomic.h>
 #include <muduo/base/CountDownLatch.h>
 #include <muduo/base/Logging.h>
+#include <muduo/base/Thread.h>
 #include <muduo/net/EventLoopThread.h>
 #include <muduo/net/TcpClient.h>
 
@@ -10,19 +16,28 @@
 
 #include <examples/wordcount/hash.h>
 
-#include <fstream>
-#include <iostream>
+#include <algorithm>
+#include <vector>
 
-#include <stdio.h>
-#define __STDC_FORMAT_MACROS
+#include <fcntl.h>
 #include <inttypes.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
 size_t g_batchSize = 65536;
 const size_t kMaxHashSize = 10 * 1000 * 1000;
+const size_t kMinChunkSize = 1024 * 1024;
+
+// Words point into mapped input files, so counting allocates nothing.
+typedef boost::unordered_map<StringPiece, int64_t, WordHash> LocalCountMap;
 
+// Sends batches on one connection, blocks senders while its output
+// buffer is over the high water mark.  Thread safe.
 class SendThrottler : boost::noncopyable
 {
  public:
@@ -46,28 +61,16 @@ class SendThrottler : boost::noncopyable
 
   void disconnect()
   {
-    if (buffer_.readableBytes() > 0)
-    {
-      LOG_DEBUG << "send " << buffer_.readableBytes() << " bytes";
-      conn_->send(&buffer_);
-    }
     conn_->shutdown();
     disconnectLatch_.wait();
   }
 
-  void send(const string& word, int64_t count)
+  // retrieves all of batch
+  void send(Buffer* batch)
   {
-    buffer_.append(word);
-    // FIXME: use LogStream
-    char buf[64];
-    snprintf(buf, sizeof buf, "\t%" PRId64 "\r\n", count);
-    buffer_.append(buf);
-    if (buffer_.readableBytes() >= g_batchSize)
-    {
-      throttle();
-      LOG_TRACE << "send " << buffer_.readableBytes();
-      conn_->send(&buffer_);
-    }
+    throttle();
+    LOG_TRACE << "send " << batch->readableBytes();
+    conn_->send(batch);
   }
 
  private:
@@ -103,7 +106,8 @@ class SendThrottler : boost::noncopyable
     congestion_ = false;
     if (oldCong)
     {
-      cond_.notify();
+      // workers share this connection
+      cond_.notifyAll();
     }
   }
 
@@ -121,17 +125,87 @@ class SendThrottler : boost::noncopyable
   TcpConnectionPtr conn_;
   CountDownLatch connectLatch_;
   CountDownLatch disconnectLatch_;
-  Buffer buffer_;
 
   MutexLock mutex_;
   Condition cond_;
   bool congestion_;
 };
 
+// An input file mapped into memory.
+class InputFile : boost::noncopyable
+{
+ public:
+  explicit InputFile(const char* filename)
+    : start_(NULL),
+      size_(0)
+  {
+    int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd >= 0 && ::fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      size_ = static_cast<size_t>(st.st_size);
+      void* p = ::mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED)
+      {
+        ::madvise(p, size_, MADV_SEQUENTIAL);
+        start_ = static_cast<const char*>(p);
+      }
+    }
+    if (start_ == NULL && (fd < 0 || size_ > 0))
+    {
+      LOG_SYSFATAL << "InputFile " << filename;
+    }
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+  }
+
+  ~InputFile()
+  {
+    if (start_)
+    {
+      ::munmap(const_cast<char*>(start_), size_);
+    }
+  }
+
+  size_t size() const { return size_; }
+
+  // chunks of about chunkSize, ending at whitespace so no word is split
+  void split(size_t chunkSize, std::vector<StringPiece>* chunks) const
+  {
+    const char* end = start_ + size_;
+    const char* begin = start_;
+    while (begin < end)
+    {
+      const char* stop = begin + std::min(chunkSize, static_cast<size_t>(end - begin));
+      while (stop < end && !isSpace(*stop))
+      {
+        ++stop;
+      }
+      chunks->push_back(StringPiece(begin, static_cast<int>(stop - begin)));
+      begin = stop;
+    }
+  }
+
+  // as std::istream >> string
+  static bool isSpace(char c)
+  {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+  }
+
+ private:
+  const char* start_;
+  size_t size_;
+};
+
+// Input files are split into chunks, worker threads count words of
+// chunks in their own maps, then shard them into batches, one for
+// each receiver.  Worker i sends on connection i % connections.
 class WordCountSender : boost::noncopyable
 {
  public:
-  explicit WordCountSender(const std::string& receivers);
+  WordCountSender(const std::string& receivers, int connections);
 
   void connectAll()
   {
@@ -151,20 +225,39 @@ class WordCountSender : boost::noncopyable
     LOG_INFO << "All disconnected";
   }
 
-  void processFile(const char* filename);
+  void addFile(const char* filename)
+  {
+    files_.push_back(new InputFile(filename));
+  }
+
+  void process(int numThreads);
 
  private:
-  EventLoopThread loopThread_;
-  EventLoop* loop_;
+  void work(int worker, int numThreads);
+  void shard(LocalCountMap* wordcounts, std::vector<Buffer>* batches, int worker);
+
+  SendThrottler& bucket(int worker, size_t receiver)
+  {
+    return buckets_[(worker % connections_) * receivers_ + receiver];
+  }
+
+  const int connections_;
+  size_t receivers_;
+  boost::ptr_vector<EventLoopThread> loopThreads_;  // one for each connection
   boost::ptr_vector<SendThrottler> buckets_;
+  boost::ptr_vector<InputFile> files_;
+  std::vector<StringPiece> chunks_;
+  AtomicInt32 nextChunk_;
 };
 
-WordCountSender::WordCountSender(const std::string& receivers)
-  : loop_(loopThread_.startLoop())
+WordCountSender::WordCountSender(const std::string& receivers, int connections)
+  : connections_(connections),
+    receivers_(0)
 {
   typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
   boost::char_separator<char> sep(", ");
   tokenizer tokens(receivers, sep);
+  std::vector<InetAddress> addrs;
   for (tokenizer::iterator tok_iter = tokens.begin();
        tok_iter != tokens.end(); ++tok_iter)
   {
@@ -173,45 +266,119 @@ WordCountSender::WordCountSender(const std::string& receivers)
     if (colon != std::string::npos)
     {
       uint16_t port = static_cast<uint16_t>(atoi(&ipport[colon+1]));
-      InetAddress addr(ipport.substr(0, colon), port);
-      buckets_.push_back(new SendThrottler(loop_, addr));
+      addrs.push_back(InetAddress(ipport.substr(0, colon), port));
     }
     else
     {
       assert(0 && "Invalid address");
     }
   }
+  receivers_ = addrs.size();
+  for (int i = 0; i < connections_; ++i)
+  {
+    loopThreads_.push_back(new EventLoopThread);
+    EventLoop* loop = loopThreads_.back().startLoop();
+    for (size_t j = 0; j < addrs.size(); ++j)
+    {
+      buckets_.push_back(new SendThrottler(loop, addrs[j]));
+    }
+  }
+}
+
+void WordCountSender::process(int numThreads)
+{
+  size_t total = 0;
+  for (size_t i = 0; i < files_.size(); ++i)
+  {
+    total += files_[i].size();
+  }
+  // a few chunks for each thread, so that they finish together
+  const size_t chunkSize = std::max(total / (numThreads * 8), kMinChunkSize);
+  for (size_t i = 0; i < files_.size(); ++i)
+  {
+    files_[i].split(chunkSize, &chunks_);
+  }
+  LOG_INFO << "process " << total << " bytes in " << chunks_.size()
+           << " chunks with " << numThreads << " threads";
+
+  boost::ptr_vector<Thread> threads;
+  for (int i = 0; i < numThreads; ++i)
+  {
+    char name[32];
+    snprintf(name, sizeof name, "worker%d", i);
+    threads.push_back(new Thread(
+          boost::bind(&WordCountSender::work, this, i, numThreads), name));
+    threads.back().start();
+  }
+  for (int i = 0; i < numThreads; ++i)
+  {
+    threads[i].join();
+  }
 }
 
-void WordCountSender::processFile(const char* filename)
+void WordCountSender::work(int worker, int numThreads)
 {
-  LOG_INFO << "processFile " << filename;
-  WordCountMap wordcounts;
-  // FIXME: use mmap to read file
-  std::ifstream in(filename);
-  string word;
-  // FIXME: make local hash optional.
-  boost::hash<string> hash;
-  while (in)
-  {
-    wordcounts.clear();
-    while (in >> word)
-    {
-      wordcounts[word] += 1;
-      if (wordcounts.size() > kMaxHashSize)
+  LocalCountMap wordcounts;
+  std::vector<Buffer> batches(receivers_);
+  const size_t maxHashSize = kMaxHashSize / numThreads;
+  int i = 0;
+  while ((i = nextChunk_.getAndAdd(1)) < static_cast<int>(chunks_.size()))
+  {
+    const char* p = chunks_[i].begin();
+    const char* end = chunks_[i].end();
+    while (p < end)
+    {
+      while (p < end && InputFile::isSpace(*p))
       {
-        break;
+        ++p;
+      }
+      const char* word = p;
+      while (p < end && !InputFile::isSpace(*p))
+      {
+        ++p;
+      }
+      if (p > word)
+      {
+        wordcounts[StringPiece(word, static_cast<int>(p - word))] += 1;
+        if (wordcounts.size() > maxHashSize)
+        {
+          shard(&wordcounts, &batches, worker);
+        }
       }
     }
+  }
+  shard(&wordcounts, &batches, worker);
+  for (size_t j = 0; j < batches.size(); ++j)
+  {
+    if (batches[j].readableBytes() > 0)
+    {
+      bucket(worker, j).send(&batches[j]);
+    }
+  }
+}
 
-    LOG_INFO << "send " << wordcounts.size() << " records";
-    for (WordCountMap::iterator it = wordcounts.begin();
-         it != wordcounts.end(); ++it)
+void WordCountSender::shard(LocalCountMap* wordcounts,
+                            std::vector<Buffer>* batches,
+                            int worker)
+{
+  LOG_INFO << "send " << wordcounts->size() << " records";
+  WordHash hash;
+  for (LocalCountMap::iterator it = wordcounts->begin();
+       it != wordcounts->end(); ++it)
+  {
+    size_t idx = hash(it->first) % receivers_;
+    Buffer& batch = (*batches)[idx];
+    batch.append(it->first.data(), it->first.size());
+    // FIXME: use LogStream
+    char buf[64];
+    snprintf(buf, sizeof buf, "\t%" PRId64 "\r\n", it->second);
+    batch.append(buf);
+    if (batch.readableBytes() >= g_batchSize)
     {
-      size_t idx = hash(it->first) % buckets_.size();
-      buckets_[idx].send(it->first, it->second);
+      bucket(worker, idx).send(&batch);
     }
   }
+  wordcounts->clear();
 }
 
 int main(int argc, char* argv[])
@@ -220,6 +387,8 @@ int main(int argc, char* argv[])
   {
     printf("Usage: %s addresses_of_receivers input_file1 [input_file2]* \n", argv[0]);
     printf("Example: %s 'ip1:port1,ip2:port2,ip3:port3' input_file1 input_file2 \n", argv[0]);
+    printf("Environment: BATCH_SIZE, THREADS (default number of CPUs), "
+           "CONNECTIONS to each receiver (default 1)\n");
   }
   else
   {
@@ -228,12 +397,18 @@ int main(int argc, char* argv[])
     {
       g_batchSize = atoi(batchSize);
     }
-    WordCountSender sender(argv[1]);
-    sender.connectAll();
+    const char* threads = ::getenv("THREADS");
+    int numThreads = threads ? atoi(threads)
+                             : static_cast<int>(::sysconf(_SC_NPROCESSORS_ONLN));
+    const char* connections = ::getenv("CONNECTIONS");
+    int numConnections = connections ? atoi(connections) : 1;
+    WordCountSender sender(argv[1], std::max(numConnections, 1));
     for (int i = 2; i < argc; ++i)
     {
-      sender.processFile(argv[i]);
+      sender.addFile(argv[i]);
     }
+    sender.connectAll();
+    sender.process(std::max(numThreads, 1));
     sender.disconnectAll();
   }
 }
@@ -1,4 +1,7 @@
+#include <muduo/base/Atomic.h>
 #include <muduo/base/Logging.h>
+#include <muduo/base/Mutex.h>
+#include <muduo/base/ThreadLocalSingleton.h>
 #include <muduo/net/EventLoop.h>
 #include <muduo/net/TcpServer.h>
 
@@ -8,35 +11,51 @@
 #include <examples/wordcount/hash.h>
 
 #include <fstream>
+#include <vector>
 
 #include <stdio.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
+// Each IO thread counts into its own map, they are merged when
+// all senders are done.
 class WordCountReceiver : boost::noncopyable
 {
  public:
   WordCountReceiver(EventLoop* loop, const InetAddress& listenAddr)
     : loop_(loop),
-      server_(loop, listenAddr, "WordCountReceiver"),
-      senders_(0)
+      server_(loop, listenAddr, "WordCountReceiver")
   {
+    server_.setThreadInitCallback(
+        boost::bind(&WordCountReceiver::threadInit, this, _1));
     server_.setConnectionCallback(
          boost::bind(&WordCountReceiver::onConnection, this, _1));
     server_.setMessageCallback(
         boost::bind(&WordCountReceiver::onMessage, this, _1, _2, _3));
   }
 
+  void setThreadNum(int numThreads)
+  {
+    server_.setThreadNum(numThreads);
+  }
+
   void start(int senders)
   {
     LOG_INFO << "start " << senders << " senders";
-    senders_ = senders;
-    wordcounts_.clear();
+    senders_.getAndSet(senders);
     server_.start();
   }
 
  private:
+  typedef ThreadLocalSingleton<WordCountMap> LocalWordCounts;
+
+  void threadInit(EventLoop*)
+  {
+    MutexLockGuard lock(mutex_);
+    localCounts_.push_back(&LocalWordCounts::instance());
+  }
+
   void onConnection(const TcpConnectionPtr& conn)
   {
     LOG_DEBUG << conn->peerAddress().toIpPort() << " -> "
@@ -44,16 +63,16 @@ class WordCountReceiver : boost::noncopyable
               << (conn->connected() ? "UP" : "DOWN");
     if (!conn->connected())
     {
-      if (--senders_ == 0)
+      if (senders_.decrementAndGet() == 0)
       {
-        output();
-        loop_->quit();
+        loop_->queueInLoop(boost::bind(&WordCountReceiver::finish, this));
       }
     }
   }
 
   void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
   {
+    WordCountMap& wordcounts = LocalWordCounts::instance();
     const char* crlf = NULL;
     while ( (crlf = buf->findCRLF()) != NULL)
     {
@@ -64,7 +83,7 @@ class WordCountReceiver : boost::noncopyable
       {
         string word(buf->peek(), tab);
         int64_t cnt = atoll(tab);
-        wordcounts_[word] += cnt;
+        wordcounts[word] += cnt;
       }
       else
       {
@@ -75,12 +94,30 @@ class WordCountReceiver : boost::noncopyable
     }
   }
 
-  void output()
+  // in loop_, no sender is left, so IO threads have stopped counting
+  void finish()
+  {
+    MutexLockGuard lock(mutex_);
+    WordCountMap& wordcounts = *localCounts_[0];
+    for (size_t i = 1; i < localCounts_.size(); ++i)
+    {
+      WordCountMap& other = *localCounts_[i];
+      for (WordCountMap::iterator it = other.begin(); it != other.end(); ++it)
+      {
+        wordcounts[it->first] += it->second;
+      }
+      WordCountMap().swap(other);
+    }
+    output(wordcounts);
+    loop_->quit();
+  }
+
+  void output(const WordCountMap& wordcounts)
   {
     LOG_INFO << "Writing shard";
     std::ofstream out("shard");
-    for (WordCountMap::iterator it = wordcounts_.begin();
-         it != wordcounts_.end(); ++it)
+    for (WordCountMap::const_iterator it = wordcounts.begin();
+         it != wordcounts.end(); ++it)
     {
       out << it->first << '\t' << it->second << '\n';
     }
@@ -88,15 +125,16 @@ class WordCountReceiver : boost::noncopyable
 
   EventLoop* loop_;
   TcpServer server_;
-  int senders_;
-  WordCountMap wordcounts_;
+  AtomicInt32 senders_;
+  MutexLock mutex_;
+  std::vector<WordCountMap*> localCounts_;  // of each IO thread
 };
 
 int main(int argc, char* argv[])
 {
   if (argc < 3)
   {
-    printf("Usage: %s listen_port number_of_senders\n", argv[0]);
+    printf("Usage: %s listen_port number_of_senders [threads]\n", argv[0]);
   }
   else
   {
@@ -104,6 +142,10 @@ int main(int argc, char* argv[])
     int port = atoi(argv[1]);
     InetAddress addr(static_cast<uint16_t>(port));
     WordCountReceiver receiver(&loop, addr);
+    if (argc > 3)
+    {
+      receiver.setThreadNum(atoi(argv[3]));
+    }
     receiver.start(atoi(argv[2]));
     loop.loop();
   }
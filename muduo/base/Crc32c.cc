@@ -0,0 +1,117 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/base/Crc32c.h>
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+using namespace muduo;
+
+namespace
+{
+
+const uint32_t kPolynomial = 0x82f63b78;  // reversed 0x1EDC6F41
+
+struct Table
+{
+  Table()
+  {
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+      uint32_t crc = i;
+      for (int j = 0; j < 8; ++j)
+      {
+        crc = (crc >> 1) ^ (kPolynomial & (0 - (crc & 1)));
+      }
+      entries[i] = crc;
+    }
+  }
+
+  uint32_t entries[256];
+};
+
+const Table table;
+
+uint32_t extendPortable(uint32_t crc, const uint8_t* p, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+  {
+    crc = table.entries[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2")))
+uint32_t extendHardware(uint32_t crc, const uint8_t* p, size_t n)
+{
+  // byte by byte until aligned, then 8 bytes per instruction
+  while (n > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0)
+  {
+    crc = _mm_crc32_u8(crc, *p++);
+    --n;
+  }
+  uint64_t crc64 = crc;
+  while (n >= 8)
+  {
+    uint64_t word;
+    ::memcpy(&word, p, sizeof word);
+    crc64 = _mm_crc32_u64(crc64, word);
+    p += 8;
+    n -= 8;
+  }
+  crc = static_cast<uint32_t>(crc64);
+  while (n > 0)
+  {
+    crc = _mm_crc32_u8(crc, *p++);
+    --n;
+  }
+  return crc;
+}
+
+bool detectHardware()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+}
+
+#else
+
+bool detectHardware()
+{
+  return false;
+}
+
+#endif
+
+const bool kHardware = detectHardware();
+
+}
+
+uint32_t Crc32c::extend(uint32_t crc, const void* data, size_t n)
+{
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+#if defined(__x86_64__)
+  if (kHardware)
+  {
+    return ~extendHardware(crc, p, n);
+  }
+#endif
+  return ~extendPortable(crc, p, n);
+}
+
+bool Crc32c::isHardwareAccelerated()
+{
+  return kHardware;
+}
@@ -0,0 +1,35 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_BASE_CRC32C_H
+#define MUDUO_BASE_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace muduo
+{
+
+/// CRC-32C (Castagnoli), as used by iSCSI and SCTP.
+/// Uses the SSE4.2 crc32 instruction if the CPU has it.
+namespace Crc32c
+{
+  /// Returns the crc of concat(A, data[0,n-1]) where crc is the crc of A.
+  uint32_t extend(uint32_t crc, const void* data, size_t n);
+
+  inline uint32_t value(const void* data, size_t n)
+  { return extend(0, data, n); }
+
+  bool isHardwareAccelerated();
+}
+
+}
+
+#endif  // MUDUO_BASE_CRC32C_H
@@ -0,0 +1,117 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_BASE_LATENCYHISTOGRAM_H
+#define MUDUO_BASE_LATENCYHISTOGRAM_H
+
+#include <muduo/base/copyable.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <stdint.h>
+
+namespace muduo
+{
+
+///
+/// Log-linear histogram of latencies in microseconds, 32 buckets per
+/// power of two, about 3% relative error.  Not thread safe, merge
+/// histograms of each thread for the total.
+///
+class LatencyHistogram : public muduo::copyable
+{
+ public:
+  LatencyHistogram()
+    : counts_(kBuckets),
+      count_(0),
+      sum_(0),
+      max_(0)
+  {
+  }
+
+  void record(int64_t us)
+  {
+    if (us < 0) us = 0;
+    ++counts_[index(us)];
+    ++count_;
+    sum_ += us;
+    max_ = std::max(max_, us);
+  }
+
+  void merge(const LatencyHistogram& rhs)
+  {
+    for (int i = 0; i < kBuckets; ++i)
+    {
+      counts_[i] += rhs.counts_[i];
+    }
+    count_ += rhs.count_;
+    sum_ += rhs.sum_;
+    max_ = std::max(max_, rhs.max_);
+  }
+
+  int64_t count() const { return count_; }
+  int64_t max() const { return max_; }
+
+  double mean() const
+  { return count_ > 0 ? static_cast<double>(sum_) / static_cast<double>(count_) : 0; }
+
+  int64_t percentile(double p) const
+  {
+    const int64_t rank = static_cast<int64_t>(p / 100 * static_cast<double>(count_));
+    int64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i)
+    {
+      seen += counts_[i];
+      if (seen > rank)
+      {
+        return std::min(value(i), max_);
+      }
+    }
+    return max_;
+  }
+
+ private:
+  static const int kSub = 32;
+  static const int kBuckets = 2 * kSub + 40 * kSub;
+
+  static int index(int64_t us)
+  {
+    if (us < 2 * kSub)
+    {
+      return static_cast<int>(us);
+    }
+    const int msb = 63 - __builtin_clzll(static_cast<unsigned long long>(us));
+    const int shift = msb - 5;
+    const int i = 2 * kSub + (shift - 1) * kSub + static_cast<int>(us >> shift) - kSub;
+    return std::min(i, kBuckets - 1);
+  }
+
+  // upper end of bucket
+  static int64_t value(int i)
+  {
+    if (i < 2 * kSub)
+    {
+      return i;
+    }
+    const int shift = (i - 2 * kSub) / kSub + 1;
+    const int64_t base = (i - 2 * kSub) % kSub + kSub;
+    return ((base + 1) << shift) - 1;
+  }
+
+  std::vector<int64_t> counts_;
+  int64_t count_;
+  int64_t sum_;
+  int64_t max_;
+};
+
+}
+
+#endif  // MUDUO_BASE_LATENCYHISTOGRAM_H
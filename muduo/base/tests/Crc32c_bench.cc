@@ -0,0 +1,47 @@
+#include <muduo/base/Crc32c.h>
+#include <muduo/base/Timestamp.h>
+
+#include <vector>
+#include <stdio.h>
+#include <zlib.h>
+
+using namespace muduo;
+
+// checksums of ProtobufCodecLite frames, adler32 vs. crc32c
+int main()
+{
+  printf("crc32c hardware accelerated: %d\n", Crc32c::isHardwareAccelerated());
+  printf("%10s %12s %12s\n", "size", "adler32MB/s", "crc32cMB/s");
+  const size_t kTotal = 1024 * 1024 * 1024;
+  const size_t sizes[] = { 64, 512, 4096, 65536, 1024 * 1024, 16 * 1024 * 1024 };
+  for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; ++i)
+  {
+    const size_t size = sizes[i];
+    std::vector<char> data(size);
+    for (size_t j = 0; j < size; ++j)
+    {
+      data[j] = static_cast<char>(j * 31);
+    }
+    const size_t rounds = kTotal / size;
+
+    uint32_t sum = 0;
+    Timestamp start(Timestamp::now());
+    for (size_t r = 0; r < rounds; ++r)
+    {
+      sum += static_cast<uint32_t>(::adler32(1, reinterpret_cast<const Bytef*>(&data[0]),
+                                             static_cast<uInt>(size)));
+    }
+    Timestamp middle(Timestamp::now());
+    for (size_t r = 0; r < rounds; ++r)
+    {
+      sum += Crc32c::value(&data[0], size);
+    }
+    Timestamp end(Timestamp::now());
+
+    const double mb = static_cast<double>(rounds * size) / (1024 * 1024);
+    printf("%10zd %12.1f %12.1f %u\n", size,
+           mb / timeDifference(middle, start),
+           mb / timeDifference(end, middle),
+           sum & 1);
+  }
+}
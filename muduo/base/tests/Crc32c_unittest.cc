@@ -0,0 +1,55 @@
+#include <muduo/base/Crc32c.h>
+
+#include <string>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+using muduo::Crc32c::extend;
+using muduo::Crc32c::value;
+
+int main()
+{
+  printf("hardware accelerated: %d\n", muduo::Crc32c::isHardwareAccelerated());
+
+  // RFC 3720 section B.4
+  char buf[32];
+  memset(buf, 0, sizeof buf);
+  assert(value(buf, sizeof buf) == 0x8a9136aa);
+  memset(buf, 0xff, sizeof buf);
+  assert(value(buf, sizeof buf) == 0x62a8ab43);
+  for (int i = 0; i < 32; ++i)
+  {
+    buf[i] = static_cast<char>(i);
+  }
+  assert(value(buf, sizeof buf) == 0x46dd794e);
+  for (int i = 0; i < 32; ++i)
+  {
+    buf[i] = static_cast<char>(31 - i);
+  }
+  assert(value(buf, sizeof buf) == 0x113fdb5c);
+
+  assert(value("123456789", 9) == 0xe3069283);
+  assert(value("", 0) == 0);
+
+  // any split, any alignment
+  std::string data;
+  for (int i = 0; i < 1000; ++i)
+  {
+    data.push_back(static_cast<char>(i * 7));
+  }
+  const uint32_t expected = value(data.data(), data.size());
+  for (size_t split = 0; split <= 17; ++split)
+  {
+    uint32_t crc = extend(0, data.data(), split);
+    assert(extend(crc, data.data() + split, data.size() - split) == expected);
+  }
+  for (size_t offset = 0; offset < 8; ++offset)
+  {
+    std::string shifted(offset, 'x');
+    shifted += data;
+    assert(value(shifted.data() + offset, data.size()) == expected);
+  }
+  (void) expected;
+  printf("all passed\n");
+}
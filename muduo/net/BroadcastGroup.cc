@@ -0,0 +1,222 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/BroadcastGroup.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+
+#include <boost/bind.hpp>
+
+using namespace muduo;
+using namespace muduo::net;
+
+BroadcastGroup::Member::Member(BroadcastGroup* group, const TcpConnectionPtr& conn)
+  : group_(group),
+    conn_(conn),
+    index_(0),
+    congested_(false),
+    pendingBytes_(0),
+    dropped_(0)
+{
+}
+
+void BroadcastGroup::Member::send(const StringPiece& message,
+                                  const boost::shared_ptr<const void>& holder,
+                                  const StringPiece& key)
+{
+  if (!conn_->connected())
+  {
+    return;
+  }
+  if (!congested_)
+  {
+    conn_->send(message);
+    return;
+  }
+
+  const size_t len = message.size();
+  const bool conflate = group_->policy_ == kConflate && !key.empty();
+  std::map<string, Pending*>::iterator it;
+  if (conflate && (it = latest_.find(key.as_string())) != latest_.end())
+  {
+    // replaces the older one, in its place
+    Pending* pending = it->second;
+    pendingBytes_ = pendingBytes_ - pending->message.size() + len;
+    pending->message = message;
+    pending->holder = holder;
+    ++dropped_;
+  }
+  else
+  {
+    Pending pending = { message, holder, conflate ? key.as_string() : string() };
+    pending_.push_back(pending);
+    if (conflate)
+    {
+      // deque::push_back() and pop_front() keep the others in place
+      latest_[pending_.back().key] = &pending_.back();
+    }
+    pendingBytes_ += len;
+  }
+
+  if (pendingBytes_ > group_->maxPendingBytes_)
+  {
+    if (group_->policy_ == kDisconnect)
+    {
+      LOG_WARN << "BroadcastGroup disconnects " << conn_->name()
+               << ", " << pendingBytes_ << " bytes pending";
+      dropped_ += static_cast<int64_t>(pending_.size());
+      pending_.clear();
+      latest_.clear();
+      pendingBytes_ = 0;
+      conn_->forceClose();
+      return;
+    }
+    while (pendingBytes_ > group_->maxPendingBytes_ && !pending_.empty())
+    {
+      dropFront();
+    }
+  }
+}
+
+void BroadcastGroup::Member::onHighWaterMark()
+{
+  // queued by TcpConnection, which may have written it all since,
+  // and then calls no write complete callback
+  if (!congested_ && conn_->outputBytes() >= group_->highWaterMark_)
+  {
+    // not set otherwise, as it costs a functor for each send()
+    congested_ = true;
+    conn_->setWriteCompleteCallback(
+        boost::bind(&BroadcastGroup::onWriteComplete, group_, _1));
+  }
+}
+
+void BroadcastGroup::Member::onWriteComplete()
+{
+  // up to highWaterMark, the rest waits for the next write complete
+  size_t sent = 0;
+  while (!pending_.empty() && sent < group_->highWaterMark_)
+  {
+    Pending& front = pending_.front();
+    conn_->send(front.message);
+    sent += front.message.size();
+    pendingBytes_ -= front.message.size();
+    if (!front.key.empty())
+    {
+      latest_.erase(front.key);
+    }
+    pending_.pop_front();
+  }
+  if (pending_.empty())
+  {
+    congested_ = false;
+    conn_->setWriteCompleteCallback(WriteCompleteCallback());
+  }
+}
+
+void BroadcastGroup::Member::dropFront()
+{
+  Pending& front = pending_.front();
+  pendingBytes_ -= front.message.size();
+  if (!front.key.empty())
+  {
+    latest_.erase(front.key);
+  }
+  pending_.pop_front();
+  ++dropped_;
+}
+
+BroadcastGroup::BroadcastGroup(Policy policy,
+                               size_t highWaterMark,
+                               size_t maxPendingBytes)
+  : policy_(policy),
+    highWaterMark_(highWaterMark),
+    maxPendingBytes_(maxPendingBytes)
+{
+}
+
+BroadcastGroup::~BroadcastGroup()
+{
+  for (size_t i = 0; i < members_.size(); ++i)
+  {
+    // in case a member is still connected
+    const TcpConnectionPtr& conn = members_[i]->conn_;
+    conn->setHighWaterMarkCallback(HighWaterMarkCallback(), 64*1024*1024);
+    conn->setWriteCompleteCallback(WriteCompleteCallback());
+    delete members_[i];
+  }
+}
+
+BroadcastGroup::Member* BroadcastGroup::add(const TcpConnectionPtr& conn)
+{
+  conn->getLoop()->assertInLoopThread();
+  assert(connections_.find(get_pointer(conn)) == connections_.end());
+  Member* member = new Member(this, conn);
+  member->index_ = members_.size();
+  members_.push_back(member);
+  connections_[get_pointer(conn)] = member;
+  conn->setHighWaterMarkCallback(
+      boost::bind(&BroadcastGroup::onHighWaterMark, this, _1), highWaterMark_);
+  return member;
+}
+
+void BroadcastGroup::remove(const TcpConnectionPtr& conn)
+{
+  std::map<TcpConnection*, Member*>::iterator it = connections_.find(get_pointer(conn));
+  if (it == connections_.end())
+  {
+    return;
+  }
+  Member* member = it->second;
+  connections_.erase(it);
+  // moves the last one into the hole
+  Member* last = members_.back();
+  members_[member->index_] = last;
+  last->index_ = member->index_;
+  members_.pop_back();
+  if (member->congested_)
+  {
+    conn->setWriteCompleteCallback(WriteCompleteCallback());
+  }
+  // the high water mark callback finds no member
+  delete member;
+}
+
+BroadcastGroup::Member* BroadcastGroup::find(const TcpConnectionPtr& conn) const
+{
+  std::map<TcpConnection*, Member*>::const_iterator it = connections_.find(get_pointer(conn));
+  return it != connections_.end() ? it->second : NULL;
+}
+
+void BroadcastGroup::send(const boost::shared_ptr<const string>& message,
+                          const StringPiece& key)
+{
+  for (size_t i = 0; i < members_.size(); ++i)
+  {
+    members_[i]->send(*message, message, key);
+  }
+}
+
+void BroadcastGroup::onHighWaterMark(const TcpConnectionPtr& conn)
+{
+  Member* member = find(conn);
+  if (member)
+  {
+    member->onHighWaterMark();
+  }
+}
+
+void BroadcastGroup::onWriteComplete(const TcpConnectionPtr& conn)
+{
+  Member* member = find(conn);
+  if (member)
+  {
+    member->onWriteComplete();
+  }
+}
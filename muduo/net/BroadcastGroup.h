@@ -0,0 +1,132 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_BROADCASTGROUP_H
+#define MUDUO_NET_BROADCASTGROUP_H
+
+#include <muduo/base/StringPiece.h>
+#include <muduo/net/TcpConnection.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+
+/// Connections of one EventLoop which are sent the same messages,
+/// so that a member who stops reading can't cost more than its limits.
+///
+/// A member gets messages into its output buffer until highWaterMark,
+/// then they wait in the group, sharing data with other members, until
+/// the output buffer is empty again.  At most maxPendingBytes wait for
+/// a member, the policy says what happens beyond that.
+///
+/// Not thread safe, all members must be of the loop the group is used in.
+/// The group takes the high water mark and write complete callbacks of
+/// its members, and must outlive them.
+class BroadcastGroup : boost::noncopyable
+{
+ public:
+  enum Policy
+  {
+    kDropOldest,  // drops waiting messages, oldest first
+    kConflate,    // keeps the latest waiting message of each key
+    kDisconnect,  // closes the connection
+  };
+
+  class Member : boost::noncopyable
+  {
+   public:
+    const TcpConnectionPtr& connection() const
+    { return conn_; }
+
+    /// holder keeps message alive while it waits, key is for kConflate.
+    void send(const StringPiece& message,
+              const boost::shared_ptr<const void>& holder,
+              const StringPiece& key = StringPiece());
+
+    void send(const boost::shared_ptr<const string>& message,
+              const StringPiece& key = StringPiece())
+    { send(*message, message, key); }
+
+    size_t pendingBytes() const
+    { return pendingBytes_; }
+
+    /// messages dropped or replaced by a newer one
+    int64_t dropped() const
+    { return dropped_; }
+
+   private:
+    friend class BroadcastGroup;
+
+    struct Pending
+    {
+      StringPiece message;
+      boost::shared_ptr<const void> holder;
+      string key;  // for kConflate only
+    };
+
+    Member(BroadcastGroup* group, const TcpConnectionPtr& conn);
+
+    void onHighWaterMark();
+    void onWriteComplete();
+    void dropFront();
+
+    BroadcastGroup* group_;
+    TcpConnectionPtr conn_;
+    size_t index_;     // in BroadcastGroup::members_
+    bool congested_;   // output buffer went over high water mark
+    std::deque<Pending> pending_;
+    std::map<string, Pending*> latest_;  // for kConflate, of pending_
+    size_t pendingBytes_;
+    int64_t dropped_;
+  };
+
+  BroadcastGroup(Policy policy, size_t highWaterMark, size_t maxPendingBytes);
+  ~BroadcastGroup();
+
+  /// In the loop of conn.
+  Member* add(const TcpConnectionPtr& conn);
+  /// Nothing if conn is not a member.
+  void remove(const TcpConnectionPtr& conn);
+  /// NULL if conn is not a member.
+  Member* find(const TcpConnectionPtr& conn) const;
+
+  /// To all members.
+  void send(const boost::shared_ptr<const string>& message,
+            const StringPiece& key = StringPiece());
+
+  size_t size() const
+  { return members_.size(); }
+
+  Policy policy() const
+  { return policy_; }
+
+ private:
+  void onHighWaterMark(const TcpConnectionPtr& conn);
+  void onWriteComplete(const TcpConnectionPtr& conn);
+
+  const Policy policy_;
+  const size_t highWaterMark_;
+  const size_t maxPendingBytes_;
+  std::vector<Member*> members_;  // dense for send()
+  std::map<TcpConnection*, Member*> connections_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_BROADCASTGROUP_H
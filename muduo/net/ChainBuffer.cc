@@ -0,0 +1,132 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/ChainBuffer.h>
+
+#include <sys/uio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+void ChainBuffer::append(const void* data, size_t len)
+{
+  if (len == 0)
+  {
+    return;
+  }
+  bytes_.append(data, len);
+  // merges with a copied segment at the end
+  if (!segments_.empty() && segments_.back().data == NULL)
+  {
+    segments_.back().len += len;
+  }
+  else
+  {
+    Segment segment = { NULL, len, boost::shared_ptr<const void>() };
+    segments_.push_back(segment);
+  }
+  readable_ += len;
+}
+
+void ChainBuffer::appendRef(const void* data, size_t len,
+                            const boost::shared_ptr<const void>& holder)
+{
+  assert(data != NULL);
+  if (len == 0)
+  {
+    return;
+  }
+  Segment segment = { static_cast<const char*>(data), len, holder };
+  segments_.push_back(segment);
+  readable_ += len;
+}
+
+void ChainBuffer::append(const ChainBuffer& rhs)
+{
+  const char* copied = rhs.bytes_.peek();
+  for (std::deque<Segment>::const_iterator it = rhs.segments_.begin();
+       it != rhs.segments_.end(); ++it)
+  {
+    if (it->data == NULL)
+    {
+      append(copied, it->len);
+      copied += it->len;
+    }
+    else
+    {
+      appendRef(it->data, it->len, it->holder);
+    }
+  }
+}
+
+int ChainBuffer::peekv(struct iovec* vec, int maxCount) const
+{
+  const char* copied = bytes_.peek();
+  int count = 0;
+  for (std::deque<Segment>::const_iterator it = segments_.begin();
+       it != segments_.end() && count < maxCount; ++it)
+  {
+    const char* data = it->data;
+    if (data == NULL)
+    {
+      data = copied;
+      copied += it->len;
+    }
+    vec[count].iov_base = const_cast<char*>(data);
+    vec[count].iov_len = it->len;
+    ++count;
+  }
+  return count;
+}
+
+void ChainBuffer::retrieve(size_t len)
+{
+  assert(len <= readable_);
+  readable_ -= len;
+  while (len > 0)
+  {
+    Segment& front = segments_.front();
+    const size_t n = std::min(len, front.len);
+    if (front.data == NULL)
+    {
+      bytes_.retrieve(n);
+    }
+    else
+    {
+      front.data += n;
+    }
+    front.len -= n;
+    len -= n;
+    if (front.len == 0)
+    {
+      segments_.pop_front();
+    }
+  }
+}
+
+string ChainBuffer::retrieveAllAsString()
+{
+  string result;
+  result.reserve(readable_);
+  const char* copied = bytes_.peek();
+  for (std::deque<Segment>::const_iterator it = segments_.begin();
+       it != segments_.end(); ++it)
+  {
+    if (it->data == NULL)
+    {
+      result.append(copied, it->len);
+      copied += it->len;
+    }
+    else
+    {
+      result.append(it->data, it->len);
+    }
+  }
+  retrieveAll();
+  return result;
+}
@@ -0,0 +1,95 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_CHAINBUFFER_H
+#define MUDUO_NET_CHAINBUFFER_H
+
+#include <muduo/base/copyable.h>
+#include <muduo/base/StringPiece.h>
+#include <muduo/net/Buffer.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <deque>
+
+struct iovec;
+
+namespace muduo
+{
+namespace net
+{
+
+/// An output buffer made of copied bytes and of references to data owned
+/// by someone else, sent by TcpConnection with writev(2).
+///
+/// A referenced segment keeps its holder alive until it is retrieved,
+/// the data must not change meanwhile.
+class ChainBuffer : public muduo::copyable
+{
+ public:
+  ChainBuffer()
+    : readable_(0)
+  {
+  }
+
+  // implicit copy-ctor, dtor and assignment are fine
+
+  void swap(ChainBuffer& rhs)
+  {
+    bytes_.swap(rhs.bytes_);
+    segments_.swap(rhs.segments_);
+    std::swap(readable_, rhs.readable_);
+  }
+
+  size_t readableBytes() const
+  { return readable_; }
+
+  void append(const StringPiece& str)
+  { append(str.data(), str.size()); }
+
+  void append(const void* data, size_t len);
+
+  /// Appends without copying, holder keeps data alive.
+  void appendRef(const void* data, size_t len,
+                 const boost::shared_ptr<const void>& holder);
+
+  void append(const ChainBuffer& rhs);
+
+  /// Fills at most maxCount iovecs from the front, returns how many.
+  int peekv(struct iovec* vec, int maxCount) const;
+
+  void retrieve(size_t len);
+
+  void retrieveAll()
+  {
+    bytes_.retrieveAll();
+    segments_.clear();
+    readable_ = 0;
+  }
+
+  string retrieveAllAsString();
+
+ private:
+  struct Segment
+  {
+    const char* data;  // NULL if copied into bytes_
+    size_t len;
+    boost::shared_ptr<const void> holder;
+  };
+
+  Buffer bytes_;  // of copied segments, in order
+  std::deque<Segment> segments_;
+  size_t readable_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_CHAINBUFFER_H
@@ -17,6 +17,7 @@
 #include <stdio.h>  // snprintf
 #include <strings.h>  // bzero
 #include <sys/socket.h>
+#include <sys/uio.h>  // readv, writev
 #include <unistd.h>
 
 using namespace muduo;
@@ -180,6 +181,11 @@ ssize_t sockets::write(int sockfd, const void *buf, size_t count)
   return ::write(sockfd, buf, count);
 }
 
+ssize_t sockets::writev(int sockfd, const struct iovec *iov, int iovcnt)
+{
+  return ::writev(sockfd, iov, iovcnt);
+}
+
 // 关闭套接字
 void sockets::close(int sockfd)
 {
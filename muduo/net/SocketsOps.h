@@ -34,6 +34,7 @@ int  accept(int sockfd, struct sockaddr_in* addr);
 ssize_t read(int sockfd, void *buf, size_t count);
 ssize_t readv(int sockfd, const struct iovec *iov, int iovcnt);
 ssize_t write(int sockfd, const void *buf, size_t count);
+ssize_t writev(int sockfd, const struct iovec *iov, int iovcnt);
 void close(int sockfd);
 void shutdownWrite(int sockfd);
 
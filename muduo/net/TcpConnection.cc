@@ -18,10 +18,17 @@
 #include <boost/bind.hpp>
 
 #include <errno.h>
+#include <sys/uio.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
+namespace
+{
+// per writev(2), well below IOV_MAX
+const int kMaxIovecs = 64;
+}
+
 // 默认的当连接建立时的回调函数
 void muduo::net::defaultConnectionCallback(const TcpConnectionPtr& conn)
 {
@@ -51,7 +58,8 @@ TcpConnection::TcpConnection(EventLoop* loop,
     channel_(new Channel(loop, sockfd)),
     localAddr_(localAddr),
     peerAddr_(peerAddr),
-    highWaterMark_(64*1024*1024) // 高水位默认是64K
+    highWaterMark_(64*1024*1024), // 高水位默认是64K
+    flushQueued_(false)
 {
   // 将回调函数注册入TCP对应的Channel中，然后由EventLoop去执行
   channel_->setReadCallback(
@@ -139,6 +147,27 @@ void TcpConnection::send(Buffer* buf)
   }
 }
 
+void TcpConnection::send(ChainBuffer* buf)
+{
+  if (state_ == kConnected)
+  {
+    if (loop_->isInLoopThread())
+    {
+      sendChainInLoop(*buf);
+      buf->retrieveAll();
+    }
+    else
+    {
+      // the copy shares referenced segments
+      loop_->runInLoop(
+          boost::bind(&TcpConnection::sendChainInLoop,
+                      shared_from_this(),
+                      *buf));
+      buf->retrieveAll();
+    }
+  }
+}
+
 void TcpConnection::sendInLoop(const StringPiece& message)
 {
   sendInLoop(message.data(), message.size());
@@ -157,7 +186,7 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
   }
   // if no thing in output queue, try writing directly
   // 如果输出缓冲区中没有数据，可以直接对fd写入数据
-  if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+  if (!channel_->isWriting() && outputBytes() == 0)
   {
     nwrote = sockets::write(channel_->fd(), data, len);
     if (nwrote >= 0) // 如果数据还有剩余
@@ -186,7 +215,7 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
   assert(remaining <= len); // 至少写入了一部分数据
   if (!faultError && remaining > 0)
   {
-    size_t oldLen = outputBuffer_.readableBytes(); // 输入缓冲区的剩余字节
+    size_t oldLen = outputBytes(); // 输入缓冲区的剩余字节
     if (oldLen + remaining >= highWaterMark_ // 此时所有需要发送的字节
         && oldLen < highWaterMark_    // 之前没有达到高水位，这次刚刚达到
         && highWaterMarkCallback_)    
@@ -203,6 +232,180 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
   }
 }
 
+void TcpConnection::sendChainInLoop(const ChainBuffer& chain)
+{
+  loop_->assertInLoopThread();
+  ssize_t nwrote = 0;
+  const size_t len = chain.readableBytes();
+  bool faultError = false;
+  if (state_ == kDisconnected)
+  {
+    LOG_WARN << "disconnected, give up writing";
+    return;
+  }
+  if (!channel_->isWriting() && outputBytes() == 0 && len > 0)
+  {
+    struct iovec vec[kMaxIovecs];
+    const int count = chain.peekv(vec, kMaxIovecs);
+    nwrote = sockets::writev(channel_->fd(), vec, count);
+    if (nwrote >= 0)
+    {
+      if (static_cast<size_t>(nwrote) == len && writeCompleteCallback_)
+      {
+        loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this()));
+      }
+    }
+    else
+    {
+      nwrote = 0;
+      if (errno != EWOULDBLOCK)
+      {
+        LOG_SYSERR << "TcpConnection::sendChainInLoop";
+        if (errno == EPIPE || errno == ECONNRESET)
+        {
+          faultError = true;
+        }
+      }
+    }
+  }
+
+  const size_t remaining = len - nwrote;
+  if (!faultError && remaining > 0)
+  {
+    size_t oldLen = outputBytes();
+    if (oldLen + remaining >= highWaterMark_
+        && oldLen < highWaterMark_
+        && highWaterMarkCallback_)
+    {
+      loop_->queueInLoop(boost::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+    }
+    if (outputBuffer_.readableBytes() > 0)
+    {
+      // goes before chain, outputBuffer_ is only for bytes after outputChain_
+      outputChain_.append(outputBuffer_.peek(), outputBuffer_.readableBytes());
+      outputBuffer_.retrieveAll();
+    }
+    if (nwrote > 0)
+    {
+      ChainBuffer rest(chain);
+      rest.retrieve(nwrote);
+      outputChain_.append(rest);
+    }
+    else
+    {
+      outputChain_.append(chain);
+    }
+    if (!channel_->isWriting())
+    {
+      channel_->enableWriting();
+    }
+  }
+}
+
+ssize_t TcpConnection::writeOutput()
+{
+  if (outputChain_.readableBytes() == 0)
+  {
+    return sockets::write(channel_->fd(),
+                          outputBuffer_.peek(),
+                          outputBuffer_.readableBytes());
+  }
+  struct iovec vec[kMaxIovecs];
+  int count = outputChain_.peekv(vec, kMaxIovecs - 1);
+  size_t len = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    len += vec[i].iov_len;
+  }
+  // outputBuffer_ only behind all of outputChain_
+  if (len == outputChain_.readableBytes() && outputBuffer_.readableBytes() > 0)
+  {
+    vec[count].iov_base = const_cast<char*>(outputBuffer_.peek());
+    vec[count].iov_len = outputBuffer_.readableBytes();
+    ++count;
+  }
+  return sockets::writev(channel_->fd(), vec, count);
+}
+
+void TcpConnection::retrieveOutput(size_t len)
+{
+  const size_t n = std::min(len, outputChain_.readableBytes());
+  outputChain_.retrieve(n);
+  outputBuffer_.retrieve(len - n);
+}
+
+void TcpConnection::flush()
+{
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected || channel_->isWriting()
+      || outputBytes() == 0)
+  {
+    // handleWrite() will write it, or nobody will
+    return;
+  }
+
+  ssize_t nwrote = writeOutput();
+  if (nwrote >= 0)
+  {
+    retrieveOutput(nwrote);
+  }
+  else if (errno != EWOULDBLOCK)
+  {
+    LOG_SYSERR << "TcpConnection::flush";
+    if (errno == EPIPE || errno == ECONNRESET)
+    {
+      outputBuffer_.retrieveAll();
+      outputChain_.retrieveAll();
+      return;
+    }
+  }
+
+  if (outputBytes() == 0)
+  {
+    if (writeCompleteCallback_)
+    {
+      loop_->queueInLoop(boost::bind(writeCompleteCallback_, shared_from_this()));
+    }
+  }
+  else
+  {
+    // the high water mark was checked by hasAppendedOutput()
+    channel_->enableWriting();
+  }
+}
+
+void TcpConnection::hasAppendedOutput(size_t len)
+{
+  loop_->assertInLoopThread();
+  const size_t newLen = outputBytes();
+  assert(newLen >= len);
+  const size_t oldLen = newLen - len;
+  // same as sendInLoop(), once for each crossing
+  if (newLen >= highWaterMark_
+      && oldLen < highWaterMark_
+      && highWaterMarkCallback_)
+  {
+    loop_->queueInLoop(boost::bind(highWaterMarkCallback_, shared_from_this(), newLen));
+  }
+}
+
+void TcpConnection::deferFlush()
+{
+  loop_->assertInLoopThread();
+  if (!flushQueued_)
+  {
+    flushQueued_ = true;
+    // pending functors run after all events of this iteration are handled
+    loop_->queueInLoop(boost::bind(&TcpConnection::deferredFlush, shared_from_this()));
+  }
+}
+
+void TcpConnection::deferredFlush()
+{
+  flushQueued_ = false;
+  flush();
+}
+
 void TcpConnection::shutdown()
 {
   // FIXME: use compare and swap
@@ -217,6 +420,7 @@ void TcpConnection::shutdown()
 void TcpConnection::shutdownInLoop()
 {
   loop_->assertInLoopThread(); // 不能跨线程
+  flush();  // data deferred by deferFlush() goes first
   if (!channel_->isWriting())
   {
     // we are not writing
@@ -344,13 +548,11 @@ void TcpConnection::handleWrite()
   loop_->assertInLoopThread();
   if (channel_->isWriting()) //如果Channel正在监听write事件
   {
-    ssize_t n = sockets::write(channel_->fd(),
-                               outputBuffer_.peek(),
-                               outputBuffer_.readableBytes());
+    ssize_t n = writeOutput();
     if (n > 0)
     {
-      outputBuffer_.retrieve(n); // 从输出缓冲区中将已经发送的数据移除
-      if (outputBuffer_.readableBytes() == 0) // 所有数据已经发送完毕
+      retrieveOutput(n); // 从输出缓冲区中将已经发送的数据移除
+      if (outputBytes() == 0) // 所有数据已经发送完毕
       {
         channel_->disableWriting(); // 停止监听fd的写事件，因为非阻塞需要监听写事件，所以需要关注是否还有字节可写
         if (writeCompleteCallback_)
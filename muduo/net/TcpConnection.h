@@ -15,6 +15,7 @@
 #include <muduo/base/Types.h>
 #include <muduo/net/Callbacks.h>
 #include <muduo/net/Buffer.h>
+#include <muduo/net/ChainBuffer.h>
 #include <muduo/net/InetAddress.h>
 
 #include <boost/any.hpp>
@@ -67,12 +68,29 @@ class TcpConnection : boost::noncopyable,
   void send(const StringPiece& message);
   // void send(Buffer&& message); // C++11
   void send(Buffer* message);  // this one will swap data
+  // referenced segments are written with writev(2), without copying,
+  // whatever is sent or appended to outputBuffer() later goes after them.
+  void send(ChainBuffer* message);  // this one will retrieve all
   void shutdown(); // NOT thread safe, no simultaneous calling
   // void shutdownAndForceCloseAfter(double seconds); // NOT thread safe, no simultaneous calling
   void forceClose();
   void forceCloseWithDelay(double seconds);
   void setTcpNoDelay(bool on);
 
+  /// Advanced interface, in loop thread only.
+  /// Data appended to outputBuffer() directly is written by flush(),
+  /// or by deferFlush() once at the end of this loop iteration,
+  /// so everything appended during one iteration goes out in one write(2).
+  /// Call hasAppendedOutput() after each append, as the output may
+  /// cross the high water mark while a previous write is in progress.
+  void flush();
+  void deferFlush();
+  void hasAppendedOutput(size_t len);
+  /// Bytes not written yet, of outputBuffer() and of ChainBuffers sent,
+  /// as compared with the high water mark.
+  size_t outputBytes() const
+  { return outputBuffer_.readableBytes() + outputChain_.readableBytes(); }
+
   // 设置TCP上下文 boost::any http://www.boost.org/doc/libs/1_57_0/doc/html/any.html
   void setContext(const boost::any& context)
   { context_ = context; }
@@ -130,9 +148,14 @@ class TcpConnection : boost::noncopyable,
   // 有判断，如果跨线程，则将其放入队列，这几个函数供send调用
   void sendInLoop(const StringPiece& message);
   void sendInLoop(const void* message, size_t len);
+  void sendChainInLoop(const ChainBuffer& message);
+  // outputChain_ then outputBuffer_
+  ssize_t writeOutput();
+  void retrieveOutput(size_t len);
   void shutdownInLoop();
   // void shutdownAndForceCloseInLoop(double seconds);
   void forceCloseInLoop();
+  void deferredFlush();
   void setState(StateE s) { state_ = s; } // 设置TCP连接的状态
 
   EventLoop* loop_;   // 处理该TCP连接的EventLoop，该EventLoop内部的epoll监听TCP连接对应的fd
@@ -149,8 +172,10 @@ class TcpConnection : boost::noncopyable,
   HighWaterMarkCallback highWaterMarkCallback_; // 高水位回调函数
   CloseCallback closeCallback_; // 关闭TCP连接的回调函数
   size_t highWaterMark_;    // 高水位标记
+  bool flushQueued_;        // deferFlush() is pending
   Buffer inputBuffer_;  // TCP连接的输入缓冲区，从连接中读取输入然后存入
   Buffer outputBuffer_; // FIXME: use list<Buffer> as output buffer. TCP的输出缓冲区，要发送的数据保存在这里
+  ChainBuffer outputChain_;  // unsent ChainBuffers and what came before them, outputBuffer_ follows
   boost::any context_;  // TCP连接的上下文，一般用于处理多次消息相互存在关联的情形，例如文件发送
   // FIXME: creationTime_, lastReceiveTime_
   //        bytesReceived_, bytesSent_
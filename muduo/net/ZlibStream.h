@@ -45,13 +45,24 @@ class ZlibInputStream : boost::noncopyable
 class ZlibOutputStream : boost::noncopyable
 {
  public:
-  explicit ZlibOutputStream(Buffer* output)
+  enum Format
+  {
+    kZlib,  // RFC 1950, aka. HTTP "deflate"
+    kGzip,  // RFC 1952
+  };
+
+  explicit ZlibOutputStream(Buffer* output,
+                            int level = Z_DEFAULT_COMPRESSION,
+                            Format format = kZlib)
     : output_(output),
       zerror_(Z_OK),
       bufferSize_(1024)
   {
     bzero(&zstream_, sizeof zstream_);
-    zerror_ = deflateInit(&zstream_, Z_DEFAULT_COMPRESSION);
+    // window bits + 16 asks zlib for gzip header and trailer
+    zerror_ = deflateInit2(&zstream_, level, Z_DEFLATED,
+                           format == kGzip ? MAX_WBITS + 16 : MAX_WBITS,
+                           8, Z_DEFAULT_STRATEGY);
   }
 
   ~ZlibOutputStream()
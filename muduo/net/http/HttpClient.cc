@@ -0,0 +1,923 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/HttpClient.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThreadPool.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/http/HttpClientContext.h>
+
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <deque>
+#include <map>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace muduo
+{
+namespace net
+{
+namespace detail
+{
+
+bool processStatusLine(const char* begin, const char* end, HttpClientContext* context)
+{
+  // HTTP/1.1 200 OK
+  bool succeed = false;
+  HttpClientResponse& response = context->response();
+  if (end - begin >= 12 && std::equal(begin, begin+7, "HTTP/1.") && begin[8] == ' ')
+  {
+    if (begin[7] == '1')
+    {
+      response.setVersion(HttpRequest::kHttp11);
+    }
+    else if (begin[7] == '0')
+    {
+      response.setVersion(HttpRequest::kHttp10);
+    }
+    const char* code = begin + 9;
+    succeed = response.getVersion() != HttpRequest::kUnknown
+        && isdigit(code[0]) && isdigit(code[1]) && isdigit(code[2])
+        && (code + 3 == end || code[3] == ' ');
+    if (succeed)
+    {
+      response.setStatusCode((code[0]-'0') * 100 + (code[1]-'0') * 10 + (code[2]-'0'));
+      response.setStatusMessage(code + 3 == end ? end : code + 4, end);
+    }
+  }
+  return succeed;
+}
+
+// decides how the body is delimited, RFC 7230 section 3.3.3
+void receiveHeaders(HttpClientContext* context)
+{
+  const HttpClientResponse& response = context->response();
+  const int code = response.statusCode();
+  if (context->noBody() || code == 204 || code == 304)
+  {
+    context->setState(HttpClientContext::kGotAll);
+  }
+  else if (response.getHeader("Transfer-Encoding").find("chunked") != string::npos)
+  {
+    context->setState(HttpClientContext::kExpectChunkSize);
+  }
+  else
+  {
+    const string& length = response.getHeader("Content-Length");
+    if (!length.empty())
+    {
+      context->setRemaining(::strtoull(length.c_str(), NULL, 10));
+      context->setState(context->remaining() > 0 ? HttpClientContext::kExpectBody
+                                                 : HttpClientContext::kGotAll);
+    }
+    else
+    {
+      context->setState(HttpClientContext::kExpectBodyUntilClose);
+    }
+  }
+}
+
+// moves at most context->remaining() bytes of body
+void receiveBody(Buffer* buf, HttpClientContext* context)
+{
+  size_t n = std::min(context->remaining(), buf->readableBytes());
+  context->response().mutableBody()->append(buf->peek(), n);
+  buf->retrieve(n);
+  context->setRemaining(context->remaining() - n);
+}
+
+// return false if any error
+bool parseResponse(Buffer* buf, HttpClientContext* context)
+{
+  bool ok = true;
+  bool hasMore = true;
+  while (hasMore && ok)
+  {
+    switch (context->state())
+    {
+      case HttpClientContext::kExpectStatusLine:
+      {
+        const char* crlf = buf->findCRLF();
+        if (crlf)
+        {
+          ok = processStatusLine(buf->peek(), crlf, context);
+          if (ok)
+          {
+            buf->retrieveUntil(crlf + 2);
+            context->setState(HttpClientContext::kExpectHeaders);
+          }
+        }
+        else
+        {
+          hasMore = false;
+        }
+        break;
+      }
+      case HttpClientContext::kExpectHeaders:
+      {
+        const char* crlf = buf->findCRLF();
+        if (crlf)
+        {
+          const char* colon = std::find(buf->peek(), crlf, ':');
+          if (crlf == buf->peek())
+          {
+            // empty line, end of header
+            if (context->response().statusCode() / 100 == 1)
+            {
+              // interim response, e.g. 100 Continue
+              context->reset(context->noBody());
+            }
+            else
+            {
+              receiveHeaders(context);
+            }
+          }
+          else if (colon != crlf)
+          {
+            context->response().addHeader(buf->peek(), colon, crlf);
+          }
+          else
+          {
+            ok = false;
+          }
+          buf->retrieveUntil(crlf + 2);
+        }
+        else
+        {
+          hasMore = false;
+        }
+        break;
+      }
+      case HttpClientContext::kExpectBody:
+      {
+        receiveBody(buf, context);
+        if (context->remaining() == 0)
+        {
+          context->setState(HttpClientContext::kGotAll);
+        }
+        hasMore = false;
+        break;
+      }
+      case HttpClientContext::kExpectChunkSize:
+      {
+        const char* crlf = buf->findCRLF();
+        if (crlf)
+        {
+          // chunk-size [; chunk-ext] CRLF
+          char* sizeEnd = NULL;
+          size_t size = ::strtoul(buf->peek(), &sizeEnd, 16);
+          ok = isxdigit(*buf->peek()) && (sizeEnd == crlf || *sizeEnd == ';' || *sizeEnd == ' ');
+          if (ok)
+          {
+            context->setRemaining(size);
+            context->setState(size > 0 ? HttpClientContext::kExpectChunkData
+                                       : HttpClientContext::kExpectTrailers);
+            buf->retrieveUntil(crlf + 2);
+          }
+        }
+        else
+        {
+          hasMore = false;
+        }
+        break;
+      }
+      case HttpClientContext::kExpectChunkData:
+      {
+        receiveBody(buf, context);
+        if (context->remaining() == 0)
+        {
+          context->setState(HttpClientContext::kExpectChunkEnd);
+        }
+        else
+        {
+          hasMore = false;
+        }
+        break;
+      }
+      case HttpClientContext::kExpectChunkEnd:
+      {
+        if (buf->readableBytes() >= 2)
+        {
+          ok = buf->peek()[0] == '\r' && buf->peek()[1] == '\n';
+          buf->retrieve(2);
+          context->setState(HttpClientContext::kExpectChunkSize);
+        }
+        else
+        {
+          hasMore = false;
+        }
+        break;
+      }
+      case HttpClientContext::kExpectTrailers:
+      {
+        const char* crlf = buf->findCRLF();
+        if (crlf)
+        {
+          if (crlf == buf->peek())
+          {
+            context->setState(HttpClientContext::kGotAll);
+          }
+          // FIXME: keep trailer fields
+          buf->retrieveUntil(crlf + 2);
+        }
+        else
+        {
+          hasMore = false;
+        }
+        break;
+      }
+      case HttpClientContext::kExpectBodyUntilClose:
+      {
+        context->response().mutableBody()->append(buf->peek(), buf->readableBytes());
+        buf->retrieveAll();
+        hasMore = false;
+        break;
+      }
+      case HttpClientContext::kGotAll:
+      {
+        hasMore = false;
+        break;
+      }
+    }
+  }
+  return ok;
+}
+
+class HttpClientConnection;
+
+struct HttpCall : boost::noncopyable
+{
+  HttpCall()
+    : noBody(false),
+      idempotent(true),
+      retried(false),
+      done(false),
+      hasTimer(false),
+      connectTimer(false)
+  {
+  }
+
+  string request;     // serialized
+  bool noBody;        // HEAD
+  bool idempotent;
+  bool retried;
+  bool done;
+  bool hasTimer;
+  bool connectTimer;  // timer is cancelled once sent
+  TimerId timer;
+  HttpClient::ResponseCallback responseCallback;
+  HttpClient::BodyCallback bodyCallback;
+  boost::weak_ptr<HttpClientConnection> connection;
+};
+
+typedef boost::shared_ptr<HttpCall> HttpCallPtr;
+
+void completeCall(EventLoop* loop, const HttpCallPtr& call, const HttpClientResponse& response)
+{
+  if (!call->done)
+  {
+    call->done = true;
+    if (call->hasTimer)
+    {
+      loop->cancel(call->timer);
+    }
+    call->responseCallback(response);
+  }
+}
+
+void failCall(EventLoop* loop, const HttpCallPtr& call, HttpClientResponse::Error error)
+{
+  HttpClientResponse response;
+  response.setError(error);
+  completeCall(loop, call, response);
+}
+
+class HttpHostPool;
+
+class HttpClientConnection : boost::noncopyable,
+                             public boost::enable_shared_from_this<HttpClientConnection>
+{
+ public:
+  HttpClientConnection(HttpHostPool* pool,
+                       EventLoop* loop,
+                       const InetAddress& serverAddr,
+                       const string& name)
+    : pool_(pool),
+      loop_(loop),
+      client_(loop, serverAddr, name),
+      closing_(false)
+  {
+    client_.setConnectionCallback(
+        boost::bind(&HttpClientConnection::onConnection, this, _1));
+    client_.setMessageCallback(
+        boost::bind(&HttpClientConnection::onMessage, this, _1, _2, _3));
+  }
+
+  ~HttpClientConnection()
+  {
+    // TcpClient does not detach callbacks bound to this
+    TcpConnectionPtr conn = client_.connection();
+    if (conn)
+    {
+      conn->setConnectionCallback(defaultConnectionCallback);
+      conn->setMessageCallback(defaultMessageCallback);
+    }
+    for (size_t i = 0; i < inflight_.size(); ++i)
+    {
+      if (inflight_[i]->hasTimer)
+      {
+        loop_->cancel(inflight_[i]->timer);
+      }
+    }
+  }
+
+  void connect()
+  { client_.connect(); }
+
+  bool connecting() const
+  { return !conn_ && !closing_; }
+
+  bool available() const
+  { return conn_ && !closing_; }
+
+  size_t inflight() const
+  { return inflight_.size(); }
+
+  void send(const HttpCallPtr& call)
+  {
+    assert(available());
+    if (inflight_.empty())
+    {
+      context_.reset(call->noBody);
+    }
+    if (call->connectTimer && call->hasTimer)
+    {
+      loop_->cancel(call->timer);
+      call->hasTimer = false;
+    }
+    call->connectTimer = false;
+    call->connection = shared_from_this();
+    inflight_.push_back(call);
+    conn_->send(call->request);
+  }
+
+  void forceClose()
+  {
+    closing_ = true;
+    if (conn_)
+    {
+      conn_->forceClose();
+    }
+  }
+
+  // leaves the pool, which may be destroyed in a callback of calls
+  void cancel()
+  {
+    pool_ = NULL;
+    client_.stop();
+    forceClose();
+    std::deque<HttpCallPtr> inflight;
+    inflight.swap(inflight_);
+    for (size_t i = 0; i < inflight.size(); ++i)
+    {
+      failCall(loop_, inflight[i], HttpClientResponse::kCancelled);
+    }
+  }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn);
+  void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp receiveTime);
+
+  HttpHostPool* pool_;
+  EventLoop* loop_;
+  TcpClient client_;
+  TcpConnectionPtr conn_;
+  bool closing_;
+  HttpClientContext context_;
+  std::deque<HttpCallPtr> inflight_;  // in order of requests sent
+};
+
+typedef boost::shared_ptr<HttpClientConnection> HttpClientConnectionPtr;
+
+void destroyConnection(const HttpClientConnectionPtr&)
+{
+}
+
+// connections to one server, in one loop
+class HttpHostPool : boost::noncopyable
+{
+ public:
+  HttpHostPool(EventLoop* loop,
+               const InetAddress& serverAddr,
+               const string& name,
+               int maxConnections,
+               int pipelineDepth,
+               double connectTimeout)
+    : loop_(loop),
+      serverAddr_(serverAddr),
+      name_(name),
+      maxConnections_(maxConnections),
+      pipelineDepth_(pipelineDepth),
+      connectTimeout_(connectTimeout)
+  {
+  }
+
+  ~HttpHostPool()
+  {
+    for (size_t i = 0; i < pending_.size(); ++i)
+    {
+      if (pending_[i]->hasTimer)
+      {
+        loop_->cancel(pending_[i]->timer);
+      }
+    }
+  }
+
+  void submit(const HttpCallPtr& call)
+  {
+    loop_->assertInLoopThread();
+    armConnectTimer(call);
+    pending_.push_back(call);
+    dispatch();
+  }
+
+  // closed connections are kept until the pool is destroyed
+  void stop()
+  {
+    std::deque<HttpCallPtr> pending;
+    pending.swap(pending_);
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+      failCall(loop_, pending[i], HttpClientResponse::kCancelled);
+    }
+    for (size_t i = 0; i < connections_.size(); ++i)
+    {
+      connections_[i]->cancel();
+    }
+  }
+
+  void onConnected()
+  { dispatch(); }
+
+  void onResponse()
+  { dispatch(); }
+
+  void onDisconnected(const HttpClientConnectionPtr& conn,
+                      std::deque<HttpCallPtr>* inflight)
+  {
+    for (size_t i = 0; i < connections_.size(); ++i)
+    {
+      if (connections_[i] == conn)
+      {
+        connections_[i] = connections_.back();
+        connections_.pop_back();
+        break;
+      }
+    }
+    // TcpClient is calling us, destroy it later
+    loop_->queueInLoop(boost::bind(&destroyConnection, conn));
+
+    // a kept-alive connection may be closed by server while our requests
+    // are on the way, retry them once on a new connection.
+    while (!inflight->empty())
+    {
+      HttpCallPtr call = inflight->back();
+      inflight->pop_back();
+      if (call->done)
+      {
+        continue;
+      }
+      if (call->idempotent && !call->retried)
+      {
+        call->retried = true;
+        armConnectTimer(call);
+        pending_.push_front(call);
+      }
+      else
+      {
+        failCall(loop_, call, HttpClientResponse::kConnectionClosed);
+      }
+    }
+    dispatch();
+  }
+
+ private:
+  // without a timeout, a call waits for a connection at most connectTimeout_
+  void armConnectTimer(const HttpCallPtr& call)
+  {
+    if (connectTimeout_ > 0 && !call->hasTimer)
+    {
+      call->timer = loop_->runAfter(connectTimeout_,
+          boost::bind(&HttpHostPool::onConnectTimeout, this, call));
+      call->hasTimer = true;
+      call->connectTimer = true;
+    }
+  }
+
+  void onConnectTimeout(const HttpCallPtr& call)
+  {
+    if (call->done)
+    {
+      return;
+    }
+    call->hasTimer = false;
+    failCall(loop_, call, HttpClientResponse::kConnectFailed);
+
+    // stop connecting if nobody is waiting, the connector retries forever
+    for (size_t i = 0; i < pending_.size(); ++i)
+    {
+      if (!pending_[i]->done)
+      {
+        return;
+      }
+    }
+    pending_.clear();
+    for (size_t i = 0; i < connections_.size(); )
+    {
+      if (connections_[i]->connecting())
+      {
+        connections_[i]->cancel();
+        loop_->queueInLoop(boost::bind(&destroyConnection, connections_[i]));
+        connections_[i] = connections_.back();
+        connections_.pop_back();
+      }
+      else
+      {
+        ++i;
+      }
+    }
+  }
+
+  void dispatch()
+  {
+    while (!pending_.empty())
+    {
+      const HttpCallPtr& call = pending_.front();
+      if (call->done)
+      {
+        pending_.pop_front();
+        continue;
+      }
+
+      HttpClientConnection* idle = NULL;
+      HttpClientConnection* busy = NULL;
+      size_t connecting = 0;
+      for (size_t i = 0; i < connections_.size(); ++i)
+      {
+        HttpClientConnection* c = connections_[i].get();
+        if (c->connecting())
+        {
+          ++connecting;
+        }
+        else if (c->available())
+        {
+          if (c->inflight() == 0)
+          {
+            idle = c;
+          }
+          else if (c->inflight() < implicit_cast<size_t>(pipelineDepth_)
+                   && (busy == NULL || c->inflight() < busy->inflight()))
+          {
+            busy = c;
+          }
+        }
+      }
+
+      // prefer idle connection, then a new one, then pipelining
+      HttpClientConnection* target = idle;
+      if (target == NULL)
+      {
+        if (connections_.size() < implicit_cast<size_t>(maxConnections_))
+        {
+          if (connecting < pending_.size())
+          {
+            newConnection();
+          }
+          break;
+        }
+        else if (call->idempotent)
+        {
+          target = busy;
+        }
+      }
+
+      if (target == NULL)
+      {
+        break;
+      }
+      HttpCallPtr next(call);
+      pending_.pop_front();
+      target->send(next);
+    }
+  }
+
+  void newConnection()
+  {
+    HttpClientConnectionPtr conn(
+        new HttpClientConnection(this, loop_, serverAddr_, name_));
+    connections_.push_back(conn);
+    conn->connect();
+  }
+
+  EventLoop* loop_;
+  const InetAddress serverAddr_;
+  const string name_;
+  const int maxConnections_;
+  const int pipelineDepth_;
+  const double connectTimeout_;
+  std::vector<HttpClientConnectionPtr> connections_;
+  std::deque<HttpCallPtr> pending_;
+};
+
+void HttpClientConnection::onConnection(const TcpConnectionPtr& conn)
+{
+  HttpClientConnectionPtr guard(shared_from_this());
+  if (conn->connected())
+  {
+    conn->setTcpNoDelay(true);
+    conn_ = conn;
+    if (pool_)
+    {
+      pool_->onConnected();
+    }
+  }
+  else
+  {
+    conn_.reset();
+    closing_ = true;
+    context_.receiveClose();
+    if (!inflight_.empty() && context_.gotAll())
+    {
+      HttpCallPtr call = inflight_.front();
+      inflight_.pop_front();
+      completeCall(loop_, call, context_.response());
+    }
+    if (pool_)
+    {
+      pool_->onDisconnected(guard, &inflight_);
+    }
+  }
+}
+
+void HttpClientConnection::onMessage(const TcpConnectionPtr& conn,
+                                     Buffer* buf,
+                                     Timestamp receiveTime)
+{
+  HttpClientConnectionPtr guard(shared_from_this());
+  while (!inflight_.empty() && !closing_)
+  {
+    HttpCallPtr call = inflight_.front();
+    HttpClientResponse& response = context_.response();
+    const size_t bodyBytes = response.body().readableBytes();
+    if (!parseResponse(buf, &context_))
+    {
+      LOG_ERROR << "HttpClientConnection::onMessage [" << conn->name()
+                << "] - bad response";
+      inflight_.pop_front();
+      failCall(loop_, call, HttpClientResponse::kBadResponse);
+      forceClose();
+      break;
+    }
+
+    if (call->bodyCallback && !call->done && context_.gotHeaders()
+        && response.body().readableBytes() > bodyBytes)
+    {
+      call->bodyCallback(response, response.mutableBody());
+    }
+
+    // cancelled in bodyCallback
+    if (!context_.gotAll() || call->done)
+    {
+      break;
+    }
+
+    const bool keepAlive = context_.keepAlive();
+    inflight_.pop_front();
+    completeCall(loop_, call, response);
+    context_.reset(inflight_.empty() ? false : inflight_.front()->noBody);
+    if (keepAlive)
+    {
+      if (pool_)
+      {
+        pool_->onResponse();
+      }
+    }
+    else
+    {
+      // requests behind it will be retried in onConnection()
+      closing_ = true;
+      conn->shutdown();
+    }
+  }
+
+  if (inflight_.empty() && buf->readableBytes() > 0)
+  {
+    LOG_WARN << "HttpClientConnection::onMessage [" << conn->name()
+             << "] - discard " << buf->readableBytes() << " unexpected bytes";
+    buf->retrieveAll();
+  }
+}
+
+void onCallTimeout(EventLoop* loop, const HttpCallPtr& call)
+{
+  if (!call->done)
+  {
+    call->hasTimer = false;
+    HttpClientConnectionPtr conn(call->connection.lock());
+    failCall(loop, call, HttpClientResponse::kTimeout);
+    if (conn)
+    {
+      // responses after it would be out of order
+      conn->forceClose();
+    }
+  }
+}
+
+// all pools of one loop
+class HttpClientLoop : boost::noncopyable
+{
+ public:
+  HttpClientLoop(EventLoop* loop,
+                 const string& name,
+                 int maxConnections,
+                 int pipelineDepth,
+                 double timeout,
+                 double connectTimeout)
+    : loop_(loop),
+      name_(name),
+      maxConnections_(maxConnections),
+      pipelineDepth_(pipelineDepth),
+      timeout_(timeout),
+      connectTimeout_(timeout > 0 ? 0 : connectTimeout),
+      stopped_(false)
+  {
+  }
+
+  EventLoop* getLoop() const
+  { return loop_; }
+
+  void submit(const InetAddress& serverAddr, const HttpCallPtr& call)
+  {
+    loop_->assertInLoopThread();
+    if (stopped_)
+    {
+      failCall(loop_, call, HttpClientResponse::kCancelled);
+      return;
+    }
+    if (timeout_ > 0)
+    {
+      call->timer = loop_->runAfter(timeout_, boost::bind(&onCallTimeout, loop_, call));
+      call->hasTimer = true;
+    }
+
+    const string hostport = serverAddr.toIpPort();
+    boost::shared_ptr<HttpHostPool>& pool = pools_[hostport];
+    if (!pool)
+    {
+      pool.reset(new HttpHostPool(loop_, serverAddr, name_ + ":" + hostport,
+                                  maxConnections_, pipelineDepth_,
+                                  connectTimeout_));
+    }
+    pool->submit(call);
+  }
+
+  void stop()
+  {
+    loop_->assertInLoopThread();
+    stopped_ = true;
+    for (std::map<string, boost::shared_ptr<HttpHostPool> >::iterator it = pools_.begin();
+         it != pools_.end();
+         ++it)
+    {
+      it->second->stop();
+    }
+  }
+
+ private:
+  EventLoop* loop_;
+  const string name_;
+  const int maxConnections_;
+  const int pipelineDepth_;
+  const double timeout_;
+  const double connectTimeout_;
+  bool stopped_;
+  std::map<string, boost::shared_ptr<HttpHostPool> > pools_;
+};
+
+void destroyLoop(boost::shared_ptr<HttpClientLoop>* l, CountDownLatch* latch)
+{
+  (*l)->stop();
+  l->reset();
+  latch->countDown();
+}
+
+}
+}
+}
+
+HttpClient::HttpClient(EventLoop* loop, const string& name)
+  : loop_(CHECK_NOTNULL(loop)),
+    name_(name),
+    threadPool_(new EventLoopThreadPool(loop)),
+    maxConnectionsPerHost_(8),
+    pipelineDepth_(1),
+    timeout_(30.0),
+    connectTimeout_(10.0),
+    started_(false)
+{
+}
+
+HttpClient::~HttpClient()
+{
+  // pools must be destroyed in their own loops, before IO threads quit
+  for (size_t i = 0; i < loops_.size(); ++i)
+  {
+    EventLoop* ioLoop = loops_[i]->getLoop();
+    if (ioLoop->isInLoopThread())
+    {
+      loops_[i]->stop();
+      loops_[i].reset();
+    }
+    else
+    {
+      CountDownLatch latch(1);
+      ioLoop->runInLoop(boost::bind(&detail::destroyLoop, &loops_[i], &latch));
+      latch.wait();
+    }
+  }
+}
+
+void HttpClient::setThreadNum(int numThreads)
+{
+  assert(0 <= numThreads);
+  threadPool_->setThreadNum(numThreads);
+}
+
+void HttpClient::start()
+{
+  assert(!started_);
+  loop_->assertInLoopThread();
+  threadPool_->start();
+  std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+  for (size_t i = 0; i < loops.size(); ++i)
+  {
+    loops_.push_back(HttpClientLoopPtr(
+        new detail::HttpClientLoop(loops[i], name_, maxConnectionsPerHost_,
+                                   pipelineDepth_, timeout_, connectTimeout_)));
+  }
+  started_ = true;
+}
+
+void HttpClient::stop()
+{
+  for (size_t i = 0; i < loops_.size(); ++i)
+  {
+    loops_[i]->getLoop()->runInLoop(
+        boost::bind(&detail::HttpClientLoop::stop, loops_[i]));
+  }
+}
+
+void HttpClient::request(const InetAddress& server,
+                         const HttpRequest& req,
+                         const ResponseCallback& cb,
+                         const BodyCallback& bodyCb)
+{
+  assert(started_);
+  detail::HttpCallPtr call(new detail::HttpCall);
+  Buffer buf;
+  if (req.getHeader("Host").empty())
+  {
+    HttpRequest withHost(req);
+    withHost.addHeader("Host", server.toIpPort());
+    withHost.appendToBuffer(&buf);
+  }
+  else
+  {
+    req.appendToBuffer(&buf);
+  }
+  call->request = buf.retrieveAllAsString();
+  call->noBody = req.method() == HttpRequest::kHead;
+  call->idempotent = req.method() != HttpRequest::kPost;
+  call->responseCallback = cb;
+  call->bodyCallback = bodyCb;
+
+  const HttpClientLoopPtr& l = loops_[nextId_.getAndAdd(1) % loops_.size()];
+  l->getLoop()->runInLoop(
+      boost::bind(&detail::HttpClientLoop::submit, l, server, call));
+}
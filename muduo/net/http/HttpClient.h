@@ -0,0 +1,120 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPCLIENT_H
+#define MUDUO_NET_HTTP_HTTPCLIENT_H
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/Types.h>
+#include <muduo/net/InetAddress.h>
+#include <muduo/net/http/HttpClientResponse.h>
+#include <muduo/net/http/HttpRequest.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+
+class EventLoop;
+class EventLoopThreadPool;
+
+namespace detail
+{
+class HttpClientLoop;
+}
+
+///
+/// Asynchronous HTTP/1.1 client.
+///
+/// Each IO loop keeps a pool of keep-alive connections per server,
+/// requests are spread over loops in round-robin.  A connection carries
+/// up to pipelineDepth requests at a time, idempotent requests are
+/// retried once if the connection is closed before they get a response.
+///
+class HttpClient : boost::noncopyable
+{
+ public:
+  typedef boost::function<void (const HttpClientResponse&)> ResponseCallback;
+  /// Called as body arrives, after status line and headers are received.
+  /// Bytes retrieved from the buffer are not kept in the final response.
+  typedef boost::function<void (const HttpClientResponse&,
+                                Buffer*)> BodyCallback;
+
+  HttpClient(EventLoop* loop, const string& name);
+  /// Fails calls not completed with kCancelled, in their IO threads.
+  ~HttpClient();
+
+  EventLoop* getLoop() const { return loop_; }
+  const string& name() const { return name_; }
+
+  /// Set the number of IO threads, 0 means all IO in loop's thread.
+  /// Not thread safe, must be called before start().
+  void setThreadNum(int numThreads);
+
+  /// Connections to one server, in each IO thread.
+  void setMaxConnectionsPerHost(int maxConnections)
+  { maxConnectionsPerHost_ = maxConnections; }
+
+  /// Requests in flight on one connection, 1 disables pipelining.
+  void setPipelineDepth(int depth)
+  { pipelineDepth_ = depth; }
+
+  /// Seconds from request() to complete response, 0 means no timeout.
+  void setTimeout(double seconds)
+  { timeout_ = seconds; }
+
+  /// Seconds a request waits for a connection when there is no timeout,
+  /// 0 means forever.
+  void setConnectTimeout(double seconds)
+  { connectTimeout_ = seconds; }
+
+  /// Starts IO threads.
+  /// Must be called in loop's thread.
+  void start();
+
+  /// Fails calls not completed with kCancelled, in their IO threads,
+  /// and requests after it too.
+  /// Thread safe.
+  void stop();
+
+  /// Sends req to server, cb is called in an IO thread.
+  /// Host header is added if absent.
+  /// Thread safe, valid after calling start().
+  void request(const InetAddress& server,
+               const HttpRequest& req,
+               const ResponseCallback& cb,
+               const BodyCallback& bodyCb = BodyCallback());
+
+ private:
+  typedef boost::shared_ptr<detail::HttpClientLoop> HttpClientLoopPtr;
+
+  EventLoop* loop_;
+  const string name_;
+  boost::scoped_ptr<EventLoopThreadPool> threadPool_;
+  int maxConnectionsPerHost_;
+  int pipelineDepth_;
+  double timeout_;
+  double connectTimeout_;
+  bool started_;
+  AtomicInt64 nextId_;
+  std::vector<HttpClientLoopPtr> loops_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPCLIENT_H
@@ -0,0 +1,132 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_HTTP_HTTPCLIENTCONTEXT_H
+#define MUDUO_NET_HTTP_HTTPCLIENTCONTEXT_H
+
+#include <muduo/base/copyable.h>
+
+#include <muduo/net/http/HttpClientResponse.h>
+
+namespace muduo
+{
+namespace net
+{
+
+/// Response counterpart of HttpContext.
+class HttpClientContext : public muduo::copyable
+{
+ public:
+  enum HttpResponseParseState
+  {
+    kExpectStatusLine,
+    kExpectHeaders,
+    kExpectBody,          // Content-Length
+    kExpectChunkSize,
+    kExpectChunkData,
+    kExpectChunkEnd,      // CRLF after chunk data
+    kExpectTrailers,
+    kExpectBodyUntilClose,
+    kGotAll,
+  };
+
+  HttpClientContext()
+    : state_(kExpectStatusLine),
+      remaining_(0),
+      noBody_(false)
+  {
+  }
+
+  // default copy-ctor, dtor and assignment are fine
+
+  bool expectStatusLine() const
+  { return state_ == kExpectStatusLine; }
+
+  bool expectHeaders() const
+  { return state_ == kExpectHeaders; }
+
+  bool gotHeaders() const
+  { return state_ > kExpectHeaders; }
+
+  bool gotAll() const
+  { return state_ == kGotAll; }
+
+  HttpResponseParseState state() const
+  { return state_; }
+
+  void setState(HttpResponseParseState s)
+  { state_ = s; }
+
+  /// bytes left of body or current chunk
+  size_t remaining() const
+  { return remaining_; }
+
+  void setRemaining(size_t n)
+  { remaining_ = n; }
+
+  /// Response to HEAD has no body, whatever its headers say.
+  bool noBody() const
+  { return noBody_; }
+
+  /// Server closed connection, which ends a body without length.
+  void receiveClose()
+  {
+    if (state_ == kExpectBodyUntilClose)
+    {
+      state_ = kGotAll;
+    }
+  }
+
+  /// Whether connection can be reused after this response.
+  bool keepAlive() const
+  {
+    const string& connection = response_.getHeader("Connection");
+    if (response_.getVersion() == HttpRequest::kHttp11)
+    {
+      return ::strcasecmp(connection.c_str(), "close") != 0;
+    }
+    return ::strcasecmp(connection.c_str(), "keep-alive") == 0;
+  }
+
+  void reset(bool noBody)
+  {
+    state_ = kExpectStatusLine;
+    remaining_ = 0;
+    noBody_ = noBody;
+    HttpClientResponse dummy;
+    response_.swap(dummy);
+  }
+
+  const HttpClientResponse& response() const
+  { return response_; }
+
+  HttpClientResponse& response()
+  { return response_; }
+
+ private:
+  HttpResponseParseState state_;
+  size_t remaining_;
+  bool noBody_;
+  HttpClientResponse response_;
+};
+
+class Buffer;
+
+namespace detail
+{
+/// Parses what buf holds of a response into context, false if malformed.
+/// Defined in HttpClient.cc.
+bool parseResponse(Buffer* buf, HttpClientContext* context);
+}
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPCLIENTCONTEXT_H
@@ -0,0 +1,143 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPCLIENTRESPONSE_H
+#define MUDUO_NET_HTTP_HTTPCLIENTRESPONSE_H
+
+#include <muduo/base/copyable.h>
+#include <muduo/base/Types.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/http/HttpRequest.h>
+
+#include <map>
+
+#include <ctype.h>
+#include <strings.h>
+
+namespace muduo
+{
+namespace net
+{
+
+/// Response received by HttpClient.
+class HttpClientResponse : public muduo::copyable
+{
+ public:
+  enum Error
+  {
+    kOk,
+    kTimeout,           // no complete response before deadline
+    kConnectionClosed,  // connection lost before complete response
+    kBadResponse,       // malformed response from server
+    kConnectFailed,     // no connection before connect timeout
+    kCancelled,         // client stopped or destroyed
+  };
+
+  HttpClientResponse()
+    : error_(kOk),
+      version_(HttpRequest::kUnknown),
+      statusCode_(0)
+  {
+  }
+
+  bool ok() const
+  { return error_ == kOk; }
+
+  Error error() const
+  { return error_; }
+
+  void setError(Error e)
+  { error_ = e; }
+
+  HttpRequest::Version getVersion() const
+  { return version_; }
+
+  void setVersion(HttpRequest::Version v)
+  { version_ = v; }
+
+  int statusCode() const
+  { return statusCode_; }
+
+  void setStatusCode(int code)
+  { statusCode_ = code; }
+
+  const string& statusMessage() const
+  { return statusMessage_; }
+
+  void setStatusMessage(const char* start, const char* end)
+  { statusMessage_.assign(start, end); }
+
+  void addHeader(const char* start, const char* colon, const char* end)
+  {
+    string field(start, colon);
+    ++colon;
+    while (colon < end && isspace(*colon))
+    {
+      ++colon;
+    }
+    string value(colon, end);
+    while (!value.empty() && isspace(value[value.size()-1]))
+    {
+      value.resize(value.size()-1);
+    }
+    headers_[field] = value;
+  }
+
+  /// Field names are matched case-insensitively.
+  string getHeader(const string& field) const
+  {
+    string result;
+    for (std::map<string, string>::const_iterator it = headers_.begin();
+         it != headers_.end();
+         ++it)
+    {
+      if (it->first.size() == field.size()
+          && ::strncasecmp(it->first.c_str(), field.c_str(), field.size()) == 0)
+      {
+        result = it->second;
+        break;
+      }
+    }
+    return result;
+  }
+
+  const std::map<string, string>& headers() const
+  { return headers_; }
+
+  /// Body received so far, bytes retrieved by a BodyCallback are not here.
+  const Buffer& body() const
+  { return body_; }
+
+  Buffer* mutableBody()
+  { return &body_; }
+
+  void swap(HttpClientResponse& that)
+  {
+    std::swap(error_, that.error_);
+    std::swap(version_, that.version_);
+    std::swap(statusCode_, that.statusCode_);
+    statusMessage_.swap(that.statusMessage_);
+    headers_.swap(that.headers_);
+    body_.swap(that.body_);
+  }
+
+ private:
+  Error error_;
+  HttpRequest::Version version_;
+  int statusCode_;
+  string statusMessage_;
+  std::map<string, string> headers_;
+  Buffer body_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPCLIENTRESPONSE_H
@@ -0,0 +1,339 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/HttpCompressor.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/ZlibStream.h>
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/HttpResponse.h>
+
+#include <algorithm>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+// width of Content-Length value written before body is compressed,
+// the number is right aligned, leading spaces are allowed as OWS.
+const int kLengthWidth = 20;
+const char kLengthPlaceholder[kLengthWidth + 1] = "                    ";
+
+bool equalsIgnoreCase(const char* begin, const char* end, const char* str)
+{
+  size_t len = strlen(str);
+  return static_cast<size_t>(end - begin) == len && ::strncasecmp(begin, str, len) == 0;
+}
+
+void trim(const char** begin, const char** end)
+{
+  while (*begin < *end && isspace(**begin))
+  {
+    ++*begin;
+  }
+  while (*begin < *end && isspace((*end)[-1]))
+  {
+    --*end;
+  }
+}
+
+// case-insensitive, in a comma separated header value
+bool hasToken(const string& value, const char* token)
+{
+  const char* p = value.data();
+  const char* end = p + value.size();
+  while (p < end)
+  {
+    const char* comma = std::find(p, end, ',');
+    const char* tokenEnd = comma;
+    trim(&p, &tokenEnd);
+    if (equalsIgnoreCase(p, tokenEnd, token))
+    {
+      return true;
+    }
+    p = comma == end ? end : comma + 1;
+  }
+  return false;
+}
+
+// returns q value of one coding, 1.0 if absent
+double qvalue(const char* begin, const char* end)
+{
+  double q = 1.0;
+  const char* p = begin;
+  while (p < end && (*p == ';' || isspace(*p)))
+  {
+    ++p;
+  }
+  if (end - p > 2 && (p[0] == 'q' || p[0] == 'Q') && p[1] == '=')
+  {
+    char buf[16];
+    size_t len = std::min(static_cast<size_t>(end - p - 2), sizeof buf - 1);
+    memcpy(buf, p + 2, len);
+    buf[len] = '\0';
+    q = ::strtod(buf, NULL);
+  }
+  return q;
+}
+
+}
+
+HttpCompressor::HttpCompressor(const Options& options)
+  : options_(options),
+    cachedBytes_(0)
+{
+}
+
+HttpCompressor::~HttpCompressor()
+{
+}
+
+HttpCompressor::Encoding HttpCompressor::negotiate(const StringPiece& acceptEncoding)
+{
+  // -1 not mentioned, 0 refused, 1 accepted
+  int gzip = -1;
+  int deflate = -1;
+  int any = -1;
+  const char* p = acceptEncoding.begin();
+  const char* end = acceptEncoding.end();
+  while (p < end)
+  {
+    const char* comma = std::find(p, end, ',');
+    const char* semicolon = std::find(p, comma, ';');
+    const char* codingEnd = semicolon;
+    trim(&p, &codingEnd);
+    int accepted = qvalue(semicolon, comma) > 0 ? 1 : 0;
+    if (equalsIgnoreCase(p, codingEnd, "gzip") || equalsIgnoreCase(p, codingEnd, "x-gzip"))
+    {
+      gzip = accepted;
+    }
+    else if (equalsIgnoreCase(p, codingEnd, "deflate"))
+    {
+      deflate = accepted;
+    }
+    else if (equalsIgnoreCase(p, codingEnd, "*"))
+    {
+      any = accepted;
+    }
+    p = comma == end ? end : comma + 1;
+  }
+
+  if (gzip == 1 || (gzip == -1 && any == 1))
+  {
+    return kGzip;
+  }
+  else if (deflate == 1 || (deflate == -1 && any == 1))
+  {
+    return kDeflate;
+  }
+  return kIdentity;
+}
+
+bool HttpCompressor::compressible(const HttpResponse& resp) const
+{
+  if (resp.body().size() < options_.minSize
+      || !resp.getHeader("Content-Encoding").empty())
+  {
+    return false;
+  }
+
+  // images, videos and archives are compressed already
+  const string& type = resp.getHeader("Content-Type");
+  return type.find("text/") == 0
+      || type.find("json") != string::npos
+      || type.find("javascript") != string::npos
+      || type.find("xml") != string::npos;
+}
+
+void HttpCompressor::appendToBuffer(const HttpRequest& req,
+                                    HttpResponse* resp,
+                                    Buffer* output)
+{
+  Encoding encoding = kIdentity;
+  if (compressible(*resp))
+  {
+    // keeps what the handler varies on
+    const string vary = resp->getHeader("Vary");
+    if (vary.empty())
+    {
+      resp->addHeader("Vary", "Accept-Encoding");
+    }
+    else if (!hasToken(vary, "Accept-Encoding") && !hasToken(vary, "*"))
+    {
+      resp->addHeader("Vary", vary + ", Accept-Encoding");
+    }
+    encoding = negotiate(req.getHeader("Accept-Encoding"));
+  }
+  if (encoding == kIdentity)
+  {
+    resp->appendToBuffer(output);
+    return;
+  }
+
+  resp->addHeader("Content-Encoding", encoding == kGzip ? "gzip" : "deflate");
+  const string& body = resp->body();
+  const bool useCache = resp->cacheable() && options_.cacheBytes > 0;
+  CacheKey key;
+  char buf[32];
+  if (useCache)
+  {
+    key = cacheKey(req, *resp, encoding);
+    StringPtr cached = lookup(key);
+    if (cached)
+    {
+      resp->appendHeadersToBuffer(output);
+      if (!resp->closeConnection())
+      {
+        snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", cached->size());
+        output->append(buf);
+      }
+      output->append("\r\n");
+      output->append(*cached);
+      cacheHits_.increment();
+      compressed_.increment();
+      return;
+    }
+  }
+
+  const size_t start = output->readableBytes();
+  resp->appendHeadersToBuffer(output);
+  size_t lengthOffset = 0;
+  if (!resp->closeConnection())
+  {
+    output->append("Content-Length:");
+    lengthOffset = output->readableBytes();
+    output->append(kLengthPlaceholder, kLengthWidth);
+    output->append("\r\n");
+  }
+  output->append("\r\n");
+
+  const size_t bodyOffset = output->readableBytes();
+  bool ok = false;
+  {
+    ZlibOutputStream stream(output,
+                            options_.level,
+                            encoding == kGzip ? ZlibOutputStream::kGzip
+                                              : ZlibOutputStream::kZlib);
+    ok = stream.write(body) && stream.finish();
+    if (!ok)
+    {
+      LOG_ERROR << "HttpCompressor - zlib error " << stream.zlibErrorCode();
+    }
+  }
+  const size_t compressedSize = output->readableBytes() - bodyOffset;
+
+  if (!ok || compressedSize >= body.size())
+  {
+    // not worth it, start over without compression
+    output->unwrite(output->readableBytes() - start);
+    resp->removeHeader("Content-Encoding");
+    resp->appendToBuffer(output);
+    return;
+  }
+
+  if (!resp->closeConnection())
+  {
+    int len = snprintf(buf, sizeof buf, "%zd", compressedSize);
+    char* field = output->beginWrite() - (output->readableBytes() - lengthOffset);
+    memcpy(field + kLengthWidth - len, buf, len);
+  }
+  compressed_.increment();
+
+  if (useCache)
+  {
+    insert(key, StringPiece(output->peek() + bodyOffset,
+                            static_cast<int>(compressedSize)));
+  }
+}
+
+HttpCompressor::CacheKey HttpCompressor::cacheKey(const HttpRequest& req,
+                                                  const HttpResponse& resp,
+                                                  Encoding encoding)
+{
+  CacheKey key(req.path(), encoding);
+  key.first += req.query();
+  key.first += '\0';
+  const string etag = resp.getHeader("ETag");
+  if (etag.empty())
+  {
+    char buf[32];
+    snprintf(buf, sizeof buf, "%zd", resp.body().size());
+    key.first += buf;
+  }
+  else
+  {
+    key.first += etag;
+  }
+  return key;
+}
+
+HttpCompressor::StringPtr HttpCompressor::lookup(const CacheKey& key)
+{
+  StringPtr result;
+  MutexLockGuard lock(mutex_);
+  std::map<CacheKey, CacheList::iterator>::iterator it = index_.find(key);
+  if (it != index_.end())
+  {
+    lru_.splice(lru_.begin(), lru_, it->second);
+    result = it->second->compressed;
+  }
+  return result;
+}
+
+void HttpCompressor::insert(const CacheKey& key,
+                            const StringPiece& compressed)
+{
+  const size_t bytes = key.first.size() + compressed.size();
+  if (bytes > options_.cacheBytes)
+  {
+    return;
+  }
+
+  // build the entry outside the lock, then splice it in
+  CacheList fresh(1);
+  CacheEntry& entry = fresh.front();
+  entry.key = key;
+  entry.compressed.reset(new string(compressed.data(), compressed.size()));
+
+  MutexLockGuard lock(mutex_);
+  std::map<CacheKey, CacheList::iterator>::iterator it = index_.find(key);
+  if (it != index_.end())
+  {
+    // compressed by another thread meanwhile
+    cachedBytes_ -= key.first.size() + it->second->compressed->size();
+    lru_.erase(it->second);
+    index_.erase(it);
+  }
+
+  while (!lru_.empty() && cachedBytes_ + bytes > options_.cacheBytes)
+  {
+    const CacheEntry& victim = lru_.back();
+    cachedBytes_ -= victim.key.first.size() + victim.compressed->size();
+    index_.erase(victim.key);
+    lru_.pop_back();
+  }
+
+  lru_.splice(lru_.begin(), fresh);
+  index_[key] = lru_.begin();
+  cachedBytes_ += bytes;
+}
+
+size_t HttpCompressor::cachedBytes() const
+{
+  MutexLockGuard lock(mutex_);
+  return cachedBytes_;
+}
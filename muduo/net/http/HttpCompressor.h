@@ -0,0 +1,111 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPCOMPRESSOR_H
+#define MUDUO_NET_HTTP_HTTPCOMPRESSOR_H
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/Mutex.h>
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Types.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <list>
+#include <map>
+
+namespace muduo
+{
+namespace net
+{
+
+class Buffer;
+class HttpRequest;
+class HttpResponse;
+
+///
+/// Compresses HTTP response body with gzip or deflate, as negotiated
+/// by request's Accept-Encoding.
+///
+/// Body is compressed straight into the output buffer after the headers.
+/// Compressed form of responses marked HttpResponse::setCacheable() are
+/// kept in a LRU cache, bounded by bytes, so repeated static responses
+/// are compressed only once.  They are found by path and query of the
+/// request and ETag of the response, or body length without one.
+///
+/// Thread safe, one compressor can be shared by all IO threads.
+class HttpCompressor : boost::noncopyable
+{
+ public:
+  enum Encoding
+  {
+    kIdentity, kDeflate, kGzip,
+  };
+
+  struct Options
+  {
+    Options()
+      : level(-1),
+        minSize(1024),
+        cacheBytes(16 * 1024 * 1024)
+    {
+    }
+
+    int level;          // 1 (fastest) to 9 (smallest), -1 for zlib default
+    size_t minSize;     // smaller bodies are sent as is
+    size_t cacheBytes;  // memory for cached bodies, 0 disables the cache
+  };
+
+  explicit HttpCompressor(const Options& options = Options());
+  ~HttpCompressor();
+
+  /// Picks the preferred encoding from an Accept-Encoding header value.
+  static Encoding negotiate(const StringPiece& acceptEncoding);
+
+  /// Appends resp to output, with body compressed if worthwhile.
+  /// It may add Content-Encoding to resp, and Accept-Encoding to its Vary.
+  void appendToBuffer(const HttpRequest& req, HttpResponse* resp, Buffer* output);
+
+  int64_t compressedResponses() { return compressed_.get(); }
+  int64_t cacheHits() { return cacheHits_.get(); }
+  size_t cachedBytes() const;
+
+ private:
+  // path, query and ETag or body length, encoding
+  typedef std::pair<string, Encoding> CacheKey;
+  typedef boost::shared_ptr<const string> StringPtr;
+
+  struct CacheEntry
+  {
+    CacheKey key;
+    StringPtr compressed;
+  };
+  typedef std::list<CacheEntry> CacheList;
+
+  bool compressible(const HttpResponse& resp) const;
+  static CacheKey cacheKey(const HttpRequest& req, const HttpResponse& resp, Encoding encoding);
+  StringPtr lookup(const CacheKey& key);
+  void insert(const CacheKey& key, const StringPiece& compressed);
+
+  const Options options_;
+  AtomicInt64 compressed_;
+  AtomicInt64 cacheHits_;
+
+  mutable MutexLock mutex_;
+  CacheList lru_;  // most recently used at front, @GuardedBy mutex_
+  std::map<CacheKey, CacheList::iterator> index_;  // @GuardedBy mutex_
+  size_t cachedBytes_;  // of keys and compressed bodies, @GuardedBy mutex_
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPCOMPRESSOR_H
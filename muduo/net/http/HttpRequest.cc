@@ -0,0 +1,45 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/Buffer.h>
+
+#include <stdio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+void HttpRequest::appendToBuffer(Buffer* output) const
+{
+  output->append(methodString());
+  output->append(" ");
+  output->append(path_.empty() ? "/" : path_.c_str());
+  output->append(query_);
+  output->append(" HTTP/1.1\r\n");
+
+  for (std::map<string, string>::const_iterator it = headers_.begin();
+       it != headers_.end();
+       ++it)
+  {
+    output->append(it->first);
+    output->append(": ");
+    output->append(it->second);
+    output->append("\r\n");
+  }
+
+  if (!body_.empty() || method_ == kPost || method_ == kPut)
+  {
+    char buf[32];
+    snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", body_.size());
+    output->append(buf);
+  }
+
+  output->append("\r\n");
+  output->append(body_);
+}
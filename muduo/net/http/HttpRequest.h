@@ -24,6 +24,7 @@ namespace muduo
 namespace net
 {
 
+class Buffer;
 class HttpRequest : public muduo::copyable
 {
  public:
@@ -81,6 +82,9 @@ class HttpRequest : public muduo::copyable
     return method_ != kInvalid;
   }
 
+  void setMethod(Method m)
+  { method_ = m; }
+
   Method method() const
   { return method_; }
 
@@ -115,6 +119,9 @@ class HttpRequest : public muduo::copyable
     path_.assign(start, end);
   }
 
+  void setPath(const string& path)
+  { path_ = path; }
+
   const string& path() const
   { return path_; }
 
@@ -123,6 +130,10 @@ class HttpRequest : public muduo::copyable
     query_.assign(start, end);
   }
 
+  // query string includes leading '?'
+  void setQuery(const string& query)
+  { query_ = query; }
+
   const string& query() const
   { return query_; }
 
@@ -148,6 +159,9 @@ class HttpRequest : public muduo::copyable
     headers_[field] = value;
   }
 
+  void addHeader(const string& field, const string& value)
+  { headers_[field] = value; }
+
   string getHeader(const string& field) const
   {
     string result;
@@ -162,13 +176,24 @@ class HttpRequest : public muduo::copyable
   const std::map<string, string>& headers() const
   { return headers_; }
 
+  void setBody(const string& body)
+  { body_ = body; }
+
+  const string& body() const
+  { return body_; }
+
+  /// Serializes as a HTTP/1.1 request, for HttpClient.
+  void appendToBuffer(Buffer* output) const;
+
   void swap(HttpRequest& that)
   {
     std::swap(method_, that.method_);
+    std::swap(version_, that.version_);
     path_.swap(that.path_);
     query_.swap(that.query_);
     receiveTime_.swap(that.receiveTime_);
     headers_.swap(that.headers_);
+    body_.swap(that.body_);
   }
 
  private:
@@ -178,6 +203,7 @@ class HttpRequest : public muduo::copyable
   string query_;
   Timestamp receiveTime_;
   std::map<string, string> headers_;
+  string body_;
 };
 
 }
@@ -16,6 +16,19 @@ using namespace muduo;
 using namespace muduo::net;
 
 void HttpResponse::appendToBuffer(Buffer* output) const
+{
+  appendHeadersToBuffer(output);
+  if (!closeConnection_)
+  {
+    char buf[32];
+    snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", body_.size());
+    output->append(buf);
+  }
+  output->append("\r\n");
+  output->append(body_);
+}
+
+void HttpResponse::appendHeadersToBuffer(Buffer* output) const
 {
   char buf[32];
   snprintf(buf, sizeof buf, "HTTP/1.1 %d ", statusCode_);
@@ -29,8 +42,6 @@ void HttpResponse::appendToBuffer(Buffer* output) const
   }
   else
   {
-    snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", body_.size());
-    output->append(buf);
     output->append("Connection: Keep-Alive\r\n");
   }
 
@@ -43,7 +54,4 @@ void HttpResponse::appendToBuffer(Buffer* output) const
     output->append(it->second);
     output->append("\r\n");
   }
-
-  output->append("\r\n");
-  output->append(body_);
 }
@@ -36,13 +36,17 @@ class HttpResponse : public muduo::copyable
 
   explicit HttpResponse(bool close)
     : statusCode_(kUnknown),
-      closeConnection_(close)
+      closeConnection_(close),
+      cacheable_(false)
   {
   }
 
   void setStatusCode(HttpStatusCode code)
   { statusCode_ = code; }
 
+  HttpStatusCode statusCode() const
+  { return statusCode_; }
+
   void setStatusMessage(const string& message)
   { statusMessage_ = message; }
 
@@ -59,11 +63,41 @@ class HttpResponse : public muduo::copyable
   void addHeader(const string& key, const string& value)
   { headers_[key] = value; }
 
+  void removeHeader(const string& key)
+  { headers_.erase(key); }
+
+  string getHeader(const string& key) const
+  {
+    string result;
+    std::map<string, string>::const_iterator it = headers_.find(key);
+    if (it != headers_.end())
+    {
+      result = it->second;
+    }
+    return result;
+  }
+
   void setBody(const string& body)
   { body_ = body; }
 
+  const string& body() const
+  { return body_; }
+
+  /// Body is the same for repeated requests of the same path and query,
+  /// as long as its ETag header, or its length without one, is the same,
+  /// so its compressed form may be cached, see HttpCompressor.
+  void setCacheable(bool on)
+  { cacheable_ = on; }
+
+  bool cacheable() const
+  { return cacheable_; }
+
   void appendToBuffer(Buffer* output) const;
 
+  /// Appends status line and header fields, but not Content-Length
+  /// and the empty line, for callers which write body by themselves.
+  void appendHeadersToBuffer(Buffer* output) const;
+
  private:
   std::map<string, string> headers_;
   HttpStatusCode statusCode_;
@@ -71,6 +105,7 @@ class HttpResponse : public muduo::copyable
   string statusMessage_;
   bool closeConnection_;
   string body_;
+  bool cacheable_;
 };
 
 }
@@ -0,0 +1,354 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/HttpRouter.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/http/HttpResponse.h>
+
+#include <utility>
+
+#include <string.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+void defaultNotFoundCallback(const HttpRequest&, HttpResponse* resp)
+{
+  resp->setStatusCode(HttpResponse::k404NotFound);
+  resp->setStatusMessage("Not Found");
+  resp->setCloseConnection(true);
+}
+
+}
+
+HttpRouter::HttpRouter()
+  : notFoundCallback_(defaultNotFoundCallback),
+    compiled_(false)
+{
+  tree_.push_back(BuildNode(kStatic, ""));
+}
+
+HttpRouter::~HttpRouter()
+{
+}
+
+bool HttpRouter::addRoute(HttpRequest::Method method,
+                          const string& pattern,
+                          const Handler& handler)
+{
+  if (method < HttpRequest::kInvalid || method >= kNumMethods
+      || pattern.empty() || pattern[0] != '/')
+  {
+    LOG_ERROR << "HttpRouter::addRoute - bad route " << pattern;
+    return false;
+  }
+
+  int node = 0;
+  int numParams = 0;
+  const char* begin = pattern.data();
+  const char* end = begin + pattern.size();
+  const char* p = begin;
+  while (p < end && node >= 0)
+  {
+    if (*p == ':' || *p == '*')
+    {
+      const char* nameEnd = std::find(p+1, end, '/');
+      if (p[-1] != '/' || nameEnd == p+1 || (*p == '*' && nameEnd != end)
+          || ++numParams > Params::kMaxParams)
+      {
+        node = -1;
+      }
+      else
+      {
+        node = insertParam(node, *p == ':' ? kParam : kCatchAll, string(p+1, nameEnd));
+      }
+      p = nameEnd;
+    }
+    else
+    {
+      const char* special = p;
+      while (special < end && *special != ':' && *special != '*')
+      {
+        ++special;
+      }
+      node = insertStatic(node, StringPiece(p, static_cast<int>(special - p)));
+      p = special;
+    }
+  }
+
+  if (node < 0 || tree_[node].handlers[method] >= 0)
+  {
+    LOG_ERROR << "HttpRouter::addRoute - bad or duplicated route " << pattern;
+    return false;
+  }
+
+  handlers_.push_back(handler);
+  tree_[node].handlers[method] = static_cast<int>(handlers_.size() - 1);
+  compiled_ = false;
+  return true;
+}
+
+int HttpRouter::insertStatic(int node, StringPiece text)
+{
+  while (!text.empty())
+  {
+    int child = -1;
+    const std::vector<int>& children = tree_[node].staticChildren;
+    for (size_t i = 0; i < children.size(); ++i)
+    {
+      if (tree_[children[i]].label[0] == text[0])
+      {
+        child = children[i];
+        break;
+      }
+    }
+
+    if (child < 0)
+    {
+      tree_.push_back(BuildNode(kStatic, text.as_string()));
+      child = static_cast<int>(tree_.size() - 1);
+      tree_[node].staticChildren.push_back(child);
+      return child;
+    }
+
+    const string& label = tree_[child].label;
+    size_t common = 0;
+    while (common < label.size()
+           && common < static_cast<size_t>(text.size())
+           && label[common] == text[static_cast<int>(common)])
+    {
+      ++common;
+    }
+
+    if (common < label.size())
+    {
+      // split child, the tail keeps everything below it
+      BuildNode tail(kStatic, label.substr(common));
+      BuildNode& head = tree_[child];
+      tail.staticChildren.swap(head.staticChildren);
+      std::swap(tail.paramChild, head.paramChild);
+      std::swap(tail.catchAllChild, head.catchAllChild);
+      std::swap_ranges(tail.handlers, tail.handlers + kNumMethods, head.handlers);
+      head.label.resize(common);
+      tree_.push_back(tail);
+      tree_[child].staticChildren.push_back(static_cast<int>(tree_.size() - 1));
+    }
+    node = child;
+    text.remove_prefix(static_cast<int>(common));
+  }
+  return node;
+}
+
+int HttpRouter::insertParam(int node, NodeKind kind, const string& name)
+{
+  assert(kind == kParam || kind == kCatchAll);
+  int child = kind == kParam ? tree_[node].paramChild : tree_[node].catchAllChild;
+  if (child >= 0)
+  {
+    // one name per position, "/a/:x" and "/a/:y/b" conflict
+    return tree_[child].label == name ? child : -1;
+  }
+
+  tree_.push_back(BuildNode(kind, name));
+  child = static_cast<int>(tree_.size() - 1);
+  if (kind == kParam)
+  {
+    tree_[node].paramChild = child;
+  }
+  else
+  {
+    tree_[node].catchAllChild = child;
+  }
+  return child;
+}
+
+void HttpRouter::compile()
+{
+  nodes_.clear();
+  labels_.clear();
+  names_.clear();
+
+  // breadth first, so that static children of a node are adjacent
+  std::vector<int> order;
+  order.push_back(0);
+  for (size_t i = 0; i < order.size(); ++i)
+  {
+    const BuildNode& b = tree_[order[i]];
+    Node n;
+    n.kind = b.kind;
+    n.labelOffset = static_cast<int>(labels_.size());
+    n.labelLength = 0;
+    n.nameIndex = -1;
+    if (b.kind == kStatic)
+    {
+      labels_.append(b.label);
+      n.labelLength = static_cast<int>(b.label.size());
+    }
+    else
+    {
+      names_.push_back(b.label);
+      n.nameIndex = static_cast<int>(names_.size() - 1);
+    }
+    std::copy(b.handlers, b.handlers + kNumMethods, n.handlers);
+
+    std::vector<std::pair<char, int> > children;
+    for (size_t j = 0; j < b.staticChildren.size(); ++j)
+    {
+      int c = b.staticChildren[j];
+      children.push_back(std::make_pair(tree_[c].label[0], c));
+    }
+    std::sort(children.begin(), children.end());
+    n.firstChild = static_cast<int>(order.size());
+    n.numChildren = static_cast<int>(children.size());
+    for (size_t j = 0; j < children.size(); ++j)
+    {
+      order.push_back(children[j].second);
+    }
+
+    n.paramChild = -1;
+    if (b.paramChild >= 0)
+    {
+      n.paramChild = static_cast<int>(order.size());
+      order.push_back(b.paramChild);
+    }
+    n.catchAllChild = -1;
+    if (b.catchAllChild >= 0)
+    {
+      n.catchAllChild = static_cast<int>(order.size());
+      order.push_back(b.catchAllChild);
+    }
+
+    assert(nodes_.size() == i);
+    nodes_.push_back(n);
+  }
+  compiled_ = true;
+  LOG_DEBUG << "HttpRouter compiled " << handlers_.size() << " routes into "
+            << nodes_.size() << " nodes";
+}
+
+const HttpRouter::Handler* HttpRouter::match(HttpRequest::Method method,
+                                             const StringPiece& path,
+                                             Params* params) const
+{
+  assert(compiled_);
+  params->size_ = 0;
+  const Handler* handler = NULL;
+  if (method >= HttpRequest::kInvalid && method < kNumMethods && !nodes_.empty())
+  {
+    matchNode(0, path.begin(), path.end(), method, params, &handler);
+  }
+  return handler;
+}
+
+bool HttpRouter::matchNode(int index,
+                           const char* pos,
+                           const char* end,
+                           HttpRequest::Method method,
+                           Params* params,
+                           const Handler** handler) const
+{
+  const Node& node = nodes_[index];
+  const int savedSize = params->size_;
+  if (node.kind == kStatic)
+  {
+    if (end - pos < node.labelLength
+        || memcmp(pos, labels_.data() + node.labelOffset, node.labelLength) != 0)
+    {
+      return false;
+    }
+    pos += node.labelLength;
+  }
+  else
+  {
+    const char* segEnd = end;
+    if (node.kind == kParam)
+    {
+      segEnd = static_cast<const char*>(memchr(pos, '/', end - pos));
+      if (segEnd == NULL)
+      {
+        segEnd = end;
+      }
+      if (segEnd == pos)
+      {
+        return false;
+      }
+    }
+    assert(params->size_ < Params::kMaxParams);
+    params->names_[params->size_] = names_[node.nameIndex];
+    params->values_[params->size_].set(pos, static_cast<int>(segEnd - pos));
+    ++params->size_;
+    pos = segEnd;
+  }
+
+  if (pos == end)
+  {
+    *handler = findHandler(node, method);
+    if (*handler)
+    {
+      return true;
+    }
+  }
+  else
+  {
+    for (int i = node.firstChild; i < node.firstChild + node.numChildren; ++i)
+    {
+      if (labels_[nodes_[i].labelOffset] == *pos)
+      {
+        if (matchNode(i, pos, end, method, params, handler))
+        {
+          return true;
+        }
+        break;
+      }
+    }
+    if (node.paramChild >= 0
+        && matchNode(node.paramChild, pos, end, method, params, handler))
+    {
+      return true;
+    }
+  }
+
+  if (node.catchAllChild >= 0
+      && matchNode(node.catchAllChild, pos, end, method, params, handler))
+  {
+    return true;
+  }
+
+  params->size_ = savedSize;
+  return false;
+}
+
+const HttpRouter::Handler* HttpRouter::findHandler(const Node& node,
+                                                   HttpRequest::Method method) const
+{
+  int h = node.handlers[method];
+  if (h < 0)
+  {
+    h = node.handlers[HttpRequest::kInvalid];
+  }
+  return h >= 0 ? &handlers_[h] : NULL;
+}
+
+void HttpRouter::onRequest(const HttpRequest& req, HttpResponse* resp) const
+{
+  Params params;
+  const Handler* handler = match(req.method(), req.path(), &params);
+  if (handler)
+  {
+    (*handler)(req, params, resp);
+  }
+  else
+  {
+    notFoundCallback_(req, resp);
+  }
+}
@@ -0,0 +1,207 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_HTTPROUTER_H
+#define MUDUO_NET_HTTP_HTTPROUTER_H
+
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Types.h>
+#include <muduo/net/http/HttpRequest.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+
+class HttpResponse;
+
+///
+/// Dispatches HTTP requests by method and path.
+///
+/// Routes are patterns made of static text, named parameters and
+/// an optional trailing catch-all, e.g.
+/// @code
+///   /
+///   /users/:id
+///   /users/:id/files/*path
+/// @endcode
+/// A parameter matches one non-empty path segment, a catch-all matches
+/// the rest of the path (possibly empty).  When several routes could match,
+/// static text wins over a parameter, which wins over a catch-all.
+///
+/// All routes must be added and compile() called before the router is used.
+/// After that it is read-only, so one router can serve all IO threads of
+/// an HttpServer.  Matching does not allocate memory.
+class HttpRouter : boost::noncopyable
+{
+ public:
+  /// Parameters captured by a match, pointing into the request path
+  /// and the router, valid during the handler call only.
+  class Params
+  {
+   public:
+    static const int kMaxParams = 8;
+
+    Params()
+      : size_(0)
+    {
+    }
+
+    int size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    StringPiece name(int i) const
+    {
+      assert(0 <= i && i < size_);
+      return names_[i];
+    }
+
+    StringPiece value(int i) const
+    {
+      assert(0 <= i && i < size_);
+      return values_[i];
+    }
+
+    /// Returns empty StringPiece if not found.
+    StringPiece get(const StringPiece& name) const
+    {
+      for (int i = 0; i < size_; ++i)
+      {
+        if (names_[i] == name)
+        {
+          return values_[i];
+        }
+      }
+      return StringPiece();
+    }
+
+   private:
+    friend class HttpRouter;
+
+    StringPiece names_[kMaxParams];
+    StringPiece values_[kMaxParams];
+    int size_;
+  };
+
+  typedef boost::function<void (const HttpRequest&,
+                                const Params&,
+                                HttpResponse*)> Handler;
+  typedef boost::function<void (const HttpRequest&,
+                                HttpResponse*)> NotFoundCallback;
+
+  HttpRouter();
+  ~HttpRouter();
+
+  /// Registers handler for method and pattern.
+  /// Use HttpRequest::kInvalid to match any method.
+  /// Returns false if pattern is malformed or conflicts with existing routes.
+  /// Not thread safe, must be called before compile().
+  bool addRoute(HttpRequest::Method method,
+                const string& pattern,
+                const Handler& handler);
+
+  bool get(const string& pattern, const Handler& handler)
+  { return addRoute(HttpRequest::kGet, pattern, handler); }
+
+  bool post(const string& pattern, const Handler& handler)
+  { return addRoute(HttpRequest::kPost, pattern, handler); }
+
+  void setNotFoundCallback(const NotFoundCallback& cb)
+  { notFoundCallback_ = cb; }
+
+  /// Flattens registered routes into the lookup table.
+  void compile();
+
+  bool compiled() const { return compiled_; }
+
+  /// Finds handler for method and path, fills params.
+  /// Returns NULL if no route matches.
+  const Handler* match(HttpRequest::Method method,
+                       const StringPiece& path,
+                       Params* params) const;
+
+  /// Suitable for HttpServer::setHttpCallback(), e.g.
+  /// @code
+  ///   server.setHttpCallback(boost::bind(&HttpRouter::onRequest, &router, _1, _2));
+  /// @endcode
+  void onRequest(const HttpRequest& req, HttpResponse* resp) const;
+
+ private:
+  enum NodeKind
+  {
+    kStatic, kParam, kCatchAll,
+  };
+
+  static const int kNumMethods = HttpRequest::kDelete + 1;
+
+  // mutable tree, built by addRoute()
+  struct BuildNode
+  {
+    BuildNode(NodeKind k, const string& l)
+      : kind(k),
+        label(l),
+        paramChild(-1),
+        catchAllChild(-1)
+    {
+      std::fill(handlers, handlers + kNumMethods, -1);
+    }
+
+    NodeKind kind;
+    string label;       // static text, or parameter name
+    std::vector<int> staticChildren;
+    int paramChild;
+    int catchAllChild;
+    int handlers[kNumMethods];  // index of handlers_
+  };
+
+  // flat tree, built by compile(), children of a node are adjacent
+  struct Node
+  {
+    NodeKind kind;
+    int labelOffset;    // into labels_, for kStatic
+    int labelLength;
+    int nameIndex;      // into names_, for kParam and kCatchAll
+    int firstChild;     // static children
+    int numChildren;
+    int paramChild;
+    int catchAllChild;
+    int handlers[kNumMethods];
+  };
+
+  int insertStatic(int node, StringPiece text);
+  int insertParam(int node, NodeKind kind, const string& name);
+  bool matchNode(int node,
+                 const char* pos,
+                 const char* end,
+                 HttpRequest::Method method,
+                 Params* params,
+                 const Handler** handler) const;
+  const Handler* findHandler(const Node& node, HttpRequest::Method method) const;
+
+  std::vector<BuildNode> tree_;
+  std::vector<Handler> handlers_;
+  NotFoundCallback notFoundCallback_;
+  bool compiled_;
+
+  std::vector<Node> nodes_;
+  string labels_;
+  std::vector<string> names_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_HTTPROUTER_H
@@ -10,9 +10,11 @@
 #include <muduo/net/http/HttpServer.h>
 
 #include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
 #include <muduo/net/http/HttpContext.h>
 #include <muduo/net/http/HttpRequest.h>
 #include <muduo/net/http/HttpResponse.h>
+#include <muduo/net/http/WebSocketContext.h>
 
 #include <boost/bind.hpp>
 
@@ -173,12 +175,35 @@ void HttpServer::onConnection(const TcpConnectionPtr& conn)
   {
     conn->setContext(HttpContext());
   }
+  else
+  {
+    WebSocketContext* ws = boost::any_cast<WebSocketContext>(conn->getMutableContext());
+    if (ws)
+    {
+      if (ws->hasTimer())
+      {
+        conn->getLoop()->cancel(ws->pingTimer());
+      }
+      if (webSocketCloseCallback_)
+      {
+        webSocketCloseCallback_(conn);
+      }
+    }
+  }
 }
 
 void HttpServer::onMessage(const TcpConnectionPtr& conn,
                            Buffer* buf,
                            Timestamp receiveTime)
 {
+  WebSocketContext* ws = boost::any_cast<WebSocketContext>(conn->getMutableContext());
+  if (ws)
+  {
+    websocket::detail::onMessage(conn, buf, receiveTime, ws,
+                                 webSocketOptions_, webSocketMessageCallback_);
+    return;
+  }
+
   HttpContext* context = boost::any_cast<HttpContext>(conn->getMutableContext());
 
   if (!detail::parseRequest(buf, context, receiveTime))
@@ -189,11 +214,36 @@ void HttpServer::onMessage(const TcpConnectionPtr& conn,
 
   if (context->gotAll())
   {
+    if (webSocketMessageCallback_ && websocket::detail::isUpgrade(context->request()))
+    {
+      // context is replaced by upgrade
+      HttpRequest req(context->request());
+      onUpgrade(conn, req, receiveTime);
+      ws = boost::any_cast<WebSocketContext>(conn->getMutableContext());
+      if (ws && buf->readableBytes() > 0)
+      {
+        websocket::detail::onMessage(conn, buf, receiveTime, ws,
+                                     webSocketOptions_, webSocketMessageCallback_);
+      }
+      return;
+    }
     onRequest(conn, context->request());
     context->reset();
   }
 }
 
+void HttpServer::onUpgrade(const TcpConnectionPtr& conn,
+                           const HttpRequest& req,
+                           Timestamp receiveTime)
+{
+  if (websocket::detail::handshake(conn, req, receiveTime, webSocketOptions_)
+      && webSocketOpenCallback_
+      && !webSocketOpenCallback_(conn, req))
+  {
+    websocket::close(conn, websocket::kPolicyViolation);
+  }
+}
+
 void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
 {
   const string& connection = req.getHeader("Connection");
@@ -202,7 +252,14 @@ void HttpServer::onRequest(const TcpConnectionPtr& conn, const HttpRequest& req)
   HttpResponse response(close);
   httpCallback_(req, &response);
   Buffer buf;
-  response.appendToBuffer(&buf);
+  if (compressor_)
+  {
+    compressor_->appendToBuffer(req, &response, &buf);
+  }
+  else
+  {
+    response.appendToBuffer(&buf);
+  }
   conn->send(&buf);
   if (response.closeConnection())
   {
@@ -12,7 +12,10 @@
 #define MUDUO_NET_HTTP_HTTPSERVER_H
 
 #include <muduo/net/TcpServer.h>
+#include <muduo/net/http/HttpCompressor.h>
+#include <muduo/net/http/WebSocket.h>
 #include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
 
 namespace muduo
 {
@@ -52,6 +55,31 @@ class HttpServer : boost::noncopyable
     server_.setThreadNum(numThreads);
   }
 
+  /// Compresses response bodies with gzip or deflate when client accepts.
+  /// Not thread safe, must be called before calling start().
+  void enableCompression(const HttpCompressor::Options& options = HttpCompressor::Options())
+  {
+    compressor_.reset(new HttpCompressor(options));
+  }
+
+  HttpCompressor* compressor() const
+  { return get_pointer(compressor_); }
+
+  /// Upgrades GET requests with "Upgrade: websocket" when set,
+  /// the connection then carries WebSocket frames, see websocket::send().
+  /// Not thread safe, callback be registered before calling start().
+  void setWebSocketMessageCallback(const websocket::MessageCallback& cb)
+  { webSocketMessageCallback_ = cb; }
+
+  void setWebSocketOpenCallback(const websocket::OpenCallback& cb)
+  { webSocketOpenCallback_ = cb; }
+
+  void setWebSocketCloseCallback(const websocket::CloseCallback& cb)
+  { webSocketCloseCallback_ = cb; }
+
+  void setWebSocketOptions(const websocket::Options& options)
+  { webSocketOptions_ = options; }
+
   void start();
 
  private:
@@ -60,9 +88,15 @@ class HttpServer : boost::noncopyable
                  Buffer* buf,
                  Timestamp receiveTime);
   void onRequest(const TcpConnectionPtr&, const HttpRequest&);
+  void onUpgrade(const TcpConnectionPtr&, const HttpRequest&, Timestamp receiveTime);
 
   TcpServer server_;
   HttpCallback httpCallback_;
+  boost::scoped_ptr<HttpCompressor> compressor_;
+  websocket::Options webSocketOptions_;
+  websocket::OpenCallback webSocketOpenCallback_;
+  websocket::MessageCallback webSocketMessageCallback_;
+  websocket::CloseCallback webSocketCloseCallback_;
 };
 
 }
@@ -0,0 +1,755 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+
+#include <muduo/net/http/WebSocket.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/WebSocketContext.h>
+
+#include <boost/bind.hpp>
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include <zlib.h>
+
+// zlib init macros use old style casts
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+// enough for SHA-1 of Sec-WebSocket-Key, RFC 3174
+class Sha1
+{
+ public:
+  Sha1()
+    : length_(0),
+      blockSize_(0)
+  {
+    h_[0] = 0x67452301;
+    h_[1] = 0xEFCDAB89;
+    h_[2] = 0x98BADCFE;
+    h_[3] = 0x10325476;
+    h_[4] = 0xC3D2E1F0;
+  }
+
+  void update(const void* data, size_t len)
+  {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    length_ += len;
+    while (len > 0)
+    {
+      size_t n = std::min(len, sizeof block_ - blockSize_);
+      memcpy(block_ + blockSize_, p, n);
+      blockSize_ += n;
+      p += n;
+      len -= n;
+      if (blockSize_ == sizeof block_)
+      {
+        transform();
+        blockSize_ = 0;
+      }
+    }
+  }
+
+  void final(unsigned char digest[20])
+  {
+    uint64_t bits = length_ * 8;
+    const unsigned char pad = 0x80;
+    update(&pad, 1);
+    const unsigned char zero = 0;
+    while (blockSize_ != 56)
+    {
+      update(&zero, 1);
+    }
+    unsigned char len[8];
+    for (int i = 0; i < 8; ++i)
+    {
+      len[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+    }
+    update(len, sizeof len);
+    for (int i = 0; i < 20; ++i)
+    {
+      digest[i] = static_cast<unsigned char>(h_[i / 4] >> (24 - 8 * (i % 4)));
+    }
+  }
+
+ private:
+  static uint32_t rotl(uint32_t x, int n)
+  { return (x << n) | (x >> (32 - n)); }
+
+  void transform()
+  {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i)
+    {
+      w[i] = static_cast<uint32_t>(block_[4*i]) << 24
+          | static_cast<uint32_t>(block_[4*i+1]) << 16
+          | static_cast<uint32_t>(block_[4*i+2]) << 8
+          | static_cast<uint32_t>(block_[4*i+3]);
+    }
+    for (int i = 16; i < 80; ++i)
+    {
+      w[i] = rotl(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+    }
+    uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4];
+    for (int i = 0; i < 80; ++i)
+    {
+      uint32_t f, k;
+      if (i < 20)
+      {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      }
+      else if (i < 40)
+      {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      }
+      else if (i < 60)
+      {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      }
+      else
+      {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotl(b, 30);
+      b = a;
+      a = temp;
+    }
+    h_[0] += a;
+    h_[1] += b;
+    h_[2] += c;
+    h_[3] += d;
+    h_[4] += e;
+  }
+
+  uint32_t h_[5];
+  uint64_t length_;
+  unsigned char block_[64];
+  size_t blockSize_;
+};
+
+string base64(const unsigned char* data, size_t len)
+{
+  static const char kAlphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  string result;
+  result.reserve((len + 2) / 3 * 4);
+  for (size_t i = 0; i < len; i += 3)
+  {
+    uint32_t n = static_cast<uint32_t>(data[i]) << 16;
+    if (i + 1 < len) n |= static_cast<uint32_t>(data[i+1]) << 8;
+    if (i + 2 < len) n |= data[i+2];
+    result += kAlphabet[(n >> 18) & 63];
+    result += kAlphabet[(n >> 12) & 63];
+    result += i + 1 < len ? kAlphabet[(n >> 6) & 63] : '=';
+    result += i + 2 < len ? kAlphabet[n & 63] : '=';
+  }
+  return result;
+}
+
+// case-insensitive search of a token in a comma separated header value
+bool containsToken(const string& value, const char* token)
+{
+  const size_t len = strlen(token);
+  for (size_t i = 0; i + len <= value.size(); ++i)
+  {
+    if (::strncasecmp(value.c_str() + i, token, len) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void sendInLoop(const TcpConnectionPtr& conn, const websocket::Message& message)
+{
+  WebSocketContext* context = boost::any_cast<WebSocketContext>(conn->getMutableContext());
+  if (context && !context->closing())
+  {
+    conn->send(message.frame(context->deflate()));
+  }
+}
+
+void closeInLoop(const TcpConnectionPtr& conn, int code, const string& reason)
+{
+  WebSocketContext* context = boost::any_cast<WebSocketContext>(conn->getMutableContext());
+  if (context && !context->closing())
+  {
+    char payload[2] = { static_cast<char>(code >> 8), static_cast<char>(code & 0xFF) };
+    string body(payload, sizeof payload);
+    body += reason.substr(0, 123);
+    Buffer buf;
+    websocket::appendFrame(&buf, websocket::kClose, body);
+    conn->send(&buf);
+    context->setClosing();
+    conn->shutdown();
+  }
+}
+
+}
+
+namespace muduo
+{
+namespace net
+{
+namespace websocket
+{
+namespace detail
+{
+
+void unmask(char* data, size_t len, const char* maskKey)
+{
+  // a word at a time, compilers vectorize this loop
+  char key8[8];
+  memcpy(key8, maskKey, 4);
+  memcpy(key8 + 4, maskKey, 4);
+  uint64_t key;
+  memcpy(&key, key8, sizeof key);
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof word);
+    word ^= key;
+    memcpy(data + i, &word, sizeof word);
+  }
+  for (; i < len; ++i)
+  {
+    data[i] = static_cast<char>(data[i] ^ maskKey[i & 3]);
+  }
+}
+
+bool isValidUtf8(const StringPiece& text)
+{
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+  const unsigned char* end = p + text.size();
+  while (p < end)
+  {
+    if (end - p >= 8)
+    {
+      // skips ASCII a word at a time
+      uint64_t word;
+      memcpy(&word, p, sizeof word);
+      if ((word & 0x8080808080808080ULL) == 0)
+      {
+        p += 8;
+        continue;
+      }
+    }
+    const unsigned char c = *p;
+    if (c < 0x80)
+    {
+      ++p;
+      continue;
+    }
+    int trailing = 0;
+    unsigned char low = 0x80;   // range of the second byte
+    unsigned char high = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF)
+    {
+      trailing = 1;
+    }
+    else if (c >= 0xE0 && c <= 0xEF)
+    {
+      trailing = 2;
+      if (c == 0xE0) low = 0xA0;        // overlong
+      else if (c == 0xED) high = 0x9F;  // surrogates
+    }
+    else if (c >= 0xF0 && c <= 0xF4)
+    {
+      trailing = 3;
+      if (c == 0xF0) low = 0x90;        // overlong
+      else if (c == 0xF4) high = 0x8F;  // above U+10FFFF
+    }
+    else
+    {
+      return false;
+    }
+    if (end - p <= trailing || p[1] < low || p[1] > high)
+    {
+      return false;
+    }
+    for (int i = 2; i <= trailing; ++i)
+    {
+      if ((p[i] & 0xC0) != 0x80)
+      {
+        return false;
+      }
+    }
+    p += trailing + 1;
+  }
+  return true;
+}
+
+bool isValidCloseCode(int code)
+{
+  // 1004-1006 and 1015 are reserved, 1016-2999 unassigned
+  return (code >= 1000 && code <= 1003)
+      || (code >= 1007 && code <= 1014)
+      || (code >= 3000 && code <= 4999);
+}
+
+void appendMaskedFrame(Buffer* output,
+                       Opcode opcode,
+                       const StringPiece& payload,
+                       bool fin,
+                       bool rsv1,
+                       const char* maskKey)
+{
+  unsigned char header[14];
+  size_t n = 0;
+  header[n++] = static_cast<unsigned char>((fin ? 0x80 : 0) | (rsv1 ? 0x40 : 0) | opcode);
+  const int maskBit = maskKey ? 0x80 : 0;
+  const size_t len = implicit_cast<size_t>(payload.size());
+  if (len < 126)
+  {
+    header[n++] = static_cast<unsigned char>(maskBit | static_cast<int>(len));
+  }
+  else if (len <= 0xFFFF)
+  {
+    header[n++] = static_cast<unsigned char>(maskBit | 126);
+    header[n++] = static_cast<unsigned char>(len >> 8);
+    header[n++] = static_cast<unsigned char>(len);
+  }
+  else
+  {
+    header[n++] = static_cast<unsigned char>(maskBit | 127);
+    for (int shift = 56; shift >= 0; shift -= 8)
+    {
+      header[n++] = static_cast<unsigned char>(static_cast<uint64_t>(len) >> shift);
+    }
+  }
+  if (maskKey)
+  {
+    memcpy(header + n, maskKey, 4);
+    n += 4;
+  }
+  output->append(header, n);
+  output->append(payload.data(), len);
+  if (maskKey)
+  {
+    unmask(output->beginWrite() - len, len, maskKey);
+  }
+}
+
+ParseResult parseFrame(Buffer* buf,
+                       bool allowRsv1,
+                       size_t maxPayload,
+                       Frame* frame)
+{
+  const size_t readable = buf->readableBytes();
+  if (readable < 2)
+  {
+    return kNeedMore;
+  }
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(buf->peek());
+  const int opcode = p[0] & 0x0F;
+  frame->fin = (p[0] & 0x80) != 0;
+  frame->rsv1 = (p[0] & 0x40) != 0;
+  frame->opcode = static_cast<Opcode>(opcode);
+  frame->closeCode = kProtocolError;
+  const bool masked = (p[1] & 0x80) != 0;
+  uint64_t len = p[1] & 0x7F;
+
+  const bool control = opcode >= kClose;
+  if ((p[0] & 0x30) != 0
+      || (frame->rsv1 && (!allowRsv1 || control))
+      || (opcode > kBinary && opcode < kClose)
+      || opcode > kPong
+      || (control && (!frame->fin || len > 125))
+      || !masked)  // client frames must be masked
+  {
+    return kError;
+  }
+
+  size_t header = 2;
+  if (len == 126)
+  {
+    if (readable < 4)
+    {
+      return kNeedMore;
+    }
+    len = static_cast<uint64_t>(p[2]) << 8 | p[3];
+    header = 4;
+  }
+  else if (len == 127)
+  {
+    if (readable < 10)
+    {
+      return kNeedMore;
+    }
+    len = 0;
+    for (int i = 2; i < 10; ++i)
+    {
+      len = len << 8 | p[i];
+    }
+    header = 10;
+  }
+  if (len > maxPayload)
+  {
+    frame->closeCode = kMessageTooBig;
+    return kError;
+  }
+
+  header += 4;
+  if (readable < header || readable - header < len)
+  {
+    return kNeedMore;
+  }
+  char* payload = const_cast<char*>(buf->peek()) + header;
+  unmask(payload, static_cast<size_t>(len), payload - 4);
+  frame->payload = StringPiece(payload, static_cast<int>(len));
+  frame->length = header + static_cast<size_t>(len);
+  return kFrame;
+}
+
+bool deflateMessage(const StringPiece& payload, string* output)
+{
+  z_stream zs;
+  bzero(&zs, sizeof zs);
+  if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                   -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    return false;
+  }
+  // sync flush adds a few bytes to the bound
+  output->resize(deflateBound(&zs, static_cast<uLong>(payload.size())) + 16);
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(payload.data()));
+  zs.avail_in = static_cast<uInt>(payload.size());
+  zs.next_out = reinterpret_cast<Bytef*>(&*output->begin());
+  zs.avail_out = static_cast<uInt>(output->size());
+  const int ret = deflate(&zs, Z_SYNC_FLUSH);
+  const size_t n = output->size() - zs.avail_out;
+  bool ok = ret == Z_OK && zs.avail_in == 0 && zs.avail_out > 0 && n >= 4;
+  deflateEnd(&zs);
+  // RFC 7692 section 7.2.1, removes 00 00 ff ff
+  output->resize(ok ? n - 4 : 0);
+  return ok;
+}
+
+int inflateMessage(string* message, size_t maxSize, string* output)
+{
+  z_stream zs;
+  bzero(&zs, sizeof zs);
+  if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+  {
+    return kInternalError;
+  }
+  message->append("\x00\x00\xff\xff", 4);
+  zs.next_in = reinterpret_cast<Bytef*>(&*message->begin());
+  zs.avail_in = static_cast<uInt>(message->size());
+  const size_t kChunk = 64 * 1024;
+  output->clear();
+  int error = 0;
+  while (error == 0)
+  {
+    const size_t used = output->size();
+    output->resize(used + kChunk);
+    zs.next_out = reinterpret_cast<Bytef*>(&*output->begin() + used);
+    zs.avail_out = static_cast<uInt>(kChunk);
+    const int ret = inflate(&zs, Z_SYNC_FLUSH);
+    output->resize(used + kChunk - zs.avail_out);
+    if (ret == Z_BUF_ERROR && zs.avail_in == 0)
+    {
+      // the last chunk was filled exactly, no progress since
+      break;
+    }
+    else if (ret != Z_OK && ret != Z_STREAM_END)
+    {
+      error = kInvalidPayload;
+    }
+    else if (output->size() > maxSize)
+    {
+      error = kMessageTooBig;
+    }
+    else if (ret == Z_STREAM_END || (zs.avail_in == 0 && zs.avail_out > 0))
+    {
+      break;
+    }
+  }
+  inflateEnd(&zs);
+  return error;
+}
+
+bool isUpgrade(const HttpRequest& req)
+{
+  return req.method() == HttpRequest::kGet
+      && ::strcasecmp(req.getHeader("Upgrade").c_str(), "websocket") == 0
+      && containsToken(req.getHeader("Connection"), "upgrade");
+}
+
+bool handshake(const TcpConnectionPtr& conn,
+               const HttpRequest& req,
+               Timestamp receiveTime,
+               const Options& options)
+{
+  const string& key = req.getHeader("Sec-WebSocket-Key");
+  if (key.empty() || req.getHeader("Sec-WebSocket-Version") != "13")
+  {
+    conn->send("HTTP/1.1 400 Bad Request\r\n"
+               "Sec-WebSocket-Version: 13\r\n"
+               "\r\n");
+    conn->shutdown();
+    return false;
+  }
+
+  const bool deflate = options.deflate
+      && containsToken(req.getHeader("Sec-WebSocket-Extensions"), "permessage-deflate");
+  Buffer buf;
+  buf.append("HTTP/1.1 101 Switching Protocols\r\n"
+             "Upgrade: websocket\r\n"
+             "Connection: Upgrade\r\n"
+             "Sec-WebSocket-Accept: ");
+  buf.append(acceptKey(key));
+  buf.append("\r\n");
+  if (deflate)
+  {
+    buf.append("Sec-WebSocket-Extensions: permessage-deflate; "
+               "server_no_context_takeover; client_no_context_takeover\r\n");
+  }
+  buf.append("\r\n");
+  conn->send(&buf);
+
+  WebSocketContext context;
+  context.setDeflate(deflate);
+  context.setLastReceiveTime(receiveTime);
+  if (options.pingInterval > 0)
+  {
+    boost::weak_ptr<TcpConnection> weakConn(conn);
+    context.setPingTimer(conn->getLoop()->runEvery(
+        options.pingInterval,
+        boost::bind(&onPingTimer, weakConn, options.pingInterval)));
+  }
+  conn->setContext(context);
+  return true;
+}
+
+void onMessage(const TcpConnectionPtr& conn,
+               Buffer* buf,
+               Timestamp receiveTime,
+               WebSocketContext* context,
+               const Options& options,
+               const MessageCallback& cb)
+{
+  context->setLastReceiveTime(receiveTime);
+  while (!context->closing())
+  {
+    Frame frame;
+    ParseResult result = parseFrame(buf, context->deflate(), options.maxMessageSize, &frame);
+    if (result == kNeedMore)
+    {
+      break;
+    }
+    else if (result == kError)
+    {
+      LOG_ERROR << "websocket::onMessage [" << conn->name()
+                << "] - bad frame, close " << frame.closeCode;
+      closeInLoop(conn, frame.closeCode, string());
+      break;
+    }
+
+    int error = 0;
+    if (frame.opcode == kPing)
+    {
+      Buffer pong;
+      appendFrame(&pong, kPong, frame.payload);
+      conn->send(&pong);
+    }
+    else if (frame.opcode == kClose)
+    {
+      // echo status code, if it is valid
+      const unsigned char* p = reinterpret_cast<const unsigned char*>(frame.payload.data());
+      int code = kNormalClosure;
+      if (frame.payload.size() == 1)
+      {
+        code = kProtocolError;
+      }
+      else if (frame.payload.size() >= 2)
+      {
+        code = p[0] << 8 | p[1];
+        if (!isValidCloseCode(code))
+        {
+          code = kProtocolError;
+        }
+        else if (!isValidUtf8(StringPiece(frame.payload.data() + 2, frame.payload.size() - 2)))
+        {
+          code = kInvalidPayload;
+        }
+      }
+      closeInLoop(conn, code, string());
+    }
+    else if (frame.opcode != kPong)
+    {
+      // kText, kBinary or kContinuation
+      if ((frame.opcode == kContinuation) != context->inMessage()
+          || (frame.opcode == kContinuation && frame.rsv1))
+      {
+        error = kProtocolError;
+      }
+      else if (context->message()->size() + implicit_cast<size_t>(frame.payload.size())
+               > options.maxMessageSize)
+      {
+        error = kMessageTooBig;
+      }
+      else
+      {
+        if (!context->inMessage())
+        {
+          context->startMessage(frame.opcode, frame.rsv1);
+        }
+        context->message()->append(frame.payload.data(), frame.payload.size());
+      }
+
+      if (error == 0 && frame.fin)
+      {
+        string* message = context->message();
+        string inflated;
+        if (context->messageCompressed())
+        {
+          error = inflateMessage(message, options.maxMessageSize, &inflated);
+          if (error == 0)
+          {
+            message->swap(inflated);
+          }
+        }
+        if (error == 0 && context->messageOpcode() == kText && !isValidUtf8(*message))
+        {
+          error = kInvalidPayload;
+        }
+        if (error == 0)
+        {
+          cb(conn, *message, context->messageOpcode());
+          context->finishMessage();
+        }
+      }
+    }
+
+    buf->retrieve(frame.length);
+    if (error != 0)
+    {
+      closeInLoop(conn, error, string());
+    }
+  }
+
+  if (context->closing())
+  {
+    buf->retrieveAll();
+  }
+}
+
+void onPingTimer(const boost::weak_ptr<TcpConnection>& weakConn,
+                 double interval)
+{
+  TcpConnectionPtr conn(weakConn.lock());
+  if (conn && conn->connected())
+  {
+    WebSocketContext* context = boost::any_cast<WebSocketContext>(conn->getMutableContext());
+    if (context == NULL)
+    {
+      return;
+    }
+    if (timeDifference(Timestamp::now(), context->lastReceiveTime()) > 2 * interval)
+    {
+      LOG_WARN << "websocket::onPingTimer [" << conn->name() << "] - timeout";
+      conn->forceClose();
+    }
+    else if (!context->closing())
+    {
+      Buffer ping;
+      appendFrame(&ping, kPing, StringPiece());
+      conn->send(&ping);
+    }
+  }
+}
+
+}
+
+Message::Message(const StringPiece& payload, Opcode opcode, bool compress)
+{
+  Buffer buf;
+  appendFrame(&buf, opcode, payload);
+  plain_.reset(new string(buf.retrieveAllAsString()));
+
+  string deflated;
+  if (compress
+      && detail::deflateMessage(payload, &deflated)
+      && deflated.size() < implicit_cast<size_t>(payload.size()))
+  {
+    detail::appendMaskedFrame(&buf, opcode, deflated, true, true, NULL);
+    deflated_.reset(new string(buf.retrieveAllAsString()));
+  }
+}
+
+void send(const TcpConnectionPtr& conn, const Message& message)
+{
+  EventLoop* loop = conn->getLoop();
+  if (loop->isInLoopThread())
+  {
+    sendInLoop(conn, message);
+  }
+  else
+  {
+    loop->queueInLoop(boost::bind(&sendInLoop, conn, message));
+  }
+}
+
+void send(const TcpConnectionPtr& conn, const StringPiece& payload, Opcode opcode)
+{
+  send(conn, Message(payload, opcode));
+}
+
+void close(const TcpConnectionPtr& conn, CloseCode code, const StringPiece& reason)
+{
+  EventLoop* loop = conn->getLoop();
+  if (loop->isInLoopThread())
+  {
+    closeInLoop(conn, code, reason.as_string());
+  }
+  else
+  {
+    loop->queueInLoop(boost::bind(&closeInLoop, conn, static_cast<int>(code), reason.as_string()));
+  }
+}
+
+void appendFrame(Buffer* output, Opcode opcode, const StringPiece& payload, bool fin)
+{
+  detail::appendMaskedFrame(output, opcode, payload, fin, false, NULL);
+}
+
+string acceptKey(const StringPiece& key)
+{
+  static const char kGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+  Sha1 sha1;
+  sha1.update(key.data(), implicit_cast<size_t>(key.size()));
+  sha1.update(kGuid, sizeof kGuid - 1);
+  unsigned char digest[20];
+  sha1.final(digest);
+  return base64(digest, sizeof digest);
+}
+
+}
+}
+}
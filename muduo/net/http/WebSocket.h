@@ -0,0 +1,134 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_HTTP_WEBSOCKET_H
+#define MUDUO_NET_HTTP_WEBSOCKET_H
+
+#include <muduo/base/copyable.h>
+#include <muduo/base/StringPiece.h>
+#include <muduo/base/Types.h>
+#include <muduo/net/Callbacks.h>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace muduo
+{
+namespace net
+{
+
+class Buffer;
+class HttpRequest;
+
+///
+/// WebSocket (RFC 6455) on connections upgraded by HttpServer.
+///
+/// Server frames are never masked, so a frame encoded once can be sent
+/// to any number of connections, see Message.
+///
+namespace websocket
+{
+
+enum Opcode
+{
+  kContinuation = 0x0,
+  kText = 0x1,
+  kBinary = 0x2,
+  kClose = 0x8,
+  kPing = 0x9,
+  kPong = 0xA,
+};
+
+enum CloseCode
+{
+  kNormalClosure = 1000,
+  kGoingAway = 1001,
+  kProtocolError = 1002,
+  kUnsupportedData = 1003,
+  kInvalidPayload = 1007,   // text not UTF-8
+  kPolicyViolation = 1008,
+  kMessageTooBig = 1009,
+  kInternalError = 1011,
+};
+
+struct Options
+{
+  Options()
+    : pingInterval(30.0),
+      maxMessageSize(16 * 1024 * 1024),
+      deflate(false)
+  {
+  }
+
+  /// Seconds between pings, 0 disables keepalive.
+  /// Connection is closed if nothing is received in two intervals.
+  double pingInterval;
+  /// Larger messages are refused with kMessageTooBig.
+  size_t maxMessageSize;
+  /// Accepts permessage-deflate (RFC 7692) without context takeover.
+  bool deflate;
+};
+
+/// Called after handshake, return false to close with kPolicyViolation.
+typedef boost::function<bool (const TcpConnectionPtr&,
+                              const HttpRequest&)> OpenCallback;
+/// Called with a complete (reassembled, inflated) text or binary message.
+typedef boost::function<void (const TcpConnectionPtr&,
+                              const string& message,
+                              Opcode opcode)> MessageCallback;
+typedef boost::function<void (const TcpConnectionPtr&)> CloseCallback;
+
+/// A message encoded once, to be sent to many connections.
+class Message : public muduo::copyable
+{
+ public:
+  /// If compress, a deflated frame is also made for connections
+  /// that negotiated permessage-deflate.
+  explicit Message(const StringPiece& payload,
+                   Opcode opcode = kText,
+                   bool compress = false);
+
+  // default copy-ctor, dtor and assignment are fine
+
+  const string& frame(bool deflate) const
+  { return deflate && deflated_ ? *deflated_ : *plain_; }
+
+ private:
+  boost::shared_ptr<const string> plain_;
+  boost::shared_ptr<const string> deflated_;
+};
+
+/// Thread safe, dropped if conn is not an open WebSocket.
+void send(const TcpConnectionPtr& conn, const Message& message);
+void send(const TcpConnectionPtr& conn,
+          const StringPiece& payload,
+          Opcode opcode = kText);
+
+/// Sends a close frame and shuts down writing.
+/// Thread safe.
+void close(const TcpConnectionPtr& conn,
+           CloseCode code = kNormalClosure,
+           const StringPiece& reason = StringPiece());
+
+/// Encodes one unmasked frame.
+void appendFrame(Buffer* output,
+                 Opcode opcode,
+                 const StringPiece& payload,
+                 bool fin = true);
+
+/// Sec-WebSocket-Accept for Sec-WebSocket-Key.
+string acceptKey(const StringPiece& key);
+
+}
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_WEBSOCKET_H
@@ -0,0 +1,196 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_HTTP_WEBSOCKETCONTEXT_H
+#define MUDUO_NET_HTTP_WEBSOCKETCONTEXT_H
+
+#include <muduo/base/copyable.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/TimerId.h>
+#include <muduo/net/http/WebSocket.h>
+
+#include <boost/weak_ptr.hpp>
+
+namespace muduo
+{
+namespace net
+{
+
+/// Connection context after upgrade, replaces HttpContext.
+class WebSocketContext : public muduo::copyable
+{
+ public:
+  WebSocketContext()
+    : deflate_(false),
+      closing_(false),
+      hasTimer_(false),
+      messageOpcode_(websocket::kContinuation),
+      messageCompressed_(false)
+  {
+  }
+
+  // default copy-ctor, dtor and assignment are fine
+
+  /// permessage-deflate negotiated
+  bool deflate() const
+  { return deflate_; }
+
+  void setDeflate(bool on)
+  { deflate_ = on; }
+
+  /// close frame sent, nothing more to send or deliver
+  bool closing() const
+  { return closing_; }
+
+  void setClosing()
+  { closing_ = true; }
+
+  Timestamp lastReceiveTime() const
+  { return lastReceiveTime_; }
+
+  void setLastReceiveTime(Timestamp t)
+  { lastReceiveTime_ = t; }
+
+  bool hasTimer() const
+  { return hasTimer_; }
+
+  TimerId pingTimer() const
+  { return pingTimer_; }
+
+  void setPingTimer(TimerId timer)
+  {
+    pingTimer_ = timer;
+    hasTimer_ = true;
+  }
+
+  /// a fragmented message is being received
+  bool inMessage() const
+  { return messageOpcode_ != websocket::kContinuation; }
+
+  websocket::Opcode messageOpcode() const
+  { return messageOpcode_; }
+
+  bool messageCompressed() const
+  { return messageCompressed_; }
+
+  void startMessage(websocket::Opcode opcode, bool compressed)
+  {
+    messageOpcode_ = opcode;
+    messageCompressed_ = compressed;
+  }
+
+  string* message()
+  { return &message_; }
+
+  void finishMessage()
+  {
+    messageOpcode_ = websocket::kContinuation;
+    messageCompressed_ = false;
+    string empty;
+    message_.swap(empty);
+  }
+
+ private:
+  bool deflate_;
+  bool closing_;
+  bool hasTimer_;
+  TimerId pingTimer_;
+  Timestamp lastReceiveTime_;
+  websocket::Opcode messageOpcode_;
+  bool messageCompressed_;
+  string message_;
+};
+
+namespace websocket
+{
+namespace detail
+{
+
+struct Frame
+{
+  Frame()
+    : fin(false),
+      rsv1(false),
+      opcode(kContinuation),
+      length(0),
+      closeCode(kProtocolError)
+  {
+  }
+
+  bool fin;
+  bool rsv1;
+  Opcode opcode;
+  StringPiece payload;  // unmasked, points into input buffer
+  size_t length;        // whole frame, to be retrieved
+  CloseCode closeCode;  // if kError
+};
+
+enum ParseResult
+{
+  kNeedMore,
+  kFrame,
+  kError,
+};
+
+/// Unmasks payload in input buffer, which must be retrieved after use.
+ParseResult parseFrame(Buffer* buf,
+                       bool allowRsv1,
+                       size_t maxPayload,
+                       Frame* frame);
+
+/// GET with Upgrade: websocket and Connection: Upgrade
+bool isUpgrade(const HttpRequest& req);
+
+/// Replies 101 and replaces conn's context with WebSocketContext,
+/// false if the handshake is refused.
+bool handshake(const TcpConnectionPtr& conn,
+               const HttpRequest& req,
+               Timestamp receiveTime,
+               const Options& options);
+
+/// Handles all complete frames in buf, called in conn's loop.
+void onMessage(const TcpConnectionPtr& conn,
+               Buffer* buf,
+               Timestamp receiveTime,
+               WebSocketContext* context,
+               const Options& options,
+               const MessageCallback& cb);
+
+/// Called every pingInterval in conn's loop.
+void onPingTimer(const boost::weak_ptr<TcpConnection>& weakConn,
+                 double interval);
+
+void appendMaskedFrame(Buffer* output,
+                       Opcode opcode,
+                       const StringPiece& payload,
+                       bool fin,
+                       bool rsv1,
+                       const char* maskKey);  // NULL for server frames
+
+void unmask(char* data, size_t len, const char* maskKey);
+
+/// RFC 3629, no overlong forms, surrogates or code points above U+10FFFF.
+bool isValidUtf8(const StringPiece& text);
+/// May be received in a close frame, RFC 6455 section 7.4.
+bool isValidCloseCode(int code);
+
+/// Raw deflate without context takeover, trailing 00 00 ff ff removed.
+bool deflateMessage(const StringPiece& payload, string* output);
+/// Appends 00 00 ff ff to message, then inflates it.
+/// Returns 0, or kMessageTooBig over maxSize, kInvalidPayload if corrupt.
+int inflateMessage(string* message, size_t maxSize, string* output);
+
+}
+}
+
+}
+}
+
+#endif  // MUDUO_NET_HTTP_WEBSOCKETCONTEXT_H
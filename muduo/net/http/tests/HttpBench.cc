@@ -0,0 +1,552 @@
+// HTTP load generator, reports throughput and latency percentiles.
+//
+// Without a server address, an HttpServer is started on loopback,
+// answering every request with a body of -s bytes.
+//
+// Closed loop (default): each connection keeps -d requests in flight.
+// Open loop (-r rate): requests are issued on schedule regardless of
+// responses, latency counts from the scheduled time.
+
+#include <muduo/net/http/HttpClientContext.h>
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/HttpResponse.h>
+#include <muduo/net/http/HttpServer.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/LatencyHistogram.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/EventLoopThreadPool.h>
+#include <muduo/net/InetAddress.h>
+#include <muduo/net/TcpClient.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <deque>
+#include <vector>
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+struct Options
+{
+  Options()
+    : threads(2),
+      connections(64),
+      seconds(10),
+      depth(1),
+      keepAlive(true),
+      rate(0),
+      bodySize(64),
+      serverThreads(2),
+      port(18000),
+      path("/")
+  {
+  }
+
+  int threads;
+  int connections;
+  int seconds;
+  int depth;          // requests in flight per connection
+  bool keepAlive;
+  double rate;        // requests per second in total, 0 for closed loop
+  int bodySize;       // of embedded server
+  int serverThreads;  // of embedded server
+  uint16_t port;
+  string ip;          // empty for embedded server
+  string path;
+};
+
+int64_t nowMicroSeconds()
+{
+  return Timestamp::now().microSecondsSinceEpoch();
+}
+
+class Session : boost::noncopyable
+{
+ public:
+  Session(EventLoop* loop,
+          const InetAddress& serverAddr,
+          const string& name,
+          const Options& options,
+          const string& request)
+    : client_(loop, serverAddr, name),
+      options_(options),
+      request_(request),
+      depth_(options.keepAlive ? options.depth : 1),
+      running_(true),
+      responses_(0),
+      errors_(0),
+      bodyBytes_(0)
+  {
+    client_.setConnectionCallback(
+        boost::bind(&Session::onConnection, this, _1));
+    client_.setMessageCallback(
+        boost::bind(&Session::onMessage, this, _1, _2, _3));
+    if (!options.keepAlive)
+    {
+      // server closes after every response
+      client_.enableRetry();
+    }
+  }
+
+  ~Session()
+  {
+    if (conn_)
+    {
+      conn_->setConnectionCallback(defaultConnectionCallback);
+      conn_->setMessageCallback(defaultMessageCallback);
+    }
+  }
+
+  void start()
+  {
+    client_.connect();
+  }
+
+  void stop()
+  {
+    running_ = false;
+    client_.stop();
+    client_.disconnect();
+  }
+
+  // open loop, scheduled at intended
+  void issue(int64_t intended)
+  {
+    backlog_.push_back(intended);
+    flush();
+  }
+
+  const LatencyHistogram& latency() const { return latency_; }
+  int64_t responses() const { return responses_; }
+  int64_t errors() const { return errors_; }
+  int64_t bodyBytes() const { return bodyBytes_; }
+
+ private:
+  bool closedLoop() const
+  { return options_.rate <= 0; }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      if (!running_)
+      {
+        conn->shutdown();
+        return;
+      }
+      conn->setTcpNoDelay(true);
+      conn_ = conn;
+      context_.reset(false);
+      if (closedLoop())
+      {
+        const int64_t now = nowMicroSeconds();
+        while (inflight_.size() + backlog_.size() < static_cast<size_t>(depth_))
+        {
+          backlog_.push_back(now);
+        }
+      }
+      flush();
+    }
+    else
+    {
+      conn_.reset();
+      // body without Content-Length ends here
+      context_.receiveClose();
+      if (!inflight_.empty() && context_.gotAll())
+      {
+        receiveResponse();
+      }
+      if (running_)
+      {
+        errors_ += static_cast<int64_t>(inflight_.size());
+      }
+      inflight_.clear();
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+  {
+    while (!inflight_.empty())
+    {
+      if (!muduo::net::detail::parseResponse(buf, &context_))
+      {
+        ++errors_;
+        conn->forceClose();
+        return;
+      }
+      if (!context_.gotAll())
+      {
+        break;
+      }
+      receiveResponse();
+    }
+    flush();
+  }
+
+  void receiveResponse()
+  {
+    const int64_t now = nowMicroSeconds();
+    if (running_)
+    {
+      latency_.record(now - inflight_.front());
+      ++responses_;
+      bodyBytes_ += static_cast<int64_t>(context_.response().body().readableBytes());
+      if (context_.response().statusCode() != 200)
+      {
+        ++errors_;
+      }
+    }
+    inflight_.pop_front();
+    context_.reset(false);
+    if (closedLoop())
+    {
+      // without keep-alive, sent after reconnecting
+      backlog_.push_back(now);
+    }
+  }
+
+  void flush()
+  {
+    if (!conn_ || !running_)
+    {
+      return;
+    }
+    Buffer out;
+    while (!backlog_.empty() && inflight_.size() < static_cast<size_t>(depth_))
+    {
+      inflight_.push_back(backlog_.front());
+      backlog_.pop_front();
+      out.append(request_);
+    }
+    if (out.readableBytes() > 0)
+    {
+      conn_->send(&out);
+    }
+  }
+
+  TcpClient client_;
+  const Options& options_;
+  const string& request_;
+  const int depth_;
+  bool running_;
+  TcpConnectionPtr conn_;
+  HttpClientContext context_;
+  std::deque<int64_t> inflight_;  // scheduled time of requests sent
+  std::deque<int64_t> backlog_;   // scheduled but not sent
+  LatencyHistogram latency_;
+  int64_t responses_;
+  int64_t errors_;
+  int64_t bodyBytes_;
+};
+
+typedef boost::shared_ptr<Session> SessionPtr;
+
+// sessions of one IO loop
+class Worker : boost::noncopyable
+{
+ public:
+  Worker(EventLoop* loop, double rate)
+    : loop_(loop),
+      rate_(rate),
+      start_(0),
+      issued_(0)
+  {
+  }
+
+  EventLoop* getLoop() const { return loop_; }
+
+  void add(const SessionPtr& session)
+  { sessions_.push_back(session); }
+
+  void start()
+  {
+    for (size_t i = 0; i < sessions_.size(); ++i)
+    {
+      sessions_[i]->start();
+    }
+    if (rate_ > 0)
+    {
+      start_ = nowMicroSeconds();
+      ticker_ = loop_->runEvery(0.001, boost::bind(&Worker::tick, this));
+    }
+  }
+
+  void stop(CountDownLatch* latch)
+  {
+    if (rate_ > 0)
+    {
+      loop_->cancel(ticker_);
+    }
+    for (size_t i = 0; i < sessions_.size(); ++i)
+    {
+      sessions_[i]->stop();
+    }
+    latch->countDown();
+  }
+
+  void destroy(CountDownLatch* latch)
+  {
+    sessions_.clear();
+    latch->countDown();
+  }
+
+  const std::vector<SessionPtr>& sessions() const
+  { return sessions_; }
+
+ private:
+  // issues requests due since last tick, round-robin over sessions
+  void tick()
+  {
+    const double elapsed = static_cast<double>(nowMicroSeconds() - start_) / 1e6;
+    const int64_t due = static_cast<int64_t>(elapsed * rate_);
+    for (; issued_ < due; ++issued_)
+    {
+      const int64_t intended = start_ + static_cast<int64_t>(static_cast<double>(issued_) * 1e6 / rate_);
+      sessions_[static_cast<size_t>(issued_) % sessions_.size()]->issue(intended);
+    }
+  }
+
+  EventLoop* loop_;
+  const double rate_;
+  int64_t start_;
+  int64_t issued_;
+  TimerId ticker_;
+  std::vector<SessionPtr> sessions_;
+};
+
+typedef boost::shared_ptr<Worker> WorkerPtr;
+
+class Benchmark : boost::noncopyable
+{
+ public:
+  Benchmark(EventLoop* loop, const InetAddress& serverAddr, const Options& options)
+    : loop_(loop),
+      threadPool_(loop),
+      options_(options)
+  {
+    HttpRequest req;
+    req.setMethod(HttpRequest::kGet);
+    req.setPath(options.path);
+    req.addHeader("Host", serverAddr.toIpPort());
+    if (!options.keepAlive)
+    {
+      req.addHeader("Connection", "close");
+    }
+    Buffer buf;
+    req.appendToBuffer(&buf);
+    request_ = buf.retrieveAllAsString();
+
+    threadPool_.setThreadNum(options.threads);
+    threadPool_.start();
+    std::vector<EventLoop*> loops = threadPool_.getAllLoops();
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+      workers_.push_back(WorkerPtr(new Worker(loops[i], options.rate / static_cast<double>(loops.size()))));
+    }
+    for (int i = 0; i < options.connections; ++i)
+    {
+      char name[32];
+      snprintf(name, sizeof name, "C%05d", i);
+      Worker* worker = get_pointer(workers_[static_cast<size_t>(i) % workers_.size()]);
+      worker->add(SessionPtr(new Session(worker->getLoop(), serverAddr, name, options_, request_)));
+    }
+  }
+
+  void start()
+  {
+    start_ = Timestamp::now();
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+      workers_[i]->getLoop()->runInLoop(boost::bind(&Worker::start, get_pointer(workers_[i])));
+    }
+    loop_->runAfter(options_.seconds, boost::bind(&Benchmark::stop, this));
+  }
+
+ private:
+  void stop()
+  {
+    CountDownLatch latch(static_cast<int>(workers_.size()));
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+      workers_[i]->getLoop()->runInLoop(boost::bind(&Worker::stop, get_pointer(workers_[i]), &latch));
+    }
+    latch.wait();
+    report(timeDifference(Timestamp::now(), start_));
+    // let connections close
+    loop_->runAfter(0.5, boost::bind(&Benchmark::quit, this));
+  }
+
+  void quit()
+  {
+    CountDownLatch latch(static_cast<int>(workers_.size()));
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+      workers_[i]->getLoop()->runInLoop(boost::bind(&Worker::destroy, get_pointer(workers_[i]), &latch));
+    }
+    latch.wait();
+    // TcpClient closes remaining connections in their loops
+    loop_->runAfter(0.1, boost::bind(&EventLoop::quit, loop_));
+  }
+
+  void report(double seconds)
+  {
+    LatencyHistogram latency;
+    int64_t responses = 0;
+    int64_t errors = 0;
+    int64_t bodyBytes = 0;
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+      const std::vector<SessionPtr>& sessions = workers_[i]->sessions();
+      for (size_t j = 0; j < sessions.size(); ++j)
+      {
+        latency.merge(sessions[j]->latency());
+        responses += sessions[j]->responses();
+        errors += sessions[j]->errors();
+        bodyBytes += sessions[j]->bodyBytes();
+      }
+    }
+
+    printf("%s loop, %d threads, %d connections, depth %d, keep-alive %s",
+           options_.rate > 0 ? "open" : "closed", options_.threads, options_.connections,
+           options_.depth, options_.keepAlive ? "on" : "off");
+    if (options_.rate > 0)
+    {
+      printf(", rate %.0f/s", options_.rate);
+    }
+    printf("\n");
+    printf("%" PRId64 " responses, %" PRId64 " errors in %.2f seconds\n", responses, errors, seconds);
+    printf("%.1f requests/s, %.2f MiB/s body\n",
+           static_cast<double>(responses) / seconds,
+           static_cast<double>(bodyBytes) / seconds / 1024 / 1024);
+    printf("latency us: mean %.1f p50 %" PRId64 " p90 %" PRId64 " p99 %" PRId64
+           " p99.9 %" PRId64 " max %" PRId64 "\n",
+           latency.mean(), latency.percentile(50), latency.percentile(90),
+           latency.percentile(99), latency.percentile(99.9), latency.max());
+    fflush(stdout);
+  }
+
+  EventLoop* loop_;
+  EventLoopThreadPool threadPool_;
+  const Options& options_;
+  string request_;
+  Timestamp start_;
+  std::vector<WorkerPtr> workers_;
+};
+
+// HttpServer on loopback, in its own thread
+class EmbeddedServer : boost::noncopyable
+{
+ public:
+  explicit EmbeddedServer(const Options& options)
+    : loop_(thread_.startLoop()),
+      body_(options.bodySize, 'x')
+  {
+    CountDownLatch latch(1);
+    loop_->runInLoop(boost::bind(&EmbeddedServer::startInLoop, this, options, &latch));
+    latch.wait();
+  }
+
+  ~EmbeddedServer()
+  {
+    CountDownLatch latch(1);
+    loop_->runInLoop(boost::bind(&EmbeddedServer::stopInLoop, this, &latch));
+    latch.wait();
+  }
+
+ private:
+  void startInLoop(const Options& options, CountDownLatch* latch)
+  {
+    server_.reset(new HttpServer(loop_, InetAddress(options.port, true), "HttpBench"));
+    server_->setHttpCallback(boost::bind(&EmbeddedServer::onRequest, this, _1, _2));
+    server_->setThreadNum(options.serverThreads);
+    server_->start();
+    latch->countDown();
+  }
+
+  void stopInLoop(CountDownLatch* latch)
+  {
+    server_.reset();
+    latch->countDown();
+  }
+
+  void onRequest(const HttpRequest&, HttpResponse* resp)
+  {
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain");
+    resp->setBody(body_);
+  }
+
+  EventLoopThread thread_;
+  EventLoop* loop_;
+  const string body_;
+  boost::scoped_ptr<HttpServer> server_;
+};
+
+void usage(const char* prog)
+{
+  printf("Usage: %s [-t threads] [-c connections] [-n seconds] [-d depth] [-k 0|1]\n"
+         "          [-r rate] [-s body_size] [-T server_threads] [-p port] [ip [path]]\n"
+         "Starts an HttpServer on 127.0.0.1:port if ip is not given.\n", prog);
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:c:n:d:k:r:s:T:p:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 't': options.threads = atoi(optarg); break;
+      case 'c': options.connections = atoi(optarg); break;
+      case 'n': options.seconds = atoi(optarg); break;
+      case 'd': options.depth = atoi(optarg); break;
+      case 'k': options.keepAlive = atoi(optarg) != 0; break;
+      case 'r': options.rate = atof(optarg); break;
+      case 's': options.bodySize = atoi(optarg); break;
+      case 'T': options.serverThreads = atoi(optarg); break;
+      case 'p': options.port = static_cast<uint16_t>(atoi(optarg)); break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (optind < argc)
+  {
+    options.ip = argv[optind];
+    if (optind + 1 < argc)
+    {
+      options.path = argv[optind + 1];
+    }
+  }
+  if (options.connections <= 0 || options.depth <= 0 || options.seconds <= 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Logger::setLogLevel(Logger::WARN);
+  boost::scoped_ptr<EmbeddedServer> server;
+  if (options.ip.empty())
+  {
+    options.ip = "127.0.0.1";
+    server.reset(new EmbeddedServer(options));
+    printf("HttpServer on loopback, %d threads, body %d bytes\n",
+           options.serverThreads, options.bodySize);
+  }
+
+  EventLoop loop;
+  Benchmark bench(&loop, InetAddress(options.ip, options.port), options);
+  bench.start();
+  loop.loop();
+}
@@ -0,0 +1,66 @@
+#include <muduo/net/http/HttpClient.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/base/Logging.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <iostream>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+int remaining = 0;
+boost::scoped_ptr<HttpClient> g_client;
+
+void finish(EventLoop* loop)
+{
+  // connections are closed in loop, quit after them
+  g_client.reset();
+  loop->runAfter(0.1, boost::bind(&EventLoop::quit, loop));
+}
+
+void onResponse(EventLoop* loop, const HttpClientResponse& resp)
+{
+  if (resp.ok())
+  {
+    std::cout << resp.statusCode() << " " << resp.statusMessage()
+              << " " << resp.body().readableBytes() << " bytes" << std::endl;
+  }
+  else
+  {
+    std::cout << "error " << resp.error() << std::endl;
+  }
+  if (--remaining == 0)
+  {
+    loop->queueInLoop(boost::bind(&finish, loop));
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3)
+  {
+    printf("Usage: %s ip port [path] [requests]\n", argv[0]);
+    return 0;
+  }
+  uint16_t port = static_cast<uint16_t>(atoi(argv[2]));
+  HttpRequest req;
+  req.setMethod(HttpRequest::kGet);
+  req.setPath(argc > 3 ? argv[3] : "/");
+  remaining = argc > 4 ? atoi(argv[4]) : 1;
+
+  EventLoop loop;
+  g_client.reset(new HttpClient(&loop, "HttpClient"));
+  g_client->start();
+  const int n = remaining;
+  for (int i = 0; i < n; ++i)
+  {
+    g_client->request(InetAddress(argv[1], port), req,
+                   boost::bind(&onResponse, &loop, _1));
+  }
+  loop.loop();
+}
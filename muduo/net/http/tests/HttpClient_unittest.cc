@@ -0,0 +1,265 @@
+#include <muduo/net/http/HttpClient.h>
+#include <muduo/net/http/HttpClientContext.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/Socket.h>
+#include <muduo/net/SocketsOps.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <vector>
+
+//#define BOOST_TEST_MODULE HttpClientTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+using muduo::net::Buffer;
+using muduo::net::EventLoop;
+using muduo::net::HttpClient;
+using muduo::net::HttpClientContext;
+using muduo::net::HttpClientResponse;
+using muduo::net::HttpRequest;
+using muduo::net::InetAddress;
+using muduo::net::Socket;
+
+using muduo::net::detail::parseResponse;
+
+BOOST_AUTO_TEST_CASE(testParseResponseContentLength)
+{
+  HttpClientContext context;
+  Buffer input;
+  input.append("HTTP/1.1 200 OK\r\n"
+       "Content-Length: 5\r\n"
+       "content-type: text/plain\r\n"
+       "\r\n"
+       "hello"
+       "HTTP/1.1 404");
+
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(context.gotAll());
+  const HttpClientResponse& response = context.response();
+  BOOST_CHECK_EQUAL(response.getVersion(), HttpRequest::kHttp11);
+  BOOST_CHECK_EQUAL(response.statusCode(), 200);
+  BOOST_CHECK_EQUAL(response.statusMessage(), string("OK"));
+  BOOST_CHECK_EQUAL(response.getHeader("Content-Type"), string("text/plain"));
+  BOOST_CHECK_EQUAL(response.body().toStringPiece().as_string(), string("hello"));
+  BOOST_CHECK(context.keepAlive());
+  // next pipelined response is left in buffer
+  BOOST_CHECK_EQUAL(input.retrieveAllAsString(), string("HTTP/1.1 404"));
+}
+
+BOOST_AUTO_TEST_CASE(testParseResponseInPieces)
+{
+  string all("HTTP/1.0 200 OK\r\n"
+       "Content-Length: 11\r\n"
+       "Connection: Keep-Alive\r\n"
+       "\r\n"
+       "hello world");
+
+  for (size_t sz1 = 0; sz1 < all.size(); ++sz1)
+  {
+    HttpClientContext context;
+    Buffer input;
+    input.append(all.c_str(), sz1);
+    BOOST_CHECK(parseResponse(&input, &context));
+    BOOST_CHECK(!context.gotAll());
+
+    input.append(all.c_str() + sz1, all.size() - sz1);
+    BOOST_CHECK(parseResponse(&input, &context));
+    BOOST_CHECK(context.gotAll());
+    BOOST_CHECK_EQUAL(context.response().body().toStringPiece().as_string(), string("hello world"));
+    BOOST_CHECK(context.keepAlive());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testParseResponseChunked)
+{
+  string all("HTTP/1.1 200 OK\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n"
+       "5\r\nhello\r\n"
+       "7;ext=1\r\n, world\r\n"
+       "0\r\n"
+       "Trailer: x\r\n"
+       "\r\n");
+
+  for (size_t sz1 = 0; sz1 < all.size(); ++sz1)
+  {
+    HttpClientContext context;
+    Buffer input;
+    input.append(all.c_str(), sz1);
+    BOOST_CHECK(parseResponse(&input, &context));
+    BOOST_CHECK(!context.gotAll());
+
+    input.append(all.c_str() + sz1, all.size() - sz1);
+    BOOST_CHECK(parseResponse(&input, &context));
+    BOOST_CHECK(context.gotAll());
+    BOOST_CHECK_EQUAL(context.response().body().toStringPiece().as_string(), string("hello, world"));
+    BOOST_CHECK_EQUAL(input.readableBytes(), 0u);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testParseResponseNoBody)
+{
+  HttpClientContext context;
+  context.reset(true);  // HEAD
+  Buffer input;
+  input.append("HTTP/1.1 200 OK\r\n"
+       "Content-Length: 100\r\n"
+       "\r\n");
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(context.gotAll());
+
+  context.reset(false);
+  input.append("HTTP/1.1 100 Continue\r\n"
+       "\r\n"
+       "HTTP/1.1 304 Not Modified\r\n"
+       "\r\n");
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.response().statusCode(), 304);
+}
+
+BOOST_AUTO_TEST_CASE(testParseResponseUntilClose)
+{
+  HttpClientContext context;
+  Buffer input;
+  input.append("HTTP/1.1 200 OK\r\n"
+       "Connection: close\r\n"
+       "\r\n"
+       "hello");
+  BOOST_CHECK(parseResponse(&input, &context));
+  BOOST_CHECK(!context.gotAll());
+  BOOST_CHECK(!context.keepAlive());
+  context.receiveClose();
+  BOOST_CHECK(context.gotAll());
+  BOOST_CHECK_EQUAL(context.response().body().toStringPiece().as_string(), string("hello"));
+}
+
+BOOST_AUTO_TEST_CASE(testParseResponseBad)
+{
+  HttpClientContext context;
+  Buffer input;
+  input.append("HTTP/1.1 200 OK\r\n"
+       "bad header\r\n"
+       "\r\n");
+  BOOST_CHECK(!parseResponse(&input, &context));
+
+  HttpClientContext context2;
+  Buffer input2;
+  input2.append("HTTP/1.1 200 OK\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n"
+       "zz\r\n");
+  BOOST_CHECK(!parseResponse(&input2, &context2));
+}
+
+namespace
+{
+
+void record(EventLoop* loop,
+            std::vector<HttpClientResponse::Error>* errors,
+            size_t expected,
+            const HttpClientResponse& response)
+{
+  errors->push_back(response.error());
+  if (errors->size() == expected)
+  {
+    // connections are closed in loop, quit after them
+    loop->runAfter(0.1, boost::bind(&EventLoop::quit, loop));
+  }
+}
+
+HttpRequest getRequest()
+{
+  HttpRequest req;
+  req.setMethod(HttpRequest::kGet);
+  req.setPath("/");
+  return req;
+}
+
+// accepted by kernel, never answered
+InetAddress listenSilently(Socket* socket)
+{
+  socket->bindAddress(InetAddress(0, true));
+  socket->listen();
+  return InetAddress(muduo::net::sockets::getLocalAddr(socket->fd()));
+}
+
+void destroyClient(boost::scoped_ptr<HttpClient>* client)
+{
+  client->reset();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(testConnectTimeout)
+{
+  // bound but not listening, connection is refused and retried
+  Socket refuser(muduo::net::sockets::createNonblockingOrDie());
+  refuser.bindAddress(InetAddress(0, true));
+  InetAddress server(muduo::net::sockets::getLocalAddr(refuser.fd()));
+
+  EventLoop loop;
+  HttpClient client(&loop, "ConnectTimeout");
+  client.setTimeout(0);
+  client.setConnectTimeout(0.2);
+  client.start();
+  std::vector<HttpClientResponse::Error> errors;
+  client.request(server, getRequest(), boost::bind(&record, &loop, &errors, 1, _1));
+  loop.runAfter(5.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+  BOOST_REQUIRE_EQUAL(errors.size(), 1u);
+  BOOST_CHECK_EQUAL(errors[0], HttpClientResponse::kConnectFailed);
+}
+
+BOOST_AUTO_TEST_CASE(testStop)
+{
+  Socket listener(muduo::net::sockets::createNonblockingOrDie());
+  InetAddress server(listenSilently(&listener));
+
+  EventLoop loop;
+  HttpClient client(&loop, "Stop");
+  client.setTimeout(0);
+  client.setMaxConnectionsPerHost(1);
+  client.start();
+  std::vector<HttpClientResponse::Error> errors;
+  // one in flight, one pending
+  client.request(server, getRequest(), boost::bind(&record, &loop, &errors, 2, _1));
+  client.request(server, getRequest(), boost::bind(&record, &loop, &errors, 2, _1));
+  loop.runAfter(0.2, boost::bind(&HttpClient::stop, &client));
+  loop.runAfter(5.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+  BOOST_REQUIRE_EQUAL(errors.size(), 2u);
+  BOOST_CHECK_EQUAL(errors[0], HttpClientResponse::kCancelled);
+  BOOST_CHECK_EQUAL(errors[1], HttpClientResponse::kCancelled);
+
+  // requests after stop() fail at once
+  client.request(server, getRequest(), boost::bind(&record, &loop, &errors, 3, _1));
+  BOOST_REQUIRE_EQUAL(errors.size(), 3u);
+  BOOST_CHECK_EQUAL(errors[2], HttpClientResponse::kCancelled);
+}
+
+BOOST_AUTO_TEST_CASE(testDestroy)
+{
+  Socket listener(muduo::net::sockets::createNonblockingOrDie());
+  InetAddress server(listenSilently(&listener));
+
+  EventLoop loop;
+  boost::scoped_ptr<HttpClient> client(new HttpClient(&loop, "Destroy"));
+  client->setTimeout(0);
+  client->setMaxConnectionsPerHost(1);
+  client->start();
+  std::vector<HttpClientResponse::Error> errors;
+  client->request(server, getRequest(), boost::bind(&record, &loop, &errors, 2, _1));
+  client->request(server, getRequest(), boost::bind(&record, &loop, &errors, 2, _1));
+  loop.runAfter(0.2, boost::bind(&destroyClient, &client));
+  loop.runAfter(5.0, boost::bind(&EventLoop::quit, &loop));
+  loop.loop();
+  BOOST_REQUIRE_EQUAL(errors.size(), 2u);
+  BOOST_CHECK_EQUAL(errors[0], HttpClientResponse::kCancelled);
+  BOOST_CHECK_EQUAL(errors[1], HttpClientResponse::kCancelled);
+}
@@ -0,0 +1,262 @@
+#include <muduo/net/http/HttpCompressor.h>
+#include <muduo/net/http/HttpRequest.h>
+#include <muduo/net/http/HttpResponse.h>
+#include <muduo/net/Buffer.h>
+
+//#define BOOST_TEST_MODULE HttpCompressorTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <zlib.h>
+
+#include <stdlib.h>
+
+using muduo::string;
+using muduo::net::Buffer;
+using muduo::net::HttpCompressor;
+using muduo::net::HttpRequest;
+using muduo::net::HttpResponse;
+
+namespace
+{
+
+void addHeader(HttpRequest* req, const char* line)
+{
+  req->addHeader(line, strchr(line, ':'), line + strlen(line));
+}
+
+HttpResponse makeResponse(const string& contentType, const string& body)
+{
+  HttpResponse resp(false);
+  resp.setStatusCode(HttpResponse::k200Ok);
+  resp.setStatusMessage("OK");
+  resp.setContentType(contentType);
+  resp.setBody(body);
+  return resp;
+}
+
+string jsonBody()
+{
+  string body("[");
+  for (int i = 0; i < 200; ++i)
+  {
+    body += "{\"id\": 12345, \"name\": \"muduo\", \"tags\": [\"net\", \"http\"]},";
+  }
+  body += "{}]";
+  return body;
+}
+
+// splits raw response into headers and body, checks Content-Length
+string bodyOf(const string& response, string* headers)
+{
+  size_t end = response.find("\r\n\r\n");
+  BOOST_REQUIRE(end != string::npos);
+  *headers = response.substr(0, end + 2);
+  string body = response.substr(end + 4);
+  size_t length = headers->find("Content-Length:");
+  BOOST_REQUIRE(length != string::npos);
+  BOOST_CHECK_EQUAL(strtoul(headers->c_str() + length + 15, NULL, 10), body.size());
+  return body;
+}
+
+string inflateAll(const string& compressed)
+{
+  z_stream zs;
+  memset(&zs, 0, sizeof zs);
+  BOOST_REQUIRE_EQUAL(inflateInit2(&zs, MAX_WBITS + 32), Z_OK);  // zlib or gzip
+  string result;
+  char out[4096];
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  zs.avail_in = static_cast<uInt>(compressed.size());
+  int err = Z_OK;
+  while (err == Z_OK)
+  {
+    zs.next_out = reinterpret_cast<Bytef*>(out);
+    zs.avail_out = sizeof out;
+    err = inflate(&zs, Z_NO_FLUSH);
+    result.append(out, sizeof out - zs.avail_out);
+  }
+  BOOST_CHECK_EQUAL(err, Z_STREAM_END);
+  inflateEnd(&zs);
+  return result;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(testNegotiate)
+{
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate(""), HttpCompressor::kIdentity);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("gzip"), HttpCompressor::kGzip);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("deflate"), HttpCompressor::kDeflate);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("gzip, deflate, br"), HttpCompressor::kGzip);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("deflate, GZIP;q=0.5"), HttpCompressor::kGzip);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("gzip;q=0, deflate"), HttpCompressor::kDeflate);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("gzip; q=0"), HttpCompressor::kIdentity);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("*"), HttpCompressor::kGzip);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("gzip;q=0, *"), HttpCompressor::kDeflate);
+  BOOST_CHECK_EQUAL(HttpCompressor::negotiate("br, identity"), HttpCompressor::kIdentity);
+}
+
+BOOST_AUTO_TEST_CASE(testCompress)
+{
+  HttpCompressor compressor;
+  const string body = jsonBody();
+  const char* encodings[] = { "Accept-Encoding: gzip", "Accept-Encoding: deflate" };
+  for (int i = 0; i < 2; ++i)
+  {
+    HttpRequest req;
+    addHeader(&req, encodings[i]);
+    HttpResponse resp = makeResponse("application/json", body);
+    Buffer output;
+    compressor.appendToBuffer(req, &resp, &output);
+
+    string headers;
+    string compressed = bodyOf(output.retrieveAllAsString(), &headers);
+    BOOST_CHECK(headers.find(i == 0 ? "Content-Encoding: gzip\r\n"
+                                    : "Content-Encoding: deflate\r\n") != string::npos);
+    BOOST_CHECK(headers.find("Vary: Accept-Encoding\r\n") != string::npos);
+    BOOST_CHECK_LT(compressed.size(), body.size());
+    BOOST_CHECK(inflateAll(compressed) == body);
+  }
+  BOOST_CHECK_EQUAL(compressor.compressedResponses(), 2);
+  BOOST_CHECK_EQUAL(compressor.cachedBytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testNotCompressed)
+{
+  HttpCompressor::Options options;
+  options.minSize = 100;
+  HttpCompressor compressor(options);
+  HttpRequest req;
+  addHeader(&req, "Accept-Encoding: gzip");
+
+  HttpResponse small = makeResponse("text/plain", "hello, world!\n");
+  HttpResponse image = makeResponse("image/png", jsonBody());
+  HttpResponse* responses[] = { &small, &image };
+  for (int i = 0; i < 2; ++i)
+  {
+    Buffer output;
+    compressor.appendToBuffer(req, responses[i], &output);
+    string headers;
+    string body = bodyOf(output.retrieveAllAsString(), &headers);
+    BOOST_CHECK(headers.find("Content-Encoding") == string::npos);
+    BOOST_CHECK(body == responses[i]->body());
+  }
+
+  HttpRequest plain;
+  HttpResponse json = makeResponse("application/json", jsonBody());
+  Buffer output;
+  compressor.appendToBuffer(plain, &json, &output);
+  string headers;
+  BOOST_CHECK(bodyOf(output.retrieveAllAsString(), &headers) == json.body());
+  BOOST_CHECK(headers.find("Vary: Accept-Encoding\r\n") != string::npos);
+  BOOST_CHECK_EQUAL(compressor.compressedResponses(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testCache)
+{
+  HttpCompressor::Options options;
+  options.level = 9;
+  HttpCompressor compressor(options);
+  HttpRequest req;
+  req.setPath("/index.html");
+  addHeader(&req, "Accept-Encoding: gzip, deflate");
+
+  string first;
+  for (int i = 0; i < 3; ++i)
+  {
+    HttpResponse resp = makeResponse("text/html", jsonBody());
+    resp.setCacheable(true);
+    Buffer output;
+    compressor.appendToBuffer(req, &resp, &output);
+    string response = output.retrieveAllAsString();
+    string headers;
+    string compressed = bodyOf(response, &headers);
+    BOOST_CHECK(inflateAll(compressed) == resp.body());
+    if (i == 0)
+    {
+      first = compressed;
+    }
+    BOOST_CHECK(compressed == first);
+  }
+  BOOST_CHECK_EQUAL(compressor.compressedResponses(), 3);
+  BOOST_CHECK_EQUAL(compressor.cacheHits(), 2);
+  // the key is path, query and body length
+  BOOST_CHECK_LT(compressor.cachedBytes(), first.size() + 32);
+
+  // a new body of another length, or of another path, is compressed again
+  HttpRequest other;
+  other.setPath("/other.html");
+  addHeader(&other, "Accept-Encoding: gzip, deflate");
+  const HttpRequest* requests[] = { &req, &other };
+  for (int i = 0; i < 2; ++i)
+  {
+    HttpResponse resp = makeResponse("text/html", jsonBody() + " ");
+    resp.setCacheable(true);
+    Buffer output;
+    compressor.appendToBuffer(*requests[i], &resp, &output);
+    string headers;
+    BOOST_CHECK(inflateAll(bodyOf(output.retrieveAllAsString(), &headers)) == resp.body());
+  }
+  BOOST_CHECK_EQUAL(compressor.cacheHits(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(testCacheETag)
+{
+  HttpCompressor compressor;
+  HttpRequest req;
+  req.setPath("/data.json");
+  addHeader(&req, "Accept-Encoding: gzip");
+
+  const char* etags[] = { "\"v1\"", "\"v2\"", "\"v2\"" };
+  const string bodies[] = { jsonBody(), jsonBody() + "[]", jsonBody() + "[]" };
+  for (int i = 0; i < 3; ++i)
+  {
+    HttpResponse resp = makeResponse("application/json", bodies[i]);
+    resp.addHeader("ETag", etags[i]);
+    resp.setCacheable(true);
+    Buffer output;
+    compressor.appendToBuffer(req, &resp, &output);
+    string headers;
+    BOOST_CHECK(inflateAll(bodyOf(output.retrieveAllAsString(), &headers)) == bodies[i]);
+  }
+  BOOST_CHECK_EQUAL(compressor.cacheHits(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(testVary)
+{
+  HttpCompressor compressor;
+  HttpRequest req;
+  addHeader(&req, "Accept-Encoding: gzip");
+  const char* varies[] = { "Origin", "origin, accept-encoding", "*" };
+  const char* expected[] = { "Origin, Accept-Encoding", "origin, accept-encoding", "*" };
+  for (int i = 0; i < 3; ++i)
+  {
+    HttpResponse resp = makeResponse("application/json", jsonBody());
+    resp.addHeader("Vary", varies[i]);
+    Buffer output;
+    compressor.appendToBuffer(req, &resp, &output);
+    BOOST_CHECK_EQUAL(resp.getHeader("Vary"), string(expected[i]));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testCacheEviction)
+{
+  HttpCompressor::Options options;
+  options.cacheBytes = 2 * jsonBody().size();
+  HttpCompressor compressor(options);
+  HttpRequest req;
+  addHeader(&req, "Accept-Encoding: gzip");
+
+  for (int i = 0; i < 10; ++i)
+  {
+    HttpResponse resp = makeResponse("text/html", jsonBody() + string(i, 'x'));
+    resp.setCacheable(true);
+    Buffer output;
+    compressor.appendToBuffer(req, &resp, &output);
+    BOOST_CHECK_LE(compressor.cachedBytes(), options.cacheBytes);
+  }
+  BOOST_CHECK_EQUAL(compressor.cacheHits(), 0);
+  BOOST_CHECK_GT(compressor.cachedBytes(), 0);
+}
@@ -0,0 +1,166 @@
+#include <muduo/net/http/HttpRouter.h>
+#include <muduo/net/http/HttpResponse.h>
+
+#include <boost/bind.hpp>
+
+//#define BOOST_TEST_MODULE HttpRouterTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+using muduo::StringPiece;
+using muduo::net::HttpRequest;
+using muduo::net::HttpResponse;
+using muduo::net::HttpRouter;
+
+namespace
+{
+
+int lastRoute = 0;
+
+void onRoute(int route, const HttpRequest&, const HttpRouter::Params&, HttpResponse*)
+{
+  lastRoute = route;
+}
+
+HttpRouter::Handler route(int id)
+{
+  return boost::bind(onRoute, id, _1, _2, _3);
+}
+
+// returns route id, or 0 if not found
+int dispatch(const HttpRouter& router,
+             HttpRequest::Method method,
+             const char* path,
+             HttpRouter::Params* params)
+{
+  lastRoute = 0;
+  const HttpRouter::Handler* handler = router.match(method, path, params);
+  if (handler)
+  {
+    HttpRequest req;
+    HttpResponse resp(false);
+    (*handler)(req, *params, &resp);
+  }
+  return lastRoute;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(testStaticRoutes)
+{
+  HttpRouter router;
+  BOOST_CHECK(router.get("/", route(1)));
+  BOOST_CHECK(router.get("/hello", route(2)));
+  BOOST_CHECK(router.get("/help", route(3)));
+  BOOST_CHECK(router.get("/hello/world", route(4)));
+  BOOST_CHECK(router.post("/hello", route(5)));
+  router.compile();
+
+  HttpRouter::Params params;
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/", &params), 1);
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/hello", &params), 2);
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/help", &params), 3);
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/hello/world", &params), 4);
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kPost, "/hello", &params), 5);
+  BOOST_CHECK(params.empty());
+
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/hel", &params), 0);
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/hello/", &params), 0);
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/helloo", &params), 0);
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "", &params), 0);
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kPut, "/hello", &params), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testParams)
+{
+  HttpRouter router;
+  BOOST_CHECK(router.get("/users/:id", route(1)));
+  BOOST_CHECK(router.get("/users/:id/files/*path", route(2)));
+  BOOST_CHECK(router.get("/users/new", route(3)));
+  BOOST_CHECK(router.addRoute(HttpRequest::kInvalid, "/static/*file", route(4)));
+  router.compile();
+
+  HttpRouter::Params params;
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/users/42", &params), 1);
+  BOOST_CHECK_EQUAL(params.size(), 1);
+  BOOST_CHECK_EQUAL(params.name(0).as_string(), string("id"));
+  BOOST_CHECK_EQUAL(params.get("id").as_string(), string("42"));
+
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/users/new", &params), 3);
+  BOOST_CHECK(params.empty());
+
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/users/newer", &params), 1);
+  BOOST_CHECK_EQUAL(params.get("id").as_string(), string("newer"));
+
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/users/7/files/a/b.txt", &params), 2);
+  BOOST_CHECK_EQUAL(params.size(), 2);
+  BOOST_CHECK_EQUAL(params.get("id").as_string(), string("7"));
+  BOOST_CHECK_EQUAL(params.get("path").as_string(), string("a/b.txt"));
+  BOOST_CHECK(params.get("nonexist").empty());
+
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/users/", &params), 0);
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/users/7/x", &params), 0);
+  BOOST_CHECK(params.empty());
+
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kHead, "/static/", &params), 4);
+  BOOST_CHECK_EQUAL(params.get("file").size(), 0);
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kDelete, "/static/js/app.js", &params), 4);
+  BOOST_CHECK_EQUAL(params.get("file").as_string(), string("js/app.js"));
+}
+
+BOOST_AUTO_TEST_CASE(testBacktracking)
+{
+  HttpRouter router;
+  BOOST_CHECK(router.get("/a/b/c", route(1)));
+  BOOST_CHECK(router.get("/a/:x/d", route(2)));
+  BOOST_CHECK(router.get("/*rest", route(3)));
+  router.compile();
+
+  HttpRouter::Params params;
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/a/b/c", &params), 1);
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/a/b/d", &params), 2);
+  BOOST_CHECK_EQUAL(params.size(), 1);
+  BOOST_CHECK_EQUAL(params.get("x").as_string(), string("b"));
+  BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, "/a/b/e", &params), 3);
+  BOOST_CHECK_EQUAL(params.size(), 1);
+  BOOST_CHECK_EQUAL(params.get("rest").as_string(), string("a/b/e"));
+}
+
+BOOST_AUTO_TEST_CASE(testBadRoutes)
+{
+  HttpRouter router;
+  BOOST_CHECK(!router.get("", route(1)));
+  BOOST_CHECK(!router.get("noslash", route(1)));
+  BOOST_CHECK(!router.get("/a:b", route(1)));
+  BOOST_CHECK(!router.get("/a/:", route(1)));
+  BOOST_CHECK(!router.get("/a/*rest/more", route(1)));
+  BOOST_CHECK(router.get("/a/:x", route(1)));
+  BOOST_CHECK(!router.get("/a/:x", route(2)));
+  BOOST_CHECK(!router.get("/a/:y/b", route(2)));
+  BOOST_CHECK(router.post("/a/:x", route(2)));
+}
+
+BOOST_AUTO_TEST_CASE(testManyRoutes)
+{
+  HttpRouter router;
+  const int kRoutes = 400;
+  char pattern[64];
+  for (int i = 0; i < kRoutes; ++i)
+  {
+    snprintf(pattern, sizeof pattern, "/api/v%d/resource%d/:id", i % 3, i);
+    BOOST_CHECK(router.get(pattern, route(i + 1)));
+  }
+  router.compile();
+
+  HttpRouter::Params params;
+  for (int i = 0; i < kRoutes; ++i)
+  {
+    snprintf(pattern, sizeof pattern, "/api/v%d/resource%d/%d", i % 3, i, i * 7);
+    BOOST_CHECK_EQUAL(dispatch(router, HttpRequest::kGet, pattern, &params), i + 1);
+    char id[16];
+    snprintf(id, sizeof id, "%d", i * 7);
+    BOOST_CHECK_EQUAL(params.get("id").as_string(), string(id));
+  }
+}
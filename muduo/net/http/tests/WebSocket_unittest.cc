@@ -0,0 +1,208 @@
+#include <muduo/net/http/WebSocketContext.h>
+#include <muduo/net/Buffer.h>
+
+//#define BOOST_TEST_MODULE WebSocketTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using muduo::string;
+using muduo::StringPiece;
+using muduo::net::Buffer;
+using namespace muduo::net::websocket;
+using namespace muduo::net::websocket::detail;
+
+namespace
+{
+const char kMask[4] = { '\x37', '\xfa', '\x21', '\x3d' };
+}
+
+BOOST_AUTO_TEST_CASE(testAcceptKey)
+{
+  // RFC 6455 section 1.3
+  BOOST_CHECK_EQUAL(acceptKey("dGhlIHNhbXBsZSBub25jZQ=="),
+                    string("s3pPLMBiTxaQ9kYGzzhZRbK+xOo="));
+}
+
+BOOST_AUTO_TEST_CASE(testMaskedFrame)
+{
+  // RFC 6455 section 5.7, masked "Hello"
+  Buffer input;
+  appendMaskedFrame(&input, kText, "Hello", true, false, kMask);
+  BOOST_CHECK_EQUAL(input.toStringPiece().as_string(),
+                    string("\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58", 11));
+
+  Frame frame;
+  BOOST_CHECK_EQUAL(parseFrame(&input, false, 1024, &frame), kFrame);
+  BOOST_CHECK(frame.fin);
+  BOOST_CHECK_EQUAL(frame.opcode, kText);
+  BOOST_CHECK_EQUAL(frame.payload.as_string(), string("Hello"));
+  BOOST_CHECK_EQUAL(frame.length, 11u);
+}
+
+BOOST_AUTO_TEST_CASE(testFrameLengths)
+{
+  const size_t lengths[] = { 0, 1, 125, 126, 127, 65535, 65536, 100000 };
+  for (size_t i = 0; i < sizeof lengths / sizeof lengths[0]; ++i)
+  {
+    string payload;
+    for (size_t j = 0; j < lengths[i]; ++j)
+    {
+      payload += static_cast<char>('a' + j % 26);
+    }
+    Buffer input;
+    appendMaskedFrame(&input, kBinary, payload, false, false, kMask);
+    const size_t total = input.readableBytes();
+
+    // every proper prefix needs more
+    Buffer partial;
+    partial.append(input.peek(), total - 1);
+    Frame frame;
+    BOOST_CHECK_EQUAL(parseFrame(&partial, false, 1 << 20, &frame), kNeedMore);
+
+    BOOST_CHECK_EQUAL(parseFrame(&input, false, 1 << 20, &frame), kFrame);
+    BOOST_CHECK(!frame.fin);
+    BOOST_CHECK_EQUAL(frame.length, total);
+    BOOST_CHECK(frame.payload.as_string() == payload);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testBadFrames)
+{
+  Frame frame;
+  Buffer unmasked;
+  appendFrame(&unmasked, kText, "Hello");
+  BOOST_CHECK_EQUAL(parseFrame(&unmasked, false, 1024, &frame), kError);
+  BOOST_CHECK_EQUAL(frame.closeCode, kProtocolError);
+
+  Buffer fragmentedPing;
+  appendMaskedFrame(&fragmentedPing, kPing, "x", false, false, kMask);
+  BOOST_CHECK_EQUAL(parseFrame(&fragmentedPing, false, 1024, &frame), kError);
+
+  Buffer rsv1;
+  appendMaskedFrame(&rsv1, kText, "x", true, true, kMask);
+  BOOST_CHECK_EQUAL(parseFrame(&rsv1, false, 1024, &frame), kError);
+  BOOST_CHECK_EQUAL(parseFrame(&rsv1, true, 1024, &frame), kFrame);
+  BOOST_CHECK(frame.rsv1);
+
+  Buffer tooBig;
+  appendMaskedFrame(&tooBig, kBinary, string(2000, 'x'), true, false, kMask);
+  BOOST_CHECK_EQUAL(parseFrame(&tooBig, false, 1024, &frame), kError);
+  BOOST_CHECK_EQUAL(frame.closeCode, kMessageTooBig);
+}
+
+BOOST_AUTO_TEST_CASE(testUnmask)
+{
+  string data("The quick brown fox jumps over the lazy dog");
+  for (size_t len = 0; len <= data.size(); ++len)
+  {
+    string masked(data, 0, len);
+    unmask(&*masked.begin(), len, kMask);
+    for (size_t i = 0; i < len; ++i)
+    {
+      BOOST_CHECK_EQUAL(masked[i], static_cast<char>(data[i] ^ kMask[i % 4]));
+    }
+    unmask(&*masked.begin(), len, kMask);
+    BOOST_CHECK(masked == data.substr(0, len));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testDeflate)
+{
+  string text;
+  for (int i = 0; i < 100; ++i)
+  {
+    text += "Hello, WebSocket! ";
+  }
+  string deflated;
+  BOOST_CHECK(deflateMessage(text, &deflated));
+  BOOST_CHECK_LT(deflated.size(), text.size());
+
+  string inflated;
+  string input(deflated);
+  BOOST_CHECK_EQUAL(inflateMessage(&input, 1 << 20, &inflated), 0);
+  BOOST_CHECK(inflated == text);
+
+  // RFC 7692 section 7.2.3.1, "Hello"
+  input.assign("\xf2\x48\xcd\xc9\xc9\x07\x00", 7);
+  BOOST_CHECK_EQUAL(inflateMessage(&input, 1 << 20, &inflated), 0);
+  BOOST_CHECK_EQUAL(inflated, string("Hello"));
+
+  input = deflated;
+  BOOST_CHECK_EQUAL(inflateMessage(&input, 100, &inflated), kMessageTooBig);
+
+  // reserved block type
+  input.assign("\xff\xff\xff\xff", 4);
+  BOOST_CHECK_EQUAL(inflateMessage(&input, 1 << 20, &inflated), kInvalidPayload);
+}
+
+BOOST_AUTO_TEST_CASE(testMessage)
+{
+  string text(1000, 'a');
+  Message plain(text);
+  Buffer expected;
+  appendFrame(&expected, kText, text);
+  BOOST_CHECK(plain.frame(false) == expected.toStringPiece().as_string());
+  BOOST_CHECK(plain.frame(true) == plain.frame(false));
+
+  Message compressed(text, kText, true);
+  BOOST_CHECK(compressed.frame(false) == plain.frame(false));
+  BOOST_CHECK_LT(compressed.frame(true).size(), plain.frame(false).size());
+  BOOST_CHECK_EQUAL(compressed.frame(true)[0], '\xc1');  // fin, rsv1, text
+}
+
+BOOST_AUTO_TEST_CASE(testUtf8)
+{
+  BOOST_CHECK(isValidUtf8(""));
+  BOOST_CHECK(isValidUtf8("Hello, WebSocket! Hello, WebSocket!"));
+  BOOST_CHECK(isValidUtf8("\xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5"));  // kosme
+  BOOST_CHECK(isValidUtf8("\xed\x9f\xbf"));       // U+D7FF
+  BOOST_CHECK(isValidUtf8("\xee\x80\x80"));       // U+E000
+  BOOST_CHECK(isValidUtf8("\xf4\x8f\xbf\xbf"));   // U+10FFFF
+  BOOST_CHECK(isValidUtf8("0123456789\xf0\x90\x80\x80" "0123456789"));  // U+10000
+
+  BOOST_CHECK(!isValidUtf8("\x80"));              // lone continuation
+  BOOST_CHECK(!isValidUtf8("\xc0\xaf"));          // overlong '/'
+  BOOST_CHECK(!isValidUtf8("\xe0\x80\xaf"));
+  BOOST_CHECK(!isValidUtf8("\xf0\x80\x80\xaf"));
+  BOOST_CHECK(!isValidUtf8("\xed\xa0\x80"));      // U+D800
+  BOOST_CHECK(!isValidUtf8("\xf4\x90\x80\x80"));  // U+110000
+  BOOST_CHECK(!isValidUtf8("\xfe"));
+  BOOST_CHECK(!isValidUtf8("0123456789\xce"));    // truncated
+  BOOST_CHECK(!isValidUtf8("0123456789\xe1\xbd"));
+  BOOST_CHECK(!isValidUtf8("0123456789\xce\x41"));
+}
+
+BOOST_AUTO_TEST_CASE(testCloseCode)
+{
+  const int valid[] = { 1000, 1001, 1002, 1003, 1007, 1008, 1009, 1010, 1011,
+                        1012, 1013, 1014, 3000, 3999, 4000, 4999 };
+  for (size_t i = 0; i < sizeof valid / sizeof valid[0]; ++i)
+  {
+    BOOST_CHECK(isValidCloseCode(valid[i]));
+  }
+  const int invalid[] = { 0, 999, 1004, 1005, 1006, 1015, 1016, 1100, 2000,
+                          2999, 5000, 65535 };
+  for (size_t i = 0; i < sizeof invalid / sizeof invalid[0]; ++i)
+  {
+    BOOST_CHECK(!isValidCloseCode(invalid[i]));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testInflateChunkBoundary)
+{
+  // inflated in chunks of 64KiB, ends exactly on one
+  for (size_t len = 64 * 1024; len <= 192 * 1024; len += 64 * 1024)
+  {
+    string text;
+    for (size_t i = 0; i < len; ++i)
+    {
+      text += static_cast<char>('a' + i * i % 26);
+    }
+    string deflated;
+    BOOST_CHECK(deflateMessage(text, &deflated));
+    string inflated;
+    BOOST_CHECK_EQUAL(inflateMessage(&deflated, 1 << 20, &inflated), 0);
+    BOOST_CHECK(inflated == text);
+  }
+}
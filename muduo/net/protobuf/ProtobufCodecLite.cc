@@ -9,14 +9,19 @@
 #include <muduo/net/protobuf/ProtobufCodecLite.h>
 // #include <muduo/net/protobuf/BufferStream.h>
 
+#include <muduo/base/Crc32c.h>
 #include <muduo/base/Logging.h>
+#include <muduo/base/ThreadLocalSingleton.h>
 #include <muduo/net/Endian.h>
+#include <muduo/net/EventLoop.h>
 #include <muduo/net/TcpConnection.h>
 #include <muduo/net/protorpc/google-inl.h>
 
 #include <google/protobuf/message.h>
 #include <zlib.h>
 
+#include <map>
+
 using namespace muduo;
 using namespace muduo::net;
 
@@ -28,31 +33,88 @@ namespace
     return 0;
   }
   int dummy = ProtobufVersionCheck();
+
+  // by prototype, shared by codecs of the same message type,
+  // deleted when the thread exits
+  typedef std::map<const google::protobuf::Message*, MessagePtr> ReusableMessages;
+  typedef ThreadLocalSingleton<ReusableMessages> LocalReusableMessages;
 }
 
 void ProtobufCodecLite::send(const TcpConnectionPtr& conn,
                              const ::google::protobuf::Message& message)
 {
-  // FIXME: serialize to TcpConnection::outputBuffer()
-  muduo::net::Buffer buf;
-  fillEmptyBuffer(&buf, message);
-  conn->send(&buf);
+  if (coalesceBytes_ > 0 && conn->getLoop()->isInLoopThread())
+  {
+    if (conn->connected())
+    {
+      Buffer* output = conn->outputBuffer();
+      const size_t oldLen = output->readableBytes();
+      appendToBuffer(output, message);
+      conn->hasAppendedOutput(output->readableBytes() - oldLen);
+      if (output->readableBytes() >= coalesceBytes_)
+      {
+        conn->flush();
+      }
+      else
+      {
+        conn->deferFlush();
+      }
+    }
+  }
+  else
+  {
+    sendNow(conn, message);
+  }
+}
+
+void ProtobufCodecLite::sendNow(const TcpConnectionPtr& conn,
+                                const ::google::protobuf::Message& message)
+{
+  if (coalesceBytes_ > 0 && conn->getLoop()->isInLoopThread())
+  {
+    if (conn->connected())
+    {
+      // behind anything coalesced, in the same write
+      Buffer* output = conn->outputBuffer();
+      const size_t oldLen = output->readableBytes();
+      appendToBuffer(output, message);
+      conn->hasAppendedOutput(output->readableBytes() - oldLen);
+      conn->flush();
+    }
+  }
+  else
+  {
+    muduo::net::Buffer buf;
+    fillEmptyBuffer(&buf, message);
+    conn->send(&buf);
+  }
 }
 
 void ProtobufCodecLite::fillEmptyBuffer(muduo::net::Buffer* buf,
                                         const google::protobuf::Message& message)
 {
   assert(buf->readableBytes() == 0);
+  appendToBuffer(buf, message);
+}
+
+void ProtobufCodecLite::appendToBuffer(muduo::net::Buffer* buf,
+                                       const google::protobuf::Message& message)
+{
   // FIXME: can we move serialization & checksum to other thread?
+  const size_t start = buf->readableBytes();
+  buf->appendInt32(0);  // length, filled below
   buf->append(tag_);
 
   int byte_size = serializeToBuffer(message, buf);
 
-  int32_t checkSum = checksum(buf->peek(), static_cast<int>(buf->readableBytes()));
+  const char* data = buf->peek() + start + kHeaderLen;
+  int32_t checkSum = checksum(checksumType_, data, static_cast<int>(buf->beginWrite() - data));
   buf->appendInt32(checkSum);
-  assert(buf->readableBytes() == tag_.size() + byte_size + kChecksumLen); (void) byte_size;
-  int32_t len = sockets::hostToNetwork32(static_cast<int32_t>(buf->readableBytes()));
-  buf->prepend(&len, sizeof len);
+  const size_t len = buf->readableBytes() - start - kHeaderLen;
+  assert(len == tag_.size() + byte_size + kChecksumLen); (void) byte_size;
+  int32_t header = static_cast<int32_t>(len) | (checksumType_ << kChecksumTypeShift);
+  int32_t be32 = sockets::hostToNetwork32(header);
+  ::memcpy(buf->beginWrite() - len - kHeaderLen, &be32, sizeof be32);
 }
 
 void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
@@ -61,8 +123,9 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
 {
   while (buf->readableBytes() >= static_cast<uint32_t>(kMinMessageLen+kHeaderLen))
   {
-    const int32_t len = buf->peekInt32();
-    if (len > kMaxMessageLen || len < kMinMessageLen)
+    ChecksumType type = kAdler32;
+    const int32_t len = buf->peekInt32() & kLengthMask;
+    if (len > kMaxMessageLen || len < kMinMessageLen || !checksumTypeOf(buf->peek(), &type))
     {
       errorCallback_(conn, buf, receiveTime, kInvalidLength);
       break;
@@ -74,16 +137,32 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
         buf->retrieve(kHeaderLen+len);
         continue;
       }
-      MessagePtr message(prototype_->New());
+      MessagePtr* reusable =
+        reuseMessage_ ? &LocalReusableMessages::instance()[prototype_] : NULL;
+      MessagePtr message;
+      if (reusable && *reusable)
+      {
+        message.swap(*reusable);
+        message->Clear();  // keeps memory of strings and repeated fields
+      }
+      else
+      {
+        message.reset(prototype_->New());
+      }
       // FIXME: can we move deserialization & callback to other thread?
-      ErrorCode errorCode = parse(buf->peek()+kHeaderLen, len, message.get());
+      ErrorCode errorCode = parse(buf->peek()+kHeaderLen, len, message.get(), type);
       if (errorCode == kNoError)
       {
         // FIXME: try { } catch (...) { }
         messageCallback_(conn, message, receiveTime);
         buf->retrieve(kHeaderLen+len);
       }
-      else
+      if (reusable && message.unique())
+      {
+        // not kept by callback
+        reusable->swap(message);
+      }
+      if (errorCode != kNoError)
       {
         errorCallback_(conn, buf, receiveTime, errorCode);
         break;
@@ -183,19 +262,53 @@ int32_t ProtobufCodecLite::checksum(const void* buf, int len)
 
 bool ProtobufCodecLite::validateChecksum(const char* buf, int len)
 {
+  return validateChecksum(kAdler32, buf, len);
+}
+
+int32_t ProtobufCodecLite::checksum(ChecksumType type, const void* buf, int len)
+{
+  switch (type)
+  {
+   case kAdler32:
+     return checksum(buf, len);
+   case kCrc32c:
+     return static_cast<int32_t>(Crc32c::value(buf, len));
+   default:
+     return 0;
+  }
+}
+
+bool ProtobufCodecLite::validateChecksum(ChecksumType type, const char* buf, int len)
+{
+  if (type == kNoChecksum)
+  {
+    return true;
+  }
   // check sum
   int32_t expectedCheckSum = asInt32(buf + len - kChecksumLen);
-  int32_t checkSum = checksum(buf, len - kChecksumLen);
+  int32_t checkSum = checksum(type, buf, len - kChecksumLen);
   return checkSum == expectedCheckSum;
 }
 
+bool ProtobufCodecLite::checksumTypeOf(const char* header, ChecksumType* type)
+{
+  const uint32_t bits = static_cast<uint32_t>(asInt32(header)) >> kChecksumTypeShift;
+  if (bits > kNoChecksum)
+  {
+    return false;
+  }
+  *type = static_cast<ChecksumType>(bits);
+  return true;
+}
+
 ProtobufCodecLite::ErrorCode ProtobufCodecLite::parse(const char* buf,
                                                       int len,
-                                                      ::google::protobuf::Message* message)
+                                                      ::google::protobuf::Message* message,
+                                                      ChecksumType type)
 {
   ErrorCode error = kNoError;
 
-  if (validateChecksum(buf, len))
+  if (validateChecksum(type, buf, len))
   {
     if (memcmp(buf, tag_.data(), tag_.size()) == 0)
     {
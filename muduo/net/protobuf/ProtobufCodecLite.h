@@ -52,10 +52,13 @@ typedef boost::shared_ptr<google::protobuf::Message> MessagePtr;
 //
 // Field     Length  Content
 //
-// size      4-byte  M+N+4
+// size      4-byte  M+N+4, checksum type in the top 4 bits
 // tag       M-byte  could be "RPC0", etc.
 // payload   N-byte
-// checksum  4-byte  adler32 of tag+payload
+// checksum  4-byte  adler32, crc32c or 0 of tag+payload
+//
+// Checksum type 0 is adler32, so old peers see no change unless
+// a sender picks another type, which old receivers reject as kInvalidLength.
 //
 // This is an internal class, you should use ProtobufCodecT instead.
 class ProtobufCodecLite : boost::noncopyable
@@ -65,6 +68,15 @@ class ProtobufCodecLite : boost::noncopyable
   const static int kChecksumLen = sizeof(int32_t);
   const static int kMaxMessageLen = 64*1024*1024; // same as codec_stream.h kDefaultTotalBytesLimit
 
+  enum ChecksumType
+  {
+    kAdler32 = 0,
+    kCrc32c = 1,
+    kNoChecksum = 2,  // for loopback or otherwise trusted links
+  };
+  const static int kChecksumTypeShift = 28;
+  const static int32_t kLengthMask = (1 << kChecksumTypeShift) - 1;
+
   enum ErrorCode
   {
     kNoError = 0,
@@ -99,7 +111,10 @@ class ProtobufCodecLite : boost::noncopyable
       messageCallback_(messageCb),
       rawCb_(rawCb),
       errorCallback_(errorCb),
-      kMinMessageLen(tagArg.size() + kChecksumLen)
+      kMinMessageLen(tagArg.size() + kChecksumLen),
+      coalesceBytes_(0),
+      checksumType_(kAdler32),
+      reuseMessage_(false)
   {
   }
 
@@ -107,9 +122,38 @@ class ProtobufCodecLite : boost::noncopyable
 
   const string& tag() const { return tag_; }
 
+  /// Coalesces messages sent in conn's loop thread, they are serialized
+  /// into its output buffer and written at the end of the loop iteration,
+  /// or at once when flushBytes are pending.  0 (the default) disables it.
+  /// Messages sent from other threads are never coalesced.
+  void setCoalescing(size_t flushBytes)
+  { coalesceBytes_ = flushBytes; }
+
+  /// Parses into one message per thread and message type, reused while
+  /// no callback keeps the MessagePtr, instead of a new message for every
+  /// frame.  Callbacks that need the message after returning must copy the
+  /// MessagePtr, pointers or references to it are invalid afterwards.
+  /// Each IO thread holds on to its message until it exits, as large as
+  /// the largest parsed.
+  /// Not thread safe, call it before receiving, e.g. before TcpServer::start().
+  void setMessageReuse(bool on)
+  { reuseMessage_ = on; }
+
+  /// Checksum type of messages sent, all types are accepted on receiving.
+  void setChecksumType(ChecksumType type)
+  { checksumType_ = type; }
+
+  ChecksumType checksumType() const
+  { return checksumType_; }
+
   void send(const TcpConnectionPtr& conn,
             const ::google::protobuf::Message& message);
 
+  /// Writes message and anything coalesced before it without waiting,
+  /// for latency critical messages.
+  void sendNow(const TcpConnectionPtr& conn,
+               const ::google::protobuf::Message& message);
+
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
                  Timestamp receiveTime);
@@ -120,11 +164,17 @@ class ProtobufCodecLite : boost::noncopyable
   static const string& errorCodeToString(ErrorCode errorCode);
 
   // public for unit tests
-  ErrorCode parse(const char* buf, int len, ::google::protobuf::Message* message);
+  ErrorCode parse(const char* buf, int len, ::google::protobuf::Message* message,
+                  ChecksumType type = kAdler32);
   void fillEmptyBuffer(muduo::net::Buffer* buf, const google::protobuf::Message& message);
+  void appendToBuffer(muduo::net::Buffer* buf, const google::protobuf::Message& message);
 
   static int32_t checksum(const void* buf, int len);
   static bool validateChecksum(const char* buf, int len);
+  static int32_t checksum(ChecksumType type, const void* buf, int len);
+  static bool validateChecksum(ChecksumType type, const char* buf, int len);
+  /// Checksum type of the frame starting at header, false if unknown.
+  static bool checksumTypeOf(const char* header, ChecksumType* type);
   static int32_t asInt32(const char* buf);
   static void defaultErrorCallback(const TcpConnectionPtr&,
                                    Buffer*,
@@ -138,6 +188,9 @@ class ProtobufCodecLite : boost::noncopyable
   RawMessageCallback rawCb_;
   ErrorCallback errorCallback_;
   const int kMinMessageLen;
+  size_t coalesceBytes_;
+  ChecksumType checksumType_;
+  bool reuseMessage_;
 };
 
 template<typename MSG, const char* TAG, typename CODEC=ProtobufCodecLite>  // TAG must be a variable with external linkage, not a string literal
@@ -168,12 +221,38 @@ class ProtobufCodecLiteT
 
   const string& tag() const { return codec_.tag(); }
 
+  void setCoalescing(size_t flushBytes)
+  {
+    codec_.setCoalescing(flushBytes);
+  }
+
+  void setMessageReuse(bool on)
+  {
+    codec_.setMessageReuse(on);
+  }
+
+  void setChecksumType(ProtobufCodecLite::ChecksumType type)
+  {
+    codec_.setChecksumType(type);
+  }
+
+  ProtobufCodecLite::ChecksumType checksumType() const
+  {
+    return codec_.checksumType();
+  }
+
   void send(const TcpConnectionPtr& conn,
             const MSG& message)
   {
     codec_.send(conn, message);
   }
 
+  void sendNow(const TcpConnectionPtr& conn,
+               const MSG& message)
+  {
+    codec_.sendNow(conn, message);
+  }
+
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
                  Timestamp receiveTime)
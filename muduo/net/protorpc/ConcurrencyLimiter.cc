@@ -0,0 +1,96 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/protorpc/ConcurrencyLimiter.h>
+
+#include <algorithm>
+
+#include <assert.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+// latency over kTolerance * min is congestion
+const double kTolerance = 2.0;
+const double kBackoff = 0.9;
+// min latency is measured again after this many calls
+const int kWindow = 1000;
+}
+
+ConcurrencyLimiter::ConcurrencyLimiter(int maxLimit, bool adaptive)
+  : maxLimit_(maxLimit),
+    adaptive_(adaptive),
+    inFlight_(0),
+    limit_(maxLimit),
+    minLatency_(0.0),
+    samples_(0)
+{
+  assert(maxLimit > 0);
+}
+
+bool ConcurrencyLimiter::tryAcquire()
+{
+  MutexLockGuard lock(mutex_);
+  if (inFlight_ >= static_cast<int>(limit_))
+  {
+    return false;
+  }
+  ++inFlight_;
+  return true;
+}
+
+void ConcurrencyLimiter::release(Timestamp start, Timestamp now)
+{
+  MutexLockGuard lock(mutex_);
+  assert(inFlight_ > 0);
+  const int inUse = inFlight_--;
+  if (!adaptive_)
+  {
+    return;
+  }
+
+  const double latency = timeDifference(now, start);
+  if (minLatency_ <= 0 || latency < minLatency_)
+  {
+    minLatency_ = latency;
+  }
+
+  if (latency > minLatency_ * kTolerance)
+  {
+    // calls started before the last cut don't count again
+    if (start.microSecondsSinceEpoch() >= lastDecrease_.microSecondsSinceEpoch())
+    {
+      limit_ = std::max(1.0, limit_ * kBackoff);
+      lastDecrease_ = now;
+    }
+  }
+  else if (inUse * 2 >= static_cast<int>(limit_))
+  {
+    limit_ = std::min(static_cast<double>(maxLimit_), limit_ + 1.0 / limit_);
+  }
+
+  if (++samples_ >= kWindow)
+  {
+    samples_ = 0;
+    minLatency_ = 0.0;
+  }
+}
+
+int ConcurrencyLimiter::limit() const
+{
+  MutexLockGuard lock(mutex_);
+  return static_cast<int>(limit_);
+}
+
+int ConcurrencyLimiter::inFlight() const
+{
+  MutexLockGuard lock(mutex_);
+  return inFlight_;
+}
@@ -0,0 +1,62 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_PROTORPC_CONCURRENCYLIMITER_H
+#define MUDUO_NET_PROTORPC_CONCURRENCYLIMITER_H
+
+#include <muduo/base/Mutex.h>
+#include <muduo/base/Timestamp.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace muduo
+{
+namespace net
+{
+
+///
+/// Bounds calls in flight, shared by all connections of a method.
+///
+/// If adaptive, the limit follows AIMD on latency: it is cut by a tenth,
+/// at most once per round trip, when a call takes twice the lowest
+/// latency seen in the window, and grows by 1/limit for every other call
+/// finished while half the limit is in use.  So calls are rejected
+/// before they queue up and latency collapses.
+///
+/// Thread safe.
+///
+class ConcurrencyLimiter : boost::noncopyable
+{
+ public:
+  ConcurrencyLimiter(int maxLimit, bool adaptive);
+
+  /// false if the limit is reached, reject the call
+  bool tryAcquire();
+  /// for each successful tryAcquire(), start is when it was made
+  void release(Timestamp start, Timestamp now);
+
+  int limit() const;
+  int inFlight() const;
+
+ private:
+  mutable MutexLock mutex_;
+  const int maxLimit_;
+  const bool adaptive_;
+  int inFlight_;
+  double limit_;
+  double minLatency_;  // seconds, 0 if none in window
+  int samples_;
+  Timestamp lastDecrease_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_PROTORPC_CONCURRENCYLIMITER_H
@@ -0,0 +1,90 @@
+#undef NDEBUG
+#include <muduo/net/protorpc/ConcurrencyLimiter.h>
+
+#include <stdio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+Timestamp at(double seconds)
+{
+  return addTime(Timestamp(1000000), seconds);
+}
+
+int main()
+{
+  {
+  // fixed
+  ConcurrencyLimiter limiter(2, false);
+  assert(limiter.tryAcquire());
+  assert(limiter.tryAcquire());
+  assert(!limiter.tryAcquire());
+  assert(limiter.inFlight() == 2);
+  limiter.release(at(0), at(10));
+  assert(limiter.limit() == 2);
+  assert(limiter.tryAcquire());
+  }
+
+  {
+  // adaptive, latency doubles under load
+  ConcurrencyLimiter limiter(100, true);
+  for (int i = 0; i < 100; ++i)
+  {
+    assert(limiter.tryAcquire());
+  }
+  assert(!limiter.tryAcquire());
+
+  limiter.release(at(0), at(0.010));
+  assert(limiter.limit() == 100);
+  // slow ones started before the cut count once
+  limiter.release(at(0), at(0.050));
+  assert(limiter.limit() == 90);
+  limiter.release(at(0), at(0.060));
+  assert(limiter.limit() == 90);
+  printf("limit %d in flight %d\n", limiter.limit(), limiter.inFlight());
+
+  // keeps cutting while calls started after the cut are slow
+  double now = 1.0;
+  for (int round = 0; round < 10; ++round)
+  {
+    while (limiter.inFlight() > 0)
+    {
+      limiter.release(at(0), at(now));
+    }
+    int acquired = 0;
+    while (limiter.tryAcquire())
+    {
+      ++acquired;
+    }
+    assert(acquired == limiter.limit());
+    while (limiter.inFlight() > 0)
+    {
+      limiter.release(at(now), at(now + 0.050));
+    }
+    now += 1.0;
+    limiter.tryAcquire();
+  }
+  printf("limit %d after overload\n", limiter.limit());
+  assert(limiter.limit() < 50);
+  assert(limiter.limit() >= 1);
+
+  // and grows back while latency is low
+  const int low = limiter.limit();
+  while (limiter.inFlight() > 0)
+  {
+    limiter.release(at(now), at(now + 0.010));
+  }
+  for (int i = 0; i < 500; ++i)
+  {
+    while (limiter.tryAcquire())
+    {
+    }
+    while (limiter.inFlight() > 0)
+    {
+      limiter.release(at(now), at(now + 0.010));
+    }
+  }
+  printf("limit %d after recovery\n", limiter.limit());
+  assert(limiter.limit() > low);
+  }
+}
@@ -0,0 +1,303 @@
+#undef NDEBUG
+#include <muduo/net/protobuf/ProtobufCodecLite.h>
+#include <muduo/net/protorpc/rpc.pb.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/Endian.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpServer.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <vector>
+
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Sending side of ProtobufCodecLite on loopback, with RpcMessage as
+// the message: coalescing, sendNow() and the high water mark.
+
+namespace
+{
+
+const uint16_t kPort = 23421;
+
+void runAndCountDown(const boost::function<void()>& func, CountDownLatch* latch)
+{
+  func();
+  latch->countDown();
+}
+
+void ignoreMessage(const TcpConnectionPtr&, const MessagePtr&, Timestamp)
+{
+}
+
+RpcMessage message(int64_t id, size_t payload)
+{
+  RpcMessage msg;
+  msg.set_type(REQUEST);
+  msg.set_id(id);
+  msg.set_request(std::string(payload, 'x'));
+  return msg;
+}
+
+// A server in a loop thread with one client, which doesn't read until
+// told to.  Tests run in the loop with run().
+class Fixture : boost::noncopyable
+{
+ public:
+  explicit Fixture(int rcvbuf = 0)
+    : loop_(thread_.startLoop()),
+      codec_(&RpcMessage::default_instance(), "RPC0", ignoreMessage),
+      connected_(1),
+      highWaterMarks_(0),
+      highWaterMarkBytes_(0),
+      sock_(-1)
+  {
+    run(boost::bind(&Fixture::startServer, this));
+    sock_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (rcvbuf > 0)
+    {
+      ::setsockopt(sock_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+    }
+    InetAddress addr("127.0.0.1", kPort);
+    struct sockaddr_in sa = addr.getSockAddrInet();
+    int ret = ::connect(sock_, reinterpret_cast<struct sockaddr*>(&sa), sizeof sa);
+    assert(ret == 0); (void) ret;
+    connected_.wait();
+  }
+
+  ~Fixture()
+  {
+    ::close(sock_);
+    run(boost::bind(&Fixture::stopServer, this));
+  }
+
+  // in the loop, returns after it and functors it queued before
+  // returning have run
+  void run(const boost::function<void()>& func)
+  {
+    CountDownLatch latch(1);
+    loop_->runInLoop(boost::bind(runAndCountDown, func, &latch));
+    latch.wait();
+    CountDownLatch after(1);
+    loop_->queueInLoop(boost::bind(&CountDownLatch::countDown, &after));
+    after.wait();
+  }
+
+  // shuts down the connection after all is written, then reads until EOF,
+  // returns ids of frames received
+  std::vector<int64_t> receive()
+  {
+    loop_->runInLoop(boost::bind(&TcpConnection::shutdown, conn_));
+    string data;
+    char buf[65536];
+    ssize_t n = 0;
+    while ((n = ::read(sock_, buf, sizeof buf)) > 0)
+    {
+      data.append(buf, static_cast<size_t>(n));
+    }
+
+    std::vector<int64_t> ids;
+    size_t offset = 0;
+    while (offset + ProtobufCodecLite::kHeaderLen <= data.size())
+    {
+      const int32_t len = ProtobufCodecLite::asInt32(data.data() + offset)
+                          & ProtobufCodecLite::kLengthMask;
+      assert(offset + ProtobufCodecLite::kHeaderLen + len <= data.size());
+      RpcMessage msg;
+      ProtobufCodecLite::ErrorCode error =
+        codec_.parse(data.data() + offset + ProtobufCodecLite::kHeaderLen, len, &msg);
+      assert(error == ProtobufCodecLite::kNoError); (void) error;
+      ids.push_back(msg.id());
+      offset += ProtobufCodecLite::kHeaderLen + len;
+    }
+    assert(offset == data.size());
+    return ids;
+  }
+
+  ProtobufCodecLite& codec() { return codec_; }
+  const TcpConnectionPtr& conn() const { return conn_; }
+  int highWaterMarks() const { return highWaterMarks_; }
+  size_t highWaterMarkBytes() const { return highWaterMarkBytes_; }
+
+  void setHighWaterMark(size_t bytes)
+  {
+    conn_->setHighWaterMarkCallback(
+        boost::bind(&Fixture::onHighWaterMark, this, _1, _2), bytes);
+  }
+
+ private:
+  void startServer()
+  {
+    server_.reset(new TcpServer(loop_, InetAddress(kPort), "CodecTest"));
+    server_->setConnectionCallback(boost::bind(&Fixture::onConnection, this, _1));
+    server_->start();
+  }
+
+  void stopServer()
+  {
+    conn_.reset();
+    server_.reset();
+  }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn_ = conn;
+      connected_.countDown();
+    }
+  }
+
+  void onHighWaterMark(const TcpConnectionPtr&, size_t bytes)
+  {
+    if (highWaterMarks_++ == 0)
+    {
+      highWaterMarkBytes_ = bytes;
+    }
+  }
+
+  EventLoopThread thread_;
+  EventLoop* loop_;
+  boost::scoped_ptr<TcpServer> server_;
+  TcpConnectionPtr conn_;
+  ProtobufCodecLite codec_;
+  CountDownLatch connected_;
+  int highWaterMarks_;
+  size_t highWaterMarkBytes_;
+  int sock_;
+};
+
+void sendAll(Fixture* fixture, int64_t first, int count, size_t payload)
+{
+  for (int64_t id = first; id < first + count; ++id)
+  {
+    fixture->codec().send(fixture->conn(), message(id, payload));
+  }
+}
+
+// messages stay in the output buffer until the end of the loop iteration
+void sendCoalesced(Fixture* fixture, int64_t first, int count)
+{
+  const Buffer* output = fixture->conn()->outputBuffer();
+  size_t last = output->readableBytes();
+  for (int64_t id = first; id < first + count; ++id)
+  {
+    fixture->codec().send(fixture->conn(), message(id, 100));
+    assert(output->readableBytes() > last);
+    last = output->readableBytes();
+  }
+}
+
+// written as soon as flushBytes are pending
+void sendFlushed(Fixture* fixture, int64_t first, int count, size_t flushBytes)
+{
+  const Buffer* output = fixture->conn()->outputBuffer();
+  for (int64_t id = first; id < first + count; ++id)
+  {
+    fixture->codec().send(fixture->conn(), message(id, 100));
+    assert(output->readableBytes() < flushBytes);
+  }
+}
+
+void isEmpty(Fixture* fixture)
+{
+  assert(fixture->conn()->outputBuffer()->readableBytes() == 0);
+}
+
+void testCoalescing()
+{
+  Fixture fixture;
+  fixture.codec().setCoalescing(64 * 1024);
+  fixture.run(boost::bind(sendCoalesced, &fixture, 0, 100));
+  fixture.run(boost::bind(isEmpty, &fixture));
+
+  fixture.codec().setCoalescing(1000);
+  fixture.run(boost::bind(sendFlushed, &fixture, 100, 100, 1000));
+  fixture.run(boost::bind(isEmpty, &fixture));
+
+  std::vector<int64_t> ids = fixture.receive();
+  assert(ids.size() == 200);
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    assert(ids[i] == static_cast<int64_t>(i));
+  }
+}
+
+void sendThenSendNow(Fixture* fixture)
+{
+  fixture->codec().send(fixture->conn(), message(0, 100));
+  fixture->codec().send(fixture->conn(), message(1, 100));
+  // with the two before it
+  fixture->codec().sendNow(fixture->conn(), message(2, 100));
+  isEmpty(fixture);
+  fixture->codec().send(fixture->conn(), message(3, 100));
+  assert(fixture->conn()->outputBuffer()->readableBytes() > 0);
+}
+
+void testSendNow()
+{
+  Fixture fixture;
+  fixture.codec().setCoalescing(64 * 1024);
+  fixture.run(boost::bind(sendThenSendNow, &fixture));
+  fixture.run(boost::bind(isEmpty, &fixture));
+  // from another thread, not coalesced
+  fixture.codec().send(fixture.conn(), message(4, 100));
+  fixture.codec().sendNow(fixture.conn(), message(5, 100));
+
+  std::vector<int64_t> ids = fixture.receive();
+  assert(ids.size() == 6);
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    assert(ids[i] == static_cast<int64_t>(i));
+  }
+}
+
+// The peer doesn't read, coalesced frames pile up in the output buffer
+// while the socket is not writable, until the high water mark is crossed.
+void testHighWaterMark()
+{
+  const size_t kHighWaterMark = 64 * 1024;
+  const size_t kPayload = 1000;
+  const int kBatch = 1000;
+  const int kBatches = 32;
+  Fixture fixture(4096);
+  fixture.codec().setCoalescing(16 * 1024);
+  fixture.run(boost::bind(&Fixture::setHighWaterMark, &fixture, kHighWaterMark));
+  for (int i = 0; i < kBatches; ++i)
+  {
+    fixture.run(boost::bind(sendAll, &fixture, i * kBatch, kBatch, kPayload));
+  }
+  printf("high water mark %d times, first at %zu bytes\n",
+         fixture.highWaterMarks(), fixture.highWaterMarkBytes());
+  assert(fixture.highWaterMarks() >= 1);
+  assert(fixture.highWaterMarkBytes() >= kHighWaterMark);
+  assert(fixture.highWaterMarkBytes() < kHighWaterMark + 2 * kPayload);
+
+  std::vector<int64_t> ids = fixture.receive();
+  assert(ids.size() == static_cast<size_t>(kBatch * kBatches));
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    assert(ids[i] == static_cast<int64_t>(i));
+  }
+}
+
+}
+
+int main()
+{
+  Logger::setLogLevel(Logger::ERROR);
+  testCoalescing();
+  testSendNow();
+  testHighWaterMark();
+  printf("All tests passed\n");
+}
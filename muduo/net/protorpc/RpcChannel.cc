@@ -9,27 +9,81 @@
 #include <muduo/net/protorpc/RpcChannel.h>
 
 #include <muduo/base/Logging.h>
+#include <muduo/base/ThreadPool.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/protorpc/ConcurrencyLimiter.h>
+#include <muduo/net/protorpc/RpcController.h>
 #include <muduo/net/protorpc/rpc.pb.h>
 
 #include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
 
 #include <boost/bind.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include <algorithm>
+#include <vector>
+
 using namespace muduo;
 using namespace muduo::net;
 
+namespace
+{
+// expired calls fail within this many seconds
+const double kSweepInterval = 0.1;
+// outstanding call table, doubled as needed
+const size_t kInitialSlots = 64;
+
+// NewCallback() takes raw pointers, this one keeps a RpcChannelPtr
+class FunctionClosure : public ::google::protobuf::Closure
+{
+ public:
+  explicit FunctionClosure(const boost::function<void()>& func)
+    : func_(func)
+  {
+  }
+
+  virtual void Run()
+  {
+    boost::function<void()> func;
+    func.swap(func_);
+    delete this;
+    func();
+  }
+
+ private:
+  boost::function<void()> func_;
+};
+}
+
 RpcChannel::RpcChannel()
-  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3)),
-    services_(NULL)
+  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3),
+           boost::bind(&RpcChannel::onRawMessage, this, _1, _2, _3)),
+    numCalls_(0),
+    sweepLoop_(NULL),
+    streamHighWaterMark_(64 * 1024),
+    waitingWriteComplete_(false),
+    services_(NULL),
+    dispatch_(NULL),
+    maxInFlight_(0),
+    defaultTimeout_(0.0)
 {
   LOG_INFO << "RpcChannel::ctor - " << this;
 }
 
 RpcChannel::RpcChannel(const TcpConnectionPtr& conn)
-  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3)),
+  : codec_(boost::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3),
+           boost::bind(&RpcChannel::onRawMessage, this, _1, _2, _3)),
     conn_(conn),
-    services_(NULL)
+    numCalls_(0),
+    sweepLoop_(NULL),
+    streamHighWaterMark_(64 * 1024),
+    waitingWriteComplete_(false),
+    services_(NULL),
+    dispatch_(NULL),
+    maxInFlight_(0),
+    defaultTimeout_(0.0)
 {
   LOG_INFO << "RpcChannel::ctor - " << this;
 }
@@ -37,12 +91,15 @@ RpcChannel::RpcChannel(const TcpConnectionPtr& conn)
 RpcChannel::~RpcChannel()
 {
   LOG_INFO << "RpcChannel::dtor - " << this;
-  for (std::map<int64_t, OutstandingCall>::iterator it = outstandings_.begin(); it != outstandings_.end(); ++it)
+  if (sweepLoop_)
   {
-    OutstandingCall out = it->second;
-    delete out.response;
-    delete out.done;
+    sweepLoop_->cancel(sweepTimer_);
   }
+  closeStreams(CLOSED, false);
+  // e.g. set up without a connection callback to fail them
+  std::vector<OutstandingCall> calls;
+  takeAllCalls(&calls);
+  failCalls(calls, CLOSED);
 }
 
   // Call the given method of the remote service.  The signature of this
@@ -62,14 +119,427 @@ void RpcChannel::CallMethod(const ::google::protobuf::MethodDescriptor* method,
   message.set_id(id);
   message.set_service(method->service()->name());
   message.set_method(method->name());
-  message.set_request(request->SerializeAsString()); // FIXME: error check
 
-  OutstandingCall out = { response, done };
+  RpcController* rpcController = dynamic_cast<RpcController*>(controller);
+  double timeout = defaultTimeout_;
+  if (rpcController)
+  {
+    if (rpcController->timeout() > 0)
+    {
+      timeout = rpcController->timeout();
+    }
+    rpcController->channel_ = this;
+    rpcController->id_ = id;
+  }
+
+  OutstandingCall out = { id, response, done, rpcController, 0 };
+  if (timeout > 0)
+  {
+    message.set_timeout(static_cast<int32_t>(std::min(timeout * 1000, 2147483647.0)));
+    out.deadline = addTime(Timestamp::now(), timeout).microSecondsSinceEpoch();
+  }
+
+  EventLoop* loop = conn_->getLoop();
+  if (loop->isInLoopThread())
+  {
+    addCall(out);
+  }
+  else
+  {
+    // queued before the request, so it is in the table when the response arrives
+    loop->queueInLoop(boost::bind(&RpcChannel::addCall, shared_from_this(), out));
+  }
+  sendRpcMessage(message, request);
+}
+
+void RpcChannel::addCall(const OutstandingCall& out)
+{
+  conn_->getLoop()->assertInLoopThread();
+  if (!conn_->connected())
+  {
+    // queued from another thread after failOutstandingCalls(),
+    // nothing would fail it later
+    std::vector<OutstandingCall> closed(1, out);
+    failCalls(closed, CLOSED);
+    return;
+  }
+  if (calls_.empty())
+  {
+    calls_.resize(kInitialSlots);
+  }
+
+  OutstandingCall* slot = &calls_[slotOf(out.id)];
+  while (slot->id != 0)
+  {
+    // an older call still pending
+    if (numCalls_ * 2 >= calls_.size())
+    {
+      grow();
+    }
+    else
+    {
+      overflow_[slot->id] = *slot;
+      slot->id = 0;
+      --numCalls_;
+    }
+    slot = &calls_[slotOf(out.id)];
+  }
+  *slot = out;
+  ++numCalls_;
+
+  if (out.deadline > 0 && sweepLoop_ == NULL)
+  {
+    sweepLoop_ = conn_->getLoop();
+    // must not keep the channel alive, ~RpcChannel cancels it
+    boost::weak_ptr<RpcChannel> weakChannel(shared_from_this());
+    sweepTimer_ = sweepLoop_->runEvery(kSweepInterval,
+                                       boost::bind(&RpcChannel::sweepIfAlive, weakChannel));
+  }
+}
+
+void RpcChannel::grow()
+{
+  std::vector<OutstandingCall> calls;
+  calls.swap(calls_);
+  size_t size = calls.size() * 2;
+  bool done = false;
+  while (!done)
+  {
+    // live ids are unique, but may still share a slot
+    calls_.assign(size, OutstandingCall());
+    done = true;
+    for (size_t i = 0; i < calls.size() && done; ++i)
+    {
+      if (calls[i].id != 0)
+      {
+        OutstandingCall& slot = calls_[slotOf(calls[i].id)];
+        done = slot.id == 0;
+        slot = calls[i];
+      }
+    }
+    size *= 2;
+  }
+}
+
+bool RpcChannel::removeCall(int64_t id, OutstandingCall* out)
+{
+  conn_->getLoop()->assertInLoopThread();
+  if (!calls_.empty())
+  {
+    OutstandingCall& slot = calls_[slotOf(id)];
+    if (slot.id == id)
+    {
+      *out = slot;
+      slot.id = 0;
+      --numCalls_;
+      return true;
+    }
+  }
+  std::map<int64_t, OutstandingCall>::iterator it = overflow_.find(id);
+  if (it != overflow_.end())
+  {
+    *out = it->second;
+    overflow_.erase(it);
+    return true;
+  }
+  return false;
+}
+
+void RpcChannel::takeAllCalls(std::vector<OutstandingCall>* calls)
+{
+  for (size_t i = 0; i < calls_.size(); ++i)
+  {
+    if (calls_[i].id != 0)
+    {
+      calls->push_back(calls_[i]);
+      calls_[i].id = 0;
+    }
+  }
+  numCalls_ = 0;
+  for (std::map<int64_t, OutstandingCall>::iterator it = overflow_.begin();
+       it != overflow_.end(); ++it)
+  {
+    calls->push_back(it->second);
+  }
+  overflow_.clear();
+}
+
+void RpcChannel::failCalls(const std::vector<OutstandingCall>& calls, ErrorCode error)
+{
+  for (size_t i = 0; i < calls.size(); ++i)
+  {
+    const OutstandingCall& out = calls[i];
+    boost::scoped_ptr<google::protobuf::Message> d(out.response);
+    if (out.controller)
+    {
+      out.controller->fail(error);
+    }
+    if (out.done)
+    {
+      out.done->Run();
+    }
+  }
+}
+
+void RpcChannel::cancel(int64_t id)
+{
+  conn_->getLoop()->runInLoop(boost::bind(&RpcChannel::cancelInLoop, shared_from_this(), id));
+}
+
+void RpcChannel::cancelInLoop(int64_t id)
+{
+  std::vector<OutstandingCall> canceled;
+  OutstandingCall out = { 0, NULL, NULL, NULL, 0 };
+  if (removeCall(id, &out))
+  {
+    canceled.push_back(out);
+  }
+  failCalls(canceled, CANCELED);
+}
+
+void RpcChannel::failOutstandingCalls()
+{
+  conn_->getLoop()->assertInLoopThread();
+  std::vector<OutstandingCall> calls;
+  takeAllCalls(&calls);
+  if (!calls.empty())
+  {
+    LOG_DEBUG << "RpcChannel::failOutstandingCalls - " << calls.size() << " calls " << this;
+  }
+  failCalls(calls, CLOSED);
+  closeStreams(CLOSED, true);
+  if (waitingWriteComplete_)
+  {
+    waitingWriteComplete_ = false;
+    conn_->setWriteCompleteCallback(WriteCompleteCallback());
+  }
+}
+
+RpcStreamPtr RpcChannel::openStream(const ::google::protobuf::MethodDescriptor* method,
+                                    const ::google::protobuf::Message& request,
+                                    const RpcStream::MessageCallback& messageCb,
+                                    const RpcStream::CloseCallback& closeCb,
+                                    int window)
+{
+  EventLoop* loop = conn_->getLoop();
+  loop->assertInLoopThread();
+  int64_t id = id_.incrementAndGet();
+  const ::google::protobuf::Message* prototype =
+    ::google::protobuf::MessageFactory::generated_factory()->GetPrototype(method->output_type());
+  RpcStreamPtr stream(new RpcStream(this, loop, id, true, prototype, window));
+  stream->setMessageCallback(messageCb);
+  stream->setCloseCallback(closeCb);
+  callerStreams_[id] = stream;
+  // credits are tiny, don't let them wait for delayed ACKs
+  conn_->setTcpNoDelay(true);
+
+  RpcMessage message;
+  message.set_type(REQUEST);
+  message.set_id(id);
+  message.set_service(method->service()->name());
+  message.set_method(method->name());
+  message.set_stream(true);
+  message.set_credit(window);
+  sendRpcMessage(message, &request);
+  return stream;
+}
+
+void RpcChannel::handleStreamMessage(const RpcMessage& message, StringPiece payload)
+{
+  StreamMap& streams = message.type() == REQUEST ? calleeStreams_ : callerStreams_;
+  StreamMap::iterator it = streams.find(message.id());
+  if (it != streams.end())
+  {
+    RpcStreamPtr stream(it->second);
+    stream->onPeerMessage(message, payload);
+  }
+  else if (message.type() == REQUEST && message.has_method())
+  {
+    openCalleeStream(message, payload);
+  }
+  // else a late message of a closed stream
+}
+
+void RpcChannel::openCalleeStream(const RpcMessage& message, StringPiece payload)
+{
+  ErrorCode error = NO_SERVICE;
+  if (services_)
+  {
+    std::map<std::string, google::protobuf::Service*>::const_iterator it = services_->find(message.service());
+    if (it != services_->end())
+    {
+      google::protobuf::Service* service = it->second;
+      const google::protobuf::MethodDescriptor* method
+        = service->GetDescriptor()->FindMethodByName(message.method());
+      const RpcMethodDispatch* dispatch = NULL;
+      if (method && dispatch_)
+      {
+        RpcDispatchMap::const_iterator d = dispatch_->find(method);
+        if (d != dispatch_->end() && d->second.stream)
+        {
+          dispatch = &d->second;
+        }
+      }
+
+      const google::protobuf::Message* prototype = method ? &service->GetRequestPrototype(method) : NULL;
+      RpcStream::MessagePtr request(prototype ? prototype->New() : NULL);
+      if (dispatch == NULL)
+      {
+        error = NO_METHOD;
+      }
+      else if (!request->ParseFromArray(payload.data(), payload.size()))
+      {
+        error = INVALID_REQUEST;
+      }
+      else
+      {
+        RpcStreamPtr stream(new RpcStream(this, conn_->getLoop(), message.id(), false,
+                                          prototype, dispatch->streamWindow));
+        stream->credit_ = message.credit();
+        calleeStreams_[message.id()] = stream;
+        conn_->setTcpNoDelay(true);
+        RpcMessage grant;
+        grant.set_credit(dispatch->streamWindow);
+        stream->send(&grant, NULL);
+        dispatch->stream(stream, request);
+        return;
+      }
+    }
+  }
+
+  RpcMessage response;
+  response.set_type(RESPONSE);
+  response.set_id(message.id());
+  response.set_stream(true);
+  response.set_end(true);
+  response.set_error(error);
+  sendRpcMessage(response, NULL);
+}
+
+bool RpcChannel::belowHighWaterMark() const
+{
+  return conn_->outputBytes() < streamHighWaterMark_;
+}
+
+void RpcChannel::waitForWriteComplete()
+{
+  if (!waitingWriteComplete_)
   {
-  MutexLockGuard lock(mutex_);
-  outstandings_[id] = out;
+    // not set otherwise, as it costs a functor for each write
+    waitingWriteComplete_ = true;
+    conn_->setWriteCompleteCallback(
+        boost::bind(&RpcChannel::onWriteComplete, this, _1));
+  }
+}
+
+void RpcChannel::onWriteComplete(const TcpConnectionPtr& conn)
+{
+  assert(conn == conn_);
+  // streams still held back set it again
+  waitingWriteComplete_ = false;
+  conn_->setWriteCompleteCallback(WriteCompleteCallback());
+  std::vector<RpcStreamPtr> streams;
+  for (StreamMap::iterator it = callerStreams_.begin(); it != callerStreams_.end(); ++it)
+  {
+    if (it->second->waiting_ || it->second->holdsGrant())
+    {
+      streams.push_back(it->second);
+    }
+  }
+  for (StreamMap::iterator it = calleeStreams_.begin(); it != calleeStreams_.end(); ++it)
+  {
+    if (it->second->waiting_ || it->second->holdsGrant())
+    {
+      streams.push_back(it->second);
+    }
+  }
+  for (size_t i = 0; i < streams.size(); ++i)
+  {
+    streams[i]->onWritable();
+  }
+}
+
+void RpcChannel::removeStream(const RpcStream* stream)
+{
+  StreamMap& streams = stream->caller_ ? callerStreams_ : calleeStreams_;
+  StreamMap::iterator it = streams.find(stream->id());
+  if (it != streams.end() && get_pointer(it->second) == stream)
+  {
+    streams.erase(it);
+  }
+}
+
+void RpcChannel::closeStreams(ErrorCode error, bool notify)
+{
+  // ids of caller and callee streams may overlap
+  StreamMap callers;
+  StreamMap callees;
+  callers.swap(callerStreams_);
+  callees.swap(calleeStreams_);
+  for (StreamMap::iterator it = callers.begin(); it != callers.end(); ++it)
+  {
+    it->second->close(error, notify);
+  }
+  for (StreamMap::iterator it = callees.begin(); it != callees.end(); ++it)
+  {
+    it->second->close(error, notify);
+  }
+}
+
+void RpcChannel::sweepIfAlive(const boost::weak_ptr<RpcChannel>& weakChannel)
+{
+  RpcChannelPtr channel(weakChannel.lock());
+  if (channel)
+  {
+    channel->sweep();
+  }
+}
+
+void RpcChannel::sweep()
+{
+  const int64_t now = Timestamp::now().microSecondsSinceEpoch();
+  std::vector<OutstandingCall> expired;
+  for (size_t i = 0; i < calls_.size(); ++i)
+  {
+    OutstandingCall& slot = calls_[i];
+    if (slot.id != 0 && slot.deadline > 0 && slot.deadline <= now)
+    {
+      expired.push_back(slot);
+      slot.id = 0;
+      --numCalls_;
+    }
+  }
+  for (std::map<int64_t, OutstandingCall>::iterator it = overflow_.begin();
+       it != overflow_.end(); )
+  {
+    if (it->second.deadline > 0 && it->second.deadline <= now)
+    {
+      expired.push_back(it->second);
+      overflow_.erase(it++);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+
+  if (!expired.empty())
+  {
+    LOG_DEBUG << "RpcChannel::sweep - " << expired.size() << " calls timed out " << this;
+  }
+  failCalls(expired, TIMEOUT);
+}
+
+void RpcChannel::sendRpcMessage(const RpcMessage& message,
+                                const ::google::protobuf::Message* payload)
+{
+  // payload is serialized into buf, not into message first
+  Buffer buf;
+  if (fillRpcBuffer(&buf, message, payload,
+                    static_cast<ProtobufCodecLite::ChecksumType>(checksumType_.get())))
+  {
+    conn_->send(&buf);
   }
-  codec_.send(conn_, message);
 }
 
 void RpcChannel::onMessage(const TcpConnectionPtr& conn,
@@ -83,105 +553,247 @@ void RpcChannel::onRpcMessage(const TcpConnectionPtr& conn,
                               const RpcMessagePtr& messagePtr,
                               Timestamp receiveTime)
 {
+  // frames onRawMessage() declined, parsed by codec
+  assert(conn == conn_);
+  const RpcMessage& message = *messagePtr;
+  const std::string& payload = message.type() == REQUEST ? message.request() : message.response();
+  handleRpcMessage(message, payload, receiveTime);
+}
+
+bool RpcChannel::onRawMessage(const TcpConnectionPtr& conn,
+                              StringPiece frame,
+                              Timestamp receiveTime)
+{
+  // frame is length, tag, RpcMessage and checksum
+  const char* data = frame.data() + ProtobufCodecLite::kHeaderLen;
+  const int len = frame.size() - ProtobufCodecLite::kHeaderLen;
+  const string& tag = codec_.tag();
+  const int tagLen = static_cast<int>(tag.size());
+  ProtobufCodecLite::ChecksumType type = ProtobufCodecLite::kAdler32;
+  if (len < tagLen + ProtobufCodecLite::kChecksumLen
+      || memcmp(data, tag.data(), tag.size()) != 0
+      || !ProtobufCodecLite::checksumTypeOf(frame.data(), &type)
+      || !ProtobufCodecLite::validateChecksum(type, data, len))
+  {
+    return true;  // let codec report the error
+  }
+
+  RpcMessage message;
+  StringPiece payload;
+  if (!parseRpcMessage(StringPiece(data + tagLen, len - tagLen - ProtobufCodecLite::kChecksumLen),
+                       &message, &payload))
+  {
+    return true;
+  }
   assert(conn == conn_);
+  if (message.type() == REQUEST && checksumType_.get() != type)
+  {
+    checksumType_.getAndSet(type);
+  }
+  handleRpcMessage(message, payload, receiveTime);
+  return false;
+}
+
+void RpcChannel::handleRpcMessage(const RpcMessage& message,
+                                  StringPiece payload,
+                                  Timestamp receiveTime)
+{
   //printf("%s\n", message.DebugString().c_str());
-  RpcMessage& message = *messagePtr;
-  if (message.type() == RESPONSE)
+  if (message.stream())
+  {
+    handleStreamMessage(message, payload);
+  }
+  else if (message.type() == RESPONSE)
   {
-    int64_t id = message.id();
-    assert(message.has_response() || message.has_error());
+    handleResponse(message, payload);
+  }
+  else if (message.type() == REQUEST)
+  {
+    handleRequest(message, payload, receiveTime);
+  }
+  else if (message.type() == ERROR)
+  {
+  }
+}
 
-    OutstandingCall out = { NULL, NULL };
+void RpcChannel::handleResponse(const RpcMessage& message, StringPiece payload)
+{
+  int64_t id = message.id();
+  assert(payload.data() != NULL || message.has_error());
 
+  OutstandingCall out = { 0, NULL, NULL, NULL, 0 };
+  removeCall(id, &out);
+
+  // NULL if timed out or canceled
+  if (out.response)
+  {
+    boost::scoped_ptr<google::protobuf::Message> d(out.response);
+    ErrorCode error = message.has_error() ? message.error() : NO_ERROR;
+    if (error == NO_ERROR && payload.data() != NULL
+        && !out.response->ParseFromArray(payload.data(), payload.size()))
     {
-      MutexLockGuard lock(mutex_);
-      std::map<int64_t, OutstandingCall>::iterator it = outstandings_.find(id);
-      if (it != outstandings_.end())
-      {
-        out = it->second;
-        outstandings_.erase(it);
-      }
+      error = INVALID_RESPONSE;
     }
-
-    if (out.response)
+    if (error != NO_ERROR && out.controller)
     {
-      boost::scoped_ptr<google::protobuf::Message> d(out.response);
-      if (message.has_response())
-      {
-        out.response->ParseFromString(message.response());
-      }
-      if (out.done)
-      {
-        out.done->Run();
-      }
+      out.controller->fail(error);
+    }
+    if (out.done)
+    {
+      out.done->Run();
     }
   }
-  else if (message.type() == REQUEST)
+}
+
+void RpcChannel::handleRequest(const RpcMessage& message,
+                               StringPiece payload,
+                               Timestamp receiveTime)
+{
+  // FIXME: extract to a function
+  ErrorCode error = WRONG_PROTO;
+  Timestamp deadline;
+  if (message.has_timeout())
+  {
+    deadline = addTime(receiveTime, message.timeout() / 1000.0);
+  }
+  if (deadline.valid() && !(Timestamp::now() < deadline))
   {
-    // FIXME: extract to a function
-    ErrorCode error = WRONG_PROTO;
-    if (services_)
+    // the caller has given up, don't waste the work
+    error = TIMEOUT;
+  }
+  else if (services_)
+  {
+    std::map<std::string, google::protobuf::Service*>::const_iterator it = services_->find(message.service());
+    if (it != services_->end())
     {
-      std::map<std::string, google::protobuf::Service*>::const_iterator it = services_->find(message.service());
-      if (it != services_->end())
+      google::protobuf::Service* service = it->second;
+      assert(service != NULL);
+      const google::protobuf::ServiceDescriptor* desc = service->GetDescriptor();
+      const google::protobuf::MethodDescriptor* method
+        = desc->FindMethodByName(message.method());
+      if (method)
       {
-        google::protobuf::Service* service = it->second;
-        assert(service != NULL);
-        const google::protobuf::ServiceDescriptor* desc = service->GetDescriptor();
-        const google::protobuf::MethodDescriptor* method
-          = desc->FindMethodByName(message.method());
-        if (method)
+        RequestPtr request(service->GetRequestPrototype(method).New());
+        const RpcMethodDispatch* dispatch = NULL;
+        if (dispatch_)
         {
-          boost::scoped_ptr<google::protobuf::Message> request(service->GetRequestPrototype(method).New());
-          if (request->ParseFromString(message.request()))
-          {
-            google::protobuf::Message* response = service->GetResponsePrototype(method).New();
-            // response is deleted in doneCallback
-            int64_t id = message.id();
-            service->CallMethod(method, NULL, get_pointer(request), response,
-                                NewCallback(this, &RpcChannel::doneCallback, response, id));
-            error = NO_ERROR;
-          }
-          else
+          RpcDispatchMap::const_iterator d = dispatch_->find(method);
+          if (d != dispatch_->end())
           {
-            error = INVALID_REQUEST;
+            dispatch = &d->second;
           }
         }
+
+        if (!request->ParseFromArray(payload.data(), payload.size()))
+        {
+          error = INVALID_REQUEST;
+        }
+        else if (maxInFlight_ > 0 && inFlight_.get() >= maxInFlight_)
+        {
+          error = OVERLOADED;
+        }
+        else if (dispatch && dispatch->limiter && !dispatch->limiter->tryAcquire())
+        {
+          error = OVERLOADED;
+        }
         else
         {
-          error = NO_METHOD;
+          inFlight_.increment();
+          google::protobuf::Message* response = service->GetResponsePrototype(method).New();
+          // controller and response are deleted in doneCallback
+          RpcController* controller = new RpcController;
+          controller->id_ = message.id();
+          controller->deadline_ = deadline;
+          if (dispatch)
+          {
+            controller->limiter_ = dispatch->limiter;
+            controller->start_ = receiveTime;
+          }
+          google::protobuf::Closure* done = new FunctionClosure(
+              boost::bind(&RpcChannel::doneCallback, shared_from_this(), controller, request, response));
+          if (dispatch && dispatch->pool)
+          {
+            // runs in a worker, response is sent back via conn_'s loop
+            dispatch->pool->run(boost::bind(&RpcChannel::callMethod,
+                                            service, method, controller, request, response, done));
+          }
+          else
+          {
+            callMethod(service, method, controller, request, response, done);
+          }
+          error = NO_ERROR;
         }
       }
       else
       {
-        error = NO_SERVICE;
+        error = NO_METHOD;
       }
     }
     else
     {
       error = NO_SERVICE;
     }
-    if (error != NO_ERROR)
-    {
-      RpcMessage response;
-      response.set_type(RESPONSE);
-      response.set_id(message.id());
-      response.set_error(error);
-      codec_.send(conn_, response);
-    }
   }
-  else if (message.type() == ERROR)
+  else
+  {
+    error = NO_SERVICE;
+  }
+  if (error != NO_ERROR)
+  {
+    RpcMessage response;
+    response.set_type(RESPONSE);
+    response.set_id(message.id());
+    response.set_error(error);
+    sendRpcMessage(response, NULL);
+  }
+}
+
+void RpcChannel::callMethod(google::protobuf::Service* service,
+                            const google::protobuf::MethodDescriptor* method,
+                            RpcController* controller,
+                            const RequestPtr& request,
+                            google::protobuf::Message* response,
+                            google::protobuf::Closure* done)
+{
+  if (controller->expired(Timestamp::now()))
   {
+    // waited too long in the pool, the response would be dropped anyway
+    done->Run();
+  }
+  else
+  {
+    service->CallMethod(method, controller, get_pointer(request), response, done);
   }
 }
 
-void RpcChannel::doneCallback(::google::protobuf::Message* response, int64_t id)
+void RpcChannel::doneCallback(RpcController* controller,
+                              const RequestPtr&,
+                              ::google::protobuf::Message* response)
 {
+  boost::scoped_ptr<RpcController> c(controller);
   boost::scoped_ptr<google::protobuf::Message> d(response);
-  RpcMessage message;
-  message.set_type(RESPONSE);
-  message.set_id(id);
-  message.set_response(response->SerializeAsString()); // FIXME: error check
-  codec_.send(conn_, message);
+  inFlight_.decrement();
+  if (controller->limiter_)
+  {
+    controller->limiter_->release(controller->start_, Timestamp::now());
+  }
+  if (controller->expired(Timestamp::now()))
+  {
+    LOG_DEBUG << "RpcChannel::doneCallback - drops expired response " << controller->id_;
+  }
+  else
+  {
+    RpcMessage message;
+    message.set_type(RESPONSE);
+    message.set_id(controller->id_);
+    sendRpcMessage(message, response);
+  }
+
+  ::google::protobuf::Closure* cancelCallback = controller->cancelCallback_;
+  controller->cancelCallback_ = NULL;
+  if (cancelCallback)
+  {
+    cancelCallback->Run();
+  }
 }
 
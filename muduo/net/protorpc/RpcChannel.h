@@ -12,14 +12,19 @@
 #define MUDUO_NET_PROTORPC_RPCCHANNEL_H
 
 #include <muduo/base/Atomic.h>
-#include <muduo/base/Mutex.h>
+#include <muduo/net/TimerId.h>
 #include <muduo/net/protorpc/RpcCodec.h>
+#include <muduo/net/protorpc/RpcStream.h>
+#include <muduo/net/protorpc/rpc.pb.h>
 
 #include <google/protobuf/service.h>
 
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 
 #include <map>
+#include <vector>
 
 // Service and RpcChannel classes are incorporated from
 // google/protobuf/service.h
@@ -78,9 +83,35 @@ class Service;
 
 namespace muduo
 {
+
+class ThreadPool;
+
 namespace net
 {
 
+class ConcurrencyLimiter;
+class EventLoop;
+class RpcController;
+
+/// Server side, how calls of one method are run, see RpcServer.
+struct RpcMethodDispatch
+{
+  RpcMethodDispatch()
+    : pool(NULL),
+      limiter(NULL),
+      streamWindow(16)
+  {
+  }
+
+  ThreadPool* pool;             // NULL runs in the IO thread
+  ConcurrencyLimiter* limiter;  // NULL for no limit
+  RpcStreamHandler stream;      // for streaming calls, run in the IO thread
+  int streamWindow;
+};
+
+typedef std::map<const ::google::protobuf::MethodDescriptor*,
+                 RpcMethodDispatch> RpcDispatchMap;
+
 // Abstract interface for an RPC channel.  An RpcChannel represents a
 // communication line to a Service which can be used to call that Service's
 // methods.  The Service may be running on another machine.  Normally, you
@@ -90,7 +121,8 @@ namespace net
 //   RpcChannel* channel = new MyRpcChannel("remotehost.example.com:1234");
 //   MyService* service = new MyService::Stub(channel);
 //   service->MyMethod(request, &response, callback);
-class RpcChannel : public ::google::protobuf::RpcChannel
+class RpcChannel : public ::google::protobuf::RpcChannel,
+                   public boost::enable_shared_from_this<RpcChannel>
 {
  public:
   RpcChannel();
@@ -109,11 +141,41 @@ class RpcChannel : public ::google::protobuf::RpcChannel
     services_ = services;
   }
 
+  /// Server side, methods not in dispatch run in the IO thread.
+  /// At most maxInFlight requests run at a time, 0 for no limit,
+  /// more are rejected with OVERLOADED.
+  /// Must be owned by a shared_ptr, as pending calls keep it alive.
+  void setDispatch(const RpcDispatchMap* dispatch, int maxInFlight)
+  {
+    dispatch_ = dispatch;
+    maxInFlight_ = maxInFlight;
+  }
+
+  /// Checksum of frames sent, adler32 by default.  Peers of older versions
+  /// understand adler32 only.  The type of each valid request received is
+  /// adopted, so a server replies with whatever its client chose.
+  /// Thread safe.
+  void setChecksumType(ProtobufCodecLite::ChecksumType type)
+  {
+    checksumType_.getAndSet(type);
+  }
+
+  /// Seconds to wait for a response if the call has no RpcController
+  /// timeout, 0 waits forever.  Expired calls are failed with TIMEOUT.
+  void setDefaultTimeout(double seconds)
+  {
+    defaultTimeout_ = seconds;
+  }
+
   // Call the given method of the remote service.  The signature of this
   // procedure looks the same as Service::CallMethod(), but the requirements
   // are less strict in one important way:  the request and response objects
   // need not be of any specific class as long as their descriptors are
   // method->input_type() and method->output_type().
+  //
+  // controller is optional, if it is a muduo::net::RpcController
+  // it gets the timeout, error code and cancellation.
+  // The channel must be owned by a RpcChannelPtr.
   void CallMethod(const ::google::protobuf::MethodDescriptor* method,
                   ::google::protobuf::RpcController* controller,
                   const ::google::protobuf::Message* request,
@@ -124,27 +186,127 @@ class RpcChannel : public ::google::protobuf::RpcChannel
                  Buffer* buf,
                  Timestamp receiveTime);
 
+  /// Opens a streaming call of method, request is its first message.
+  /// Up to window messages from the callee may be in flight.
+  /// Must be called in the connection's loop.
+  RpcStreamPtr openStream(const ::google::protobuf::MethodDescriptor* method,
+                          const ::google::protobuf::Message& request,
+                          const RpcStream::MessageCallback& messageCb,
+                          const RpcStream::CloseCallback& closeCb,
+                          int window = 16);
+
+  /// Streams are not writable while the output buffer holds more,
+  /// 64KiB by default.
+  void setStreamHighWaterMark(size_t bytes)
+  {
+    streamHighWaterMark_ = bytes;
+  }
+
+  /// Fails all outstanding calls and streams with CLOSED,
+  /// when the connection is lost.
+  /// Must be called in the connection's loop.
+  void failOutstandingCalls();
+
  private:
+  friend class RpcController;
+  friend class RpcStream;
+
   void onRpcMessage(const TcpConnectionPtr& conn,
                     const RpcMessagePtr& messagePtr,
                     Timestamp receiveTime);
 
-  void doneCallback(::google::protobuf::Message* response, int64_t id);
+  bool onRawMessage(const TcpConnectionPtr& conn,
+                    StringPiece frame,
+                    Timestamp receiveTime);
+
+  // payload points into input buffer or messagePtr
+  void handleRpcMessage(const RpcMessage& message,
+                        StringPiece payload,
+                        Timestamp receiveTime);
+  void handleResponse(const RpcMessage& message, StringPiece payload);
+  void handleRequest(const RpcMessage& message,
+                     StringPiece payload,
+                     Timestamp receiveTime);
+
+  void sendRpcMessage(const RpcMessage& message,
+                      const ::google::protobuf::Message* payload);
+
+  void handleStreamMessage(const RpcMessage& message, StringPiece payload);
+  void openCalleeStream(const RpcMessage& message, StringPiece payload);
+  bool belowHighWaterMark() const;
+  // a stream's writes or grants are held back by the high water mark,
+  // until the output is written
+  void waitForWriteComplete();
+  void onWriteComplete(const TcpConnectionPtr& conn);
+  void removeStream(const RpcStream* stream);
+  void closeStreams(ErrorCode error, bool notify);
+
+  typedef boost::shared_ptr< ::google::protobuf::Message> RequestPtr;
+  // in IO thread or pool
+  static void callMethod(::google::protobuf::Service* service,
+                         const ::google::protobuf::MethodDescriptor* method,
+                         RpcController* controller,
+                         const RequestPtr& request,
+                         ::google::protobuf::Message* response,
+                         ::google::protobuf::Closure* done);
+  // request is kept alive until done
+  void doneCallback(RpcController* controller,
+                    const RequestPtr& request,
+                    ::google::protobuf::Message* response);
+
+  // fails an outstanding call, thread safe
+  void cancel(int64_t id);
+  void cancelInLoop(int64_t id);
+  // in loop, fails calls past their deadline
+  void sweep();
+  static void sweepIfAlive(const boost::weak_ptr<RpcChannel>& weakChannel);
 
   struct OutstandingCall
   {
+    int64_t id;                 // 0 for a free slot
     ::google::protobuf::Message* response;
     ::google::protobuf::Closure* done;
+    RpcController* controller;  // may be NULL
+    int64_t deadline;           // microseconds since epoch, 0 for none
   };
 
+  // The outstanding call table is owned by conn_'s loop, so it needs no lock.
+  // Ids are sequential, a call lives in slot id % size.  A call that is still
+  // pending when a new id wraps around to its slot moves to overflow_,
+  // unless the table is half full, then it is doubled.
+  size_t slotOf(int64_t id) const
+  { return static_cast<size_t>(id) & (calls_.size() - 1); }
+  void addCall(const OutstandingCall& out);
+  void grow();
+  // false if not found, e.g. timed out or canceled
+  bool removeCall(int64_t id, OutstandingCall* out);
+  void takeAllCalls(std::vector<OutstandingCall>* calls);
+  static void failCalls(const std::vector<OutstandingCall>& calls, ErrorCode error);
+
   RpcCodec codec_;
   TcpConnectionPtr conn_;
   AtomicInt64 id_;
+  // of frames sent, set in loop by requests received, read by callers
+  AtomicInt32 checksumType_;
+
+  std::vector<OutstandingCall> calls_;  // size is a power of 2
+  size_t numCalls_;                     // in calls_
+  std::map<int64_t, OutstandingCall> overflow_;
+  EventLoop* sweepLoop_;  // NULL until the first call with a deadline
+  TimerId sweepTimer_;
 
-  MutexLock mutex_;
-  std::map<int64_t, OutstandingCall> outstandings_;
+  // in loop
+  typedef std::map<int64_t, RpcStreamPtr> StreamMap;
+  StreamMap callerStreams_;  // opened by us, ids from id_
+  StreamMap calleeStreams_;  // opened by peer
+  size_t streamHighWaterMark_;
+  bool waitingWriteComplete_;  // write complete callback is set
 
   const std::map<std::string, ::google::protobuf::Service*>* services_;
+  const RpcDispatchMap* dispatch_;
+  int maxInFlight_;
+  AtomicInt32 inFlight_;
+  double defaultTimeout_;
 };
 typedef boost::shared_ptr<RpcChannel> RpcChannelPtr;
 
@@ -0,0 +1,360 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/protorpc/RpcClient.h>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThreadPool.h>
+#include <muduo/net/TcpClient.h>
+#include <muduo/net/protorpc/RpcController.h>
+
+#include <google/protobuf/message.h>
+
+#include <boost/bind.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+// weight of the latest sample in latency average
+const double kLatencyAlpha = 0.1;
+// latency before the first sample
+const double kInitialLatency = 0.001;
+}
+
+struct RpcClient::Endpoint : boost::noncopyable
+{
+  Endpoint(EventLoop* l, int b)
+    : loop(l),
+      backend(b),
+      outstanding(0),
+      latency(kInitialLatency)
+  {
+  }
+
+  EventLoop* loop;
+  int backend;
+  boost::scoped_ptr<TcpClient> client;
+  // guarded by RpcClient::mutex_
+  RpcChannelPtr channel;  // NULL if not connected
+  int outstanding;
+  double latency;  // moving average in seconds
+};
+
+struct RpcClient::Call : boost::noncopyable
+{
+  Endpoint* endpoint;
+  Timestamp start;
+  ::google::protobuf::Closure* done;
+  ::google::protobuf::RpcController* userController;
+  RpcController* controller;            // userController or ownController
+  boost::scoped_ptr<RpcController> ownController;
+};
+
+RpcClient::RpcClient(EventLoop* loop,
+                     const std::vector<InetAddress>& backends,
+                     const string& name)
+  : loop_(CHECK_NOTNULL(loop)),
+    name_(name),
+    threadPool_(new EventLoopThreadPool(loop)),
+    connectionsPerBackend_(1),
+    policy_(kPowerOfTwoChoices),
+    timeout_(30.0),
+    checksumType_(ProtobufCodecLite::kAdler32),
+    maxFailures_(5),
+    ejectTime_(10.0),
+    started_(false),
+    next_(0),
+    seed_(static_cast<unsigned int>(reinterpret_cast<uintptr_t>(this)))
+{
+  for (size_t i = 0; i < backends.size(); ++i)
+  {
+    Backend backend = { backends[i], 0, Timestamp() };
+    backends_.push_back(backend);
+  }
+}
+
+RpcClient::~RpcClient()
+{
+  // clients must be destroyed in their own loops, before IO threads quit
+  for (size_t i = 0; i < endpoints_.size(); ++i)
+  {
+    Endpoint* endpoint = &endpoints_[i];
+    if (endpoint->loop->isInLoopThread())
+    {
+      destroyEndpoint(endpoint, NULL);
+    }
+    else
+    {
+      CountDownLatch latch(1);
+      endpoint->loop->runInLoop(boost::bind(&RpcClient::destroyEndpoint, this, endpoint, &latch));
+      latch.wait();
+    }
+  }
+}
+
+void RpcClient::destroyEndpoint(Endpoint* endpoint, CountDownLatch* latch)
+{
+  // don't call back into RpcClient after it is gone
+  TcpConnectionPtr conn = endpoint->client->connection();
+  if (conn)
+  {
+    conn->setConnectionCallback(defaultConnectionCallback);
+    conn->setMessageCallback(defaultMessageCallback);
+    conn->setWriteCompleteCallback(WriteCompleteCallback());
+  }
+  endpoint->client.reset();
+
+  // pending calls get CLOSED
+  RpcChannelPtr channel;
+  {
+    MutexLockGuard lock(mutex_);
+    channel.swap(endpoint->channel);
+  }
+  if (channel)
+  {
+    channel->failOutstandingCalls();
+  }
+  if (latch)
+  {
+    latch->countDown();
+  }
+}
+
+void RpcClient::setThreadNum(int numThreads)
+{
+  assert(0 <= numThreads);
+  threadPool_->setThreadNum(numThreads);
+}
+
+void RpcClient::start()
+{
+  assert(!started_);
+  loop_->assertInLoopThread();
+  threadPool_->start();
+  for (int i = 0; i < connectionsPerBackend_; ++i)
+  {
+    for (size_t b = 0; b < backends_.size(); ++b)
+    {
+      Endpoint* endpoint = new Endpoint(threadPool_->getNextLoop(), static_cast<int>(b));
+      char buf[64];
+      snprintf(buf, sizeof buf, "-%s#%d", backends_[b].addr.toIpPort().c_str(), i);
+      endpoint->client.reset(new TcpClient(endpoint->loop, backends_[b].addr, name_ + buf));
+      endpoint->client->setConnectionCallback(
+          boost::bind(&RpcClient::onConnection, this, endpoint, _1));
+      endpoint->client->enableRetry();
+      endpoints_.push_back(endpoint);
+    }
+  }
+  candidates_.reserve(endpoints_.size());
+  started_ = true;
+
+  for (size_t i = 0; i < endpoints_.size(); ++i)
+  {
+    endpoints_[i].client->connect();
+  }
+}
+
+int RpcClient::numConnected() const
+{
+  MutexLockGuard lock(mutex_);
+  int n = 0;
+  for (size_t i = 0; i < endpoints_.size(); ++i)
+  {
+    if (endpoints_[i].channel)
+    {
+      ++n;
+    }
+  }
+  return n;
+}
+
+void RpcClient::onConnection(Endpoint* endpoint, const TcpConnectionPtr& conn)
+{
+  LOG_INFO << "RpcClient " << name_ << " - " << conn->localAddress().toIpPort() << " -> "
+           << conn->peerAddress().toIpPort() << " is "
+           << (conn->connected() ? "UP" : "DOWN");
+  if (conn->connected())
+  {
+    // a new channel for each connection, calls on the old one have failed
+    RpcChannelPtr channel(new muduo::net::RpcChannel(conn));
+    channel->setDefaultTimeout(timeout_);
+    channel->setChecksumType(checksumType_);
+    conn->setMessageCallback(
+        boost::bind(&muduo::net::RpcChannel::onMessage, get_pointer(channel), _1, _2, _3));
+    conn->setContext(channel);
+    MutexLockGuard lock(mutex_);
+    endpoint->channel = channel;
+  }
+  else
+  {
+    RpcChannelPtr channel;
+    {
+      MutexLockGuard lock(mutex_);
+      channel.swap(endpoint->channel);
+    }
+    if (channel)
+    {
+      channel->failOutstandingCalls();
+    }
+  }
+}
+
+RpcClient::Endpoint* RpcClient::chooseLocked(Timestamp now)
+{
+  mutex_.assertLocked();
+  candidates_.clear();
+  for (size_t i = 0; i < endpoints_.size(); ++i)
+  {
+    Endpoint* endpoint = &endpoints_[i];
+    if (endpoint->channel && !(now < backends_[endpoint->backend].ejectedUntil))
+    {
+      candidates_.push_back(endpoint);
+    }
+  }
+  if (candidates_.empty())
+  {
+    // all ejected, better than failing
+    for (size_t i = 0; i < endpoints_.size(); ++i)
+    {
+      if (endpoints_[i].channel)
+      {
+        candidates_.push_back(&endpoints_[i]);
+      }
+    }
+  }
+
+  const size_t n = candidates_.size();
+  if (n == 0)
+  {
+    return NULL;
+  }
+  const size_t first = next_++ % n;
+  if (policy_ == kRoundRobin || n == 1)
+  {
+    return candidates_[first];
+  }
+  else if (policy_ == kLeastOutstanding)
+  {
+    Endpoint* best = candidates_[first];
+    for (size_t i = 1; i < n; ++i)
+    {
+      Endpoint* endpoint = candidates_[(first + i) % n];
+      if (endpoint->outstanding < best->outstanding)
+      {
+        best = endpoint;
+      }
+    }
+    return best;
+  }
+  else
+  {
+    assert(policy_ == kPowerOfTwoChoices);
+    const size_t i = rand_r(&seed_) % n;
+    size_t j = rand_r(&seed_) % (n - 1);
+    if (j >= i)
+    {
+      ++j;
+    }
+    Endpoint* a = candidates_[i];
+    Endpoint* b = candidates_[j];
+    return a->latency * (a->outstanding + 1) <= b->latency * (b->outstanding + 1) ? a : b;
+  }
+}
+
+void RpcClient::CallMethod(const ::google::protobuf::MethodDescriptor* method,
+                           ::google::protobuf::RpcController* controller,
+                           const ::google::protobuf::Message* request,
+                           ::google::protobuf::Message* response,
+                           ::google::protobuf::Closure* done)
+{
+  assert(started_);
+  Call* call = new Call;
+  call->start = Timestamp::now();
+  call->done = done;
+  call->userController = controller;
+  call->controller = dynamic_cast<RpcController*>(controller);
+  if (call->controller == NULL)
+  {
+    // to see how the call ends
+    call->ownController.reset(new RpcController);
+    call->controller = get_pointer(call->ownController);
+  }
+
+  RpcChannelPtr channel;
+  {
+    MutexLockGuard lock(mutex_);
+    call->endpoint = chooseLocked(call->start);
+    if (call->endpoint)
+    {
+      ++call->endpoint->outstanding;
+      channel = call->endpoint->channel;
+    }
+  }
+
+  if (channel)
+  {
+    channel->CallMethod(method, call->controller, request, response,
+                        NewCallback(this, &RpcClient::finishCall, call));
+  }
+  else
+  {
+    // same as a call failed by RpcChannel, response is deleted after done
+    boost::scoped_ptr< ::google::protobuf::Message> d(response);
+    call->controller->fail(CLOSED);
+    finishCall(call);
+  }
+}
+
+void RpcClient::finishCall(Call* call)
+{
+  boost::scoped_ptr<Call> c(call);
+  const ErrorCode error = call->controller->errorCode();
+  if (call->endpoint)
+  {
+    const Timestamp now = Timestamp::now();
+    const double latency = timeDifference(now, call->start);
+    MutexLockGuard lock(mutex_);
+    Endpoint* endpoint = call->endpoint;
+    --endpoint->outstanding;
+    endpoint->latency += kLatencyAlpha * (latency - endpoint->latency);
+
+    Backend& backend = backends_[endpoint->backend];
+    if (error == TIMEOUT || error == CLOSED)
+    {
+      // calls sent before the ejection don't extend it
+      if (!(now < backend.ejectedUntil)
+          && ++backend.failures >= maxFailures_ && maxFailures_ > 0)
+      {
+        LOG_WARN << "RpcClient " << name_ << " - ejects " << backend.addr.toIpPort()
+                 << " for " << ejectTime_ << "s after " << backend.failures << " failures";
+        backend.failures = 0;
+        backend.ejectedUntil = addTime(now, ejectTime_);
+      }
+    }
+    else
+    {
+      backend.failures = 0;
+    }
+  }
+
+  if (call->ownController && call->userController && call->controller->Failed())
+  {
+    call->userController->SetFailed(call->controller->ErrorText());
+  }
+  if (call->done)
+  {
+    call->done->Run();
+  }
+}
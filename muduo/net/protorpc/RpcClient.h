@@ -0,0 +1,143 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_PROTORPC_RPCCLIENT_H
+#define MUDUO_NET_PROTORPC_RPCCLIENT_H
+
+#include <muduo/base/Mutex.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/InetAddress.h>
+#include <muduo/net/protorpc/RpcChannel.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <vector>
+
+namespace muduo
+{
+
+class CountDownLatch;
+
+namespace net
+{
+
+class EventLoop;
+class EventLoopThreadPool;
+
+///
+/// Client side RPC channel over connections to several backends.
+///
+/// Each backend gets N connections spread over the IO threads, every call
+/// goes to one of them as picked by Policy.  Connections are retried with
+/// Connector's backoff, calls on a lost connection fail with CLOSED.
+/// A backend that times out or drops maxFailures calls in a row is
+/// ejected for ejectTime seconds, unless all backends are.
+///
+/// Use it as the channel of a Stub.
+///
+class RpcClient : public ::google::protobuf::RpcChannel,
+                  boost::noncopyable
+{
+ public:
+  enum Policy
+  {
+    kRoundRobin,
+    kLeastOutstanding,
+    kPowerOfTwoChoices,  // of two random connections, the one with lower latency * outstanding
+  };
+
+  RpcClient(EventLoop* loop,
+            const std::vector<InetAddress>& backends,
+            const string& name);
+  ~RpcClient();  // force out-line dtor, for scoped_ptr members.
+
+  // The following are not thread safe, call them before start().
+
+  /// Set the number of IO threads, 0 means all IO in loop's thread.
+  void setThreadNum(int numThreads);
+
+  void setConnectionsPerBackend(int numConnections)
+  { connectionsPerBackend_ = numConnections; }
+
+  void setPolicy(Policy policy)
+  { policy_ = policy; }
+
+  /// Seconds to wait for a response if the call has no RpcController
+  /// timeout, 0 waits forever.
+  void setTimeout(double seconds)
+  { timeout_ = seconds; }
+
+  /// See RpcChannel::setChecksumType(), all backends must understand it.
+  void setChecksumType(ProtobufCodecLite::ChecksumType type)
+  { checksumType_ = type; }
+
+  void setEjection(int maxFailures, double ejectTime)
+  {
+    maxFailures_ = maxFailures;
+    ejectTime_ = ejectTime;
+  }
+
+  /// Starts IO threads and connects to all backends.
+  /// Must be called in loop's thread.
+  void start();
+
+  /// Thread safe, valid after calling start().
+  /// Fails with CLOSED if no backend is connected.
+  virtual void CallMethod(const ::google::protobuf::MethodDescriptor* method,
+                          ::google::protobuf::RpcController* controller,
+                          const ::google::protobuf::Message* request,
+                          ::google::protobuf::Message* response,
+                          ::google::protobuf::Closure* done);
+
+  /// connections up
+  int numConnected() const;
+
+ private:
+  struct Backend
+  {
+    InetAddress addr;
+    int failures;           // in a row
+    Timestamp ejectedUntil;
+  };
+  struct Endpoint;
+  struct Call;
+
+  void onConnection(Endpoint* endpoint, const TcpConnectionPtr& conn);
+  // in endpoint's loop
+  void destroyEndpoint(Endpoint* endpoint, CountDownLatch* latch);
+  // must be called with mutex_ held, NULL if none connected
+  Endpoint* chooseLocked(Timestamp now);
+  void finishCall(Call* call);
+
+  EventLoop* loop_;
+  const string name_;
+  boost::scoped_ptr<EventLoopThreadPool> threadPool_;
+  int connectionsPerBackend_;
+  Policy policy_;
+  double timeout_;
+  ProtobufCodecLite::ChecksumType checksumType_;
+  int maxFailures_;
+  double ejectTime_;
+  bool started_;
+
+  mutable MutexLock mutex_;
+  std::vector<Backend> backends_;
+  boost::ptr_vector<Endpoint> endpoints_;
+  std::vector<Endpoint*> candidates_;  // scratch of chooseLocked()
+  size_t next_;
+  unsigned int seed_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_PROTORPC_RPCCLIENT_H
@@ -0,0 +1,519 @@
+#undef NDEBUG
+#include <muduo/net/protorpc/RpcClient.h>
+#include <muduo/net/protorpc/RpcController.h>
+#include <muduo/net/protorpc/RpcServer.h>
+#include <muduo/net/protorpc/rpcservice.pb.h>
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/base/Thread.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <map>
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Loopback tests of RpcClient, and of RpcChannel's outstanding call
+// table under it.
+
+namespace
+{
+
+const uint16_t kPort = 23411;
+
+void runAndCountDown(const boost::function<void()>& func, CountDownLatch* latch)
+{
+  func();
+  latch->countDown();
+}
+
+void runInLoopAndWait(EventLoop* loop, const boost::function<void()>& func)
+{
+  CountDownLatch latch(1);
+  loop->runInLoop(boost::bind(runAndCountDown, func, &latch));
+  latch.wait();
+}
+
+bool waitFor(AtomicInt32& value, int expected)
+{
+  for (int i = 0; i < 5000 && value.get() != expected; ++i)
+  {
+    usleep(1000);
+  }
+  return value.get() == expected;
+}
+
+// listRpc answers with its backend's name and the request, unless it is
+// told to hold calls, then they wait for release().  In the IO thread.
+class TestService : public RpcService
+{
+ public:
+  TestService(const string& name, bool holdAll)
+    : name_(name),
+      holdAll_(holdAll)
+  {
+  }
+
+  virtual void listRpc(::google::protobuf::RpcController* controller,
+                       const ListRpcRequest* request,
+                       ListRpcResponse* response,
+                       ::google::protobuf::Closure* done)
+  {
+    response->set_error(NO_ERROR);
+    response->add_service_name(name_.c_str());
+    response->add_method_name(request->service_name());
+    calls_.increment();
+    if (holdAll_ || request->service_name().compare(0, 4, "hold") == 0)
+    {
+      held_.push_back(done);
+      numHeld_.increment();
+    }
+    else
+    {
+      done->Run();
+    }
+  }
+
+  void release()
+  {
+    std::vector< ::google::protobuf::Closure*> held;
+    held.swap(held_);
+    numHeld_.getAndSet(0);
+    for (size_t i = 0; i < held.size(); ++i)
+    {
+      held[i]->Run();
+    }
+  }
+
+  AtomicInt32& calls() { return calls_; }
+  AtomicInt32& numHeld() { return numHeld_; }
+
+ private:
+  const string name_;
+  const bool holdAll_;
+  std::vector< ::google::protobuf::Closure*> held_;
+  AtomicInt32 calls_;
+  AtomicInt32 numHeld_;
+};
+
+class Backend : boost::noncopyable
+{
+ public:
+  Backend(int index, bool holdAll = false)
+    : loop_(thread_.startLoop()),
+      addr_(static_cast<uint16_t>(kPort + index)),
+      service_(addr_.toIpPort(), holdAll)
+  {
+    start();
+  }
+
+  ~Backend()
+  {
+    stop();
+  }
+
+  void start()
+  {
+    runInLoopAndWait(loop_, boost::bind(&Backend::startInLoop, this));
+  }
+
+  // closes all connections, held calls are dropped
+  void stop()
+  {
+    runInLoopAndWait(loop_, boost::bind(&Backend::stopInLoop, this));
+  }
+
+  void release()
+  {
+    runInLoopAndWait(loop_, boost::bind(&TestService::release, &service_));
+  }
+
+  const InetAddress& addr() const { return addr_; }
+  TestService& service() { return service_; }
+
+ private:
+  void startInLoop()
+  {
+    server_.reset(new RpcServer(loop_, addr_));
+    server_->registerService(&service_);
+    server_->start();
+  }
+
+  void stopInLoop()
+  {
+    server_.reset();
+    service_.release();
+  }
+
+  EventLoopThread thread_;
+  EventLoop* loop_;
+  InetAddress addr_;
+  TestService service_;
+  boost::scoped_ptr<RpcServer> server_;
+};
+
+class Client : boost::noncopyable
+{
+ public:
+  Client(boost::ptr_vector<Backend>& backends,
+         RpcClient::Policy policy,
+         int maxFailures = 0)
+    : loop_(thread_.startLoop()),
+      client_(loop_, addrsOf(backends), "RpcClientTest"),
+      stub_(&client_)
+  {
+    client_.setPolicy(policy);
+    client_.setTimeout(0);
+    client_.setEjection(maxFailures, 10.0);
+    runInLoopAndWait(loop_, boost::bind(&RpcClient::start, &client_));
+    waitConnected(static_cast<int>(backends.size()));
+  }
+
+  void waitConnected(int n)
+  {
+    for (int i = 0; i < 5000 && client_.numConnected() != n; ++i)
+    {
+      usleep(1000);
+    }
+    assert(client_.numConnected() == n);
+  }
+
+  RpcService::Stub& stub() { return stub_; }
+
+ private:
+  static std::vector<InetAddress> addrsOf(boost::ptr_vector<Backend>& backends)
+  {
+    std::vector<InetAddress> addrs;
+    for (size_t i = 0; i < backends.size(); ++i)
+    {
+      addrs.push_back(backends[i].addr());
+    }
+    return addrs;
+  }
+
+  EventLoopThread thread_;
+  EventLoop* loop_;
+  RpcClient client_;
+  RpcService::Stub stub_;
+};
+
+// one call, the response is deleted after done
+struct Call : boost::noncopyable
+{
+  Call()
+    : latch(1),
+      response(NULL),
+      error(NO_ERROR)
+  {
+  }
+
+  CountDownLatch latch;
+  RpcController controller;
+  ListRpcResponse* response;
+  AtomicInt32 runs;
+  ErrorCode error;
+  string backend;
+  string echoed;  // request of the response
+
+  static void done(Call* call)
+  {
+    call->error = call->controller.errorCode();
+    if (call->error == NO_ERROR)
+    {
+      call->backend = call->response->service_name(0).c_str();
+      call->echoed = call->response->method_name(0).c_str();
+    }
+    call->runs.increment();
+    call->latch.countDown();
+  }
+
+  void start(RpcService::Stub& stub, const string& req, double timeout = 0)
+  {
+    ListRpcRequest request;
+    request.set_service_name(req.c_str());
+    response = new ListRpcResponse;
+    controller.setTimeout(timeout);
+    stub.listRpc(&controller, &request, response,
+                 ::google::protobuf::NewCallback(&Call::done, this));
+  }
+
+  void run(RpcService::Stub& stub, const string& req, double timeout = 0)
+  {
+    start(stub, req, timeout);
+    latch.wait();
+  }
+};
+
+string hold(int i)
+{
+  char buf[32];
+  snprintf(buf, sizeof buf, "hold %d", i);
+  return buf;
+}
+
+void testRoundRobin()
+{
+  boost::ptr_vector<Backend> backends;
+  for (int i = 0; i < 3; ++i)
+  {
+    backends.push_back(new Backend(i));
+  }
+  Client client(backends, RpcClient::kRoundRobin);
+  std::map<string, int> counts;
+  for (int i = 0; i < 30; ++i)
+  {
+    Call call;
+    call.run(client.stub(), "hello");
+    assert(call.error == NO_ERROR);
+    assert(call.echoed == "hello");
+    ++counts[call.backend];
+  }
+  assert(counts.size() == 3);
+  for (size_t i = 0; i < backends.size(); ++i)
+  {
+    assert(counts[backends[i].addr().toIpPort()] == 10);
+  }
+}
+
+// held calls spread evenly, as each is outstanding when the next is sent
+void testBalance(RpcClient::Policy policy, int numBackends)
+{
+  boost::ptr_vector<Backend> backends;
+  for (int i = 0; i < numBackends; ++i)
+  {
+    backends.push_back(new Backend(i));
+  }
+  Client client(backends, policy);
+  const int kPerBackend = 4;
+  boost::ptr_vector<Call> calls;
+  for (int i = 0; i < numBackends * kPerBackend; ++i)
+  {
+    calls.push_back(new Call);
+    calls.back().start(client.stub(), hold(i));
+  }
+  for (int i = 0; i < numBackends; ++i)
+  {
+    assert(waitFor(backends[i].service().numHeld(), kPerBackend));
+    backends[i].release();
+  }
+  for (size_t i = 0; i < calls.size(); ++i)
+  {
+    calls[i].latch.wait();
+    assert(calls[i].error == NO_ERROR);
+    assert(calls[i].echoed == hold(static_cast<int>(i)));
+  }
+}
+
+// calls to a backend which never answers time out, then it is ejected
+void testTimeoutAndEjection()
+{
+  boost::ptr_vector<Backend> backends;
+  backends.push_back(new Backend(0));
+  backends.push_back(new Backend(1, true));
+  Client client(backends, RpcClient::kRoundRobin, 2);
+  int timeouts = 0;
+  for (int i = 0; i < 4; ++i)
+  {
+    Call call;
+    Timestamp start(Timestamp::now());
+    call.run(client.stub(), "hello", 0.2);
+    if (call.error == TIMEOUT)
+    {
+      // by the sweep, every 0.1s
+      assert(timeDifference(Timestamp::now(), start) < 1.0);
+      ++timeouts;
+    }
+    else
+    {
+      assert(call.error == NO_ERROR);
+      assert(call.backend == backends[0].addr().toIpPort());
+    }
+  }
+  assert(timeouts == 2);
+  for (int i = 0; i < 6; ++i)
+  {
+    Call call;
+    call.run(client.stub(), "hello", 0.2);
+    assert(call.error == NO_ERROR);
+  }
+  assert(backends[1].service().calls().get() == 2);
+}
+
+void testCancel()
+{
+  boost::ptr_vector<Backend> backends;
+  backends.push_back(new Backend(0));
+  Client client(backends, RpcClient::kRoundRobin);
+  Call call;
+  call.start(client.stub(), hold(0));
+  assert(waitFor(backends[0].service().numHeld(), 1));
+  call.controller.StartCancel();
+  call.latch.wait();
+  assert(call.error == CANCELED);
+  // the late response is dropped
+  backends[0].release();
+  Call after;
+  after.run(client.stub(), "hello");
+  assert(after.error == NO_ERROR);
+  assert(call.runs.get() == 1);
+}
+
+// ids wrap around the 64 slots of a new channel, pending calls move
+// to the overflow map, where they still time out or get the response
+void testOverflow()
+{
+  boost::ptr_vector<Backend> backends;
+  backends.push_back(new Backend(0));
+  Client client(backends, RpcClient::kRoundRobin);
+  Call expiring;
+  Call held;
+  expiring.start(client.stub(), hold(0), 1.0);
+  held.start(client.stub(), hold(1));
+  for (int i = 0; i < 100; ++i)
+  {
+    Call call;
+    call.run(client.stub(), "hello");
+    assert(call.error == NO_ERROR);
+  }
+  expiring.latch.wait();
+  assert(expiring.error == TIMEOUT);
+  backends[0].release();
+  held.latch.wait();
+  assert(held.error == NO_ERROR);
+  assert(held.echoed == hold(1));
+}
+
+// more pending calls than slots, the table grows
+void testGrow()
+{
+  boost::ptr_vector<Backend> backends;
+  backends.push_back(new Backend(0));
+  Client client(backends, RpcClient::kRoundRobin);
+  const int kCalls = 300;
+  boost::ptr_vector<Call> calls;
+  for (int i = 0; i < kCalls; ++i)
+  {
+    calls.push_back(new Call);
+    calls.back().start(client.stub(), hold(i));
+  }
+  assert(waitFor(backends[0].service().numHeld(), kCalls));
+  backends[0].release();
+  for (int i = 0; i < kCalls; ++i)
+  {
+    calls[i].latch.wait();
+    assert(calls[i].error == NO_ERROR);
+    assert(calls[i].echoed == hold(i));
+  }
+}
+
+// pending calls fail with CLOSED, the connection is retried
+void testDisconnect()
+{
+  boost::ptr_vector<Backend> backends;
+  backends.push_back(new Backend(0));
+  Client client(backends, RpcClient::kRoundRobin);
+  boost::ptr_vector<Call> calls;
+  for (int i = 0; i < 10; ++i)
+  {
+    calls.push_back(new Call);
+    calls.back().start(client.stub(), hold(i));
+  }
+  assert(waitFor(backends[0].service().numHeld(), 10));
+  backends[0].stop();
+  for (size_t i = 0; i < calls.size(); ++i)
+  {
+    calls[i].latch.wait();
+    assert(calls[i].error == CLOSED);
+  }
+  client.waitConnected(0);
+
+  Call down;
+  down.run(client.stub(), "hello");
+  assert(down.error == CLOSED);
+
+  backends[0].start();
+  client.waitConnected(1);
+  Call up;
+  up.run(client.stub(), "hello");
+  assert(up.error == NO_ERROR);
+}
+
+// settings of a method no service has are refused, not fatal
+void testUnknownMethod()
+{
+  EventLoop loop;
+  RpcServer server(&loop, InetAddress(0, true));
+  TestService service("unknown", false);
+  server.registerService(&service);
+  assert(server.setMethodConcurrency("muduo.net.RpcService.listRpc", 1));
+  assert(!server.setMethodConcurrency("muduo.net.RpcService.noSuchMethod", 1));
+  assert(!server.setMethodThreadPool("no.Such.Method", NULL));
+}
+
+const int kRacingCalls = 2000;
+
+void startCalls(RpcService::Stub* stub, boost::ptr_vector<Call>* calls)
+{
+  for (int i = 0; i < kRacingCalls; ++i)
+  {
+    (*calls)[i].start(*stub, hold(i));
+  }
+}
+
+// calls from another thread while the connection is lost all finish
+void testCallsRacingDisconnect()
+{
+  boost::ptr_vector<Backend> backends;
+  backends.push_back(new Backend(0));
+  Client client(backends, RpcClient::kRoundRobin);
+  boost::ptr_vector<Call> calls;
+  for (int i = 0; i < kRacingCalls; ++i)
+  {
+    calls.push_back(new Call);
+  }
+  Thread caller(boost::bind(startCalls, &client.stub(), &calls), "caller");
+  caller.start();
+  while (backends[0].service().calls().get() < kRacingCalls / 4)
+  {
+    usleep(100);
+  }
+  backends[0].stop();
+  caller.join();
+  int closed = 0;
+  for (int i = 0; i < kRacingCalls; ++i)
+  {
+    calls[i].latch.wait();
+    assert(calls[i].error == CLOSED);
+    assert(calls[i].runs.get() == 1);
+    ++closed;
+  }
+  printf("%d calls closed, %d reached the backend\n",
+         closed, backends[0].service().calls().get());
+}
+
+}
+
+int main()
+{
+  Logger::setLogLevel(Logger::ERROR);
+  testRoundRobin();
+  testBalance(RpcClient::kLeastOutstanding, 3);
+  testBalance(RpcClient::kPowerOfTwoChoices, 2);
+  testTimeoutAndEjection();
+  testCancel();
+  testOverflow();
+  testGrow();
+  testDisconnect();
+  testUnknownMethod();
+  testCallsRacingDisconnect();
+  printf("All tests passed\n");
+}
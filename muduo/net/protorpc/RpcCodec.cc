@@ -15,8 +15,12 @@
 #include <muduo/net/protorpc/rpc.pb.h>
 #include <muduo/net/protorpc/google-inl.h>
 
+#include <google/protobuf/io/coded_stream.h>
+
 #include <boost/bind.hpp>
 
+#include <limits.h>
+
 using namespace muduo;
 using namespace muduo::net;
 
@@ -37,3 +41,195 @@ namespace net
 const char rpctag [] = "RPC0";
 }
 }
+
+namespace
+{
+  using google::protobuf::io::CodedInputStream;
+  using google::protobuf::io::CodedOutputStream;
+
+  enum WireType
+  {
+    kVarint = 0,
+    kFixed64 = 1,
+    kLengthDelimited = 2,
+    kFixed32 = 5,
+  };
+
+  uint32_t makeTag(int field, WireType type)
+  {
+    return static_cast<uint32_t>(field << 3 | type);
+  }
+
+  // copied from MessageLite::SerializeWithCachedSizesToArray() callers,
+  // size must be from ByteSizeLong() just called.
+  void serializeTo(const google::protobuf::Message& message, int size, Buffer* buf)
+  {
+    uint8_t* start = reinterpret_cast<uint8_t*>(buf->beginWrite());
+    uint8_t* end = message.SerializeWithCachedSizesToArray(start);
+    if (end - start != size)
+    {
+      ByteSizeConsistencyError(size, static_cast<int>(message.ByteSizeLong()),
+                               static_cast<int>(end - start));
+    }
+    buf->hasWritten(size);
+  }
+}
+
+bool muduo::net::fillRpcBuffer(Buffer* buf,
+                               const RpcMessage& message,
+                               const google::protobuf::Message* payload,
+                               ProtobufCodecLite::ChecksumType type)
+{
+  assert(buf->readableBytes() == 0);
+  assert(!message.has_request() && !message.has_response());
+  GOOGLE_DCHECK(message.IsInitialized()) << InitializationErrorMessage("serialize", message);
+  const size_t kTagLen = sizeof rpctag - 1;
+  const int kMaxVarint32Bytes = 5;
+  const size_t byteSize = message.ByteSizeLong();
+  const size_t payloadByteSize = payload ? payload->ByteSizeLong() : 0;
+  // sizes are narrowed to int, frame length must fit in the header
+  if (byteSize > INT_MAX || payloadByteSize > INT_MAX
+      || kTagLen + byteSize + 2 * kMaxVarint32Bytes + payloadByteSize
+         + ProtobufCodecLite::kChecksumLen > static_cast<size_t>(ProtobufCodecLite::kLengthMask))
+  {
+    LOG_ERROR << "fillRpcBuffer - message too big, " << byteSize
+              << " + " << payloadByteSize << " bytes";
+    return false;
+  }
+
+  buf->append(rpctag, kTagLen);
+  const int size = static_cast<int>(byteSize);
+  buf->ensureWritableBytes(size);
+  serializeTo(message, size, buf);
+
+  if (payload)
+  {
+    // fields may come in any order, parsers take the last one.
+    GOOGLE_DCHECK(payload->IsInitialized()) << InitializationErrorMessage("serialize", *payload);
+    const int field = message.type() == REQUEST ? RpcMessage::kRequestFieldNumber
+                                                : RpcMessage::kResponseFieldNumber;
+    const int payloadSize = static_cast<int>(payloadByteSize);
+    buf->ensureWritableBytes(payloadSize + 2 * kMaxVarint32Bytes
+                             + ProtobufCodecLite::kChecksumLen);
+    uint8_t* start = reinterpret_cast<uint8_t*>(buf->beginWrite());
+    uint8_t* end = CodedOutputStream::WriteVarint32ToArray(makeTag(field, kLengthDelimited), start);
+    end = CodedOutputStream::WriteVarint32ToArray(static_cast<uint32_t>(payloadSize), end);
+    buf->hasWritten(end - start);
+    serializeTo(*payload, payloadSize, buf);
+  }
+
+  int32_t checkSum = ProtobufCodecLite::checksum(type, buf->peek(), static_cast<int>(buf->readableBytes()));
+  buf->appendInt32(checkSum);
+  int32_t header = static_cast<int32_t>(buf->readableBytes())
+                   | (type << ProtobufCodecLite::kChecksumTypeShift);
+  int32_t be32 = sockets::hostToNetwork32(header);
+  buf->prepend(&be32, sizeof be32);
+  return true;
+}
+
+bool muduo::net::parseRpcMessage(StringPiece data,
+                                 RpcMessage* message,
+                                 StringPiece* payload)
+{
+  const uint8_t* begin = reinterpret_cast<const uint8_t*>(data.data());
+  CodedInputStream in(begin, data.size());
+  *payload = StringPiece();
+  uint32_t tag = 0;
+  bool ok = true;
+  while (ok && (tag = in.ReadTag()) != 0)
+  {
+    const int field = static_cast<int>(tag >> 3);
+    const WireType type = static_cast<WireType>(tag & 7);
+    uint32_t u32 = 0;
+    uint64_t u64 = 0;
+    if (tag == makeTag(RpcMessage::kTypeFieldNumber, kVarint))
+    {
+      ok = in.ReadVarint32(&u32) && MessageType_IsValid(static_cast<int>(u32));
+      if (ok)
+      {
+        message->set_type(static_cast<MessageType>(u32));
+      }
+    }
+    else if (tag == makeTag(RpcMessage::kIdFieldNumber, kFixed64))
+    {
+      ok = in.ReadLittleEndian64(&u64);
+      message->set_id(u64);
+    }
+    else if (tag == makeTag(RpcMessage::kServiceFieldNumber, kLengthDelimited))
+    {
+      ok = in.ReadVarint32(&u32) && in.ReadString(message->mutable_service(), static_cast<int>(u32));
+    }
+    else if (tag == makeTag(RpcMessage::kMethodFieldNumber, kLengthDelimited))
+    {
+      ok = in.ReadVarint32(&u32) && in.ReadString(message->mutable_method(), static_cast<int>(u32));
+    }
+    else if (tag == makeTag(RpcMessage::kRequestFieldNumber, kLengthDelimited)
+             || tag == makeTag(RpcMessage::kResponseFieldNumber, kLengthDelimited))
+    {
+      // not copied
+      ok = in.ReadVarint32(&u32);
+      const int offset = in.CurrentPosition();
+      ok = ok && in.Skip(static_cast<int>(u32));
+      if (ok)
+      {
+        payload->set(data.data() + offset, static_cast<int>(u32));
+      }
+    }
+    else if (tag == makeTag(RpcMessage::kErrorFieldNumber, kVarint))
+    {
+      ok = in.ReadVarint32(&u32);
+      if (ok && ErrorCode_IsValid(static_cast<int>(u32)))
+      {
+        message->set_error(static_cast<ErrorCode>(u32));
+      }
+    }
+    else if (tag == makeTag(RpcMessage::kTimeoutFieldNumber, kVarint))
+    {
+      // negative int32 takes 10 bytes
+      ok = in.ReadVarint64(&u64);
+      message->set_timeout(static_cast<int32_t>(u64));
+    }
+    else if (tag == makeTag(RpcMessage::kStreamFieldNumber, kVarint))
+    {
+      ok = in.ReadVarint64(&u64);
+      message->set_stream(u64 != 0);
+    }
+    else if (tag == makeTag(RpcMessage::kEndFieldNumber, kVarint))
+    {
+      ok = in.ReadVarint64(&u64);
+      message->set_end(u64 != 0);
+    }
+    else if (tag == makeTag(RpcMessage::kCreditFieldNumber, kVarint))
+    {
+      ok = in.ReadVarint64(&u64);
+      message->set_credit(static_cast<int32_t>(u64));
+    }
+    else if (field == 0)
+    {
+      ok = false;
+    }
+    else
+    {
+      // unknown field, skipped
+      switch (type)
+      {
+        case kVarint:
+          ok = in.ReadVarint64(&u64);
+          break;
+        case kFixed64:
+          ok = in.ReadLittleEndian64(&u64);
+          break;
+        case kLengthDelimited:
+          ok = in.ReadVarint32(&u32) && in.Skip(static_cast<int>(u32));
+          break;
+        case kFixed32:
+          ok = in.ReadLittleEndian32(&u32);
+          break;
+        default:
+          ok = false;
+          break;
+      }
+    }
+  }
+  return ok && in.ConsumedEntireMessage() && message->IsInitialized();
+}
@@ -35,14 +35,30 @@ extern const char rpctag[];// = "RPC0";
 //
 // Field     Length  Content
 //
-// size      4-byte  N+8
+// size      4-byte  N+8, checksum type in the top 4 bits
 // "RPC0"    4-byte
 // payload   N-byte
-// checksum  4-byte  adler32 of "RPC0"+payload
+// checksum  4-byte  adler32 (or crc32c, or 0) of "RPC0"+payload
 //
 
 typedef ProtobufCodecLiteT<RpcMessage, rpctag> RpcCodec;
 
+/// Fills an empty buf with a frame of message, whose request (or response,
+/// by message.type()) field is payload serialized in place.
+/// Same bytes as setting the field to payload.SerializeAsString(),
+/// without the temporary string.
+/// Returns false, leaving buf empty, if the frame is too big for its header.
+bool fillRpcBuffer(Buffer* buf,
+                   const RpcMessage& message,
+                   const ::google::protobuf::Message* payload,
+                   ProtobufCodecLite::ChecksumType type = ProtobufCodecLite::kAdler32);
+
+/// Parses RpcMessage from the bytes between tag and checksum, leaving
+/// request or response field in payload, which points into data.
+bool parseRpcMessage(StringPiece data,
+                     RpcMessage* message,
+                     StringPiece* payload);
+
 }
 }
 
@@ -4,6 +4,8 @@
 #include <muduo/net/protobuf/ProtobufCodecLite.h>
 #include <muduo/net/Buffer.h>
 
+#include <vector>
+
 #include <stdio.h>
 
 using namespace muduo;
@@ -23,6 +25,19 @@ void messageCallback(const TcpConnectionPtr&,
   g_msgptr = msg;
 }
 
+bool g_keep = false;
+std::vector<const google::protobuf::Message*> g_seen;
+void reuseCallback(const TcpConnectionPtr&,
+                   const MessagePtr& msg,
+                   Timestamp)
+{
+  g_seen.push_back(get_pointer(msg));
+  if (g_keep)
+  {
+    g_msgptr = msg;
+  }
+}
+
 void print(const Buffer& buf)
 {
   printf("encoded to %zd bytes\n", buf.readableBytes());
@@ -77,5 +92,146 @@ int main()
   assert(g_msgptr->DebugString() == message.DebugString());
   }
 
+  {
+  // payload serialized in place, same bytes as the nested string
+  RpcMessage payload;
+  payload.set_type(RESPONSE);
+  payload.set_id(3);
+  payload.set_service("EchoService");
+  payload.set_response(std::string(300, 'x'));
+
+  RpcMessage nested(message);
+  nested.set_request(payload.SerializeAsString());
+  Buffer expectedBuf;
+  RpcCodec codec(rpcMessageCallback);
+  codec.fillEmptyBuffer(&expectedBuf, nested);
+
+  Buffer buf;
+  fillRpcBuffer(&buf, message, &payload);
+  assert(buf.toStringPiece() == expectedBuf.toStringPiece());
+
+  RpcMessage parsed;
+  StringPiece parsedPayload;
+  const int headerLen = ProtobufCodecLite::kHeaderLen + 4;  // "RPC0"
+  StringPiece data(buf.peek() + headerLen,
+                   static_cast<int>(buf.readableBytes()) - headerLen - ProtobufCodecLite::kChecksumLen);
+  assert(parseRpcMessage(data, &parsed, &parsedPayload));
+  assert(parsed.DebugString() == message.DebugString());
+  assert(parsedPayload == StringPiece(payload.SerializeAsString()));
+  assert(parsedPayload.data() >= buf.peek() && parsedPayload.end() <= buf.peek() + buf.readableBytes());
+
+  RpcMessage truncated;
+  data.remove_suffix(1);
+  assert(!parseRpcMessage(data, &truncated, &parsedPayload));
+  }
+
+  {
+  // timeout, negative ones take 10 bytes
+  const int timeouts[] = { 0, 1, 1500, -1 };
+  for (size_t i = 0; i < sizeof timeouts / sizeof timeouts[0]; ++i)
+  {
+    RpcMessage request(message);
+    request.set_timeout(timeouts[i]);
+    Buffer buf;
+    fillRpcBuffer(&buf, request, NULL);
+    RpcMessage parsed;
+    StringPiece payload;
+    const int headerLen = ProtobufCodecLite::kHeaderLen + 4;  // "RPC0"
+    StringPiece data(buf.peek() + headerLen,
+                     static_cast<int>(buf.readableBytes()) - headerLen - ProtobufCodecLite::kChecksumLen);
+    assert(parseRpcMessage(data, &parsed, &payload));
+    assert(parsed.has_timeout());
+    assert(parsed.timeout() == timeouts[i]);
+    assert(parsed.DebugString() == request.DebugString());
+  }
+  }
+
+  {
+  // stream fields
+  RpcMessage request(message);
+  request.set_stream(true);
+  request.set_end(true);
+  request.set_credit(16);
+  request.set_error(CANCELED);
+  Buffer buf;
+  fillRpcBuffer(&buf, request, NULL);
+  RpcMessage parsed;
+  StringPiece payload;
+  const int headerLen = ProtobufCodecLite::kHeaderLen + 4;  // "RPC0"
+  StringPiece data(buf.peek() + headerLen,
+                   static_cast<int>(buf.readableBytes()) - headerLen - ProtobufCodecLite::kChecksumLen);
+  assert(parseRpcMessage(data, &parsed, &payload));
+  assert(parsed.DebugString() == request.DebugString());
+  assert(payload.data() == NULL);
+  }
+
+  {
+  // checksum types, all accepted by the receiver
+  const ProtobufCodecLite::ChecksumType types[] = {
+    ProtobufCodecLite::kAdler32, ProtobufCodecLite::kCrc32c, ProtobufCodecLite::kNoChecksum };
+  for (size_t i = 0; i < sizeof types / sizeof types[0]; ++i)
+  {
+    Buffer buf;
+    fillRpcBuffer(&buf, message, NULL, types[i]);
+    ProtobufCodecLite::ChecksumType type = ProtobufCodecLite::kAdler32;
+    assert(ProtobufCodecLite::checksumTypeOf(buf.peek(), &type));
+    assert(type == types[i]);
+
+    ProtobufCodecLite codec(&RpcMessage::default_instance(), "RPC0", messageCallback);
+    codec.setChecksumType(types[i]);
+    Buffer expectedBuf;
+    codec.fillEmptyBuffer(&expectedBuf, message);
+    assert(buf.toStringPiece() == expectedBuf.toStringPiece());
+
+    ProtobufCodecLite receiver(&RpcMessage::default_instance(), "RPC0", messageCallback);
+    g_msgptr.reset();
+    receiver.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
+    assert(g_msgptr);
+    assert(g_msgptr->DebugString() == message.DebugString());
+  }
+  Buffer crc;
+  fillRpcBuffer(&crc, message, NULL, ProtobufCodecLite::kCrc32c);
+  assert(crc.readableBytes() == expected.size());
+  assert(crc.peek()[0] == '\x10');  // type 1 in the top 4 bits
+  assert(memcmp(crc.peek() + 1, expected.data() + 1, expected.size() - 5) == 0);
+  }
+
+  {
+  // reused messages, unless the callback keeps one
+  ProtobufCodecLite codec(&RpcMessage::default_instance(), "RPC0", reuseCallback);
+  codec.setMessageReuse(true);
+  Buffer buf;
+  for (int i = 0; i < 2; ++i)
+  {
+    RpcMessage request(message);
+    request.set_id(i);
+    if (i == 0)
+    {
+      request.set_service("EchoService");
+    }
+    fillRpcBuffer(&buf, request, NULL);
+    codec.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
+  }
+  assert(g_seen.size() == 2 && g_seen[0] == g_seen[1]);
+  assert(!static_cast<const RpcMessage*>(g_seen[1])->has_service());
+
+  g_keep = true;
+  fillRpcBuffer(&buf, message, NULL);
+  codec.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
+  g_keep = false;
+  fillRpcBuffer(&buf, message, NULL);
+  codec.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
+  assert(g_seen.size() == 4 && g_seen[2] == g_seen[1] && g_seen[3] != g_seen[2]);
+  assert(get_pointer(g_msgptr) == g_seen[2]);
+  assert(g_msgptr->DebugString() == message.DebugString());
+
+  // shared with other codecs of RpcMessage in this thread
+  ProtobufCodecLite other(&RpcMessage::default_instance(), "RPC0", reuseCallback);
+  other.setMessageReuse(true);
+  fillRpcBuffer(&buf, message, NULL);
+  other.onMessage(TcpConnectionPtr(), &buf, Timestamp::now());
+  assert(g_seen.size() == 5 && g_seen[4] == g_seen[3]);
+  }
+
   google::protobuf::ShutdownProtobufLibrary();
 }
@@ -0,0 +1,80 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/protorpc/RpcController.h>
+
+#include <muduo/net/protorpc/RpcChannel.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+RpcController::RpcController()
+  : timeout_(0.0),
+    errorCode_(NO_ERROR),
+    cancelCallback_(NULL),
+    channel_(NULL),
+    id_(0),
+    limiter_(NULL)
+{
+}
+
+RpcController::~RpcController()
+{
+  delete cancelCallback_;
+}
+
+void RpcController::Reset()
+{
+  errorCode_ = NO_ERROR;
+  errorText_.clear();
+  deadline_ = Timestamp();
+  delete cancelCallback_;
+  cancelCallback_ = NULL;
+  channel_ = NULL;
+  id_ = 0;
+}
+
+bool RpcController::Failed() const
+{
+  return errorCode_ != NO_ERROR || !errorText_.empty();
+}
+
+std::string RpcController::ErrorText() const
+{
+  return errorText_;
+}
+
+void RpcController::StartCancel()
+{
+  if (channel_)
+  {
+    channel_->cancel(id_);
+  }
+}
+
+void RpcController::SetFailed(const std::string& reason)
+{
+  errorText_ = reason;
+}
+
+bool RpcController::IsCanceled() const
+{
+  return false;
+}
+
+void RpcController::NotifyOnCancel(::google::protobuf::Closure* callback)
+{
+  delete cancelCallback_;
+  cancelCallback_ = callback;
+}
+
+void RpcController::fail(ErrorCode code)
+{
+  errorCode_ = code;
+  errorText_ = ErrorCode_Name(code);
+}
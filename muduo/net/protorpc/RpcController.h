@@ -0,0 +1,99 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_PROTORPC_RPCCONTROLLER_H
+#define MUDUO_NET_PROTORPC_RPCCONTROLLER_H
+
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/protorpc/rpc.pb.h>
+
+#include <google/protobuf/service.h>
+
+namespace muduo
+{
+namespace net
+{
+
+class ConcurrencyLimiter;
+class RpcChannel;
+
+///
+/// Per call timeout, error and cancellation.
+///
+/// On the client side, pass it to a stub method and keep it alive until
+/// done is run.  On the server side, RpcChannel passes one to the service,
+/// it is valid until done is run.
+///
+class RpcController : public ::google::protobuf::RpcController
+{
+ public:
+  RpcController();
+  virtual ~RpcController();
+
+  // client side
+  virtual void Reset();
+  virtual bool Failed() const;
+  virtual std::string ErrorText() const;
+  /// Fails the call with CANCELED and runs done in the connection's loop,
+  /// a late response is dropped.
+  /// Thread safe, the channel must outlive the call.
+  virtual void StartCancel();
+
+  // server side
+  virtual void SetFailed(const std::string& reason);
+  /// Cancellation is not sent to the server, always false.
+  virtual bool IsCanceled() const;
+  /// callback is run after done.
+  virtual void NotifyOnCancel(::google::protobuf::Closure* callback);
+
+  /// Seconds to wait for the response, 0 uses RpcChannel's default.
+  /// Sent to the server, which drops the request once it expires.
+  void setTimeout(double seconds)
+  { timeout_ = seconds; }
+
+  double timeout() const
+  { return timeout_; }
+
+  ErrorCode errorCode() const
+  { return errorCode_; }
+
+  /// Server side, when the caller stops waiting.
+  /// Invalid if the caller has no timeout.
+  Timestamp deadline() const
+  { return deadline_; }
+
+  bool expired(Timestamp now) const
+  { return deadline_.valid() && now.microSecondsSinceEpoch() >= deadline_.microSecondsSinceEpoch(); }
+
+ private:
+  friend class RpcChannel;
+  friend class RpcClient;
+
+  void fail(ErrorCode code);
+
+  double timeout_;
+  ErrorCode errorCode_;
+  std::string errorText_;
+  Timestamp deadline_;
+  ::google::protobuf::Closure* cancelCallback_;
+
+  // set by RpcChannel::CallMethod()
+  RpcChannel* channel_;
+  int64_t id_;
+
+  // server side, released in RpcChannel::doneCallback()
+  ConcurrencyLimiter* limiter_;
+  Timestamp start_;
+};
+
+}
+}
+
+#endif  // MUDUO_NET_PROTORPC_RPCCONTROLLER_H
@@ -9,6 +9,7 @@
 #include <muduo/net/protorpc/RpcServer.h>
 
 #include <muduo/base/Logging.h>
+#include <muduo/net/protorpc/ConcurrencyLimiter.h>
 #include <muduo/net/protorpc/RpcChannel.h>
 
 #include <google/protobuf/descriptor.h>
@@ -21,7 +22,8 @@ using namespace muduo::net;
 
 RpcServer::RpcServer(EventLoop* loop,
                      const InetAddress& listenAddr)
-  : server_(loop, listenAddr, "RpcServer")
+  : maxInFlight_(0),
+    server_(loop, listenAddr, "RpcServer")
 {
   server_.setConnectionCallback(
       boost::bind(&RpcServer::onConnection, this, _1));
@@ -29,12 +31,82 @@ RpcServer::RpcServer(EventLoop* loop,
 //       boost::bind(&RpcServer::onMessage, this, _1, _2, _3));
 }
 
+RpcServer::~RpcServer()
+{
+}
+
 void RpcServer::registerService(google::protobuf::Service* service)
 {
   const google::protobuf::ServiceDescriptor* desc = service->GetDescriptor();
   services_[desc->name()] = service;
 }
 
+void RpcServer::registerService(google::protobuf::Service* service, ThreadPool* pool)
+{
+  registerService(service);
+  const google::protobuf::ServiceDescriptor* desc = service->GetDescriptor();
+  for (int i = 0; i < desc->method_count(); ++i)
+  {
+    dispatch_[desc->method(i)].pool = pool;
+  }
+}
+
+bool RpcServer::setMethodThreadPool(const std::string& method, ThreadPool* pool)
+{
+  const google::protobuf::MethodDescriptor* desc = findMethod(method);
+  if (desc)
+  {
+    dispatch_[desc].pool = pool;
+  }
+  return desc != NULL;
+}
+
+bool RpcServer::setMethodConcurrency(const std::string& method,
+                                     int maxConcurrency,
+                                     bool adaptive)
+{
+  const google::protobuf::MethodDescriptor* desc = findMethod(method);
+  if (desc)
+  {
+    limiters_.push_back(new ConcurrencyLimiter(maxConcurrency, adaptive));
+    dispatch_[desc].limiter = &limiters_.back();
+  }
+  return desc != NULL;
+}
+
+bool RpcServer::registerStreamHandler(const std::string& method,
+                                      const RpcStreamHandler& handler,
+                                      int window)
+{
+  const google::protobuf::MethodDescriptor* desc = findMethod(method);
+  if (desc)
+  {
+    RpcMethodDispatch& dispatch = dispatch_[desc];
+    dispatch.stream = handler;
+    dispatch.streamWindow = window;
+  }
+  return desc != NULL;
+}
+
+const google::protobuf::MethodDescriptor* RpcServer::findMethod(const std::string& method) const
+{
+  for (std::map<std::string, google::protobuf::Service*>::const_iterator it = services_.begin();
+       it != services_.end(); ++it)
+  {
+    const google::protobuf::ServiceDescriptor* desc = it->second->GetDescriptor();
+    for (int i = 0; i < desc->method_count(); ++i)
+    {
+      if (desc->method(i)->full_name() == method)
+      {
+        return desc->method(i);
+      }
+    }
+  }
+  // calls of it are answered with NO_SERVICE or NO_METHOD
+  LOG_ERROR << "RpcServer - no method " << method << ", register its service first";
+  return NULL;
+}
+
 void RpcServer::start()
 {
   server_.start();
@@ -49,14 +121,19 @@ void RpcServer::onConnection(const TcpConnectionPtr& conn)
   {
     RpcChannelPtr channel(new RpcChannel(conn));
     channel->setServices(&services_);
+    channel->setDispatch(&dispatch_, maxInFlight_);
     conn->setMessageCallback(
         boost::bind(&RpcChannel::onMessage, get_pointer(channel), _1, _2, _3));
     conn->setContext(channel);
   }
   else
   {
+    RpcChannelPtr channel(boost::any_cast<RpcChannelPtr>(conn->getContext()));
     conn->setContext(RpcChannelPtr());
-    // FIXME:
+    if (channel)
+    {
+      channel->failOutstandingCalls();
+    }
   }
 }
 
@@ -12,10 +12,14 @@
 #define MUDUO_NET_PROTORPC_RPCSERVER_H
 
 #include <muduo/net/TcpServer.h>
+#include <muduo/net/protorpc/RpcChannel.h>
+
+#include <boost/ptr_container/ptr_vector.hpp>
 
 namespace google {
 namespace protobuf {
 
+class MethodDescriptor;
 class Service;
 
 }  // namespace protobuf
@@ -31,6 +35,7 @@ class RpcServer
  public:
   RpcServer(EventLoop* loop,
             const InetAddress& listenAddr);
+  ~RpcServer();
 
   void setThreadNum(int numThreads)
   {
@@ -38,17 +43,55 @@ class RpcServer
   }
 
   void registerService(::google::protobuf::Service*);
+
+  /// Runs methods of service in pool instead of the IO thread.
+  /// pool must be started, with no max queue size or run() blocks
+  /// the IO thread.
+  void registerService(::google::protobuf::Service*, ThreadPool* pool);
+
+  // The following are not thread safe, call them before start().
+  // method is its full name, e.g. "sudoku.SudokuService.Solve",
+  // they return false if no service registered has it.
+
+  /// Overrides the pool of one method, NULL runs it in the IO thread.
+  bool setMethodThreadPool(const std::string& method, ThreadPool* pool);
+
+  /// At most maxConcurrency calls of method run at a time across all
+  /// connections, more are rejected with OVERLOADED.  If adaptive, the
+  /// limit drops below maxConcurrency as latency rises.
+  bool setMethodConcurrency(const std::string& method,
+                            int maxConcurrency,
+                            bool adaptive = false);
+
+  /// Serves method as a streaming call, see RpcStream.
+  /// handler runs in the IO thread.  window is how many messages
+  /// from the caller may be in flight.
+  bool registerStreamHandler(const std::string& method,
+                             const RpcStreamHandler& handler,
+                             int window = 16);
+
+  /// At most maxInFlight calls per connection, 0 for no limit.
+  void setMaxInFlightPerConnection(int maxInFlight)
+  {
+    maxInFlight_ = maxInFlight;
+  }
+
   void start();
 
  private:
   void onConnection(const TcpConnectionPtr& conn);
+  const ::google::protobuf::MethodDescriptor* findMethod(const std::string& method) const;
 
   // void onMessage(const TcpConnectionPtr& conn,
   //                Buffer* buf,
   //                Timestamp time);
 
-  TcpServer server_;
+  // used by channels of server_'s connections
   std::map<std::string, ::google::protobuf::Service*> services_;
+  boost::ptr_vector<ConcurrencyLimiter> limiters_;
+  RpcDispatchMap dispatch_;
+  int maxInFlight_;
+  TcpServer server_;
 };
 
 }
@@ -0,0 +1,226 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include <muduo/net/protorpc/RpcStream.h>
+
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/protorpc/RpcChannel.h>
+
+#include <google/protobuf/message.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+RpcStream::RpcStream(RpcChannel* channel,
+                     EventLoop* loop,
+                     int64_t id,
+                     bool caller,
+                     const ::google::protobuf::Message* prototype,
+                     int window)
+  : channel_(channel),
+    loop_(loop),
+    id_(id),
+    caller_(caller),
+    prototype_(prototype),
+    window_(window),
+    credit_(0),
+    received_(0),
+    granted_(window),
+    finished_(false),
+    closed_(false),
+    waiting_(false)
+{
+  assert(window_ > 0);
+}
+
+RpcStream::~RpcStream()
+{
+}
+
+bool RpcStream::canWrite() const
+{
+  return !closed_ && !finished_ && credit_ > 0;
+}
+
+bool RpcStream::write(const ::google::protobuf::Message& message)
+{
+  loop_->assertInLoopThread();
+  if (!canWrite())
+  {
+    waiting_ = !closed_ && !finished_;
+    return false;
+  }
+  --credit_;
+  RpcMessage rpc;
+  send(&rpc, &message);
+  return true;
+}
+
+bool RpcStream::writable()
+{
+  loop_->assertInLoopThread();
+  if (!canWrite())
+  {
+    waiting_ = !closed_ && !finished_;
+    return false;
+  }
+  if (!channel_->belowHighWaterMark())
+  {
+    waiting_ = true;
+    channel_->waitForWriteComplete();
+    return false;
+  }
+  return true;
+}
+
+void RpcStream::finish()
+{
+  loop_->assertInLoopThread();
+  if (closed_ || finished_)
+  {
+    return;
+  }
+  finished_ = true;
+  RpcMessage rpc;
+  rpc.set_end(true);
+  send(&rpc, NULL);
+  if (!caller_)
+  {
+    close(NO_ERROR, true);
+  }
+}
+
+void RpcStream::cancel(ErrorCode error)
+{
+  loop_->assertInLoopThread();
+  if (closed_)
+  {
+    return;
+  }
+  RpcMessage rpc;
+  rpc.set_end(true);
+  rpc.set_error(error);
+  send(&rpc, NULL);
+  close(error, true);
+}
+
+void RpcStream::send(RpcMessage* rpc, const ::google::protobuf::Message* payload)
+{
+  rpc->set_type(caller_ ? REQUEST : RESPONSE);
+  rpc->set_id(id_);
+  rpc->set_stream(true);
+  channel_->sendRpcMessage(*rpc, payload);
+}
+
+void RpcStream::onPeerMessage(const RpcMessage& message, StringPiece payload)
+{
+  RpcStreamPtr guard(shared_from_this());
+  if (message.has_credit())
+  {
+    credit_ += message.credit();
+  }
+
+  if (payload.data() != NULL)
+  {
+    if (granted_ == 0)
+    {
+      LOG_ERROR << "RpcStream::onPeerMessage - peer exceeds window on stream " << id_;
+      cancel(caller_ ? INVALID_RESPONSE : INVALID_REQUEST);
+      return;
+    }
+    --granted_;
+    MessagePtr msg(prototype_->New());
+    if (!msg->ParseFromArray(payload.data(), payload.size()))
+    {
+      LOG_ERROR << "RpcStream::onPeerMessage - bad message on stream " << id_;
+      cancel(caller_ ? INVALID_RESPONSE : INVALID_REQUEST);
+      return;
+    }
+    if (messageCallback_)
+    {
+      messageCallback_(guard, msg);
+    }
+    // delivered, ready for more
+    ++received_;
+    grant();
+  }
+
+  if (message.end() && !closed_)
+  {
+    ErrorCode error = message.has_error() ? message.error() : NO_ERROR;
+    if (caller_ || error != NO_ERROR)
+    {
+      close(error, true);
+    }
+    else if (messageCallback_)
+    {
+      messageCallback_(guard, MessagePtr());
+    }
+  }
+
+  if (message.has_credit())
+  {
+    onWritable();
+  }
+}
+
+void RpcStream::grant()
+{
+  if (holdsGrant())
+  {
+    if (!channel_->belowHighWaterMark())
+    {
+      channel_->waitForWriteComplete();
+      return;
+    }
+    RpcMessage rpc;
+    rpc.set_credit(received_);
+    granted_ += received_;
+    received_ = 0;
+    send(&rpc, NULL);
+  }
+}
+
+void RpcStream::onWritable()
+{
+  grant();
+  if (waiting_ && canWrite())
+  {
+    if (!channel_->belowHighWaterMark())
+    {
+      channel_->waitForWriteComplete();
+      return;
+    }
+    waiting_ = false;
+    if (writableCallback_)
+    {
+      writableCallback_(shared_from_this());
+    }
+  }
+}
+
+void RpcStream::close(ErrorCode error, bool notify)
+{
+  if (closed_)
+  {
+    return;
+  }
+  RpcStreamPtr guard(shared_from_this());
+  closed_ = true;
+  channel_->removeStream(this);
+  channel_ = NULL;
+  if (notify && closeCallback_)
+  {
+    closeCallback_(guard, error);
+  }
+  // break cycles through bound stream pointers
+  messageCallback_ = MessageCallback();
+  writableCallback_ = WritableCallback();
+  closeCallback_ = CloseCallback();
+}
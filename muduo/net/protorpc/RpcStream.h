@@ -0,0 +1,144 @@
+// Copyright 2010, Shuo Chen.  All rights reserved.
+// http://code.google.com/p/muduo/
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_PROTORPC_RPCSTREAM_H
+#define MUDUO_NET_PROTORPC_RPCSTREAM_H
+
+#include <muduo/base/StringPiece.h>
+#include <muduo/net/protorpc/rpc.pb.h>
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace google {
+namespace protobuf {
+
+class Message;
+
+}  // namespace protobuf
+}  // namespace google
+
+namespace muduo
+{
+namespace net
+{
+
+class EventLoop;
+class RpcChannel;
+class RpcStream;
+typedef boost::shared_ptr<RpcStream> RpcStreamPtr;
+
+///
+/// A streaming call, many messages each way under one id.
+///
+/// The caller opens it with RpcChannel::openStream(), the callee gets it
+/// in its RpcStreamHandler, see RpcServer::registerStreamHandler().
+/// The callee's finish() or cancel() ends the call, the caller's finish()
+/// only ends its own messages.
+///
+/// Each side grants credits, how many messages it is ready to receive,
+/// a window at a time, and grants more as messages are delivered.  write()
+/// fails without credit, writable() is also false while the connection's
+/// output buffer is above the channel's high water mark.  So a slow
+/// consumer holds back the producer instead of filling its output buffer.
+/// Grants are held back above the high water mark too, a peer that doesn't
+/// read can't keep us busy.  A peer sending more than it was granted gets
+/// the stream canceled.
+///
+/// Must be used in the connection's loop.
+///
+class RpcStream : boost::noncopyable,
+                  public boost::enable_shared_from_this<RpcStream>
+{
+ public:
+  typedef boost::shared_ptr< ::google::protobuf::Message> MessagePtr;
+  /// message is NULL when the peer has finished sending.
+  typedef boost::function<void (const RpcStreamPtr&,
+                                const MessagePtr& message)> MessageCallback;
+  typedef boost::function<void (const RpcStreamPtr&)> WritableCallback;
+  /// error is NO_ERROR if the callee finished normally.
+  typedef boost::function<void (const RpcStreamPtr&,
+                                ErrorCode error)> CloseCallback;
+
+  ~RpcStream();
+
+  int64_t id() const { return id_; }
+  EventLoop* getLoop() const { return loop_; }
+
+  /// Sends one message, false if closed, finished or out of credit.
+  bool write(const ::google::protobuf::Message& message);
+  /// Has credit and the output buffer is below the high water mark.
+  /// If false, the writable callback is run when it becomes true.
+  bool writable();
+
+  /// No more messages from this side.
+  void finish();
+  /// Ends the call for both sides.
+  void cancel(ErrorCode error = CANCELED);
+
+  bool closed() const { return closed_; }
+
+  void setMessageCallback(const MessageCallback& cb)
+  { messageCallback_ = cb; }
+
+  void setWritableCallback(const WritableCallback& cb)
+  { writableCallback_ = cb; }
+
+  void setCloseCallback(const CloseCallback& cb)
+  { closeCallback_ = cb; }
+
+ private:
+  friend class RpcChannel;
+
+  RpcStream(RpcChannel* channel,
+            EventLoop* loop,
+            int64_t id,
+            bool caller,
+            const ::google::protobuf::Message* prototype,
+            int window);
+
+  // called by RpcChannel
+  void onPeerMessage(const RpcMessage& message, StringPiece payload);
+  void onWritable();
+  void close(ErrorCode error, bool notify);
+
+  bool canWrite() const;
+  bool holdsGrant() const
+  { return !closed_ && received_ * 2 >= window_; }
+  void grant();
+  void send(RpcMessage* message, const ::google::protobuf::Message* payload);
+
+  RpcChannel* channel_;  // NULL once closed
+  EventLoop* loop_;
+  const int64_t id_;
+  const bool caller_;
+  const ::google::protobuf::Message* prototype_;  // of incoming messages
+  const int window_;
+  int credit_;    // messages we may send
+  int received_;  // since last grant
+  int granted_;   // messages the peer may send
+  bool finished_;
+  bool closed_;
+  bool waiting_;  // for writable callback
+  MessageCallback messageCallback_;
+  WritableCallback writableCallback_;
+  CloseCallback closeCallback_;
+};
+
+/// Callee side, request is the first message.
+typedef boost::function<void (const RpcStreamPtr&,
+                              const RpcStream::MessagePtr& request)> RpcStreamHandler;
+
+}
+}
+
+#endif  // MUDUO_NET_PROTORPC_RPCSTREAM_H
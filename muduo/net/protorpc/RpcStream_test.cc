@@ -0,0 +1,411 @@
+#undef NDEBUG
+#include <muduo/net/protorpc/RpcChannel.h>
+#include <muduo/net/protorpc/RpcServer.h>
+#include <muduo/net/protorpc/rpcservice.pb.h>
+
+#include <muduo/base/Atomic.h>
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/Buffer.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/TcpClient.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Loopback tests of streaming calls: credit and the high water mark
+// each way, and a peer that sends more than it was granted.
+
+namespace
+{
+
+const uint16_t kPort = 23431;
+const int kWindow = 4;
+
+void runAndCountDown(const boost::function<void()>& func, CountDownLatch* latch)
+{
+  func();
+  latch->countDown();
+}
+
+void runInLoopAndWait(EventLoop* loop, const boost::function<void()>& func)
+{
+  CountDownLatch latch(1);
+  loop->runInLoop(boost::bind(runAndCountDown, func, &latch));
+  latch.wait();
+}
+
+bool waitFor(AtomicInt32& value, int expected)
+{
+  for (int i = 0; i < 10000 && value.get() != expected; ++i)
+  {
+    usleep(1000);
+  }
+  return value.get() == expected;
+}
+
+class TestService : public RpcService
+{
+};
+
+const google::protobuf::MethodDescriptor* listRpc()
+{
+  return RpcService::descriptor()->FindMethodByName("listRpc");
+}
+
+// Writes count messages, while writable, the rest from the writable
+// callback, then finishes.  The first field of each is its index,
+// responses carry payload bytes.
+class Producer
+{
+ public:
+  static void start(const RpcStreamPtr& stream, bool caller, int count, size_t payload)
+  {
+    boost::shared_ptr<Producer> producer(new Producer(caller, count, payload));
+    // the stream drops its callbacks once closed
+    stream->setWritableCallback(boost::bind(&Producer::produce, producer, _1));
+    producer->produce(stream);
+  }
+
+ private:
+  Producer(bool caller, int count, size_t payload)
+    : caller_(caller),
+      next_(0),
+      count_(count),
+      payload_(payload)
+  {
+  }
+
+  void produce(const RpcStreamPtr& stream)
+  {
+    while (next_ < count_ && stream->writable())
+    {
+      char index[32];
+      snprintf(index, sizeof index, "%d", next_);
+      bool ok = false;
+      if (caller_)
+      {
+        ListRpcRequest request;
+        request.set_service_name(index);
+        request.set_list_method(true);
+        ok = stream->write(request);
+      }
+      else
+      {
+        ListRpcResponse response;
+        response.set_error(NO_ERROR);
+        response.add_service_name(index);
+        response.add_method_name(std::string(payload_, ' '));
+        ok = stream->write(response);
+      }
+      assert(ok); (void) ok;
+      ++next_;
+    }
+    if (next_ == count_)
+    {
+      stream->finish();
+    }
+  }
+
+  const bool caller_;
+  int next_;
+  const int count_;
+  const size_t payload_;
+};
+
+// Callee of streams, by service_name of the request:
+// "down count payload" streams count responses back,
+// "up" counts requests, answers with the count when the caller finishes,
+// "sink" answers with a big response the peer doesn't read, then counts.
+class Server : boost::noncopyable
+{
+ public:
+  Server()
+    : closeError(NO_ERROR),
+      loop_(thread_.startLoop())
+  {
+    runInLoopAndWait(loop_, boost::bind(&Server::start, this));
+  }
+
+  ~Server()
+  {
+    runInLoopAndWait(loop_, boost::bind(&Server::stop, this));
+  }
+
+  AtomicInt32 received;
+  AtomicInt32 closed;
+  ErrorCode closeError;
+
+ private:
+  void start()
+  {
+    server_.reset(new RpcServer(loop_, InetAddress(kPort)));
+    server_->registerService(&service_);
+    server_->registerStreamHandler(listRpc()->full_name(),
+        boost::bind(&Server::onStream, this, _1, _2), kWindow);
+    server_->start();
+  }
+
+  void stop()
+  {
+    server_.reset();
+  }
+
+  void onStream(const RpcStreamPtr& stream, const RpcStream::MessagePtr& message)
+  {
+    const std::string& what = static_cast<ListRpcRequest&>(*message).service_name();
+    stream->setCloseCallback(boost::bind(&Server::onClose, this, _1, _2));
+    if (what.compare(0, 4, "down") == 0)
+    {
+      int count = 0;
+      int payload = 0;
+      sscanf(what.c_str(), "down %d %d", &count, &payload);
+      Producer::start(stream, false, count, payload);
+    }
+    else
+    {
+      stream->setMessageCallback(boost::bind(&Server::onMessage, this, _1, _2));
+      if (what == "sink")
+      {
+        ListRpcResponse response;
+        response.set_error(NO_ERROR);
+        response.add_method_name(std::string(8 * 1024 * 1024, ' '));
+        stream->write(response);
+      }
+    }
+  }
+
+  void onMessage(const RpcStreamPtr& stream, const RpcStream::MessagePtr& message)
+  {
+    if (message)
+    {
+      received.increment();
+    }
+    else
+    {
+      // caller has finished
+      char count[32];
+      snprintf(count, sizeof count, "%d", received.get());
+      ListRpcResponse response;
+      response.set_error(NO_ERROR);
+      response.add_service_name(count);
+      stream->write(response);
+      stream->finish();
+    }
+  }
+
+  void onClose(const RpcStreamPtr&, ErrorCode error)
+  {
+    closeError = error;
+    closed.increment();
+  }
+
+  EventLoopThread thread_;
+  EventLoop* loop_;
+  TestService service_;
+  boost::scoped_ptr<RpcServer> server_;
+};
+
+// Caller of streams on one connection, counts messages of the last one.
+class Client : boost::noncopyable
+{
+ public:
+  Client()
+    : closeError(NO_ERROR),
+      loop_(thread_.startLoop()),
+      connected_(1),
+      disconnected_(1)
+  {
+    runInLoopAndWait(loop_, boost::bind(&Client::connect, this));
+    connected_.wait();
+  }
+
+  ~Client()
+  {
+    loop_->runInLoop(boost::bind(&TcpClient::disconnect, get_pointer(client_)));
+    disconnected_.wait();
+    runInLoopAndWait(loop_, boost::bind(&Client::stop, this));
+  }
+
+  void setStreamHighWaterMark(size_t bytes)
+  {
+    runInLoopAndWait(loop_,
+        boost::bind(&RpcChannel::setStreamHighWaterMark, get_pointer(channel_), bytes));
+  }
+
+  // and writes count requests if count > 0
+  void open(const string& what, int count)
+  {
+    runInLoopAndWait(loop_, boost::bind(&Client::openInLoop, this, what, count));
+  }
+
+  AtomicInt32 received;
+  AtomicInt32 closed;
+  ErrorCode closeError;
+  std::string last;
+
+ private:
+  void connect()
+  {
+    client_.reset(new TcpClient(loop_, InetAddress("127.0.0.1", kPort), "StreamTest"));
+    client_->setConnectionCallback(boost::bind(&Client::onConnection, this, _1));
+    client_->connect();
+  }
+
+  void stop()
+  {
+    client_.reset();
+  }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      channel_.reset(new RpcChannel(conn));
+      conn->setMessageCallback(
+          boost::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
+      connected_.countDown();
+    }
+    else
+    {
+      channel_->failOutstandingCalls();
+      channel_.reset();
+      disconnected_.countDown();
+    }
+  }
+
+  void openInLoop(const string& what, int count)
+  {
+    ListRpcRequest request;
+    request.set_service_name(what.c_str());
+    RpcStreamPtr stream = channel_->openStream(listRpc(), request,
+        boost::bind(&Client::onMessage, this, _1, _2),
+        boost::bind(&Client::onClose, this, _1, _2),
+        kWindow);
+    if (count > 0)
+    {
+      Producer::start(stream, true, count, 0);
+    }
+  }
+
+  void onMessage(const RpcStreamPtr&, const RpcStream::MessagePtr& message)
+  {
+    assert(message);
+    const ListRpcResponse& response = static_cast<const ListRpcResponse&>(*message);
+    assert(response.service_name_size() == 1);
+    last = response.service_name(0);
+    received.increment();
+  }
+
+  void onClose(const RpcStreamPtr&, ErrorCode error)
+  {
+    closeError = error;
+    closed.increment();
+  }
+
+  EventLoopThread thread_;
+  EventLoop* loop_;
+  boost::scoped_ptr<TcpClient> client_;
+  RpcChannelPtr channel_;
+  CountDownLatch connected_;
+  CountDownLatch disconnected_;
+};
+
+// The callee keeps within the credit of the caller, or the caller
+// cancels, and is held back by its own high water mark.
+void testDown()
+{
+  Server server;
+  Client client;
+  client.open("down 1000 1000", 0);
+  assert(waitFor(client.closed, 1));
+  assert(client.closeError == NO_ERROR);
+  assert(client.received.get() == 1000);
+  assert(client.last == "999");
+  assert(server.closeError == NO_ERROR);
+}
+
+// Writes of the caller are held back by a high water mark of one byte,
+// so most of them resume from the write complete callback.
+void testUp()
+{
+  Server server;
+  Client client;
+  client.setStreamHighWaterMark(1);
+  client.open("up", 1000);
+  assert(waitFor(client.closed, 1));
+  assert(client.closeError == NO_ERROR);
+  assert(server.received.get() == 1000);
+  assert(client.received.get() == 1);
+  assert(client.last == "1000");
+}
+
+void appendFrame(Buffer* buf, const RpcMessage& message, const ListRpcRequest& request)
+{
+  Buffer frame;
+  fillRpcBuffer(&frame, message, &request);
+  buf->append(frame.peek(), frame.readableBytes());
+}
+
+// A peer that neither reads nor keeps to its credit.  Grants are held back
+// while the callee's output is above the high water mark, so after its
+// window the peer is over it and the stream is canceled.
+void testExceedWindow()
+{
+  Server server;
+  int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+  int rcvbuf = 4096;
+  ::setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+  InetAddress addr("127.0.0.1", kPort);
+  struct sockaddr_in sa = addr.getSockAddrInet();
+  int ret = ::connect(sock, reinterpret_cast<struct sockaddr*>(&sa), sizeof sa);
+  assert(ret == 0); (void) ret;
+
+  Buffer buf;
+  RpcMessage open;
+  open.set_type(REQUEST);
+  open.set_id(1);
+  open.set_service(RpcService::descriptor()->name());
+  open.set_method("listRpc");
+  open.set_stream(true);
+  open.set_credit(kWindow);
+  ListRpcRequest request;
+  request.set_service_name("sink");
+  appendFrame(&buf, open, request);
+  RpcMessage message;
+  message.set_type(REQUEST);
+  message.set_id(1);
+  message.set_stream(true);
+  for (int i = 0; i < 100; ++i)
+  {
+    appendFrame(&buf, message, request);
+  }
+  ssize_t n = ::write(sock, buf.peek(), buf.readableBytes());
+  assert(n == static_cast<ssize_t>(buf.readableBytes())); (void) n;
+
+  assert(waitFor(server.closed, 1));
+  assert(server.closeError == INVALID_REQUEST);
+  assert(server.received.get() == kWindow);
+  ::close(sock);
+}
+
+}
+
+int main()
+{
+  Logger::setLogLevel(Logger::FATAL);
+  testDown();
+  testUp();
+  testExceedWindow();
+  printf("All tests passed\n");
+}
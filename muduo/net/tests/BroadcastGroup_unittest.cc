@@ -0,0 +1,323 @@
+#include <muduo/net/BroadcastGroup.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/InetAddress.h>
+#include <muduo/net/TcpServer.h>
+#include <muduo/base/CountDownLatch.h>
+
+//#define BOOST_TEST_MODULE BroadcastGroupTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using muduo::string;
+using muduo::CountDownLatch;
+using muduo::net::BroadcastGroup;
+using muduo::net::EventLoop;
+using muduo::net::EventLoopThread;
+using muduo::net::InetAddress;
+using muduo::net::TcpConnectionPtr;
+using muduo::net::TcpServer;
+
+namespace
+{
+
+const int kMessages = 4000;
+const size_t kMessageSize = 8192;
+const size_t kHighWaterMark = 64*1024;
+const size_t kMaxPending = 256*1024;
+const int kKeys = 4;
+
+// A group in a loop thread, whose only member doesn't read until told.
+class Fixture
+{
+ public:
+  Fixture(BroadcastGroup::Policy policy, uint16_t port)
+    : loop_(thread_.startLoop()),
+      group_(policy, kHighWaterMark, kMaxPending),
+      member_(NULL),
+      connected_(1),
+      sent_(1),
+      pendingBytes_(0),
+      dropped_(0),
+      disconnected_(false),
+      shutdownTries_(0),
+      total_(0),
+      sock_(-1)
+  {
+    CountDownLatch started(1);
+    loop_->runInLoop(boost::bind(&Fixture::startServer, this, port, &started));
+    started.wait();
+    sock_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = 4096;
+    ::setsockopt(sock_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+    InetAddress addr("127.0.0.1", port);
+    struct sockaddr_in sa = addr.getSockAddrInet();
+    int ret = ::connect(sock_, reinterpret_cast<struct sockaddr*>(&sa), sizeof sa);
+    BOOST_REQUIRE_EQUAL(ret, 0);
+    connected_.wait();
+  }
+
+  ~Fixture()
+  {
+    ::close(sock_);
+    loop_->runInLoop(boost::bind(&Fixture::stopServer, this));
+    CountDownLatch stopped(1);
+    loop_->runInLoop(boost::bind(&CountDownLatch::countDown, &stopped));
+    stopped.wait();
+  }
+
+  // kMessages to the group, a batch in each loop iteration, so that
+  // callbacks of the member run in between.
+  void broadcast()
+  {
+    loop_->runInLoop(boost::bind(&Fixture::sendBatch, this, 0));
+    sent_.wait();
+  }
+
+  // Fills the socket, then crosses the high water mark from a pending
+  // functor, and reads all from the socket, so that the rest is written
+  // in the next iteration, before the high water mark callback runs.
+  // Then one more message, and closes after written.
+  void crossAndDrain()
+  {
+    CountDownLatch done(1);
+    loop_->runInLoop(boost::bind(&Fixture::sendAndDrain, this, &done));
+    done.wait();
+  }
+
+  // reads until EOF or error, returns the messages
+  std::vector<string> receive(bool whole)
+  {
+    std::vector<string> messages;
+    string data;
+    data.swap(drained_);
+    char buf[65536];
+    ssize_t n = 0;
+    while ((n = ::read(sock_, buf, sizeof buf)) > 0)
+    {
+      data.append(buf, static_cast<size_t>(n));
+    }
+    for (size_t i = 0; i + kMessageSize <= data.size(); i += kMessageSize)
+    {
+      messages.push_back(data.substr(i, 16));
+    }
+    if (whole)
+    {
+      BOOST_CHECK_EQUAL(data.size() % kMessageSize, 0);
+    }
+    return messages;
+  }
+
+  // in the loop
+  void closeAfterWritten()
+  {
+    loop_->runInLoop(boost::bind(&Fixture::shutdown, this));
+  }
+
+  // when broadcast() returns
+  size_t pendingBytes() const { return pendingBytes_; }
+  int64_t dropped() const { return dropped_; }
+  bool disconnected() const { return disconnected_; }
+  // by crossAndDrain(), when receive() returns
+  int total() const { return total_; }
+
+  static string message(int i)
+  {
+    char buf[32];
+    snprintf(buf, sizeof buf, "key%d %08d", i % kKeys, i);
+    string msg(buf);
+    msg.resize(kMessageSize, '.');
+    return msg;
+  }
+
+ private:
+  void startServer(uint16_t port, CountDownLatch* started)
+  {
+    server_.reset(new TcpServer(loop_, InetAddress(port), "BroadcastGroupTest"));
+    server_->setConnectionCallback(boost::bind(&Fixture::onConnection, this, _1));
+    server_->start();
+    started->countDown();
+  }
+
+  void stopServer()
+  {
+    server_.reset();
+  }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      member_ = group_.add(conn);
+      connected_.countDown();
+    }
+    else
+    {
+      group_.remove(conn);
+      member_ = NULL;
+    }
+  }
+
+  void sendOne(int i)
+  {
+    boost::shared_ptr<string> msg(new string(message(i)));
+    group_.send(msg);
+  }
+
+  void sendAndDrain(CountDownLatch* done)
+  {
+    int i = 0;
+    while (member_->connection()->outputBytes() == 0)
+    {
+      sendOne(i++);
+    }
+    for (int end = i + static_cast<int>(kHighWaterMark / kMessageSize); i < end; ++i)
+    {
+      sendOne(i);
+    }
+    BOOST_CHECK(member_->connection()->outputBytes() >= kHighWaterMark);
+
+    char buf[65536];
+    for (int tries = 0; tries < 10; ++tries)
+    {
+      ssize_t n = 0;
+      while ((n = ::recv(sock_, buf, sizeof buf, MSG_DONTWAIT)) > 0)
+      {
+        drained_.append(buf, static_cast<size_t>(n));
+      }
+      BOOST_CHECK(n < 0 && errno == EAGAIN);
+      ::usleep(1000);
+    }
+    // after the high water mark callback
+    loop_->queueInLoop(boost::bind(&Fixture::sendLast, this, i));
+    done->countDown();
+  }
+
+  void sendLast(int i)
+  {
+    total_ = i + 1;
+    sendOne(i);
+    shutdown();
+  }
+
+  void sendBatch(int start)
+  {
+    for (int i = start; i < start + 10 && i < kMessages; ++i)
+    {
+      boost::shared_ptr<string> msg(new string(message(i)));
+      group_.send(msg, msg->substr(0, 4));
+    }
+    if (start + 10 < kMessages)
+    {
+      loop_->queueInLoop(boost::bind(&Fixture::sendBatch, this, start + 10));
+    }
+    else
+    {
+      pendingBytes_ = member_ ? member_->pendingBytes() : 0;
+      dropped_ = member_ ? member_->dropped() : 0;
+      disconnected_ = member_ == NULL;
+      sent_.countDown();
+    }
+  }
+
+  void shutdown()
+  {
+    // gives up after a few seconds if messages are stuck
+    if (member_ && member_->pendingBytes() > 0 && ++shutdownTries_ < 300)
+    {
+      loop_->runAfter(0.01, boost::bind(&Fixture::shutdown, this));
+    }
+    else if (member_)
+    {
+      member_->connection()->shutdown();
+    }
+  }
+
+  EventLoopThread thread_;
+  EventLoop* loop_;
+  boost::scoped_ptr<TcpServer> server_;
+  BroadcastGroup group_;
+  BroadcastGroup::Member* member_;
+  CountDownLatch connected_;
+  CountDownLatch sent_;
+  size_t pendingBytes_;
+  int64_t dropped_;
+  bool disconnected_;
+  int shutdownTries_;
+  string drained_;  // read by sendAndDrain()
+  int total_;
+  int sock_;
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(testBroadcastGroupDropOldest)
+{
+  Fixture fixture(BroadcastGroup::kDropOldest, 23301);
+  fixture.broadcast();
+  BOOST_CHECK(fixture.pendingBytes() <= kMaxPending);
+  BOOST_CHECK(fixture.dropped() > 0);
+  fixture.closeAfterWritten();
+  std::vector<string> messages = fixture.receive(true);
+  BOOST_REQUIRE(!messages.empty());
+  BOOST_CHECK(static_cast<int>(messages.size()) < kMessages);
+  // the newest ones are kept
+  BOOST_CHECK_EQUAL(messages.back(), Fixture::message(kMessages-1).substr(0, 16));
+  for (size_t i = 1; i < messages.size(); ++i)
+  {
+    BOOST_CHECK(messages[i-1].substr(5) < messages[i].substr(5));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testBroadcastGroupConflate)
+{
+  Fixture fixture(BroadcastGroup::kConflate, 23302);
+  fixture.broadcast();
+  // at most one waiting message of each key
+  BOOST_CHECK(fixture.pendingBytes() <= kKeys * kMessageSize);
+  BOOST_CHECK(fixture.dropped() > 0);
+  fixture.closeAfterWritten();
+  std::vector<string> messages = fixture.receive(true);
+  BOOST_REQUIRE(static_cast<int>(messages.size()) >= kKeys);
+  // the latest of each key arrives last
+  std::vector<string> last(messages.end() - kKeys, messages.end());
+  std::sort(last.begin(), last.end());
+  for (int i = 0; i < kKeys; ++i)
+  {
+    BOOST_CHECK_EQUAL(last[i], Fixture::message(kMessages-kKeys+i).substr(0, 16));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testBroadcastGroupDisconnect)
+{
+  Fixture fixture(BroadcastGroup::kDisconnect, 23303);
+  fixture.broadcast();
+  BOOST_CHECK(fixture.disconnected());
+  std::vector<string> messages = fixture.receive(false);
+  BOOST_CHECK(static_cast<int>(messages.size()) < kMessages);
+}
+
+BOOST_AUTO_TEST_CASE(testBroadcastGroupDrainedBeforeHighWaterMark)
+{
+  // no write complete callback follows, the member must not wait for one
+  Fixture fixture(BroadcastGroup::kDropOldest, 23304);
+  fixture.crossAndDrain();
+  std::vector<string> messages = fixture.receive(true);
+  BOOST_REQUIRE_EQUAL(static_cast<int>(messages.size()), fixture.total());
+  for (size_t i = 0; i < messages.size(); ++i)
+  {
+    BOOST_CHECK_EQUAL(messages[i], Fixture::message(static_cast<int>(i)).substr(0, 16));
+  }
+}
@@ -0,0 +1,61 @@
+#include <muduo/net/ChainBuffer.h>
+
+//#define BOOST_TEST_MODULE ChainBufferTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <sys/uio.h>
+
+using muduo::string;
+using muduo::net::ChainBuffer;
+
+BOOST_AUTO_TEST_CASE(testChainBufferAppendRetrieve)
+{
+  boost::shared_ptr<string> value(new string(100, 'v'));
+  ChainBuffer buf;
+  buf.append("VALUE ");
+  buf.append("k\r\n");
+  buf.appendRef(value->data(), value->size(), value);
+  buf.append("\r\nEND\r\n");
+  BOOST_CHECK_EQUAL(buf.readableBytes(), 9 + value->size() + 7);
+  BOOST_CHECK_EQUAL(value.use_count(), 2);
+
+  struct iovec vec[4];
+  BOOST_CHECK_EQUAL(buf.peekv(vec, 4), 3);
+  BOOST_CHECK_EQUAL(vec[0].iov_len, 9);
+  BOOST_CHECK(vec[1].iov_base == value->data());
+  BOOST_CHECK_EQUAL(vec[2].iov_len, 7);
+  BOOST_CHECK_EQUAL(buf.peekv(vec, 2), 2);
+
+  buf.retrieve(5);
+  BOOST_CHECK_EQUAL(buf.peekv(vec, 4), 3);
+  BOOST_CHECK_EQUAL(vec[0].iov_len, 4);
+  buf.retrieve(4 + 50);
+  BOOST_CHECK_EQUAL(buf.peekv(vec, 4), 2);
+  BOOST_CHECK(vec[0].iov_base == value->data() + 50);
+
+  ChainBuffer copy(buf);
+  BOOST_CHECK_EQUAL(value.use_count(), 3);
+  buf.retrieve(50);
+  BOOST_CHECK_EQUAL(value.use_count(), 2);
+  BOOST_CHECK_EQUAL(buf.retrieveAllAsString(), "\r\nEND\r\n");
+  BOOST_CHECK_EQUAL(copy.retrieveAllAsString(), string(50, 'v') + "\r\nEND\r\n");
+  BOOST_CHECK_EQUAL(value.use_count(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(testChainBufferAppendChain)
+{
+  boost::shared_ptr<string> value(new string("referenced"));
+  ChainBuffer first;
+  first.append("copied ");
+  first.appendRef(value->data(), value->size(), value);
+
+  ChainBuffer buf;
+  buf.append("head ");
+  buf.append(first);
+  buf.append(" tail");
+  BOOST_CHECK_EQUAL(buf.retrieveAllAsString(), "head copied referenced tail");
+  BOOST_CHECK_EQUAL(first.retrieveAllAsString(), "copied referenced");
+  BOOST_CHECK_EQUAL(buf.readableBytes(), 0);
+}